@@ -4737,6 +4737,85 @@ void* mspace_malloc(mspace msp, size_t bytes) {
   return 0;
 }
 
+/*
+  Free chunk p of an mspace whose lock is held.  Shared by mspace_free
+  and mspace_bulk_free.
+*/
+static void mspace_dispose_chunk(mstate fm, mchunkptr p) {
+  check_inuse_chunk(fm, p);
+  if (RTCHECK(ok_address(fm, p) && ok_cinuse(p))) {
+    size_t psize = chunksize(p);
+    mchunkptr next = chunk_plus_offset(p, psize);
+    if (!pinuse(p)) {
+      size_t prevsize = p->prev_foot;
+      if ((prevsize & IS_MMAPPED_BIT) != 0) {
+        prevsize &= ~IS_MMAPPED_BIT;
+        psize += prevsize + MMAP_FOOT_PAD;
+        if (CALL_MUNMAP((char*)p - prevsize, psize) == 0)
+          fm->footprint -= psize;
+        return;
+      }
+      else {
+        mchunkptr prev = chunk_minus_offset(p, prevsize);
+        psize += prevsize;
+        p = prev;
+        if (RTCHECK(ok_address(fm, prev))) { /* consolidate backward */
+          if (p != fm->dv) {
+            unlink_chunk(fm, p, prevsize);
+          }
+          else if ((next->head & INUSE_BITS) == INUSE_BITS) {
+            fm->dvsize = psize;
+            set_free_with_pinuse(p, psize, next);
+            return;
+          }
+        }
+        else
+          goto erroraction;
+      }
+    }
+
+    if (RTCHECK(ok_next(p, next) && ok_pinuse(next))) {
+      if (!cinuse(next)) {  /* consolidate forward */
+        if (next == fm->top) {
+          size_t tsize = fm->topsize += psize;
+          fm->top = p;
+          p->head = tsize | PINUSE_BIT;
+          if (p == fm->dv) {
+            fm->dv = 0;
+            fm->dvsize = 0;
+          }
+          if (should_trim(fm, tsize))
+            sys_trim(fm, 0);
+          return;
+        }
+        else if (next == fm->dv) {
+          size_t dsize = fm->dvsize += psize;
+          fm->dv = p;
+          set_size_and_pinuse_of_free_chunk(p, dsize);
+          return;
+        }
+        else {
+          size_t nsize = chunksize(next);
+          psize += nsize;
+          unlink_chunk(fm, next, nsize);
+          set_size_and_pinuse_of_free_chunk(p, psize);
+          if (p == fm->dv) {
+            fm->dvsize = psize;
+            return;
+          }
+        }
+      }
+      else
+        set_free_with_pinuse(p, psize, next);
+      insert_chunk(fm, p, psize);
+      check_free_chunk(fm, p);
+      return;
+    }
+  }
+ erroraction:
+  USAGE_ERROR_ACTION(fm, p);
+}
+
 void mspace_free(mspace msp, void* mem) {
   if (mem != 0) {
     mchunkptr p  = mem2chunk(mem);
@@ -4750,81 +4829,46 @@ void mspace_free(mspace msp, void* mem) {
       return;
     }
     if (!PREACTION(fm)) {
-      check_inuse_chunk(fm, p);
-      if (RTCHECK(ok_address(fm, p) && ok_cinuse(p))) {
-        size_t psize = chunksize(p);
-        mchunkptr next = chunk_plus_offset(p, psize);
-        if (!pinuse(p)) {
-          size_t prevsize = p->prev_foot;
-          if ((prevsize & IS_MMAPPED_BIT) != 0) {
-            prevsize &= ~IS_MMAPPED_BIT;
-            psize += prevsize + MMAP_FOOT_PAD;
-            if (CALL_MUNMAP((char*)p - prevsize, psize) == 0)
-              fm->footprint -= psize;
-            goto postaction;
-          }
-          else {
-            mchunkptr prev = chunk_minus_offset(p, prevsize);
-            psize += prevsize;
-            p = prev;
-            if (RTCHECK(ok_address(fm, prev))) { /* consolidate backward */
-              if (p != fm->dv) {
-                unlink_chunk(fm, p, prevsize);
-              }
-              else if ((next->head & INUSE_BITS) == INUSE_BITS) {
-                fm->dvsize = psize;
-                set_free_with_pinuse(p, psize, next);
-                goto postaction;
-              }
-            }
-            else
-              goto erroraction;
-          }
-        }
+      mspace_dispose_chunk(fm, p);
+      POSTACTION(fm);
+    }
+  }
+}
 
-        if (RTCHECK(ok_next(p, next) && ok_pinuse(next))) {
-          if (!cinuse(next)) {  /* consolidate forward */
-            if (next == fm->top) {
-              size_t tsize = fm->topsize += psize;
-              fm->top = p;
-              p->head = tsize | PINUSE_BIT;
-              if (p == fm->dv) {
-                fm->dv = 0;
-                fm->dvsize = 0;
-              }
-              if (should_trim(fm, tsize))
-                sys_trim(fm, 0);
-              goto postaction;
-            }
-            else if (next == fm->dv) {
-              size_t dsize = fm->dvsize += psize;
-              fm->dv = p;
-              set_size_and_pinuse_of_free_chunk(p, dsize);
-              goto postaction;
-            }
-            else {
-              size_t nsize = chunksize(next);
-              psize += nsize;
-              unlink_chunk(fm, next, nsize);
-              set_size_and_pinuse_of_free_chunk(p, psize);
-              if (p == fm->dv) {
-                fm->dvsize = psize;
-                goto postaction;
-              }
-            }
-          }
-          else
-            set_free_with_pinuse(p, psize, next);
-          insert_chunk(fm, p, psize);
-          check_free_chunk(fm, p);
-          goto postaction;
+/*
+  Free the nelem chunks in array (null entries are skipped) under a
+  single acquisition of the mspace lock.  When the next entry is the
+  chunk that immediately follows, the two are merged first and freed
+  as one, so runs of neighbours, e.g. from an address-ordered sweep,
+  cost a single free.  The array is overwritten.
+*/
+void mspace_bulk_free(mspace msp, void** array, size_t nelem) {
+  mstate fm = (mstate)msp;
+  if (!ok_magic(fm)) {
+    USAGE_ERROR_ACTION(fm, fm);
+    return;
+  }
+  if (!PREACTION(fm)) {
+    void** a;
+    void** fence = array + nelem;
+    for (a = array; a != fence; ++a) {
+      void* mem = *a;
+      if (mem != 0) {
+        mchunkptr p = mem2chunk(mem);
+        void** b = a + 1;
+        *a = 0;
+        if (b != fence && RTCHECK(ok_address(fm, p) && ok_cinuse(p)) &&
+            *b == chunk2mem(next_chunk(p))) {
+          mchunkptr next = next_chunk(p);
+          set_inuse(fm, p, chunksize(p) + chunksize(next));
+          *b = chunk2mem(p);
+        }
+        else {
+          mspace_dispose_chunk(fm, p);
         }
       }
-    erroraction:
-      USAGE_ERROR_ACTION(fm, p);
-    postaction:
-      POSTACTION(fm);
     }
+    POSTACTION(fm);
   }
 }
 
@@ -535,6 +535,14 @@ void* mspace_malloc(mspace msp, size_t bytes);
 */
 void mspace_free(mspace msp, void* mem);
 
+/*
+  mspace_bulk_free frees the nelem chunks in array, which must all
+  belong to msp, taking the mspace lock once.  Null entries are
+  skipped, adjacent chunks are coalesced before being freed, and
+  the array is overwritten.
+*/
+void mspace_bulk_free(mspace msp, void** array, size_t nelem);
+
 /*
   mspace_realloc behaves as realloc, but operates within
   the given space.
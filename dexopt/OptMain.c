@@ -124,6 +124,7 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
     DexClassVerifyMode verifyMode = VERIFY_MODE_ALL;
     DexOptimizerMode dexOptMode = OPTIMIZE_MODE_VERIFIED;
     int dexoptFlags = 0; /* bit flags, from enum DexoptFlags */
+    int numThreads = 0;
     if (dexoptFlagStr[0] != '\0') {
         const char *opc;
         const char *val;
@@ -158,9 +159,16 @@ static int extractAndProcessZip(int zipFd, int cacheFd,
         if (opc != NULL) {
             dexoptFlags |= DEXOPT_GEN_REGISTER_MAPS;
         }
+
+        opc = strstr(dexoptFlagStr, "t="); /* worker threads */
+        if (opc != NULL) {
+            numThreads = strtol(opc + 2, NULL, 10);
+            if (numThreads < 0)
+                numThreads = 0;
+        }
     }
     if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode,
-                         dexoptFlags) != 0) {
+                         dexoptFlags, numThreads) != 0) {
         LOGE("DexOptZ: VM init failed\n");
         goto bail;
     }
@@ -296,7 +304,7 @@ bail:
  *   6. filename of file being optimized (for debug messages only)
  *   7. modification date of source (goes into dependency section)
  *   8. CRC of source (goes into dependency section)
- *   9. flags (optimization level, isBootstrap)
+ *   9. flags (optimization level, isBootstrap, worker threads)
  *  10. bootclasspath entry #1
  *  11. bootclasspath entry #2
  *   ...
@@ -412,8 +420,8 @@ static int fromDex(int argc, char *const argv[]) {
         dexoptFlags |= DEXOPT_GEN_REGISTER_MAPS;
     }
 
-    if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode,
-                         dexoptFlags) != 0) {
+    if (dvmPrepForDexOpt(bootClassPath, dexOptMode, verifyMode, dexoptFlags,
+                         (flags >> DEXOPT_THREADS_SHIFT) & DEXOPT_THREADS_MAX) != 0) {
         LOGE("VM init failed\n");
         goto bail;
     }
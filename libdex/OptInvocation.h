@@ -42,6 +42,10 @@ int dexOptCreateEmptyHeader(int fd);
 #define DEXOPT_IS_BOOTSTRAP     (1 << 4)
 #define DEXOPT_GEN_REGISTER_MAP (1 << 5)
 
+/* worker thread count (0 = one per CPU) rides in the bits above these */
+#define DEXOPT_THREADS_SHIFT    8
+#define DEXOPT_THREADS_MAX      0xff
+
 
 #ifdef __cplusplus
 };
@@ -37,9 +37,16 @@
  *
  * TODO: consider making the parameters configurable, so DDMS can decide
  * how many allocations it wants to see and what the stack depth should be.
+ *
+ * The allocation sampler at the bottom of this file is the cheap version,
+ * meant to be left on: each thread records one allocation in every N
+ * bytes, and the samples are added up by site.
  */
 #include "Dalvik.h"
 #include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #define kMaxAllocRecordStackDepth   8       /* max 255 */
 #define kNumAllocRecords            512     /* MUST be power of 2 */
@@ -75,6 +82,8 @@ bool dvmAllocTrackerStartup(void)
 {
     /* prep locks */
     dvmInitMutex(&gDvm.allocTrackerLock);
+    dvmInitMutex(&gDvm.allocSampler.lock);
+    pthread_cond_init(&gDvm.allocSampler.cond, NULL);
 
     /* initialized when enabled by DDMS */
     assert(gDvm.allocRecords == NULL);
@@ -89,6 +98,8 @@ void dvmAllocTrackerShutdown(void)
 {
     free(gDvm.allocRecords);
     dvmDestroyMutex(&gDvm.allocTrackerLock);
+    pthread_cond_destroy(&gDvm.allocSampler.cond);
+    dvmDestroyMutex(&gDvm.allocSampler.lock);
 }
 
 
@@ -649,3 +660,333 @@ bail:
     }
 }
 
+
+
+/*
+ * ===========================================================================
+ *      Sampling
+ * ===========================================================================
+ */
+
+#define kMaxAllocSampleStackDepth   16
+
+/*
+ * One allocation site: a class and the stack it was allocated from.
+ * Entries in the table are allocated with just "depth" methods.
+ */
+typedef struct AllocSiteSample {
+    int             count;          /* samples taken here */
+    s8              bytes;          /* bytes those samples stand for */
+    ClassObject*    clazz;
+    int             depth;
+    const Method*   methods[kMaxAllocSampleStackDepth];    /* innermost first */
+} AllocSiteSample;
+
+static u4 hashAllocSite(const AllocSiteSample* site)
+{
+    return dvmHashSampleStack((u4) ((uintptr_t) site->clazz >> 3),
+        site->methods, site->depth);
+}
+
+static int compareAllocSites(const void* vsite1, const void* vsite2)
+{
+    const AllocSiteSample* site1 = (const AllocSiteSample*) vsite1;
+    const AllocSiteSample* site2 = (const AllocSiteSample*) vsite2;
+
+    if (site1->clazz != site2->clazz)
+        return (site1->clazz < site2->clazz) ? -1 : 1;
+    return dvmCompareSampleStacks(site1->methods, site1->depth,
+        site2->methods, site2->depth);
+}
+
+/*
+ * This thread has used up its sampling interval; charge the allocation
+ * that did it to the current stack.
+ *
+ * A large allocation can span several intervals.  It's still one sample,
+ * but it stands for all of them, so the byte totals stay unbiased.
+ */
+void dvmDoSampleAllocation(Thread* self, ClassObject* clazz, int size)
+{
+    AllocSamplerState* state = &gDvm.allocSampler;
+    AllocSiteSample sample;
+    AllocSiteSample* found;
+    int numIntervals;
+    u4 hash;
+
+    dvmLockMutex(&state->lock);
+    if (!state->enabled)
+        goto bail;
+
+    /* first time through since the sampler started; just set the count */
+    if (self->allocSampleGeneration != state->generation) {
+        self->allocSampleGeneration = state->generation;
+        self->allocSampleBytesLeft = state->intervalBytes;
+        goto bail;
+    }
+
+    numIntervals = 1 + (-self->allocSampleBytesLeft) / state->intervalBytes;
+    self->allocSampleBytesLeft += numIntervals * state->intervalBytes;
+
+    sample.count = 1;
+    sample.bytes = (s8) numIntervals * state->intervalBytes;
+    sample.clazz = clazz;
+    sample.depth = dvmFillSampleStack(self->curFrame, sample.methods,
+        kMaxAllocSampleStackDepth);
+    hash = hashAllocSite(&sample);
+
+    found = (AllocSiteSample*) dvmHashTableLookup(state->sites, hash,
+                &sample, compareAllocSites, false);
+    if (found != NULL) {
+        found->count++;
+        found->bytes += sample.bytes;
+    } else {
+        size_t allocSize = offsetof(AllocSiteSample, methods) +
+            sample.depth * sizeof(sample.methods[0]);
+
+        found = (AllocSiteSample*) malloc(allocSize);
+        if (found == NULL)
+            goto bail;
+        memcpy(found, &sample, allocSize);
+        dvmHashTableLookup(state->sites, hash, found, compareAllocSites,
+            true);
+    }
+    state->numSamples++;
+
+bail:
+    dvmUnlockMutex(&state->lock);
+}
+
+/*
+ * A site and its byte total, copied out of the table under the lock so
+ * the file can be written without holding it.  The site itself is never
+ * changed or freed while the sampler runs, apart from its totals.
+ */
+typedef struct AllocSiteTotal {
+    const AllocSiteSample* site;
+    s8              bytes;
+} AllocSiteTotal;
+
+typedef struct AllocSiteSnapshot {
+    AllocSiteTotal* totals;
+    int             count;
+} AllocSiteSnapshot;
+
+static int copyAllocSite(void* vsite, void* varg)
+{
+    const AllocSiteSample* site = (const AllocSiteSample*) vsite;
+    AllocSiteSnapshot* snapshot = (AllocSiteSnapshot*) varg;
+
+    snapshot->totals[snapshot->count].site = site;
+    snapshot->totals[snapshot->count].bytes = site->bytes;
+    snapshot->count++;
+    return 0;
+}
+
+/*
+ * Copy the totals out of "sites".  Call with the sampler lock held, or
+ * with a table nobody else can see.  Returns false if malloc fails.
+ */
+static bool snapshotAllocSites(HashTable* sites, AllocSiteSnapshot* snapshot)
+{
+    int numEntries = dvmHashTableNumEntries(sites);
+
+    snapshot->count = 0;
+    snapshot->totals = (AllocSiteTotal*)
+        malloc((numEntries > 0 ? numEntries : 1) * sizeof(AllocSiteTotal));
+    if (snapshot->totals == NULL)
+        return false;
+    dvmHashForeach(sites, copyAllocSite, snapshot);
+    return true;
+}
+
+/*
+ * Write one site, outermost method first, with the class as the leaf.
+ */
+static void writeAllocSite(const AllocSiteTotal* total, FILE* fp)
+{
+    const AllocSiteSample* site = total->site;
+    char* className;
+    int i;
+
+    for (i = site->depth - 1; i >= 0; i--) {
+        const Method* method = site->methods[i];
+
+        className = dvmDescriptorToDot(method->clazz->descriptor);
+        fprintf(fp, "%s.%s;", className, method->name);
+        free(className);
+    }
+    className = dvmDescriptorToDot(site->clazz->descriptor);
+    fprintf(fp, "%s %lld\n", className, (long long) total->bytes);
+    free(className);
+}
+
+/*
+ * Write every site in a snapshot.  (This is a dvmWriteSampleFile
+ * callback.)
+ */
+static void writeAllocSites(FILE* fp, void* vsnapshot)
+{
+    const AllocSiteSnapshot* snapshot = (const AllocSiteSnapshot*) vsnapshot;
+    int i;
+
+    for (i = 0; i < snapshot->count; i++)
+        writeAllocSite(&snapshot->totals[i], fp);
+}
+
+/*
+ * The dump thread.  Every period, copy out what we have so far and
+ * write it with the lock dropped, so sampling threads don't wait on the
+ * file system.  Stop wakes us early, and writes the final totals itself.
+ *
+ * state->fileName and the sites stay put until Stop has joined us.
+ */
+static void* allocSamplerThreadStart(void* arg)
+{
+    AllocSamplerState* state = &gDvm.allocSampler;
+    Thread* self = dvmThreadSelf();
+    int generation = (int) (intptr_t) arg;
+    AllocSiteSnapshot snapshot;
+    const char* fileName;
+
+    dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&state->lock);
+    while (true) {
+        struct timeval now;
+        struct timespec timeout;
+
+        gettimeofday(&now, NULL);
+        timeout.tv_sec = now.tv_sec + state->periodSec;
+        timeout.tv_nsec = now.tv_usec * 1000;
+        while (state->generation == generation) {
+            if (pthread_cond_timedwait(&state->cond, &state->lock,
+                    &timeout) == ETIMEDOUT)
+                break;
+        }
+        if (state->generation != generation)
+            break;
+
+        if (!snapshotAllocSites(state->sites, &snapshot))
+            continue;
+        fileName = state->fileName;
+        dvmUnlockMutex(&state->lock);
+
+        dvmWriteSampleFile(fileName, writeAllocSites, &snapshot);
+        free(snapshot.totals);
+
+        dvmLockMutex(&state->lock);
+    }
+    dvmUnlockMutex(&state->lock);
+    dvmChangeStatus(self, THREAD_RUNNING);
+
+    return NULL;
+}
+
+/*
+ * Start the allocation sampler.
+ */
+bool dvmAllocSamplerStart(const char* fileName, int intervalBytes,
+    int periodSec)
+{
+    AllocSamplerState* state = &gDvm.allocSampler;
+    pthread_t dumpHandle;
+    int generation;
+
+    assert(intervalBytes > 0);
+    assert(periodSec > 0);
+
+    dvmLockMutex(&state->lock);
+    if (state->enabled) {
+        LOGI("Allocation sampler already running\n");
+        dvmUnlockMutex(&state->lock);
+        return false;
+    }
+    state->sites = dvmHashTableCreate(1024, free);
+    state->fileName = strdup(fileName);
+    if (state->sites == NULL || state->fileName == NULL) {
+        dvmHashTableFree(state->sites);
+        state->sites = NULL;
+        free(state->fileName);
+        state->fileName = NULL;
+        dvmUnlockMutex(&state->lock);
+        return false;
+    }
+    state->intervalBytes = intervalBytes;
+    state->periodSec = periodSec;
+    state->numSamples = 0;
+    generation = ++state->generation;
+    state->enabled = true;
+    dvmUnlockMutex(&state->lock);
+
+    /* the thread finds its own way out when the generation changes */
+    if (!dvmCreateInternalThread(&dumpHandle, "Allocation sampler",
+            allocSamplerThreadStart, (void*) (intptr_t) generation))
+    {
+        LOGE("Unable to start allocation sampler thread\n");
+        dvmAllocSamplerStop();
+        return false;
+    }
+    dvmLockMutex(&state->lock);
+    if (state->generation == generation) {
+        state->dumpThread = dumpHandle;
+        state->haveDumpThread = true;
+    }
+    dvmUnlockMutex(&state->lock);
+
+    LOGI("Allocation sampler started: every %d bytes, to '%s' every %ds\n",
+        intervalBytes, fileName, periodSec);
+    return true;
+}
+
+/*
+ * Stop the allocation sampler and write the final totals.
+ *
+ * We wait for the dump thread to exit, so this is safe to call while
+ * shutting down.
+ */
+void dvmAllocSamplerStop(void)
+{
+    AllocSamplerState* state = &gDvm.allocSampler;
+    Thread* self = dvmThreadSelf();
+    HashTable* sites;
+    AllocSiteSnapshot snapshot;
+    char* fileName;
+    pthread_t dumpHandle;
+    bool haveDumpThread;
+    int numSamples;
+
+    dvmLockMutex(&state->lock);
+    if (!state->enabled) {
+        dvmUnlockMutex(&state->lock);
+        return;
+    }
+    state->enabled = false;
+    state->generation++;
+    pthread_cond_broadcast(&state->cond);
+    sites = state->sites;
+    state->sites = NULL;
+    fileName = state->fileName;
+    state->fileName = NULL;
+    numSamples = state->numSamples;
+    dumpHandle = state->dumpThread;
+    haveDumpThread = state->haveDumpThread;
+    state->haveDumpThread = false;
+    dvmUnlockMutex(&state->lock);
+
+    if (haveDumpThread) {
+        int oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        pthread_join(dumpHandle, NULL);
+        dvmChangeStatus(self, oldStatus);
+    }
+
+    /* the table is ours alone now */
+    if (snapshotAllocSites(sites, &snapshot)) {
+        dvmWriteSampleFile(fileName, writeAllocSites, &snapshot);
+        free(snapshot.totals);
+    }
+    LOGI("Allocation sampler stopped: %d samples, %d sites in '%s'\n",
+        numSamples, dvmHashTableNumEntries(sites), fileName);
+
+    dvmHashTableFree(sites);
+    free(fileName);
+}
@@ -26,6 +26,25 @@ void dvmAllocTrackerShutdown(void);
 struct AllocRecord;
 typedef struct AllocRecord AllocRecord;
 
+/*
+ * Sampling allocation profiler state.  Each thread counts down the bytes
+ * it allocates in Thread.allocSampleBytesLeft; when that runs out, it
+ * records its stack and the class it was allocating in "sites".
+ */
+typedef struct AllocSamplerState {
+    volatile bool   enabled;        /* read without the lock */
+    pthread_mutex_t lock;           /* guards everything below */
+    pthread_cond_t  cond;           /* wakes the dump thread early */
+    int             generation;     /* bumped on start and stop */
+    int             intervalBytes;
+    int             periodSec;
+    char*           fileName;
+    HashTable*      sites;          /* AllocSiteSample* entries */
+    int             numSamples;
+    bool            haveDumpThread;
+    pthread_t       dumpThread;
+} AllocSamplerState;
+
 /*
  * Enable allocation tracking.  Does nothing if tracking is already enabled.
  */
@@ -37,14 +56,42 @@ bool dvmEnableAllocTracker(void);
 void dvmDisableAllocTracker(void);
 
 /*
- * If allocation tracking is enabled, add a new entry to the set.
+ * If allocation tracking is enabled, add a new entry to the set.  If the
+ * allocation sampler is running, count the bytes against this thread,
+ * and take a sample when its interval runs out.
  */
 #define dvmTrackAllocation(_clazz, _size)                                   \
     {                                                                       \
         if (gDvm.allocRecords != NULL)                                      \
             dvmDoTrackAllocation(_clazz, _size);                            \
+        if (gDvm.allocSampler.enabled) {                                    \
+            Thread* _self = dvmThreadSelf();                                \
+            if (_self != NULL &&                                            \
+                (_self->allocSampleBytesLeft -= (_size)) <= 0)              \
+                dvmDoSampleAllocation(_self, _clazz, _size);                \
+        }                                                                   \
     }
 void dvmDoTrackAllocation(ClassObject* clazz, int size);
+void dvmDoSampleAllocation(Thread* self, ClassObject* clazz, int size);
+
+/*
+ * Start the allocation sampler: take a sample for every "intervalBytes"
+ * bytes each thread allocates, and every "periodSec" seconds write the
+ * totals so far to "fileName".  Returns false if it's already running or
+ * can't be started.
+ *
+ * The file has one line per distinct allocation site, in the "collapsed"
+ * format flame graph tools take: "outer;...;inner;class bytes", where
+ * "bytes" is the estimated number of bytes allocated there.
+ */
+bool dvmAllocSamplerStart(const char* fileName, int intervalBytes,
+    int periodSec);
+
+/*
+ * Stop the allocation sampler, writing the final totals.  Does nothing
+ * if it isn't running.
+ */
+void dvmAllocSamplerStop(void);
 
 /*
  * Generate a DDM packet with all of the tracked allocation data.
@@ -108,6 +108,7 @@ LOCAL_SRC_FILES := \
 	Properties.c \
 	RawDexFile.c \
 	ReferenceTable.c \
+	SampleStack.c \
 	SignalCatcher.c \
 	StdioConverter.c \
 	Sync.c \
@@ -177,7 +178,10 @@ LOCAL_SRC_FILES := \
 	reflect/Annotation.c \
 	reflect/Proxy.c \
 	reflect/Reflect.c \
-	test/TestHash.c
+	test/TestHash.c \
+	test/TestHeapBitmap.c \
+	test/TestZygoteHeap.c \
+	test/TestLockFattening.c
 
 WITH_HPROF := $(strip $(WITH_HPROF))
 ifeq ($(WITH_HPROF),)
@@ -45,4 +45,34 @@
 #define ATOMIC_CMP_SWAP(_addr, _old, _new) \
             (android_atomic_cmpxchg((_old), (_new), (_addr)) == 0)
 
+/*
+ * Atomic OR into a pointer-sized word, returning the previous value.
+ * The android_atomic_* calls only handle 32-bit values, so this uses the
+ * compiler builtin (a full barrier on gcc and clang).
+ */
+#define ATOMIC_OR_WORD(_addr, _bits) \
+            __sync_fetch_and_or((_addr), (_bits))
+
+/*
+ * Pointer-sized compare-and-swap; returns nonzero on success.
+ */
+#define ATOMIC_CMP_SWAP_WORD(_addr, _old, _new) \
+            __sync_bool_compare_and_swap((_addr), (_old), (_new))
+
+/*
+ * Ordered loads and stores of pointer-sized words.  Unlike MEM_BARRIER(),
+ * these also constrain the CPU, which the lock-free structures that are
+ * shared between SMP threads need on weakly-ordered hardware.
+ */
+#define ATOMIC_LOAD_ACQUIRE(_addr) \
+            __atomic_load_n((_addr), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE_RELEASE(_addr, _val) \
+            __atomic_store_n((_addr), (_val), __ATOMIC_RELEASE)
+
+/*
+ * Full hardware fence: no load or store moves across it in either
+ * direction.
+ */
+#define MEM_FENCE()     __sync_synchronize()
+
 #endif /*_DALVIK_ATOMIC*/
@@ -35,6 +35,7 @@
 #include "RawDexFile.h"
 #include "RamOdexFile.h"
 #include "Sync.h"
+#include "alloc/CardTable.h"
 #include "oo/Object.h"
 #include "Native.h"
 #include "native/InternalNative.h"
@@ -46,6 +47,7 @@
 #include "Intern.h"
 #include "ReferenceTable.h"
 #include "AtomicCache.h"
+#include "alloc/Tlab.h"
 #include "Thread.h"
 #include "Ddm.h"
 #include "Hash.h"
@@ -64,6 +66,7 @@
 #include "jdwp/Jdwp.h"
 #include "SignalCatcher.h"
 #include "StdioConverter.h"
+#include "Preload.h"
 #include "JniInternal.h"
 #include "LinearAlloc.h"
 #include "analysis/DexVerify.h"
@@ -72,12 +75,15 @@
 #include "libdex/OpCode.h"
 #include "libdex/InstrUtils.h"
 #include "AllocTracker.h"
+#include "SampleStack.h"
 #include "PointerSet.h"
 #include "Globals.h"
 #include "reflect/Reflect.h"
 #include "oo/TypeCheck.h"
 #include "Atomic.h"
 #include "interp/Interp.h"
+#include "interp/InlineCache.h"
+#include "compiler/Compiler.h"
 #include "InlineNative.h"
 
 #endif /*_DALVIK_DALVIK*/
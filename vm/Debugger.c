@@ -548,7 +548,7 @@ bool dvmDbgIsInterface(RefTypeId id)
 }
 
 /*
- * dvmHashForeach callback
+ * dvmForeachLoadedClass callbacks
  */
 static int copyRefType(void* vclazz, void* varg)
 {
@@ -558,6 +558,14 @@ static int copyRefType(void* vclazz, void* varg)
     return 0;
 }
 
+static int countRefType(void* vclazz, void* varg)
+{
+    UNUSED_PARAMETER(vclazz);
+
+    (*(int*)varg)++;
+    return 0;
+}
+
 /*
  * Get the complete list of reference classes (i.e. all classes except
  * the primitive types).
@@ -568,24 +576,25 @@ void dvmDbgGetClassList(u4* pNumClasses, RefTypeId** pClassRefBuf)
 {
     RefTypeId* pRefType;
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    *pNumClasses = dvmHashTableNumEntries(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    *pNumClasses = dvmGetNumLoadedClasses();
     pRefType = *pClassRefBuf = malloc(sizeof(RefTypeId) * *pNumClasses);
 
-    if (dvmHashForeach(gDvm.loadedClasses, copyRefType, &pRefType) != 0) {
+    if (dvmForeachLoadedClass(copyRefType, &pRefType) != 0) {
         LOGW("Warning: problem getting class list\n");
         /* not really expecting this to happen */
     } else {
         assert(pRefType - *pClassRefBuf == (int) *pNumClasses);
     }
 
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmUnlockLoadedClasses();
 }
 
 /*
  * Get the list of reference classes "visible" to the specified class
  * loader.  A class is visible to a class loader if the ClassLoader object
- * is the defining loader or is listed as an initiating loader.
+ * is the defining loader or is listed as an initiating loader, which is
+ * exactly what's in the loader's class table.
  *
  * Returns a newly-allocated buffer full of RefTypeId values.
  */
@@ -593,38 +602,24 @@ void dvmDbgGetVisibleClassList(ObjectId classLoaderId, u4* pNumClasses,
     RefTypeId** pClassRefBuf)
 {
     Object* classLoader;
-    int numClasses = 0, maxClasses;
+    RefTypeId* pRefType;
+    int numClasses = 0;
 
     classLoader = objectIdToObject(classLoaderId);
     // I don't think classLoader can be NULL, but the spec doesn't say
 
     LOGVV("GetVisibleList: comparing to %p\n", classLoader);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-
-    /* over-allocate the return buffer */
-    maxClasses = dvmHashTableNumEntries(gDvm.loadedClasses);
-    *pClassRefBuf = malloc(sizeof(RefTypeId) * maxClasses);
+    dvmLockLoadedClasses();
 
-    /*
-     * Run through the list, looking for matches.
-     */
-    HashIter iter;
-    for (dvmHashIterBegin(gDvm.loadedClasses, &iter); !dvmHashIterDone(&iter);
-        dvmHashIterNext(&iter))
-    {
-        ClassObject* clazz = (ClassObject*) dvmHashIterData(&iter);
-
-        if (clazz->classLoader == classLoader ||
-            dvmLoaderInInitiatingList(clazz, classLoader))
-        {
-            LOGVV("  match '%s'\n", clazz->descriptor);
-            (*pClassRefBuf)[numClasses++] = classObjectToRefTypeId(clazz);
-        }
-    }
+    /* count, then fill in */
+    dvmForeachClassVisibleTo(classLoader, countRefType, &numClasses);
+    pRefType = *pClassRefBuf = malloc(sizeof(RefTypeId) * numClasses);
+    dvmForeachClassVisibleTo(classLoader, copyRefType, &pRefType);
+    assert(pRefType - *pClassRefBuf == numClasses);
     *pNumClasses = numClasses;
 
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmUnlockLoadedClasses();
 }
 
 /*
@@ -207,7 +207,7 @@ void dvmThrowChainedException(const char* exceptionDescriptor, const char* msg,
         (cause != NULL) ? cause->clazz->descriptor : "(none)");
 
     if (gDvm.initializing) {
-        if (++gDvm.initExceptionCount >= 2) {
+        if (++dvmThreadSelf()->initExceptionCount >= 2) {
             LOGE("Too many exceptions during init (failed on '%s' '%s')\n",
                 exceptionDescriptor, msg);
             dvmAbort();
@@ -554,7 +554,7 @@ bail:
 void dvmClearOptException(Thread* self)
 {
     self->exception = NULL;
-    gDvm.initExceptionCount = 0;
+    self->initExceptionCount = 0;
 }
 
 /*
@@ -54,6 +54,9 @@ typedef enum ExecutionMode {
     kExecutionModeUnknown = 0,
     kExecutionModeInterpPortable,
     kExecutionModeInterpFast,
+#if defined(WITH_JIT)
+    kExecutionModeJit,
+#endif
 } ExecutionMode;
 
 /*
@@ -77,6 +80,12 @@ struct DvmGlobals {
     unsigned int    heapSizeStart;
     unsigned int    heapSizeMax;
     unsigned int    stackSize;
+    int             gcMarkThreads;  // 0 means one per online CPU
+    int             finalizerThreads; // 0 means one per online CPU
+    bool            concurrentMarkSweep;
+    bool            generationalGc;
+    bool            hprofSnapshot;  // dump the heap from a fork()ed child
+    bool            biasedLocking;
 
     bool        verboseGc;
     bool        verboseJni;
@@ -99,12 +108,20 @@ struct DvmGlobals {
     bool        noQuitHandler;
     bool        verifyDexChecksum;
     char*       stackTraceFile;     // for SIGQUIT-inspired output
+    char*       sampleProfFile;     // -Xsampleprof: start sampling at boot
+    int         sampleProfIntervalUsec;
+    char*       allocSampleFile;    // -Xallocsample: start sampling at boot
+    int         allocSampleBytes;
+    int         allocSamplePeriodSec;
+    char*       preloadClassesFile; // -Xpreloadclasses: load these at boot
+    int         preloadThreads;     // 0 means one per online CPU
 
     bool        logStdio;
 
     DexOptimizerMode    dexOptMode;
     DexClassVerifyMode  classVerifyMode;
     bool        generateRegisterMaps;
+    int         dexOptThreads;      // 0 means one per online CPU
 
     int         assertionCtrlCount;
     AssertionControl*   assertionCtrl;
@@ -115,7 +132,6 @@ struct DvmGlobals {
      * VM init management.
      */
     bool        initializing;
-    int         initExceptionCount;
     bool        optimizing;
 
     /*
@@ -134,10 +150,11 @@ struct DvmGlobals {
     bool        optimizingBootstrapClass;
 
     /*
-     * Loaded classes, hashed by class name.  Each entry is a ClassObject*,
-     * allocated in GC space.
+     * Loaded classes, in one table per class loader, hashed by class name.
+     * Each entry is a ClassObject*, allocated in GC space.  Lookups don't
+     * lock; see dvmLockLoadedClasses() for everything else.
      */
-    HashTable*  loadedClasses;
+    struct ClassTables* loadedClasses;
 
     /*
      * Value for the next class serial number to be assigned.  This is
@@ -158,7 +175,7 @@ struct DvmGlobals {
     /*
      * Interned strings.
      */
-    HashTable*  internedStrings;
+    struct InternTable* internedStrings;
 
     /*
      * Quick lookups for popular classes used internally.
@@ -414,13 +431,24 @@ struct DvmGlobals {
 
     /*
      * GC heap lock.  Functions like gcMalloc() acquire this before making
-     * any changes to the heap.  It is held throughout garbage collection.
+     * any changes to the heap.  It is held throughout garbage collection,
+     * except while a concurrent collection is marking; gcHeapCond is
+     * broadcast when a collection finishes.
      */
     pthread_mutex_t gcHeapLock;
+    pthread_cond_t  gcHeapCond;
 
     /* Opaque pointer representing the heap. */
     GcHeap*     gcHeap;
 
+    /*
+     * Card table for the concurrent collector's write barrier; see
+     * alloc/CardTable.h.  cardTableLength is zero until the table exists.
+     */
+    u1*         cardTable;
+    u_int64_t   cardTableOrigin;
+    size_t      cardTableLength;
+
     /*
      * Pre-allocated object for out-of-memory errors.
      */
@@ -461,6 +489,13 @@ struct DvmGlobals {
     /* instruction format table, used for verification */
     InstructionFormat*  instrFormat;
 
+    /*
+     * Methods the GC had to scan conservatively because they had no
+     * register map.  The HeapWorker generates their maps after the GC.
+     */
+    pthread_mutex_t registerMapLock;
+    PointerSet*     registerMapPending;
+
     /*
      * Bootstrap class loader linear allocator.
      */
@@ -537,6 +572,11 @@ struct DvmGlobals {
     int             allocRecordHead;        /* most-recently-added entry */
     int             allocRecordCount;       /* #of valid entries */
 
+    /*
+     * Sampling allocation profiler.
+     */
+    AllocSamplerState allocSampler;
+
 #ifdef WITH_ALLOC_LIMITS
     /* set on first use of an alloc limit, never cleared */
     bool        checkAllocLimits;
@@ -567,6 +607,11 @@ struct DvmGlobals {
      */
     MethodTraceState methodTrace;
 
+    /*
+     * State for the sampling profiler.
+     */
+    SampleProfState sampleProf;
+
     /*
      * State for emulator tracing.
      */
@@ -592,6 +637,22 @@ struct DvmGlobals {
     bool        instructionCountEnableCount;
 #endif
 
+#if defined(WITH_JIT)
+    /*
+     * Baseline JIT state (see compiler/Compiler.h).  The code cache holds
+     * the shared entry trampoline followed by the compiled methods; it is
+     * only ever appended to, under jitLock.
+     */
+    u4          jitThreshold;
+    size_t      jitCodeCacheSize;
+    u1*         jitCodeCache;
+    size_t      jitCodeCacheUsed;
+    bool        jitCodeCacheFull;
+    u4          jitEpilogueOffset;
+    int         jitMethodsCompiled;
+    pthread_mutex_t jitLock;
+#endif
+
     /*
      * Signal catcher thread (for SIGQUIT).
      */
@@ -38,6 +38,21 @@ size_t dvmHashSize(size_t size) {
 }
 
 
+/*
+ * Allocate an empty generation of "tableSize" entries.
+ */
+static HashSlots* allocSlots(int tableSize)
+{
+    HashSlots* slots;
+
+    slots = (HashSlots*) calloc(1,
+        sizeof(HashSlots) + (tableSize - 1) * sizeof(HashEntry));
+    if (slots == NULL)
+        return NULL;
+    slots->tableSize = tableSize;
+    return slots;
+}
+
 /*
  * Create and initialize a hash table.
  */
@@ -53,17 +68,14 @@ HashTable* dvmHashTableCreate(size_t initialSize, HashFreeFunc freeFunc)
 
     dvmInitMutex(&pHashTable->lock);
 
-    pHashTable->tableSize = dexRoundUpPower2(initialSize);
     pHashTable->numEntries = pHashTable->numDeadEntries = 0;
     pHashTable->freeFunc = freeFunc;
-    pHashTable->pEntries =
-        (HashEntry*) malloc(pHashTable->tableSize * sizeof(HashEntry));
-    if (pHashTable->pEntries == NULL) {
+    pHashTable->slots = allocSlots(dexRoundUpPower2(initialSize));
+    if (pHashTable->slots == NULL) {
         free(pHashTable);
         return NULL;
     }
 
-    memset(pHashTable->pEntries, 0, pHashTable->tableSize * sizeof(HashEntry));
     return pHashTable;
 }
 
@@ -72,11 +84,12 @@ HashTable* dvmHashTableCreate(size_t initialSize, HashFreeFunc freeFunc)
  */
 void dvmHashTableClear(HashTable* pHashTable)
 {
+    HashSlots* slots = pHashTable->slots;
     HashEntry* pEnt;
     int i;
 
-    pEnt = pHashTable->pEntries;
-    for (i = 0; i < pHashTable->tableSize; i++, pEnt++) {
+    pEnt = slots->entries;
+    for (i = 0; i < slots->tableSize; i++, pEnt++) {
         if (pEnt->data == HASH_TOMBSTONE) {
             // nuke entry
             pEnt->data = NULL;
@@ -92,6 +105,18 @@ void dvmHashTableClear(HashTable* pHashTable)
     pHashTable->numDeadEntries = 0;
 }
 
+/*
+ * Free a chain of generations.
+ */
+static void freeSlotList(HashSlots* slots)
+{
+    while (slots != NULL) {
+        HashSlots* retired = slots->retired;
+        free(slots);
+        slots = retired;
+    }
+}
+
 /*
  * Free the table.
  */
@@ -100,20 +125,32 @@ void dvmHashTableFree(HashTable* pHashTable)
     if (pHashTable == NULL)
         return;
     dvmHashTableClear(pHashTable);
-    free(pHashTable->pEntries);
+
+    freeSlotList(pHashTable->slots);
     free(pHashTable);
 }
 
+/*
+ * Free the generations replaced by resizes.  The caller guarantees that
+ * no reader is still probing one.
+ */
+void dvmHashTableFreeRetired(HashTable* pHashTable)
+{
+    freeSlotList(pHashTable->slots->retired);
+    pHashTable->slots->retired = NULL;
+}
+
 #ifndef NDEBUG
 /*
  * Count up the number of tombstone entries in the hash table.
  */
 static int countTombStones(HashTable* pHashTable)
 {
+    const HashSlots* slots = pHashTable->slots;
     int i, count;
 
-    for (count = i = 0; i < pHashTable->tableSize; i++) {
-        if (pHashTable->pEntries[i].data == HASH_TOMBSTONE)
+    for (count = i = 0; i < slots->tableSize; i++) {
+        if (slots->entries[i].data == HASH_TOMBSTONE)
             count++;
     }
     return count;
@@ -126,26 +163,29 @@ static int countTombStones(HashTable* pHashTable)
  *
  * This essentially requires re-inserting all elements into the new storage.
  *
- * If multiple threads can access the hash table, the table's lock should
- * have been grabbed before issuing the "lookup+add" call that led to the
- * resize, so we don't have a synchronization problem here.
+ * The caller holds the table's lock, so nothing else is changing the
+ * table.  Readers may be probing the old entries; we leave those alone
+ * and only switch "slots" over once the new ones are filled in.
  */
 static bool resizeHash(HashTable* pHashTable, int newSize)
 {
+    HashSlots* oldSlots = pHashTable->slots;
+    HashSlots* newSlots;
     HashEntry* pNewEntries;
     int i;
 
     assert(countTombStones(pHashTable) == pHashTable->numDeadEntries);
     //LOGI("before: dead=%d\n", pHashTable->numDeadEntries);
 
-    pNewEntries = (HashEntry*) calloc(newSize, sizeof(HashEntry));
-    if (pNewEntries == NULL)
+    newSlots = allocSlots(newSize);
+    if (newSlots == NULL)
         return false;
+    pNewEntries = newSlots->entries;
 
-    for (i = 0; i < pHashTable->tableSize; i++) {
-        void* data = pHashTable->pEntries[i].data;
+    for (i = 0; i < oldSlots->tableSize; i++) {
+        void* data = oldSlots->entries[i].data;
         if (data != NULL && data != HASH_TOMBSTONE) {
-            int hashValue = pHashTable->pEntries[i].hashValue;
+            int hashValue = oldSlots->entries[i].hashValue;
             int newIdx;
 
             /* probe for new spot, wrapping around */
@@ -158,9 +198,9 @@ static bool resizeHash(HashTable* pHashTable, int newSize)
         }
     }
 
-    free(pHashTable->pEntries);
-    pHashTable->pEntries = pNewEntries;
-    pHashTable->tableSize = newSize;
+    /* old entries stay valid for readers until the table is freed */
+    newSlots->retired = oldSlots;
+    ATOMIC_STORE_RELEASE(&pHashTable->slots, newSlots);
     pHashTable->numDeadEntries = 0;
 
     assert(countTombStones(pHashTable) == 0);
@@ -171,73 +211,82 @@ static bool resizeHash(HashTable* pHashTable, int newSize)
  * Look up an entry.
  *
  * We probe on collisions, wrapping around the table.
+ *
+ * Without "doAdd" this runs without the lock, against whichever
+ * generation of the entries was current when we started.  That's safe
+ * because nothing in a generation changes under a reader except a NULL
+ * entry being filled in (hash first, then a release store of data) or
+ * live data becoming a tombstone, and a generation isn't freed until the
+ * table is.
  */
 void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
     HashCompareFunc cmpFunc, bool doAdd)
 {
+    HashSlots* slots = ATOMIC_LOAD_ACQUIRE(&pHashTable->slots);
     HashEntry* pEntry;
     HashEntry* pEnd;
+    void* data;
     void* result = NULL;
 
-    assert(pHashTable->tableSize > 0);
+    assert(slots->tableSize > 0);
     assert(item != HASH_TOMBSTONE);
     assert(item != NULL);
 
     /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
-    while (pEntry->data != NULL) {
-        if (pEntry->data != HASH_TOMBSTONE &&
+    pEntry = &slots->entries[itemHash & (slots->tableSize-1)];
+    pEnd = &slots->entries[slots->tableSize];
+    while ((data = ATOMIC_LOAD_ACQUIRE(&pEntry->data)) != NULL) {
+        if (data != HASH_TOMBSTONE &&
             pEntry->hashValue == itemHash &&
-            (*cmpFunc)(pEntry->data, item) == 0)
+            (*cmpFunc)(data, item) == 0)
         {
             /* match */
-            //LOGD("+++ match on entry %d\n", pEntry - pHashTable->pEntries);
+            //LOGD("+++ match on entry %d\n", pEntry - slots->entries);
             break;
         }
 
         pEntry++;
         if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
+            if (slots->tableSize == 1)
                 break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
+            pEntry = slots->entries;
         }
 
-        //LOGI("+++ look probing %d...\n", pEntry - pHashTable->pEntries);
+        //LOGI("+++ look probing %d...\n", pEntry - slots->entries);
     }
 
-    if (pEntry->data == NULL) {
+    if (data == NULL) {
         if (doAdd) {
             pEntry->hashValue = itemHash;
-            pEntry->data = item;
+            ATOMIC_STORE_RELEASE(&pEntry->data, item);
             pHashTable->numEntries++;
 
             /*
              * We've added an entry.  See if this brings us too close to full.
              */
             if ((pHashTable->numEntries+pHashTable->numDeadEntries) * LOAD_DENOM
-                > pHashTable->tableSize * LOAD_NUMER)
+                > slots->tableSize * LOAD_NUMER)
             {
-                if (!resizeHash(pHashTable, pHashTable->tableSize * 2)) {
+                if (!resizeHash(pHashTable, slots->tableSize * 2)) {
                     /* don't really have a way to indicate failure */
                     LOGE("Dalvik hash resize failure\n");
                     dvmAbort();
                 }
-                /* note "pEntry" is now invalid */
+                /* note "pEntry" now points into the retired entries */
             } else {
                 //LOGW("okay %d/%d/%d\n",
-                //    pHashTable->numEntries, pHashTable->tableSize,
-                //    (pHashTable->tableSize * LOAD_NUMER) / LOAD_DENOM);
+                //    pHashTable->numEntries, slots->tableSize,
+                //    (slots->tableSize * LOAD_NUMER) / LOAD_DENOM);
             }
 
             /* full table is bad -- search for nonexistent never halts */
-            assert(pHashTable->numEntries < pHashTable->tableSize);
+            assert(pHashTable->numEntries < pHashTable->slots->tableSize);
             result = item;
         } else {
             assert(result == NULL);
         }
     } else {
-        result = pEntry->data;
+        result = data;
     }
 
     return result;
@@ -246,21 +295,24 @@ void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
 /*
  * Remove an entry from the table.
  *
- * Does NOT invoke the "free" function on the item.
+ * Does NOT invoke the "free" function on the item.  Lookups running at
+ * the same time may still return it, so the caller has to make sure none
+ * can be in progress before freeing it.
  */
 bool dvmHashTableRemove(HashTable* pHashTable, u4 itemHash, void* item)
 {
+    HashSlots* slots = pHashTable->slots;
     HashEntry* pEntry;
     HashEntry* pEnd;
 
-    assert(pHashTable->tableSize > 0);
+    assert(slots->tableSize > 0);
 
     /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
+    pEntry = &slots->entries[itemHash & (slots->tableSize-1)];
+    pEnd = &slots->entries[slots->tableSize];
     while (pEntry->data != NULL) {
         if (pEntry->data == item) {
-            //LOGI("+++ stepping on entry %d\n", pEntry - pHashTable->pEntries);
+            //LOGI("+++ stepping on entry %d\n", pEntry - slots->entries);
             pEntry->data = HASH_TOMBSTONE;
             pHashTable->numEntries--;
             pHashTable->numDeadEntries++;
@@ -269,12 +321,12 @@ bool dvmHashTableRemove(HashTable* pHashTable, u4 itemHash, void* item)
 
         pEntry++;
         if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
+            if (slots->tableSize == 1)
                 break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
+            pEntry = slots->entries;
         }
 
-        //LOGI("+++ del probing %d...\n", pEntry - pHashTable->pEntries);
+        //LOGI("+++ del probing %d...\n", pEntry - slots->entries);
     }
 
     return false;
@@ -291,10 +343,11 @@ bool dvmHashTableRemove(HashTable* pHashTable, u4 itemHash, void* item)
  */
 int dvmHashForeachRemove(HashTable* pHashTable, HashForeachRemoveFunc func)
 {
+    HashSlots* slots = pHashTable->slots;
     int i, val;
 
-    for (i = 0; i < pHashTable->tableSize; i++) {
-        HashEntry* pEnt = &pHashTable->pEntries[i];
+    for (i = 0; i < slots->tableSize; i++) {
+        HashEntry* pEnt = &slots->entries[i];
 
         if (pEnt->data != NULL && pEnt->data != HASH_TOMBSTONE) {
             val = (*func)(pEnt->data);
@@ -316,16 +369,20 @@ int dvmHashForeachRemove(HashTable* pHashTable, HashForeachRemoveFunc func)
  * Execute a function on every entry in the hash table.
  *
  * If "func" returns a nonzero value, terminate early and return the value.
+ *
+ * We walk whichever generation was current when we started, so this is
+ * safe without the lock (see dvmHashTableLookup).
  */
 int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg)
 {
+    const HashSlots* slots = ATOMIC_LOAD_ACQUIRE(&pHashTable->slots);
     int i, val;
 
-    for (i = 0; i < pHashTable->tableSize; i++) {
-        HashEntry* pEnt = &pHashTable->pEntries[i];
+    for (i = 0; i < slots->tableSize; i++) {
+        void* data = ATOMIC_LOAD_ACQUIRE(&slots->entries[i].data);
 
-        if (pEnt->data != NULL && pEnt->data != HASH_TOMBSTONE) {
-            val = (*func)(pEnt->data, arg);
+        if (data != NULL && data != HASH_TOMBSTONE) {
+            val = (*func)(data, arg);
             if (val != 0)
                 return val;
         }
@@ -343,17 +400,18 @@ int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg)
 static int countProbes(HashTable* pHashTable, u4 itemHash, const void* item,
     HashCompareFunc cmpFunc)
 {
-    HashEntry* pEntry;
-    HashEntry* pEnd;
+    const HashSlots* slots = pHashTable->slots;
+    const HashEntry* pEntry;
+    const HashEntry* pEnd;
     int count = 0;
 
-    assert(pHashTable->tableSize > 0);
+    assert(slots->tableSize > 0);
     assert(item != HASH_TOMBSTONE);
     assert(item != NULL);
 
     /* jump to the first entry and probe for a match */
-    pEntry = &pHashTable->pEntries[itemHash & (pHashTable->tableSize-1)];
-    pEnd = &pHashTable->pEntries[pHashTable->tableSize];
+    pEntry = &slots->entries[itemHash & (slots->tableSize-1)];
+    pEnd = &slots->entries[slots->tableSize];
     while (pEntry->data != NULL) {
         if (pEntry->data != HASH_TOMBSTONE &&
             pEntry->hashValue == itemHash &&
@@ -365,9 +423,9 @@ static int countProbes(HashTable* pHashTable, u4 itemHash, const void* item,
 
         pEntry++;
         if (pEntry == pEnd) {     /* wrap around to start */
-            if (pHashTable->tableSize == 1)
+            if (slots->tableSize == 1)
                 break;      /* edge case - single-entry table */
-            pEntry = pHashTable->pEntries;
+            pEntry = slots->entries;
         }
 
         count++;
@@ -387,7 +445,7 @@ static int countProbes(HashTable* pHashTable, u4 itemHash, const void* item,
  * The caller should lock the table before calling here.
  */
 void dvmHashTableProbeCount(HashTable* pHashTable, HashCalcFunc calcFunc,
-    HashCompareFunc cmpFunc)
+    HashCompareFunc cmpFunc, HashProbeStats* pStats)
 {
     int numEntries, minProbe, maxProbe, totalProbe;
     HashIter iter;
@@ -411,8 +469,19 @@ void dvmHashTableProbeCount(HashTable* pHashTable, HashCalcFunc calcFunc,
             maxProbe = count;
         totalProbe += count;
     }
+    if (numEntries == 0)
+        minProbe = 0;
 
     LOGI("Probe: min=%d max=%d, total=%d in %d (%d), avg=%.3f\n",
-        minProbe, maxProbe, totalProbe, numEntries, pHashTable->tableSize,
-        (float) totalProbe / (float) numEntries);
+        minProbe, maxProbe, totalProbe, numEntries,
+        pHashTable->slots->tableSize,
+        numEntries == 0 ? 0.0 : (float) totalProbe / (float) numEntries);
+
+    if (pStats != NULL) {
+        pStats->numEntries = numEntries;
+        pStats->tableSize = pHashTable->slots->tableSize;
+        pStats->minProbe = minProbe;
+        pStats->maxProbe = maxProbe;
+        pStats->totalProbe = totalProbe;
+    }
 }
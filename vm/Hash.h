@@ -18,6 +18,11 @@
  *
  * When the number of elements reaches a certain percentage of the table's
  * capacity, the table will be resized.
+ *
+ * Lookups that don't add can be done without holding the table's lock,
+ * even while another thread is adding, removing or resizing.  Anything
+ * that changes the table must be done with the lock held (or otherwise
+ * serialized), as must walks with the iterator.
  */
 #ifndef _DALVIK_HASH
 #define _DALVIK_HASH
@@ -60,21 +65,34 @@ typedef int (*HashForeachRemoveFunc)(void* data);
  */
 typedef struct HashEntry {
     u4 hashValue;
-    void* data;
+    void* volatile data;    /* release-stored after hashValue */
 } HashEntry;
 
 #define HASH_TOMBSTONE ((void*) 0xcbcacccd)     // invalid ptr value
 
+/*
+ * One generation of a table's entries.  A resize builds a new one and
+ * swaps it in; readers that already have the old one keep using it, so
+ * it isn't freed until the table is, or until the owner knows there are
+ * no readers left (see dvmHashTableFreeRetired).  (Each is at most half
+ * the size of the next, so together they're smaller than the current
+ * one.)
+ */
+typedef struct HashSlots {
+    int         tableSize;          /* must be power of 2 */
+    struct HashSlots* retired;      /* previous generation */
+    HashEntry   entries[1];
+} HashSlots;
+
 /*
  * Expandable hash table.
  *
  * This structure should be considered opaque.
  */
 typedef struct HashTable {
-    int         tableSize;          /* must be power of 2 */
+    HashSlots* volatile slots;      /* current generation */
     int         numEntries;         /* current #of "live" entries */
     int         numDeadEntries;     /* current #of tombstone entries */
-    HashEntry*  pEntries;           /* array on heap */
     HashFreeFunc freeFunc;
     pthread_mutex_t lock;
 } HashTable;
@@ -98,7 +116,8 @@ HashTable* dvmHashTableCreate(size_t initialSize, HashFreeFunc freeFunc);
 size_t dvmHashSize(size_t size);
 
 /*
- * Clear out a hash table, freeing the contents of any used entries.
+ * Clear out a hash table, freeing the contents of any used entries.  No
+ * other thread may be using the table.
  */
 void dvmHashTableClear(HashTable* pHashTable);
 
@@ -108,8 +127,16 @@ void dvmHashTableClear(HashTable* pHashTable);
 void dvmHashTableFree(HashTable* pHashTable);
 
 /*
- * Exclusive access.  Important when adding items to a table, or when
- * doing any operations on a table that could be added to by another thread.
+ * Free the generations of entries that resizes have replaced.  Only safe
+ * when no lookup can be in progress, e.g. with the world stopped, and
+ * with the table locked.
+ */
+void dvmHashTableFreeRetired(HashTable* pHashTable);
+
+/*
+ * Exclusive access.  Required when adding or removing items, and when
+ * iterating over a table that could be changed by another thread.  Not
+ * needed for lookups.
  */
 INLINE void dvmHashTableLock(HashTable* pHashTable) {
     dvmLockMutex(&pHashTable->lock);
@@ -129,7 +156,8 @@ INLINE int dvmHashTableNumEntries(HashTable* pHashTable) {
  * Get total size of hash table (for memory usage calculations).
  */
 INLINE int dvmHashTableMemUsage(HashTable* pHashTable) {
-    return sizeof(HashTable) + pHashTable->tableSize * sizeof(HashEntry);
+    return sizeof(HashTable) + sizeof(HashSlots) +
+        (pHashTable->slots->tableSize - 1) * sizeof(HashEntry);
 }
 
 /*
@@ -140,14 +168,16 @@ INLINE int dvmHashTableMemUsage(HashTable* pHashTable) {
  * tell the difference by seeing if return value == item.)
  *
  * An "add" operation may cause the entire table to be reallocated.  Don't
- * forget to lock the table before calling this.
+ * forget to lock the table before calling this with "doAdd" set.  Plain
+ * lookups don't need the lock.
  */
 void* dvmHashTableLookup(HashTable* pHashTable, u4 itemHash, void* item,
     HashCompareFunc cmpFunc, bool doAdd);
 
 /*
  * Remove an item from the hash table, given its "data" pointer.  Does not
- * invoke the "free" function; just detaches it from the table.
+ * invoke the "free" function; just detaches it from the table.  Lock the
+ * table before calling this.
  */
 bool dvmHashTableRemove(HashTable* pHashTable, u4 hash, void* item);
 
@@ -155,6 +185,9 @@ bool dvmHashTableRemove(HashTable* pHashTable, u4 hash, void* item);
  * Execute "func" on every entry in the hash table.
  *
  * If "func" returns a nonzero value, terminate early and return the value.
+ *
+ * This doesn't need the lock; without it, entries added or removed while
+ * we're walking may or may not be seen.
  */
 int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg);
 
@@ -162,14 +195,15 @@ int dvmHashForeach(HashTable* pHashTable, HashForeachFunc func, void* arg);
  * Execute "func" on every entry in the hash table.
  *
  * If "func" returns 1 detach the entry from the hash table. Does not invoke
- * the "free" function.
+ * the "free" function.  Lock the table before calling this.
  *
  * Returning values other than 0 or 1 from "func" will abort the routine.
  */
 int dvmHashForeachRemove(HashTable* pHashTable, HashForeachRemoveFunc func);
 
 /*
- * An alternative to dvmHashForeach(), using an iterator.
+ * An alternative to dvmHashForeach(), using an iterator.  The table must
+ * be locked for the whole walk.
  *
  * Use like this:
  *   HashIter iter;
@@ -185,10 +219,11 @@ typedef struct HashIter {
     int         idx;
 } HashIter;
 INLINE void dvmHashIterNext(HashIter* pIter) {
+    const HashSlots* slots = pIter->pHashTable->slots;
     int i = pIter->idx +1;
-    int lim = pIter->pHashTable->tableSize;
+    int lim = slots->tableSize;
     for ( ; i < lim; i++) {
-        void* data = pIter->pHashTable->pEntries[i].data;
+        void* data = slots->entries[i].data;
         if (data != NULL && data != HASH_TOMBSTONE)
             break;
     }
@@ -200,22 +235,30 @@ INLINE void dvmHashIterBegin(HashTable* pHashTable, HashIter* pIter) {
     dvmHashIterNext(pIter);
 }
 INLINE bool dvmHashIterDone(HashIter* pIter) {
-    return (pIter->idx >= pIter->pHashTable->tableSize);
+    return (pIter->idx >= pIter->pHashTable->slots->tableSize);
 }
 INLINE void* dvmHashIterData(HashIter* pIter) {
-    assert(pIter->idx >= 0 && pIter->idx < pIter->pHashTable->tableSize);
-    return pIter->pHashTable->pEntries[pIter->idx].data;
+    assert(pIter->idx >= 0 && pIter->idx < pIter->pHashTable->slots->tableSize);
+    return pIter->pHashTable->slots->entries[pIter->idx].data;
 }
 
 
 /*
  * Evaluate hash table performance by examining the number of times we
- * have to probe for an entry.
+ * have to probe for an entry.  The results are logged, and stored in
+ * "pStats" if it isn't NULL.
  *
  * The caller should lock the table beforehand.
  */
+typedef struct HashProbeStats {
+    int         numEntries;
+    int         tableSize;
+    int         minProbe;
+    int         maxProbe;
+    int         totalProbe;
+} HashProbeStats;
 typedef u4 (*HashCalcFunc)(const void* item);
 void dvmHashTableProbeCount(HashTable* pHashTable, HashCalcFunc calcFunc,
-    HashCompareFunc cmpFunc);
+    HashCompareFunc cmpFunc, HashProbeStats* pStats);
 
 #endif /*_DALVIK_HASH*/
@@ -34,6 +34,10 @@
 #define kMinHeapSize        (2*1024*1024)
 #define kMaxHeapSize        (1*1024*1024*1024)
 
+#define kDefaultSampleIntervalUsec  10000   /* 100 samples per second */
+#define kDefaultAllocSampleBytes    (512*1024)
+#define kDefaultAllocSamplePeriodSec 10
+
 /*
  * Register VM-agnostic native methods for system classes.
  *
@@ -85,8 +89,18 @@ static void dvmUsage(const char *progName) {
                kMinStackSize / 1024, kMaxStackSize / 1024);
     dvmFprintf(stderr, "  -Xverify:{none,remote,all}\n");
     dvmFprintf(stderr, "  -Xrs\n");
+    dvmFprintf(stderr, "  -Xgcthreads:N  (GC marking threads, 0 = one per CPU)\n");
+    dvmFprintf(stderr, "  -Xfinalizerthreads:N  (finalizer threads, 0 = one per CPU)\n");
+    dvmFprintf(stderr, "  -Xgc:[no]concurrent\n");
+    dvmFprintf(stderr, "  -Xgc:[no]generational\n");
+    dvmFprintf(stderr, "  -Xhprof:[no]snapshot\n");
+    dvmFprintf(stderr, "  -Xlockbias:{on,off}\n");
     dvmFprintf(stderr,
                "  -Xint  (extended to accept ':portable' and ':fast')\n");
+#if defined(WITH_JIT)
+    dvmFprintf(stderr, "  -Xjitthreshold:N  (calls + loop iterations before compiling)\n");
+    dvmFprintf(stderr, "  -Xjitcodecachesize:N  (must be multiple of 1K)\n");
+#endif
     dvmFprintf(stderr, "\n");
     dvmFprintf(stderr, "These are unique to Dalvik:\n");
     dvmFprintf(stderr, "  -Xzygote\n");
@@ -97,6 +111,17 @@ static void dvmUsage(const char *progName) {
     dvmFprintf(stderr, "  -Xjniopts:{warnonly,forcecopy}\n");
     dvmFprintf(stderr, "  -Xdeadlockpredict:{off,warn,err,abort}\n");
     dvmFprintf(stderr, "  -Xstacktracefile:<filename>\n");
+    dvmFprintf(stderr,
+               "  -Xsampleprof:<filename>[,<usec>]  (default %d usec)\n",
+               kDefaultSampleIntervalUsec);
+    dvmFprintf(stderr,
+               "  -Xallocsample:<filename>[,<bytes>[,<sec>]]  (default %d bytes, %d sec)\n",
+               kDefaultAllocSampleBytes, kDefaultAllocSamplePeriodSec);
+    dvmFprintf(stderr, "  -Xpreloadclasses:<filename>\n");
+    dvmFprintf(stderr,
+               "  -Xpreloadthreads:N  (class preloading threads, 0 = one per CPU)\n");
+    dvmFprintf(stderr,
+               "  -Xdexoptthreads:N  (dexopt verify/optimize threads, 0 = one per CPU)\n");
     dvmFprintf(stderr, "  -Xgenregmap\n");
     dvmFprintf(stderr, "  -Xcheckdexsum\n");
     dvmFprintf(stderr, "\n");
@@ -716,6 +741,57 @@ static int dvmProcessOptions(int argc, const char *const argv[],
                 return -1;
             }
             gDvm.jniGrefLimit = lim;
+        } else if (strncmp(argv[i], "-Xgcthreads:", 12) == 0) {
+            char* end;
+            long threads = strtol(argv[i] + 12, &end, 10);
+            if (end == argv[i] + 12 || *end != '\0' || threads < 0) {
+                dvmFprintf(stderr, "Bad value for -Xgcthreads: '%s'\n",
+                           argv[i] + 12);
+                return -1;
+            }
+            gDvm.gcMarkThreads = threads;
+        } else if (strncmp(argv[i], "-Xfinalizerthreads:", 19) == 0) {
+            char* end;
+            long threads = strtol(argv[i] + 19, &end, 10);
+            if (end == argv[i] + 19 || *end != '\0' || threads < 0) {
+                dvmFprintf(stderr, "Bad value for -Xfinalizerthreads: '%s'\n",
+                           argv[i] + 19);
+                return -1;
+            }
+            gDvm.finalizerThreads = threads;
+        } else if (strncmp(argv[i], "-Xgc:", 5) == 0) {
+            if (strcmp(argv[i] + 5, "concurrent") == 0)
+                gDvm.concurrentMarkSweep = true;
+            else if (strcmp(argv[i] + 5, "noconcurrent") == 0)
+                gDvm.concurrentMarkSweep = false;
+            else if (strcmp(argv[i] + 5, "generational") == 0)
+                gDvm.generationalGc = true;
+            else if (strcmp(argv[i] + 5, "nogenerational") == 0)
+                gDvm.generationalGc = false;
+            else {
+                dvmFprintf(stderr, "Unrecognized gc option '%s'\n", argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-Xhprof:", 8) == 0) {
+            if (strcmp(argv[i] + 8, "snapshot") == 0)
+                gDvm.hprofSnapshot = true;
+            else if (strcmp(argv[i] + 8, "nosnapshot") == 0)
+                gDvm.hprofSnapshot = false;
+            else {
+                dvmFprintf(stderr, "Unrecognized hprof option '%s'\n",
+                           argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "-Xlockbias:", 11) == 0) {
+            if (strcmp(argv[i] + 11, "on") == 0)
+                gDvm.biasedLocking = true;
+            else if (strcmp(argv[i] + 11, "off") == 0)
+                gDvm.biasedLocking = false;
+            else {
+                dvmFprintf(stderr, "Unrecognized lockbias option '%s'\n",
+                           argv[i]);
+                return -1;
+            }
         } else if (strcmp(argv[i], "-Xlog-stdio") == 0) {
             gDvm.logStdio = true;
         } else if (strncmp(argv[i], "-Xint", 5) == 0) {
@@ -730,8 +806,30 @@ static int dvmProcessOptions(int argc, const char *const argv[],
                     /* keep going */
                 }
             } else {
-                /* disable JIT -- nothing to do here for now */
+                /* disable JIT */
+#if defined(WITH_JIT)
+                if (gDvm.executionMode == kExecutionModeJit)
+                    gDvm.executionMode = kExecutionModeInterpFast;
+#endif
+            }
+#if defined(WITH_JIT)
+        } else if (strncmp(argv[i], "-Xjitthreshold:", 15) == 0) {
+            int threshold = atoi(argv[i] + 15);
+            if (threshold <= 0) {
+                dvmFprintf(stderr, "Bad value for -Xjitthreshold: '%s'\n",
+                           argv[i] + 15);
+                return -1;
+            }
+            gDvm.jitThreshold = threshold;
+        } else if (strncmp(argv[i], "-Xjitcodecachesize:", 19) == 0) {
+            unsigned int size = dvmParseMemOption(argv[i] + 19, 1024);
+            if (size == 0) {
+                dvmFprintf(stderr, "Invalid -Xjitcodecachesize option '%s'\n",
+                           argv[i]);
+                return -1;
             }
+            gDvm.jitCodeCacheSize = size;
+#endif
         } else if (strncmp(argv[i], "-Xdeadlockpredict:", 18) == 0) {
 #ifdef WITH_DEADLOCK_PREDICTION
             if (strcmp(argv[i] + 18, "off") == 0)
@@ -751,6 +849,77 @@ static int dvmProcessOptions(int argc, const char *const argv[],
 #endif
         } else if (strncmp(argv[i], "-Xstacktracefile:", 17) == 0) {
             gDvm.stackTraceFile = strdup(argv[i] + 17);
+        } else if (strncmp(argv[i], "-Xsampleprof:", 13) == 0) {
+            const char* comma = strchr(argv[i] + 13, ',');
+            if (comma != NULL) {
+                char* end;
+                long usec = strtol(comma + 1, &end, 10);
+                if (end == comma + 1 || *end != '\0' || usec <= 0) {
+                    dvmFprintf(stderr, "Bad value for -Xsampleprof: '%s'\n",
+                               argv[i] + 13);
+                    return -1;
+                }
+                gDvm.sampleProfIntervalUsec = usec;
+            } else {
+                comma = argv[i] + strlen(argv[i]);
+            }
+            free(gDvm.sampleProfFile);
+            gDvm.sampleProfFile = strndup(argv[i] + 13, comma - (argv[i] + 13));
+        } else if (strncmp(argv[i], "-Xallocsample:", 14) == 0) {
+            char* fileName = strdup(argv[i] + 14);
+            char* bytesStr = strchr(fileName, ',');
+            char* periodStr = NULL;
+            bool bad = (*fileName == '\0' || *fileName == ',');
+            if (bytesStr != NULL) {
+                unsigned int bytes;
+
+                *bytesStr++ = '\0';
+                periodStr = strchr(bytesStr, ',');
+                if (periodStr != NULL)
+                    *periodStr++ = '\0';
+                bytes = dvmParseMemOption(bytesStr, 1);
+                if (bytes == 0 || bytes > INT_MAX)
+                    bad = true;
+                else
+                    gDvm.allocSampleBytes = bytes;
+            }
+            if (periodStr != NULL) {
+                char* end;
+                long sec = strtol(periodStr, &end, 10);
+                if (end == periodStr || *end != '\0' || sec <= 0)
+                    bad = true;
+                else
+                    gDvm.allocSamplePeriodSec = sec;
+            }
+            if (bad) {
+                dvmFprintf(stderr, "Bad value for -Xallocsample: '%s'\n",
+                           argv[i] + 14);
+                free(fileName);
+                return -1;
+            }
+            free(gDvm.allocSampleFile);
+            gDvm.allocSampleFile = fileName;
+        } else if (strncmp(argv[i], "-Xpreloadclasses:", 17) == 0) {
+            free(gDvm.preloadClassesFile);
+            gDvm.preloadClassesFile = strdup(argv[i] + 17);
+        } else if (strncmp(argv[i], "-Xpreloadthreads:", 17) == 0) {
+            char* end;
+            long threads = strtol(argv[i] + 17, &end, 10);
+            if (end == argv[i] + 17 || *end != '\0' || threads < 0) {
+                dvmFprintf(stderr, "Bad value for -Xpreloadthreads: '%s'\n",
+                           argv[i] + 17);
+                return -1;
+            }
+            gDvm.preloadThreads = threads;
+        } else if (strncmp(argv[i], "-Xdexoptthreads:", 16) == 0) {
+            char* end;
+            long threads = strtol(argv[i] + 16, &end, 10);
+            if (end == argv[i] + 16 || *end != '\0' || threads < 0) {
+                dvmFprintf(stderr, "Bad value for -Xdexoptthreads: '%s'\n",
+                           argv[i] + 16);
+                return -1;
+            }
+            gDvm.dexOptThreads = threads;
         } else if (strcmp(argv[i], "-Xgenregmap") == 0) {
             gDvm.generateRegisterMaps = true;
         } else if (strcmp(argv[i], "-Xcheckdexsum") == 0) {
@@ -769,15 +938,6 @@ static int dvmProcessOptions(int argc, const char *const argv[],
     }
     gDvm.classVerifyMode = VERIFY_MODE_NONE;
     gDvm.dexOptMode = OPTIMIZE_MODE_NONE;
-
-    /*
-     * Default execution mode.
-     *
-     * This should probably interact with the mterp code somehow, e.g. if
-     * we know we're using the "desktop" build we should probably be
-     * using "portable" rather than "fast".
-     */
-    gDvm.executionMode = kExecutionModeInterpPortable;
     return 0;
 }
 
@@ -804,6 +964,12 @@ static void setCommandLineDefaults() {
     gDvm.heapSizeStart = 2 * 1024 * 1024; // Spec says 16MB; too big for us.
     gDvm.heapSizeMax = 16 * 1024 * 1024; // Spec says 75% physical mem
     gDvm.stackSize = kDefaultStackSize;
+    gDvm.concurrentMarkSweep = true;
+    gDvm.generationalGc = true;
+    gDvm.biasedLocking = true;
+    gDvm.sampleProfIntervalUsec = kDefaultSampleIntervalUsec;
+    gDvm.allocSampleBytes = kDefaultAllocSampleBytes;
+    gDvm.allocSamplePeriodSec = kDefaultAllocSamplePeriodSec;
 
     /* gDvm.jdwpSuspend = true; */
 
@@ -820,8 +986,19 @@ static void setCommandLineDefaults() {
      * This should probably interact with the mterp code somehow, e.g. if
      * we know we're using the "desktop" build we should probably be
      * using "portable" rather than "fast".
+     *
+     * "fast" is the threaded build of the portable interpreter, which
+     * needs GCC computed goto; make it the default with WITH_THREADED_INTERP.
      */
+#if defined(WITH_JIT)
+    gDvm.executionMode = kExecutionModeJit;
+    gDvm.jitThreshold = kJitDefaultThreshold;
+    gDvm.jitCodeCacheSize = kJitDefaultCodeCacheSize;
+#elif defined(WITH_THREADED_INTERP)
+    gDvm.executionMode = kExecutionModeInterpFast;
+#else
     gDvm.executionMode = kExecutionModeInterpPortable;
+#endif
 }
 
 
@@ -937,6 +1114,8 @@ int dvmStartup(int argc, const char *const argv[], bool ignoreUnrecognized,
     if (!dvmVerificationStartup())
         goto fail;
     LOGD("[+] dvmVerificationStartup startup success\n");
+    if (!dvmRegisterMapStartup())
+        goto fail;
     if (!dvmInstanceofStartup())
         goto fail;
     LOGD("[+] dvmInstanceofStartup startup success\n");
@@ -969,6 +1148,11 @@ int dvmStartup(int argc, const char *const argv[], bool ignoreUnrecognized,
         goto fail;
     LOGD("[+] dvmProfilingStartup startup success\n");
 #endif
+#if defined(WITH_JIT)
+    if (!dvmCompilerStartup())
+        goto fail;
+    LOGD("[+] dvmCompilerStartup startup success\n");
+#endif
 
     LOGD("[+] --- almost make it! ---\n");
     /* make sure we got these [can this go away?] */
@@ -1035,6 +1219,15 @@ int dvmStartup(int argc, const char *const argv[], bool ignoreUnrecognized,
     if (!dvmDebuggerStartup())
         goto fail;
 
+    /*
+     * Load the classes we were told the app will need, in parallel,
+     * before any app code runs.
+     */
+    if (gDvm.preloadClassesFile != NULL) {
+        if (!dvmPreloadClasses(gDvm.preloadClassesFile, gDvm.preloadThreads))
+            LOGW("Class preloading failed; continuing anyway\n");
+    }
+
     /*
      * Init for either zygote mode or non-zygote mode.  The key difference
      * is that we don't start any additional threads in Zygote mode.
@@ -1050,10 +1243,12 @@ int dvmStartup(int argc, const char *const argv[], bool ignoreUnrecognized,
 
 #ifndef NDEBUG
     dvmTestHash();
+    dvmTestHeapBitmap();
+    dvmTestLockFattening();
 #endif
 
     assert(!dvmCheckException(dvmThreadSelf()));
-    gDvm.initExceptionCount = 0;
+    dvmThreadSelf()->initExceptionCount = 0;
 
     return 0;
 
@@ -1138,6 +1333,22 @@ bool dvmInitAfterZygote(void) {
             return false;
     }
 
+#ifdef WITH_PROFILER
+    /* start the sampling profiler, if requested */
+    if (gDvm.sampleProfFile != NULL) {
+        if (!dvmSampleProfStart(gDvm.sampleProfFile,
+                gDvm.sampleProfIntervalUsec))
+            LOGW("Sampling profiler failed to start; continuing anyway\n");
+    }
+#endif
+
+    /* start the allocation sampler, if requested */
+    if (gDvm.allocSampleFile != NULL) {
+        if (!dvmAllocSamplerStart(gDvm.allocSampleFile,
+                gDvm.allocSampleBytes, gDvm.allocSamplePeriodSec))
+            LOGW("Allocation sampler failed to start; continuing anyway\n");
+    }
+
     endQuit = dvmGetRelativeTimeUsec();
     startJdwp = dvmGetRelativeTimeUsec();
 
@@ -1240,7 +1451,8 @@ static bool dvmInitJDWP(void) {
  * Returns 0 on success.
  */
 int dvmPrepForDexOpt(const char *bootClassPath, DexOptimizerMode dexOptMode,
-                     DexClassVerifyMode verifyMode, int dexoptFlags) {
+                     DexClassVerifyMode verifyMode, int dexoptFlags,
+                     int numThreads) {
     gDvm.initializing = true;
     gDvm.optimizing = true;
 
@@ -1256,6 +1468,7 @@ int dvmPrepForDexOpt(const char *bootClassPath, DexOptimizerMode dexOptMode,
     gDvm.dexOptMode = dexOptMode;
     gDvm.classVerifyMode = verifyMode;
     gDvm.generateRegisterMaps = (dexoptFlags & DEXOPT_GEN_REGISTER_MAPS) != 0;
+    gDvm.dexOptThreads = numThreads;
 
     /*
      * Initialize the heap, some basic thread control mutexes, and
@@ -1316,6 +1529,7 @@ void dvmShutdown(void) {
     /*
      * Stop our internal threads.
      */
+    dvmGcThreadShutdown();
     dvmHeapWorkerShutdown();
 
     if (gDvm.jdwpState != NULL)
@@ -1324,6 +1538,12 @@ void dvmShutdown(void) {
     gDvm.jdwpHost = NULL;
     free(gDvm.stackTraceFile);
     gDvm.stackTraceFile = NULL;
+    free(gDvm.sampleProfFile);
+    gDvm.sampleProfFile = NULL;
+    free(gDvm.allocSampleFile);
+    gDvm.allocSampleFile = NULL;
+    free(gDvm.preloadClassesFile);
+    gDvm.preloadClassesFile = NULL;
 
     /* tell signal catcher to shut down if it was started */
     dvmSignalCatcherShutdown();
@@ -1331,6 +1551,9 @@ void dvmShutdown(void) {
     /* shut down stdout/stderr conversion */
     dvmStdioConverterShutdown();
 
+    /* write the final allocation samples, and wait for the dump thread */
+    dvmAllocSamplerStop();
+
     /*
      * Kill any daemon threads that still exist.  Actively-running threads
      * are likely to crash the process if they continue to execute while
@@ -1344,6 +1567,9 @@ void dvmShutdown(void) {
     dvmReflectShutdown();
 #ifdef WITH_PROFILER
     dvmProfilingShutdown();
+#endif
+#if defined(WITH_JIT)
+    dvmCompilerShutdown();
 #endif
     dvmJniShutdown();
     dvmStringInternShutdown();
@@ -1351,6 +1577,7 @@ void dvmShutdown(void) {
     dvmThreadShutdown();
     dvmClassShutdown();
     dvmVerificationShutdown();
+    dvmRegisterMapShutdown();
     dvmInstanceofShutdown();
     dvmInlineNativeShutdown();
     dvmGcShutdown();
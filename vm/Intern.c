@@ -15,6 +15,16 @@
  */
 /*
  * String interning.
+ *
+ * The table is split into INTERN_STRIPES stripes by hash, each a
+ * HashTable with its own lock.  Lookups don't take any lock, and only
+ * fall back to the stripe lock to add a string that wasn't there.
+ *
+ * A stripe's replaced generations of entries can't be freed right away,
+ * since a reader may still be probing one.  They're freed at the next GC
+ * pause instead.  That's safe because lookups are only made from threads
+ * in THREAD_RUNNING, and a running thread can't be suspended in the
+ * middle of one.
  */
 #include "Dalvik.h"
 
@@ -28,15 +38,37 @@
 #define IS_IMMORTAL(strObj) \
             ((u_int64_t)(strObj) & INTERN_STRING_IMMORTAL_BIT)
 
+/* the stripe comes from the top bits of the hash, the slot from the bottom */
+#define INTERN_STRIPE_BITS      4
+#define INTERN_STRIPES          (1 << INTERN_STRIPE_BITS)
+#define INTERN_STRIPE(hash)     ((hash) >> (32 - INTERN_STRIPE_BITS))
+#define INTERN_INITIAL_SIZE     32      /* per stripe */
+
+struct InternTable {
+    HashTable*      stripes[INTERN_STRIPES];
+};
+
 
 /*
  * Prep string interning.
  */
 bool dvmStringInternStartup(void)
 {
-    gDvm.internedStrings = dvmHashTableCreate(256, NULL);
-    if (gDvm.internedStrings == NULL)
+    InternTable* table;
+    int i;
+
+    table = (InternTable*) calloc(1, sizeof(InternTable));
+    if (table == NULL)
         return false;
+    gDvm.internedStrings = table;
+
+    for (i = 0; i < INTERN_STRIPES; i++) {
+        table->stripes[i] = dvmHashTableCreate(INTERN_INITIAL_SIZE, NULL);
+        if (table->stripes[i] == NULL) {
+            dvmStringInternShutdown();
+            return false;
+        }
+    }
 
     return true;
 }
@@ -48,7 +80,15 @@ bool dvmStringInternStartup(void)
  */
 void dvmStringInternShutdown(void)
 {
-    dvmHashTableFree(gDvm.internedStrings);
+    InternTable* table = gDvm.internedStrings;
+    int i;
+
+    if (table == NULL)
+        return;
+
+    for (i = 0; i < INTERN_STRIPES; i++)
+        dvmHashTableFree(table->stripes[i]);
+    free(table);
     gDvm.internedStrings = NULL;
 }
 
@@ -63,47 +103,68 @@ static int hashcmpImmortalStrings(const void* vstrObj1, const void* vstrObj2)
                              (const void*) STRIP_IMMORTAL_BIT(vstrObj2));
 }
 
-static StringObject* lookupInternedString(StringObject* strObj, bool immortal)
+/*
+ * Slow path: add "strObj" to its stripe, unless another thread got
+ * there first, and make the entry immortal if asked to.
+ */
+static void* addInternedString(HashTable* stripe, u4 hash,
+    StringObject* strObj, bool immortal)
 {
-    StringObject* found;
-    u4 hash;
-
-    assert(strObj != NULL);
-    hash = dvmComputeStringHash(strObj);
+    void* found;
 
-    if (false) {
-        char* debugStr = dvmCreateCstrFromString(strObj);
-        LOGV("+++ dvmLookupInternedString searching for '%s'\n", debugStr);
-        free(debugStr);
-    }
-
-    if (immortal) {
+    if (immortal)
         strObj = (StringObject*) SET_IMMORTAL_BIT(strObj);
-    }
 
-    dvmHashTableLock(gDvm.internedStrings);
+    dvmHashTableLock(stripe);
 
-    found = (StringObject*) dvmHashTableLookup(gDvm.internedStrings,
-                                hash, strObj, hashcmpImmortalStrings, true);
+    found = dvmHashTableLookup(stripe, hash, strObj, hashcmpImmortalStrings,
+                true);
     if (immortal && !IS_IMMORTAL(found)) {
         /* Make this entry immortal.  We have to use the existing object
          * because, as an interned string, it's not allowed to change.
          *
-         * There's no way to get a pointer to the actual hash table entry,
-         * so the only way to modify the existing entry is to remove,
-         * modify, and re-add it.
+         * The only way to modify the existing entry is to remove, modify,
+         * and re-add it.  A lookup that misses it in between comes here
+         * and waits for the lock.
          */
-        dvmHashTableRemove(gDvm.internedStrings, hash, found);
-        found = (StringObject*) SET_IMMORTAL_BIT(found);
-        found = (StringObject*) dvmHashTableLookup(gDvm.internedStrings,
-                                    hash, found, hashcmpImmortalStrings, true);
+        dvmHashTableRemove(stripe, hash, found);
+        found = (void*) SET_IMMORTAL_BIT(found);
+        found = dvmHashTableLookup(stripe, hash, found,
+                    hashcmpImmortalStrings, true);
         assert(IS_IMMORTAL(found));
     }
 
-    dvmHashTableUnlock(gDvm.internedStrings);
+    dvmHashTableUnlock(stripe);
 
     //if (found == strObj)
     //    LOGVV("+++  added string\n");
+    return found;
+}
+
+static StringObject* lookupInternedString(StringObject* strObj, bool immortal)
+{
+    HashTable* stripe;
+    void* found;
+    u4 hash;
+
+    assert(strObj != NULL);
+    assert(dvmThreadSelf() == NULL ||
+        dvmThreadSelf()->status == THREAD_RUNNING);
+    hash = dvmComputeStringHash(strObj);
+
+    if (false) {
+        char* debugStr = dvmCreateCstrFromString(strObj);
+        LOGV("+++ dvmLookupInternedString searching for '%s'\n", debugStr);
+        free(debugStr);
+    }
+
+    stripe = gDvm.internedStrings->stripes[INTERN_STRIPE(hash)];
+
+    found = dvmHashTableLookup(stripe, hash, strObj, hashcmpImmortalStrings,
+                false);
+    if (found == NULL || (immortal && !IS_IMMORTAL(found)))
+        found = addInternedString(stripe, hash, strObj, immortal);
+
     return (StringObject*) STRIP_IMMORTAL_BIT(found);
 }
 
@@ -144,13 +205,19 @@ static int markStringObject(void* strObj, void* arg)
 
 void dvmGcScanInternedStrings()
 {
+    InternTable* table = gDvm.internedStrings;
+    int i;
+
     /* It's possible for a GC to happen before dvmStringInternStartup()
      * is called.
      */
-    if (gDvm.internedStrings != NULL) {
-        dvmHashTableLock(gDvm.internedStrings);
-        dvmHashForeach(gDvm.internedStrings, markStringObject, NULL);
-        dvmHashTableUnlock(gDvm.internedStrings);
+    if (table == NULL)
+        return;
+
+    for (i = 0; i < INTERN_STRIPES; i++) {
+        dvmHashTableLock(table->stripes[i]);
+        dvmHashForeach(table->stripes[i], markStringObject, NULL);
+        dvmHashTableUnlock(table->stripes[i]);
     }
 }
 
@@ -159,15 +226,25 @@ void dvmGcScanInternedStrings()
  * marked.  isUnmarkedObject is a function suitable for passing
  * to dvmHashForeachRemove();  it must strip the low bits from
  * its pointer argument to deal with the immortal bit, though.
+ *
+ * The world is stopped, so nobody can still be probing the generations
+ * of entries that earlier resizes replaced, and we free them here.
  */
 void dvmGcDetachDeadInternedStrings(int (*isUnmarkedObject)(void *))
 {
+    InternTable* table = gDvm.internedStrings;
+    int i;
+
     /* It's possible for a GC to happen before dvmStringInternStartup()
      * is called.
      */
-    if (gDvm.internedStrings != NULL) {
-        dvmHashTableLock(gDvm.internedStrings);
-        dvmHashForeachRemove(gDvm.internedStrings, isUnmarkedObject);
-        dvmHashTableUnlock(gDvm.internedStrings);
+    if (table == NULL)
+        return;
+
+    for (i = 0; i < INTERN_STRIPES; i++) {
+        dvmHashTableLock(table->stripes[i]);
+        dvmHashForeachRemove(table->stripes[i], isUnmarkedObject);
+        dvmHashTableFreeRetired(table->stripes[i]);
+        dvmHashTableUnlock(table->stripes[i]);
     }
 }
@@ -19,9 +19,16 @@
 #ifndef _DALVIK_INTERN
 #define _DALVIK_INTERN
 
+/* striped, lock-free-for-readers table; see Intern.c */
+typedef struct InternTable InternTable;
+
 bool dvmStringInternStartup(void);
 void dvmStringInternShutdown(void);
 
+/*
+ * Lookups must be made from a thread in THREAD_RUNNING (or before the
+ * VM has threads); the GC relies on that to free the table's old arrays.
+ */
 StringObject* dvmLookupInternedString(StringObject* strObj);
 StringObject* dvmLookupImmortalInternedString(StringObject* strObj);
 
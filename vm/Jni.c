@@ -2368,6 +2368,8 @@ static void SetObjectArrayElement(JNIEnv* env, jobjectArray array,
     //LOGV("JNI: set element %d in array %p to %p\n", index, array, value);
 
     ((Object**) arrayObj->contents)[index] = (Object*) value;
+    if (value != NULL)
+        dvmMarkCard(arrayObj);
 
 bail:
     JNI_EXIT();
@@ -55,8 +55,19 @@ this for free in a given block.
 A NULL value for the "classLoader" argument refers to the bootstrap class
 loader, which is never unloaded (until the VM shuts down).
 
+A region is a list of segments.  When the newest one fills up we map
+another one rather than giving up, so there's no fixed limit on how much
+class metadata we can hold.  Space is claimed from the newest segment
+with a compare-and-swap on its "curOffset", and each thread claims a
+CHUNK_SIZE piece at a time and hands out small blocks from that without
+touching shared state at all, so threads loading classes in parallel
+don't contend.  A length word of zero marks space that was claimed but
+never handed out (the tail of a chunk); walks skip over it.
+
 Because the memory is not expected to be updated, we can use mprotect to
 guard the pages on debug builds.  Handy when tracking down corruption.
+With ENFORCE_READ_ONLY set, allocation goes back to being done under the
+region's lock, because the page state has to be tracked precisely.
 */
 
 /* alignment for allocations; must be power of 2, and currently >= hdr_xtra */
@@ -65,6 +76,10 @@ guard the pages on debug builds.  Handy when tracking down corruption.
 /* default length of memory segment (worst case is probably "dexopt") */
 #define DEFAULT_MAX_LENGTH  (4*1024*1024)
 
+/* size of the per-thread chunks, and the largest block we carve from one */
+#define CHUNK_SIZE          4096
+#define CHUNK_MAX_ALLOC     (CHUNK_SIZE / 4)
+
 /* leave enough space for a length word */
 #define HEADER_EXTRA        4
 
@@ -102,17 +117,74 @@ static inline u4* getBlockHeader(void* mem)
 }
 
 /*
- * Create a new linear allocation block.
+ * Compute the offset of the next block header after an allocation of
+ * "size" bytes whose header is at "offset".  The old offset points at the
+ * address where we will store the hidden block header, so we advance past
+ * that, add the size of data they want, add another header's worth so we
+ * know we have room for that, and round up to BLOCK_ALIGN.  That's the
+ * next location where we'll put user data.  We then subtract the chunk
+ * header size off so we're back to the header pointer.
+ *
+ * Examples:
+ *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
+ *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
  */
-LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
+static inline size_t nextBlockOffset(int offset, size_t size)
 {
-#ifdef DISABLE_LINEAR_ALLOC
-    return (LinearAllocHdr*) 0x12345;
-#endif
-    LinearAllocHdr* pHdr;
+    return ((offset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
+                & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
+}
 
-    pHdr = (LinearAllocHdr*) malloc(sizeof(*pHdr));
+/*
+ * Find the segment holding "mem", or NULL if it isn't in this region.
+ */
+static LinearAllocSeg* findSegment(LinearAllocHdr* pHdr, const void* mem)
+{
+    LinearAllocSeg* pSeg;
 
+    for (pSeg = ATOMIC_LOAD_ACQUIRE(&pHdr->curSeg); pSeg != NULL;
+        pSeg = pSeg->next)
+    {
+        if (mem >= (void*) pSeg->mapAddr &&
+            mem < (void*) (pSeg->mapAddr + pSeg->curOffset))
+        {
+            return pSeg;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Unmap a segment and free it.
+ */
+static void destroySegment(LinearAllocSeg* pSeg)
+{
+    if (munmap(pSeg->mapAddr, pSeg->mapLength) != 0) {
+        LOGW("LinearAlloc munmap(%p, %d) failed: %s\n",
+            pSeg->mapAddr, pSeg->mapLength, strerror(errno));
+    }
+    free(pSeg->writeRefCount);
+    free(pSeg);
+}
+
+/*
+ * Map a new segment with room for at least one "minSize"-byte block.
+ *
+ * Returns NULL on failure.
+ */
+static LinearAllocSeg* createSegment(size_t minSize)
+{
+    LinearAllocSeg* pSeg;
+    size_t mapLength;
+
+    if (minSize > INT_MAX / 2) {
+        LOGE("LinearAlloc can't hold a %zu-byte block\n", minSize);
+        return NULL;
+    }
+
+    pSeg = (LinearAllocSeg*) calloc(1, sizeof(*pSeg));
+    if (pSeg == NULL)
+        return NULL;
 
     /*
      * "curOffset" points to the location of the next pre-block header,
@@ -124,25 +196,30 @@ LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
      * chunk of data will be properly aligned.
      */
     assert(BLOCK_ALIGN >= HEADER_EXTRA);
-    pHdr->curOffset = pHdr->firstOffset = (BLOCK_ALIGN-HEADER_EXTRA) + PAGESIZE;
-    pHdr->mapLength = DEFAULT_MAX_LENGTH;
+    pSeg->curOffset = pSeg->firstOffset = (BLOCK_ALIGN-HEADER_EXTRA) + PAGESIZE;
+
+    mapLength = (nextBlockOffset(pSeg->firstOffset, minSize) + PAGESIZE-1)
+                & ~(PAGESIZE-1);
+    if (mapLength < DEFAULT_MAX_LENGTH)
+        mapLength = DEFAULT_MAX_LENGTH;
+    pSeg->mapLength = (int) mapLength;
 
 #ifdef USE_ASHMEM
     int fd;
 
-    fd = ashmem_create_region("dalvik-LinearAlloc", DEFAULT_MAX_LENGTH);
+    fd = ashmem_create_region("dalvik-LinearAlloc", pSeg->mapLength);
     if (fd < 0) {
         LOGE("ashmem LinearAlloc failed %s", strerror(errno)); 
-        free(pHdr);
+        free(pSeg);
         return NULL;
     }
 
-    pHdr->mapAddr = mmap(NULL, pHdr->mapLength, PROT_READ | PROT_WRITE,
+    pSeg->mapAddr = mmap(NULL, pSeg->mapLength, PROT_READ | PROT_WRITE,
         MAP_PRIVATE, fd, 0);
-    if (pHdr->mapAddr == MAP_FAILED) {
-        LOGE("LinearAlloc mmap(%d) failed: %s\n", pHdr->mapLength,
+    if (pSeg->mapAddr == MAP_FAILED) {
+        LOGE("LinearAlloc mmap(%d) failed: %s\n", pSeg->mapLength,
             strerror(errno));
-        free(pHdr);
+        free(pSeg);
 	close(fd);
         return NULL;
     }
@@ -151,66 +228,118 @@ LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
 #else /*USE_ASHMEM*/
     // MAP_ANON is listed as "deprecated" on Linux, 
     // but MAP_ANONYMOUS is not defined under Mac OS X.
-    pHdr->mapAddr = mmap(NULL, pHdr->mapLength, PROT_READ | PROT_WRITE,
+    pSeg->mapAddr = mmap(NULL, pSeg->mapLength, PROT_READ | PROT_WRITE,
         MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (pHdr->mapAddr == MAP_FAILED) {
-        LOGE("LinearAlloc mmap(%d) failed: %s\n", pHdr->mapLength,
+    if (pSeg->mapAddr == MAP_FAILED) {
+        LOGE("LinearAlloc mmap(%d) failed: %s\n", pSeg->mapLength,
             strerror(errno));
-        free(pHdr);
+        free(pSeg);
         return NULL;
     }
 #endif /*USE_ASHMEM*/
 
     /* region expected to begin on a page boundary */
-    assert(((int) pHdr->mapAddr & (PAGESIZE-1)) == 0);
+    assert(((int) pSeg->mapAddr & (PAGESIZE-1)) == 0);
 
     /* the system should initialize newly-mapped memory to zero */
-    assert(*(u4*) (pHdr->mapAddr + pHdr->curOffset) == 0);
+    assert(*(u4*) (pSeg->mapAddr + pSeg->curOffset) == 0);
 
     /*
-     * Disable access to all except starting page.  We will enable pages
-     * as we use them.  This helps prevent bad pointers from working.  The
-     * pages start out PROT_NONE, become read/write while we access them,
-     * then go to read-only after we finish our changes.
+     * We insert an extra page at the start to force a break in the memory
+     * map so we can see ourselves more easily in "showmap".  Otherwise
+     * this stuff blends into the neighboring pages.  [TODO: do we still
+     * need the extra page now that we have ashmem?]
+     *
+     * The rest of the segment stays read/write.  Untouched pages don't
+     * cost anything, and not having to mprotect() pages as allocations
+     * reach them is what lets us allocate without a lock.
+     *
+     * With ENFORCE_READ_ONLY, disable access to all except the starting
+     * page.  We will enable pages as we use them.  This helps prevent bad
+     * pointers from working.  The pages start out PROT_NONE, become
+     * read/write while we access them, then go to read-only after we
+     * finish our changes.
      *
      * We have to make the first page readable because we have 4 pad bytes,
      * followed by 4 length bytes, giving an initial offset of 8.  The
      * generic code below assumes that there could have been a previous
      * allocation that wrote into those 4 pad bytes, therefore the page
      * must have been marked readable by the previous allocation.
-     *
-     * We insert an extra page in here to force a break in the memory map
-     * so we can see ourselves more easily in "showmap".  Otherwise this
-     * stuff blends into the neighboring pages.  [TODO: do we still need
-     * the extra page now that we have ashmem?]
      */
-    if (mprotect(pHdr->mapAddr, pHdr->mapLength, PROT_NONE) != 0) {
-        LOGW("LinearAlloc init mprotect failed: %s\n", strerror(errno));
-        free(pHdr);
-        return NULL;
-    }
-    if (mprotect(pHdr->mapAddr + PAGESIZE, PAGESIZE,
-            ENFORCE_READ_ONLY ? PROT_READ : PROT_READ|PROT_WRITE) != 0)
+    if (mprotect(pSeg->mapAddr,
+            ENFORCE_READ_ONLY ? pSeg->mapLength : PAGESIZE, PROT_NONE) != 0)
     {
-        LOGW("LinearAlloc init mprotect #2 failed: %s\n", strerror(errno));
-        free(pHdr);
+        LOGW("LinearAlloc init mprotect failed: %s\n", strerror(errno));
+        destroySegment(pSeg);
         return NULL;
     }
 
     if (ENFORCE_READ_ONLY) {
+        if (mprotect(pSeg->mapAddr + PAGESIZE, PAGESIZE, PROT_READ) != 0) {
+            LOGW("LinearAlloc init mprotect #2 failed: %s\n", strerror(errno));
+            destroySegment(pSeg);
+            return NULL;
+        }
+
         /* allocate the per-page ref count */
-        int numPages = (pHdr->mapLength+PAGESIZE-1) / PAGESIZE;
-        pHdr->writeRefCount = calloc(numPages, sizeof(short));
-        if (pHdr->writeRefCount == NULL) {
-            free(pHdr);
+        int numPages = (pSeg->mapLength+PAGESIZE-1) / PAGESIZE;
+        pSeg->writeRefCount = calloc(numPages, sizeof(short));
+        if (pSeg->writeRefCount == NULL) {
+            destroySegment(pSeg);
             return NULL;
         }
     }
 
-    dvmInitMutex(&pHdr->lock);
+    LOGV("LinearAlloc: created segment at %p-%p\n",
+        pSeg->mapAddr, pSeg->mapAddr + pSeg->mapLength-1);
+
+    return pSeg;
+}
+
+/*
+ * Add a segment with room for a "size"-byte block to the region and make
+ * it the one we allocate from.  The caller must hold the region's lock.
+ *
+ * There's nothing sensible to do if we can't map one, so we abort.
+ */
+static LinearAllocSeg* addSegment(LinearAllocHdr* pHdr, size_t size)
+{
+    LinearAllocSeg* pSeg;
+
+    pSeg = createSegment(size);
+    if (pSeg == NULL) {
+        LOGE("LinearAlloc unable to grow, last=%d\n", (int) size);
+        dvmAbort();
+    }
+
+    /* the segment has to be complete before anybody can see it */
+    pSeg->next = pHdr->curSeg;
+    ATOMIC_STORE_RELEASE(&pHdr->curSeg, pSeg);
+
+    return pSeg;
+}
+
+/*
+ * Create a new linear allocation block.
+ */
+LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
+{
+#ifdef DISABLE_LINEAR_ALLOC
+    return (LinearAllocHdr*) 0x12345;
+#endif
+    LinearAllocHdr* pHdr;
+
+    pHdr = (LinearAllocHdr*) malloc(sizeof(*pHdr));
+    if (pHdr == NULL)
+        return NULL;
+
+    pHdr->curSeg = createSegment(0);
+    if (pHdr->curSeg == NULL) {
+        free(pHdr);
+        return NULL;
+    }
 
-    LOGV("LinearAlloc: created region at %p-%p\n",
-        pHdr->mapAddr, pHdr->mapAddr + pHdr->mapLength-1);
+    dvmInitMutex(&pHdr->lock);
 
     return pHdr;
 }
@@ -227,6 +356,10 @@ void dvmLinearAllocDestroy(Object* classLoader)
     return;
 #endif
     LinearAllocHdr* pHdr = getHeader(classLoader);
+    LinearAllocSeg* pSeg;
+    LinearAllocSeg* pNext;
+    int mapLength;
+
     if (pHdr == NULL)
         return;
 
@@ -234,41 +367,71 @@ void dvmLinearAllocDestroy(Object* classLoader)
 
     //dvmLinearAllocDump(classLoader);
 
-    LOGV("Unmapping linear allocator base=%p\n", pHdr->mapAddr);
+    mapLength = 0;
+    for (pSeg = pHdr->curSeg; pSeg != NULL; pSeg = pSeg->next)
+        mapLength += pSeg->mapLength;
     LOGD("LinearAlloc %p used %d of %d (%d%%)\n",
-        classLoader, pHdr->curOffset, pHdr->mapLength,
-        (pHdr->curOffset * 100) / pHdr->mapLength);
+        classLoader, dvmLinearAllocBytesUsed(classLoader), mapLength,
+        (int) ((dvmLinearAllocBytesUsed(classLoader) * 100LL) / mapLength));
 
-    if (munmap(pHdr->mapAddr, pHdr->mapLength) != 0) {
-        LOGW("LinearAlloc munmap(%p, %d) failed: %s\n",
-            pHdr->mapAddr, pHdr->mapLength, strerror(errno));
+    for (pSeg = pHdr->curSeg; pSeg != NULL; pSeg = pNext) {
+        pNext = pSeg->next;
+        LOGV("Unmapping linear allocator base=%p\n", pSeg->mapAddr);
+        destroySegment(pSeg);
     }
     free(pHdr);
 }
 
 /*
- * Allocate "size" bytes of storage, associated with a particular class
- * loader.
- *
- * It's okay for size to be zero.
- *
- * We always leave "curOffset" pointing at the next place where we will
- * store the header that precedes the returned storage.
- *
- * This aborts the VM on failure, so it's not necessary to check for a
- * NULL return value.
+ * Claim space for a "size"-byte block at the end of the newest segment,
+ * adding a segment if it's full.  On return, "*pStartOffset" is where
+ * the block header goes and "*pNextOffset" is where the next one will.
  */
-void* dvmLinearAlloc(Object* classLoader, size_t size)
+static LinearAllocSeg* reserveBlock(LinearAllocHdr* pHdr, size_t size,
+    int* pStartOffset, int* pNextOffset)
 {
-    LinearAllocHdr* pHdr = getHeader(classLoader);
-    int startOffset, nextOffset;
-    int lastGoodOff, firstWriteOff, lastWriteOff;
+    LinearAllocSeg* pSeg;
+    int startOffset;
+    size_t nextOffset;
+
+    while (true) {
+        pSeg = ATOMIC_LOAD_ACQUIRE(&pHdr->curSeg);
+        startOffset = pSeg->curOffset;
+        assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
+
+        nextOffset = nextBlockOffset(startOffset, size);
+        if (nextOffset > (size_t) pSeg->mapLength) {
+            /* full; grow the region unless somebody just did */
+            dvmLockMutex(&pHdr->lock);
+            if (pHdr->curSeg == pSeg)
+                addSegment(pHdr, size);
+            dvmUnlockMutex(&pHdr->lock);
+            continue;
+        }
 
-#ifdef DISABLE_LINEAR_ALLOC
-    return calloc(1, size);
-#endif
+        if (android_atomic_cmpxchg(startOffset, (int) nextOffset,
+                &pSeg->curOffset) == 0)
+        {
+            break;
+        }
+    }
+    LOGVV("--- old=%d size=%d new=%d\n", startOffset, size, (int) nextOffset);
 
-    LOGVV("--- LinearAlloc(%p, %d)\n", classLoader, size);
+    *pStartOffset = startOffset;
+    *pNextOffset = (int) nextOffset;
+    return pSeg;
+}
+
+/*
+ * Allocate "size" bytes with ENFORCE_READ_ONLY set.  The pages have to
+ * be mprotect()ed as allocations reach them, so this is done under the
+ * region's lock.
+ */
+static void* allocReadOnlyTracked(LinearAllocHdr* pHdr, size_t size)
+{
+    LinearAllocSeg* pSeg;
+    int startOffset, nextOffset;
+    int lastGoodOff, firstWriteOff, lastWriteOff;
 
     /*
      * What we'd like to do is just determine the new end-of-alloc size
@@ -282,64 +445,38 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
      */
     dvmLockMutex(&pHdr->lock);
 
-    startOffset = pHdr->curOffset;
-    assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
+    pSeg = pHdr->curSeg;
+    if (nextBlockOffset(pSeg->curOffset, size) > (size_t) pSeg->mapLength)
+        pSeg = addSegment(pHdr, size);
 
-    /*
-     * Compute the new offset.  The old offset points at the address where
-     * we will store the hidden block header, so we advance past that,
-     * add the size of data they want, add another header's worth so we
-     * know we have room for that, and round up to BLOCK_ALIGN.  That's
-     * the next location where we'll put user data.  We then subtract the
-     * chunk header size off so we're back to the header pointer.
-     *
-     * Examples:
-     *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
-     *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
-     */
-    nextOffset = ((startOffset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
-                    & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
+    startOffset = pSeg->curOffset;
+    nextOffset = (int) nextBlockOffset(startOffset, size);
     LOGVV("--- old=%d size=%d new=%d\n", startOffset, size, nextOffset);
 
-    if (nextOffset > pHdr->mapLength) {
-        /*
-         * We don't have to abort here.  We could fall back on the system
-         * malloc(), and have our "free" call figure out what to do.  Only
-         * works if the users of these functions actually free everything
-         * they allocate.
-         */
-        LOGE("LinearAlloc exceeded capacity, last=%d\n", (int) size);
-        dvmAbort();
-    }
-
     /*
      * Round up "size" to encompass the entire region, including the 0-7
      * pad bytes before the next chunk header.  This way we get maximum
-     * utility out of "realloc", and when we're doing ENFORCE_READ_ONLY
-     * stuff we always treat the full extent.
+     * utility out of "realloc", and we always treat the full extent.
      */
     size = nextOffset - (startOffset + HEADER_EXTRA);
     LOGVV("--- (size now %d)\n", size);
 
     /*
-     * See if we are starting on or have crossed into a new page.  If so,
-     * call mprotect on the page(s) we're about to write to.  We have to
+     * Call mprotect on the page(s) we're about to write to.  We have to
      * page-align the start address, but don't have to make the length a
-     * PAGESIZE multiple (but we do it anyway).
+     * PAGESIZE multiple (but we do it anyway).  We have to do this even
+     * if we've written to the page before, because it might be read-only.
      *
      * Note that "startOffset" is not the last *allocated* byte, but rather
      * the offset of the first *unallocated* byte (which we are about to
      * write the chunk header to).  "nextOffset" is similar.
-     *
-     * If ENFORCE_READ_ONLY is enabled, we have to call mprotect even if
-     * we've written to this page before, because it might be read-only.
      */
     lastGoodOff = (startOffset-1) & ~(PAGESIZE-1);
     firstWriteOff = startOffset & ~(PAGESIZE-1);
     lastWriteOff = (nextOffset-1) & ~(PAGESIZE-1);
     LOGVV("---  lastGood=0x%04x firstWrite=0x%04x lastWrite=0x%04x\n",
         lastGoodOff, firstWriteOff, lastWriteOff);
-    if (lastGoodOff != lastWriteOff || ENFORCE_READ_ONLY) {
+    {
         int cc, start, len;
 
         start = firstWriteOff;
@@ -347,7 +484,7 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
         len = (lastWriteOff - firstWriteOff) + PAGESIZE;
 
         LOGVV("---    calling mprotect(start=%d len=%d RW)\n", start, len);
-        cc = mprotect(pHdr->mapAddr + start, len, PROT_READ | PROT_WRITE);
+        cc = mprotect(pSeg->mapAddr + start, len, PROT_READ | PROT_WRITE);
         if (cc != 0) {
             LOGE("LinearAlloc mprotect (+%d %d) failed: %s\n",
                 start, len, strerror(errno));
@@ -357,31 +494,91 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
     }
 
     /* update the ref counts on the now-writable pages */
-    if (ENFORCE_READ_ONLY) {
+    {
         int i, start, end;
 
         start = firstWriteOff / PAGESIZE;
         end = lastWriteOff / PAGESIZE;
 
         LOGVV("---  marking pages %d-%d RW (alloc %d at %p)\n",
-            start, end, size, pHdr->mapAddr + startOffset + HEADER_EXTRA);
+            start, end, size, pSeg->mapAddr + startOffset + HEADER_EXTRA);
         for (i = start; i <= end; i++)
-            pHdr->writeRefCount[i]++;
+            pSeg->writeRefCount[i]++;
     }
 
     /* stow the size in the header */
-    if (ENFORCE_READ_ONLY)
-        *(u4*)(pHdr->mapAddr + startOffset) = size | LENGTHFLAG_RW;
-    else
-        *(u4*)(pHdr->mapAddr + startOffset) = size;
+    *(u4*)(pSeg->mapAddr + startOffset) = size | LENGTHFLAG_RW;
 
     /*
      * Update data structure.
      */
-    pHdr->curOffset = nextOffset;
+    pSeg->curOffset = nextOffset;
 
     dvmUnlockMutex(&pHdr->lock);
-    return pHdr->mapAddr + startOffset + HEADER_EXTRA;
+    return pSeg->mapAddr + startOffset + HEADER_EXTRA;
+}
+
+/*
+ * Allocate "size" bytes of storage, associated with a particular class
+ * loader.
+ *
+ * It's okay for size to be zero.
+ *
+ * Small blocks come out of the calling thread's current chunk (which,
+ * like everything else for now, belongs to the bootstrap loader's
+ * region).  Big ones, and any from threads the VM doesn't know about,
+ * are claimed from the region directly.
+ *
+ * This aborts the VM on failure, so it's not necessary to check for a
+ * NULL return value.
+ */
+void* dvmLinearAlloc(Object* classLoader, size_t size)
+{
+    LinearAllocHdr* pHdr = getHeader(classLoader);
+    LinearAllocSeg* pSeg;
+    Thread* self;
+    int startOffset, nextOffset;
+
+#ifdef DISABLE_LINEAR_ALLOC
+    return calloc(1, size);
+#endif
+
+    LOGVV("--- LinearAlloc(%p, %d)\n", classLoader, size);
+
+    if (ENFORCE_READ_ONLY)
+        return allocReadOnlyTracked(pHdr, size);
+
+    self = dvmThreadSelf();
+    if (self == NULL || size > CHUNK_MAX_ALLOC) {
+        pSeg = reserveBlock(pHdr, size, &startOffset, &nextOffset);
+    } else {
+        pSeg = self->linearAllocSeg;
+        startOffset = self->linearAllocOffset;
+        if (pSeg == NULL || nextBlockOffset(startOffset, size) >
+                (size_t) self->linearAllocEnd)
+        {
+            /* start a new chunk; what's left of the old one stays zeroed */
+            pSeg = reserveBlock(pHdr, CHUNK_SIZE - HEADER_EXTRA*2,
+                    &startOffset, &self->linearAllocEnd);
+            self->linearAllocSeg = pSeg;
+        }
+        nextOffset = (int) nextBlockOffset(startOffset, size);
+        assert(nextOffset <= self->linearAllocEnd);
+        self->linearAllocOffset = nextOffset;
+    }
+
+    /*
+     * Round up "size" to encompass the entire region, including the 0-7
+     * pad bytes before the next chunk header.  This way we get maximum
+     * utility out of "realloc".
+     */
+    size = nextOffset - (startOffset + HEADER_EXTRA);
+    LOGVV("--- (size now %d)\n", size);
+
+    /* stow the size in the header */
+    *(u4*)(pSeg->mapAddr + startOffset) = size;
+
+    return pSeg->mapAddr + startOffset + HEADER_EXTRA;
 }
 
 /*
@@ -418,8 +615,7 @@ void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize)
 
     /* make sure we have the right region (and mem != NULL) */
     assert(mem != NULL);
-    assert(mem >= (void*) pHdr->mapAddr &&
-           mem < (void*) (pHdr->mapAddr + pHdr->curOffset));
+    assert(findSegment(pHdr, mem) != NULL);
 
     const u4* pLen = getBlockHeader(mem);
     LOGV("--- LinearRealloc(%d) old=%d\n", newSize, *pLen);
@@ -451,15 +647,15 @@ static void updatePages(Object* classLoader, void* mem, int direction)
     dvmLockMutex(&pHdr->lock);
 
     /* make sure we have the right region */
-    assert(mem >= (void*) pHdr->mapAddr &&
-           mem < (void*) (pHdr->mapAddr + pHdr->curOffset));
+    LinearAllocSeg* pSeg = findSegment(pHdr, mem);
+    assert(pSeg != NULL);
 
     u4* pLen = getBlockHeader(mem);
     u4 len = *pLen & LENGTHFLAG_MASK;
     int firstPage, lastPage;
 
-    firstPage = ((u1*)pLen - (u1*)pHdr->mapAddr) / PAGESIZE;
-    lastPage = ((u1*)mem - (u1*)pHdr->mapAddr + (len-1)) / PAGESIZE;
+    firstPage = ((u1*)pLen - (u1*)pSeg->mapAddr) / PAGESIZE;
+    lastPage = ((u1*)mem - (u1*)pSeg->mapAddr + (len-1)) / PAGESIZE;
     LOGVV("--- updating pages %d-%d (%d)\n", firstPage, lastPage, direction);
 
     int i, cc;
@@ -482,31 +678,31 @@ static void updatePages(Object* classLoader, void* mem, int direction)
                     *pLen &= ~LENGTHFLAG_RW;
             }
 
-            if (pHdr->writeRefCount[i] == 0) {
+            if (pSeg->writeRefCount[i] == 0) {
                 LOGE("Can't make page %d any less writable\n", i);
                 dvmAbort();
             }
-            pHdr->writeRefCount[i]--;
-            if (pHdr->writeRefCount[i] == 0) {
+            pSeg->writeRefCount[i]--;
+            if (pSeg->writeRefCount[i] == 0) {
                 LOGVV("---  prot page %d RO\n", i);
-                cc = mprotect(pHdr->mapAddr + PAGESIZE * i, PAGESIZE, PROT_READ);
+                cc = mprotect(pSeg->mapAddr + PAGESIZE * i, PAGESIZE, PROT_READ);
                 assert(cc == 0);
             }
         } else {
             /*
              * Trying to mark writable.
              */
-            if (pHdr->writeRefCount[i] >= 32767) {
+            if (pSeg->writeRefCount[i] >= 32767) {
                 LOGE("Can't make page %d any more writable\n", i);
                 dvmAbort();
             }
-            if (pHdr->writeRefCount[i] == 0) {
+            if (pSeg->writeRefCount[i] == 0) {
                 LOGVV("---  prot page %d RW\n", i);
-                cc = mprotect(pHdr->mapAddr + PAGESIZE * i, PAGESIZE,
+                cc = mprotect(pSeg->mapAddr + PAGESIZE * i, PAGESIZE,
                         PROT_READ | PROT_WRITE);
                 assert(cc == 0);
             }
-            pHdr->writeRefCount[i]++;
+            pSeg->writeRefCount[i]++;
 
             if (i == firstPage) {
                 if ((*pLen & LENGTHFLAG_RW) != 0) {
@@ -567,8 +763,7 @@ void dvmLinearFree(Object* classLoader, void* mem)
     LinearAllocHdr* pHdr = getHeader(classLoader);
 
     /* make sure we have the right region */
-    assert(mem >= (void*) pHdr->mapAddr &&
-           mem < (void*) (pHdr->mapAddr + pHdr->curOffset));
+    assert(findSegment(pHdr, mem) != NULL);
 
     if (ENFORCE_READ_ONLY)
         dvmLinearSetReadWrite(classLoader, mem);
@@ -583,8 +778,9 @@ void dvmLinearFree(Object* classLoader, void* mem)
 /*
  * For debugging, dump the contents of a linear alloc area.
  *
- * We grab the lock so that the header contents and list output are
- * consistent.
+ * We grab the lock so that the segment list doesn't change under us.
+ * Threads can still be allocating, so the last few blocks may show up
+ * with a zero length.
  */
 void dvmLinearAllocDump(Object* classLoader)
 {
@@ -592,61 +788,89 @@ void dvmLinearAllocDump(Object* classLoader)
     return;
 #endif
     LinearAllocHdr* pHdr = getHeader(classLoader);
+    LinearAllocSeg* pSeg;
+    int mapLength = 0;
 
     dvmLockMutex(&pHdr->lock);
 
     LOGI("LinearAlloc classLoader=%p\n", classLoader);
-    LOGI("  mapAddr=%p mapLength=%d firstOffset=%d\n",
-        pHdr->mapAddr, pHdr->mapLength, pHdr->firstOffset);
-    LOGI("  curOffset=%d\n", pHdr->curOffset);
 
-    int off = pHdr->firstOffset;
-    u4 rawLen, fullLen;
+    for (pSeg = pHdr->curSeg; pSeg != NULL; pSeg = pSeg->next) {
+        LOGI(" segment mapAddr=%p mapLength=%d firstOffset=%d\n",
+            pSeg->mapAddr, pSeg->mapLength, pSeg->firstOffset);
+        LOGI("  curOffset=%d\n", pSeg->curOffset);
+        mapLength += pSeg->mapLength;
+
+        int off = pSeg->firstOffset;
+        u4 rawLen, fullLen;
+
+        while (off < pSeg->curOffset) {
+            rawLen = *(u4*) (pSeg->mapAddr + off);
+            if (rawLen == 0) {
+                /* never handed out */
+                off += BLOCK_ALIGN;
+                continue;
+            }
+            fullLen = ((HEADER_EXTRA*2 + (rawLen & LENGTHFLAG_MASK))
+                        & ~(BLOCK_ALIGN-1));
 
-    while (off < pHdr->curOffset) {
-        rawLen = *(u4*) (pHdr->mapAddr + off);
-        fullLen = ((HEADER_EXTRA*2 + (rawLen & LENGTHFLAG_MASK))
-                    & ~(BLOCK_ALIGN-1));
+            LOGI("  %p (%3d): %clen=%d%s\n", pSeg->mapAddr + off + HEADER_EXTRA,
+                (int) ((off + HEADER_EXTRA) / PAGESIZE),
+                (rawLen & LENGTHFLAG_FREE) != 0 ? '*' : ' ',
+                rawLen & LENGTHFLAG_MASK,
+                (rawLen & LENGTHFLAG_RW) != 0 ? " [RW]" : "");
 
-        LOGI("  %p (%3d): %clen=%d%s\n", pHdr->mapAddr + off + HEADER_EXTRA,
-            (int) ((off + HEADER_EXTRA) / PAGESIZE),
-            (rawLen & LENGTHFLAG_FREE) != 0 ? '*' : ' ',
-            rawLen & LENGTHFLAG_MASK,
-            (rawLen & LENGTHFLAG_RW) != 0 ? " [RW]" : "");
+            off += fullLen;
+        }
 
-        off += fullLen;
-    }
+        if (ENFORCE_READ_ONLY) {
+            LOGI("writeRefCount map:\n");
 
-    if (ENFORCE_READ_ONLY) {
-        LOGI("writeRefCount map:\n");
-
-        int numPages = (pHdr->mapLength+PAGESIZE-1) / PAGESIZE;
-        int zstart = 0;
-        int i;
-
-        for (i = 0; i < numPages; i++) {
-            int count = pHdr->writeRefCount[i];
-
-            if (count != 0) {
-                if (zstart < i-1)
-                    printf(" %d-%d: zero\n", zstart, i-1);
-                else if (zstart == i-1)
-                    printf(" %d: zero\n", zstart);
-                zstart = i+1;
-                printf(" %d: %d\n", i, count);
+            int numPages = (pSeg->mapLength+PAGESIZE-1) / PAGESIZE;
+            int zstart = 0;
+            int i;
+
+            for (i = 0; i < numPages; i++) {
+                int count = pSeg->writeRefCount[i];
+
+                if (count != 0) {
+                    if (zstart < i-1)
+                        printf(" %d-%d: zero\n", zstart, i-1);
+                    else if (zstart == i-1)
+                        printf(" %d: zero\n", zstart);
+                    zstart = i+1;
+                    printf(" %d: %d\n", i, count);
+                }
             }
+            if (zstart < i)
+                printf(" %d-%d: zero\n", zstart, i-1);
         }
-        if (zstart < i)
-            printf(" %d-%d: zero\n", zstart, i-1);
     }
 
     LOGD("LinearAlloc %p using %d of %d (%d%%)\n",
-        classLoader, pHdr->curOffset, pHdr->mapLength,
-        (pHdr->curOffset * 100) / pHdr->mapLength);
+        classLoader, dvmLinearAllocBytesUsed(classLoader), mapLength,
+        (int) ((dvmLinearAllocBytesUsed(classLoader) * 100LL) / mapLength));
 
     dvmUnlockMutex(&pHdr->lock);
 }
 
+/*
+ * Get the number of bytes claimed from the region so far.
+ */
+int dvmLinearAllocBytesUsed(Object* classLoader)
+{
+#ifdef DISABLE_LINEAR_ALLOC
+    return 0;
+#endif
+    LinearAllocHdr* pHdr = getHeader(classLoader);
+    LinearAllocSeg* pSeg;
+    int used = 0;
+
+    for (pSeg = pHdr->curSeg; pSeg != NULL; pSeg = pSeg->next)
+        used += pSeg->curOffset - pSeg->firstOffset;
+    return used;
+}
+
 /*
  * Verify that all blocks are freed.
  *
@@ -659,23 +883,32 @@ static void checkAllFree(Object* classLoader)
     return;
 #endif
     LinearAllocHdr* pHdr = getHeader(classLoader);
+    LinearAllocSeg* pSeg;
 
     dvmLockMutex(&pHdr->lock);
 
-    int off = pHdr->firstOffset;
-    u4 rawLen, fullLen;
+    for (pSeg = pHdr->curSeg; pSeg != NULL; pSeg = pSeg->next) {
+        int off = pSeg->firstOffset;
+        u4 rawLen, fullLen;
 
-    while (off < pHdr->curOffset) {
-        rawLen = *(u4*) (pHdr->mapAddr + off);
-        fullLen = ((HEADER_EXTRA*2 + (rawLen & LENGTHFLAG_MASK))
-                    & ~(BLOCK_ALIGN-1));
+        while (off < pSeg->curOffset) {
+            rawLen = *(u4*) (pSeg->mapAddr + off);
+            if (rawLen == 0) {
+                /* never handed out */
+                off += BLOCK_ALIGN;
+                continue;
+            }
+            fullLen = ((HEADER_EXTRA*2 + (rawLen & LENGTHFLAG_MASK))
+                        & ~(BLOCK_ALIGN-1));
 
-        if ((rawLen & LENGTHFLAG_FREE) == 0) {
-            LOGW("LinearAlloc %p not freed: %p len=%d\n", classLoader,
-                pHdr->mapAddr + off + HEADER_EXTRA, rawLen & LENGTHFLAG_MASK);
-        }
+            if ((rawLen & LENGTHFLAG_FREE) == 0) {
+                LOGW("LinearAlloc %p not freed: %p len=%d\n", classLoader,
+                    pSeg->mapAddr + off + HEADER_EXTRA,
+                    rawLen & LENGTHFLAG_MASK);
+            }
 
-        off += fullLen;
+            off += fullLen;
+        }
     }
 
     dvmUnlockMutex(&pHdr->lock);
@@ -27,21 +27,32 @@
 #define ENFORCE_READ_ONLY   false
 
 /*
- * Linear allocation state.  We could tuck this into the start of the
- * allocated region, but that would prevent us from sharing the rest of
- * that first page.
+ * One mmap()ed segment of a linear allocation region.  A region starts
+ * with one segment and gets another each time the newest one fills up.
  */
-typedef struct LinearAllocHdr {
-    int     curOffset;          /* offset where next data goes */
-    pthread_mutex_t lock;       /* controls updates to this struct */
+typedef struct LinearAllocSeg {
+    struct LinearAllocSeg* next;    /* next-older segment */
 
+    volatile int curOffset;     /* offset where next data goes */
     char*   mapAddr;            /* start of mmap()ed region */
     int     mapLength;          /* length of region */
     int     firstOffset;        /* for chasing through */
 
     short*  writeRefCount;      /* for ENFORCE_READ_ONLY */
-} LinearAllocHdr;
+} LinearAllocSeg;
 
+/*
+ * Linear allocation state.  We could tuck this into the start of the
+ * allocated region, but that would prevent us from sharing the rest of
+ * that first page.
+ *
+ * Allocations bump "curSeg->curOffset" with a compare-and-swap; the lock
+ * is only taken to add a segment (and for ENFORCE_READ_ONLY bookkeeping).
+ */
+typedef struct LinearAllocHdr {
+    LinearAllocSeg* volatile curSeg;    /* newest segment */
+    pthread_mutex_t lock;       /* controls adding segments */
+} LinearAllocHdr;
 
 /*
  * Create a new alloc region.
@@ -112,4 +123,10 @@ char* dvmLinearStrdup(Object* classLoader, const char* str);
  */
 void dvmLinearAllocDump(Object* classLoader);
 
+/*
+ * Get the number of bytes handed out from a region, including the
+ * unused parts of threads' chunks.
+ */
+int dvmLinearAllocBytesUsed(Object* classLoader);
+
 #endif /*_DALVIK_LINEARALLOC*/
@@ -211,15 +211,18 @@ static SharedLib* findSharedLibEntry(const char* pathName)
 static SharedLib* addSharedLibEntry(SharedLib* pLib)
 {
     u4 hash = dvmComputeUtf8Hash(pLib->pathName);
-    void* ent;
+    SharedLib* ent;
 
     /*
      * Do the lookup with the "add" flag set.  If we add it, we will get
      * our own pointer back.  If somebody beat us to the punch, we'll get
      * their pointer back instead.
      */
-    return dvmHashTableLookup(gDvm.nativeLibs, hash, pLib, hashcmpSharedLib,
+    dvmHashTableLock(gDvm.nativeLibs);
+    ent = dvmHashTableLookup(gDvm.nativeLibs, hash, pLib, hashcmpSharedLib,
                 true);
+    dvmHashTableUnlock(gDvm.nativeLibs);
+    return ent;
 }
 
 /*
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Parallel class preloading at startup.
+ *
+ * Worker threads take class names off a shared list and run them through
+ * the ordinary find-class path, then verify them.  Everything that makes
+ * that safe from several threads at once is already there for demand
+ * loading: a class is published in the loaded-class table before it's
+ * linked, other threads that find it wait on the class's monitor until
+ * linking finishes, and verification is done under the same monitor
+ * that dvmInitClass takes.  Nothing here runs <clinit>.
+ */
+#include "Dalvik.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* upper bound on worker threads, whatever the CPU count */
+#define PRELOAD_MAX_THREADS 16
+
+typedef struct PreloadState {
+    char**          descriptors;
+    int             numDescriptors;
+
+    volatile int    nextIndex;      /* next entry to claim */
+    volatile int    numFailed;
+} PreloadState;
+
+/*
+ * Read the class list into "state->descriptors".
+ */
+static bool readClassList(const char* fileName, PreloadState* state)
+{
+    FILE* fp;
+    char line[512];
+    int capacity = 0;
+
+    fp = fopen(fileName, "r");
+    if (fp == NULL) {
+        LOGW("Unable to open preloaded-classes file '%s': %s\n",
+            fileName, strerror(errno));
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* start = line;
+        char* end = line + strlen(line);
+        char* descriptor;
+
+        while (isspace((unsigned char) *start))
+            start++;
+        while (end > start && isspace((unsigned char) end[-1]))
+            end--;
+        *end = '\0';
+        if (*start == '\0' || *start == '#')
+            continue;
+
+        if (*start == 'L' && end[-1] == ';' && strchr(start, '.') == NULL)
+            descriptor = strdup(start);
+        else
+            descriptor = dvmDotToDescriptor(start);
+        if (descriptor == NULL)
+            break;
+
+        if (state->numDescriptors == capacity) {
+            char** newList;
+
+            capacity = (capacity == 0) ? 256 : capacity * 2;
+            newList = (char**) realloc(state->descriptors,
+                        capacity * sizeof(char*));
+            if (newList == NULL) {
+                free(descriptor);
+                break;
+            }
+            state->descriptors = newList;
+        }
+        state->descriptors[state->numDescriptors++] = descriptor;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Load, link and verify classes until the list runs out.  Runs in the
+ * worker threads and in the thread that started them.
+ */
+static void* preloadThreadStart(void* arg)
+{
+    PreloadState* state = (PreloadState*) arg;
+    Thread* self = dvmThreadSelf();
+
+    while (true) {
+        int index = android_atomic_inc(&state->nextIndex);
+        const char* descriptor;
+        ClassObject* clazz;
+
+        if (index >= state->numDescriptors)
+            break;
+        descriptor = state->descriptors[index];
+
+        clazz = dvmFindClassNoInit(descriptor, NULL);
+        if (clazz == NULL || !dvmEnsureClassVerified(clazz)) {
+            LOGV("Preload of %s failed\n", descriptor);
+            dvmClearException(self);
+            android_atomic_inc(&state->numFailed);
+        }
+
+        /* let the GC in between classes */
+        dvmCheckSuspendPending(self);
+    }
+
+    return NULL;
+}
+
+/*
+ * Preload the classes listed in "fileName".
+ */
+bool dvmPreloadClasses(const char* fileName, int numThreads)
+{
+    Thread* self = dvmThreadSelf();
+    PreloadState state;
+    pthread_t* handles;
+    int numStarted, oldStatus, i;
+    u8 startWhen;
+
+    memset(&state, 0, sizeof(state));
+    if (!readClassList(fileName, &state))
+        return false;
+
+    startWhen = dvmGetRelativeTimeUsec();
+
+    if (numThreads == 0)
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > PRELOAD_MAX_THREADS)
+        numThreads = PRELOAD_MAX_THREADS;
+    if (numThreads > state.numDescriptors)
+        numThreads = state.numDescriptors;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    /*
+     * We count as one of the workers, so start one fewer threads.  If
+     * some can't be started, the rest of us pick up the slack.
+     */
+    handles = (pthread_t*) malloc(numThreads * sizeof(pthread_t));
+    numStarted = 0;
+    if (handles != NULL) {
+        for (i = 0; i < numThreads - 1; i++) {
+            char name[32];
+
+            snprintf(name, sizeof(name), "Class Preloader %d", i + 1);
+            if (!dvmCreateInternalThread(&handles[numStarted], name,
+                    preloadThreadStart, &state))
+            {
+                LOGW("Unable to start class preloader thread\n");
+                break;
+            }
+            numStarted++;
+        }
+    }
+
+    preloadThreadStart(&state);
+
+    /* the others may still be busy; don't hold up a GC while we wait */
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    for (i = 0; i < numStarted; i++)
+        pthread_join(handles[i], NULL);
+    dvmChangeStatus(self, oldStatus);
+
+    LOGD("Preloaded %d classes (%d failed) with %d threads in %dms\n",
+        state.numDescriptors - state.numFailed, state.numFailed,
+        numStarted + 1,
+        (int) ((dvmGetRelativeTimeUsec() - startWhen) / 1000));
+
+    free(handles);
+    for (i = 0; i < state.numDescriptors; i++)
+        free(state.descriptors[i]);
+    free(state.descriptors);
+
+    return true;
+}
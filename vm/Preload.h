@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Parallel class preloading at startup.
+ */
+#ifndef _DALVIK_PRELOAD
+#define _DALVIK_PRELOAD
+
+/*
+ * Load, link and verify every class named in "fileName" with a pool of
+ * "numThreads" worker threads (0 means one per online CPU), and wait for
+ * them to finish.  Classes are not initialized.
+ *
+ * The file has one class name per line, in either "java.lang.String" or
+ * "Ljava/lang/String;" form.  Blank lines and lines starting with '#'
+ * are ignored.
+ *
+ * Classes that can't be loaded are skipped; they'll fail again, with the
+ * usual exception, when something actually uses them.  Returns false
+ * only if the file can't be read.
+ */
+bool dvmPreloadClasses(const char* fileName, int numThreads);
+
+#endif /*_DALVIK_PRELOAD*/
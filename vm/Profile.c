@@ -50,17 +50,22 @@
  *  u2  version
  *  u2  offset to data
  *  u8  start date/time in usec
+ *  u2  record size in bytes
  *
  * Record format:
- *  u1  thread ID
- *  u4  method ID | method action
+ *  u2  thread ID
+ *  u8  method ID | method action
  *  u4  time delta since start, in usec
  *
- * 32 bits of microseconds is 70 minutes.
+ * The method ID is the full Method pointer.  32 bits of microseconds
+ * is 70 minutes.
  *
  * All values are stored in little-endian order.
+ *
+ * Records from different threads are interleaved a chunk at a time, not
+ * by time; each thread's records are in order.
  */
-#define TRACE_REC_SIZE      9
+#define TRACE_REC_SIZE      14
 #define TRACE_MAGIC         0x574f4c53
 #define TRACE_HEADER_LEN    32
 
@@ -120,6 +125,12 @@ static inline void storeIntLE(u1* buf, u4 val)
     *buf++ = (u1) (val >> 16);
     *buf++ = (u1) (val >> 24);
 }
+static inline u8 loadLongLE(const u1* buf)
+{
+    return (u8) buf[0] | ((u8) buf[1] << 8) | ((u8) buf[2] << 16) |
+        ((u8) buf[3] << 24) | ((u8) buf[4] << 32) | ((u8) buf[5] << 40) |
+        ((u8) buf[6] << 48) | ((u8) buf[7] << 56);
+}
 static inline void storeLongLE(u1* buf, u8 val)
 {
     *buf++ = (u1) val;
@@ -141,8 +152,13 @@ bool dvmProfilingStartup(void)
      * Initialize "dmtrace" method profiling.
      */
     memset(&gDvm.methodTrace, 0, sizeof(gDvm.methodTrace));
+    memset(&gDvm.sampleProf, 0, sizeof(gDvm.sampleProf));
     dvmInitMutex(&gDvm.methodTrace.startStopLock);
     pthread_cond_init(&gDvm.methodTrace.threadExitCond, NULL);
+    dvmInitMutex(&gDvm.methodTrace.writerLock);
+    dvmInitMutex(&gDvm.sampleProf.lock);
+    pthread_cond_init(&gDvm.methodTrace.writerCond, NULL);
+    pthread_cond_init(&gDvm.methodTrace.drainedCond, NULL);
 
     ClassObject* clazz =
         dvmFindClassNoInit("Ldalvik/system/VMDebug;", NULL);
@@ -203,6 +219,7 @@ bool dvmProfilingStartup(void)
  */
 void dvmProfilingShutdown(void)
 {
+    dvmSampleProfStop();
 #ifdef UPDATE_MAGIC_PAGE
     if (gDvm.emulatorTracePage != NULL)
         munmap(gDvm.emulatorTracePage, PAGESIZE);
@@ -314,9 +331,173 @@ static int dumpMarkedMethods(void* vclazz, void* vfp)
  */
 static void dumpMethodList(FILE* fp)
 {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashForeach(gDvm.loadedClasses, dumpMarkedMethods, (void*) fp);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    dvmForeachLoadedClass(dumpMarkedMethods, (void*) fp);
+    dvmUnlockLoadedClasses();
+}
+
+/*
+ * Take startStopLock.  dvmMethodTraceStop() suspends all threads while
+ * holding it, so we mustn't be running while we wait for it.
+ */
+static void lockStartStop(MethodTraceState* state)
+{
+    Thread* self = dvmThreadSelf();
+    ThreadStatus oldStatus;
+
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&state->startStopLock);
+    dvmChangeStatus(self, oldStatus);
+}
+
+/*
+ * Put "chunk" on the writer's queue.  Call with writerLock held.
+ */
+static void queueTraceChunk(MethodTraceState* state, MethodTraceChunk* chunk)
+{
+    chunk->next = NULL;
+    if (state->lastFullChunk == NULL)
+        state->fullChunks = chunk;
+    else
+        state->lastFullChunk->next = chunk;
+    state->lastFullChunk = chunk;
+    pthread_cond_signal(&state->writerCond);
+}
+
+/*
+ * Hand "thread"'s partial chunk, if it has one, to the writer.  Call with
+ * writerLock held.
+ */
+static void retireTraceChunk(MethodTraceState* state, Thread* thread)
+{
+    if (thread->traceChunk != NULL) {
+        queueTraceChunk(state, thread->traceChunk);
+        thread->traceChunk = NULL;
+    }
+}
+
+/*
+ * Hand self's current chunk (if any) to the writer and get an empty one.
+ *
+ * Returns NULL if the chunks we already have add up to the trace's
+ * buffer size, i.e. the writer isn't keeping up, or if malloc fails.
+ * The caller drops the record.
+ */
+static MethodTraceChunk* swapTraceChunk(MethodTraceState* state, Thread* self)
+{
+    MethodTraceChunk* chunk;
+
+    dvmLockMutex(&state->writerLock);
+    retireTraceChunk(state, self);
+
+    chunk = state->freeChunks;
+    if (chunk != NULL) {
+        state->freeChunks = chunk->next;
+    } else if (state->chunkBytes + (int) sizeof(MethodTraceChunk) <=
+               state->bufferSize)
+    {
+        chunk = (MethodTraceChunk*) malloc(sizeof(MethodTraceChunk));
+        if (chunk != NULL)
+            state->chunkBytes += sizeof(MethodTraceChunk);
+    }
+    if (chunk != NULL)
+        chunk->used = 0;
+    self->traceChunk = chunk;
+    dvmUnlockMutex(&state->writerLock);
+
+    return chunk;
+}
+
+/*
+ * The trace writer thread.  Waits for full chunks and appends them to the
+ * trace's data file, then puts them on the free list.
+ *
+ * It's started by the first dvmMethodTraceStart() and sticks around
+ * after that, idle between traces.
+ */
+static void* traceWriterThreadStart(void* arg)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+    MethodTraceChunk* chunks;
+    MethodTraceChunk* chunk;
+    MethodTraceChunk* last;
+
+    UNUSED_PARAMETER(arg);
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+    dvmLockMutex(&state->writerLock);
+    while (true) {
+        while (state->fullChunks == NULL) {
+            int cc = pthread_cond_wait(&state->writerCond, &state->writerLock);
+            assert(cc == 0);
+        }
+
+        chunks = state->fullChunks;
+        state->fullChunks = state->lastFullChunk = NULL;
+        state->writerBusy = true;
+        dvmUnlockMutex(&state->writerLock);
+
+        /* the file stays open until the queue drains; see dvmMethodTraceStop */
+        last = NULL;
+        for (chunk = chunks; chunk != NULL; chunk = chunk->next) {
+            if (!state->writeFailed && chunk->used > 0) {
+                if (fwrite(chunk->data, chunk->used, 1, state->dataFile) != 1) {
+                    LOGE("trace data write failed, errno=%d\n", errno);
+                    state->writeFailed = true;
+                } else {
+                    state->bytesWritten += chunk->used;
+                }
+            }
+            last = chunk;
+        }
+
+        dvmLockMutex(&state->writerLock);
+        last->next = state->freeChunks;
+        state->freeChunks = chunks;
+        state->writerBusy = false;
+        if (state->fullChunks == NULL)
+            pthread_cond_broadcast(&state->drainedCond);
+    }
+
+    return NULL;
+}
+
+/*
+ * Take every live thread's partial chunk, wait until the writer has
+ * written everything, and free the chunks.  Threads that exited during
+ * the trace handed theirs over in dvmMethodTraceThreadExit().  Tracing
+ * must be disabled and the other threads suspended or otherwise unable
+ * to add records.
+ */
+static void flushTraceChunks(MethodTraceState* state)
+{
+    Thread* self = dvmThreadSelf();
+    Thread* thread;
+    MethodTraceChunk* chunk;
+    ThreadStatus oldStatus;
+
+    dvmLockThreadList(self);
+    dvmLockMutex(&state->writerLock);
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next)
+        retireTraceChunk(state, thread);
+    dvmUnlockMutex(&state->writerLock);
+    dvmUnlockThreadList();
+
+    /* the writer can take a while; don't hold up a GC */
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&state->writerLock);
+    while (state->fullChunks != NULL || state->writerBusy) {
+        int cc = pthread_cond_wait(&state->drainedCond, &state->writerLock);
+        assert(cc == 0);
+    }
+    while (state->freeChunks != NULL) {
+        chunk = state->freeChunks;
+        state->freeChunks = chunk->next;
+        free(chunk);
+    }
+    state->chunkBytes = 0;
+    dvmUnlockMutex(&state->writerLock);
+    dvmChangeStatus(self, oldStatus);
 }
 
 /*
@@ -340,17 +521,27 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
     updateActiveProfilers(1);
     LOGI("TRACE STARTED: '%s' %dKB\n",
         traceFileName, bufferSize / 1024);
-    dvmLockMutex(&state->startStopLock);
+    lockStartStop(state);
 
     /*
-     * Allocate storage and open files.
-     *
-     * We don't need to initialize the buffer, but doing so might remove
-     * some fault overhead if the pages aren't mapped until touched.
+     * Start the writer thread if we haven't yet, and open files.  The
+     * records are streamed to an anonymous temporary file while we run,
+     * because they go after the key, which we can't write until the end.
      */
-    state->buf = (u1*) malloc(bufferSize);
-    if (state->buf == NULL) {
-        dvmThrowException("Ljava/lang/InternalError;", "buffer alloc failed");
+    if (!state->hasWriter) {
+        if (!dvmCreateInternalThread(&state->writerHandle,
+                "Method trace writer", traceWriterThreadStart, NULL))
+        {
+            dvmThrowException("Ljava/lang/InternalError;",
+                "writer thread start failed");
+            goto fail;
+        }
+        state->hasWriter = true;
+    }
+    state->dataFile = tmpfile();
+    if (state->dataFile == NULL) {
+        LOGE("Unable to create trace data file: %s\n", strerror(errno));
+        dvmThrowException("Ljava/lang/RuntimeException;", "file open failed");
         goto fail;
     }
     if (traceFd < 0) {
@@ -364,10 +555,11 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
         dvmThrowException("Ljava/lang/RuntimeException;", "file open failed");
         goto fail;
     }
-    memset(state->buf, 0xee, bufferSize);
 
     state->bufferSize = bufferSize;
     state->overflow = false;
+    state->writeFailed = false;
+    state->bytesWritten = 0;
 
     /*
      * Enable alloc counts if we've been requested to do so.
@@ -381,16 +573,6 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
 
     state->startWhen = getTimeInUsec();
 
-    /*
-     * Output the header.
-     */
-    memset(state->buf, 0, TRACE_HEADER_LEN);
-    storeIntLE(state->buf + 0, TRACE_MAGIC);
-    storeShortLE(state->buf + 4, TRACE_VERSION);
-    storeShortLE(state->buf + 6, TRACE_HEADER_LEN);
-    storeLongLE(state->buf + 8, state->startWhen);
-    state->curOffset = TRACE_HEADER_LEN;
-
     MEM_BARRIER();
 
     /*
@@ -407,34 +589,62 @@ fail:
         fclose(state->traceFile);
         state->traceFile = NULL;
     }
-    if (state->buf != NULL) {
-        free(state->buf);
-        state->buf = NULL;
+    if (state->dataFile != NULL) {
+        fclose(state->dataFile);
+        state->dataFile = NULL;
     }
     dvmUnlockMutex(&state->startStopLock);
 }
 
 /*
- * Run through the data buffer and pull out the methods that were visited.
+ * Run through the data file and pull out the methods that were visited.
  * Set a mark so that we know which ones to output.
  */
-static void markTouchedMethods(void)
+static void markTouchedMethods(FILE* dataFile)
 {
-    u1* ptr = gDvm.methodTrace.buf + TRACE_HEADER_LEN;
-    u1* end = gDvm.methodTrace.buf + gDvm.methodTrace.curOffset;
-    unsigned int methodVal;
+    u1 buf[TRACE_REC_SIZE * 1024];
+    size_t count, i;
+    u8 methodVal;
     Method* method;
 
-    while (ptr < end) {
-        methodVal = *(ptr+1) | (*(ptr+2) << 8) | (*(ptr+3) << 16)
-                    | (*(ptr+4) << 24);
-        method = (Method*) METHOD_ID(methodVal);
+    rewind(dataFile);
+    while ((count = fread(buf, TRACE_REC_SIZE, 1024, dataFile)) > 0) {
+        for (i = 0; i < count; i++) {
+            methodVal = loadLongLE(buf + i * TRACE_REC_SIZE + 2);
+            method = (Method*) (uintptr_t) METHOD_ID(methodVal);
 
-        method->inProfile = true;
-        ptr += TRACE_REC_SIZE;
+            method->inProfile = true;
+        }
     }
 }
 
+/*
+ * Append the header and the contents of the data file to the trace file.
+ *
+ * Returns false on failure.
+ */
+static bool copyTraceData(FILE* traceFile, FILE* dataFile, u8 startWhen)
+{
+    u1 buf[8192];
+    size_t count;
+
+    memset(buf, 0, TRACE_HEADER_LEN);
+    storeIntLE(buf + 0, TRACE_MAGIC);
+    storeShortLE(buf + 4, TRACE_VERSION);
+    storeShortLE(buf + 6, TRACE_HEADER_LEN);
+    storeLongLE(buf + 8, startWhen);
+    storeShortLE(buf + 16, TRACE_REC_SIZE);
+    if (fwrite(buf, TRACE_HEADER_LEN, 1, traceFile) != 1)
+        return false;
+
+    rewind(dataFile);
+    while ((count = fread(buf, 1, sizeof(buf), dataFile)) > 0) {
+        if (fwrite(buf, count, 1, traceFile) != 1)
+            return false;
+    }
+    return !ferror(dataFile);
+}
+
 /*
  * Compute the amount of overhead in a clock call, in nsec.
  *
@@ -479,12 +689,13 @@ void dvmMethodTraceStop(void)
 {
     MethodTraceState* state = &gDvm.methodTrace;
     u8 elapsed;
+    int numRecords;
 
     /*
      * We need this to prevent somebody from starting a new trace while
      * we're in the process of stopping the old.
      */
-    dvmLockMutex(&state->startStopLock);
+    lockStartStop(state);
 
     if (!state->traceEnabled) {
         /* somebody already stopped it, or it was never started */
@@ -499,22 +710,24 @@ void dvmMethodTraceStop(void)
     elapsed = getTimeInUsec() - state->startWhen;
 
     /*
-     * Globally disable it, and allow other threads to notice.  We want
-     * to stall here for at least as long as dvmMethodTraceAdd needs
-     * to finish.  There's no real risk though -- it will take a while to
-     * write the data to disk, and we don't clear the buffer pointer until
-     * after that completes.
+     * Globally disable it.  Threads only add records while they're
+     * running, so once everybody is suspended nobody is in the middle
+     * of dvmMethodTraceAdd, and nobody will start another.
      */
+    dvmSuspendAllThreads(SUSPEND_FOR_DEBUG);
     state->traceEnabled = false;
     MEM_BARRIER();
-    sched_yield();
+    dvmResumeAllThreads(SUSPEND_FOR_DEBUG);
+
+    flushTraceChunks(state);
+    numRecords = (int) (state->bytesWritten / TRACE_REC_SIZE);
 
     if ((state->flags & TRACE_ALLOC_COUNTS) != 0)
         dvmStopAllocCounting();
 
     LOGI("TRACE STOPPED%s: writing %d records\n",
         state->overflow ? " (NOTE: overflowed buffer)" : "",
-        (state->curOffset - TRACE_HEADER_LEN) / TRACE_REC_SIZE);
+        numRecords);
     if (gDvm.debuggerActive) {
         LOGW("WARNING: a debugger is active; method-tracing results "
              "will be skewed\n");
@@ -525,7 +738,7 @@ void dvmMethodTraceStop(void)
      */
     u4 clockNsec = getClockOverhead();
 
-    markTouchedMethods();
+    markTouchedMethods(state->dataFile);
 
     fprintf(state->traceFile, "%cversion\n", TOKEN_CHAR);
     fprintf(state->traceFile, "%d\n", TRACE_VERSION);
@@ -537,8 +750,7 @@ void dvmMethodTraceStop(void)
     fprintf(state->traceFile, "clock=global\n");
 #endif
     fprintf(state->traceFile, "elapsed-time-usec=%llu\n", elapsed);
-    fprintf(state->traceFile, "num-method-calls=%d\n",
-        (state->curOffset - TRACE_HEADER_LEN) / TRACE_REC_SIZE);
+    fprintf(state->traceFile, "num-method-calls=%d\n", numRecords);
     fprintf(state->traceFile, "clock-call-overhead-nsec=%d\n", clockNsec);
     fprintf(state->traceFile, "vm=dalvik\n");
     if ((state->flags & TRACE_ALLOC_COUNTS) != 0) {
@@ -555,15 +767,17 @@ void dvmMethodTraceStop(void)
     dumpMethodList(state->traceFile);
     fprintf(state->traceFile, "%cend\n", TOKEN_CHAR);
 
-    if (fwrite(state->buf, state->curOffset, 1, state->traceFile) != 1) {
-        LOGE("trace fwrite(%d) failed, errno=%d\n", state->curOffset, errno);
+    if (state->writeFailed ||
+        !copyTraceData(state->traceFile, state->dataFile, state->startWhen))
+    {
+        LOGE("trace data write failed, errno=%d\n", errno);
         dvmThrowException("Ljava/lang/RuntimeException;", "data write failed");
         goto bail;
     }
 
 bail:
-    free(state->buf);
-    state->buf = NULL;
+    fclose(state->dataFile);
+    state->dataFile = NULL;
     fclose(state->traceFile);
     state->traceFile = NULL;
 
@@ -572,18 +786,46 @@ bail:
     dvmUnlockMutex(&state->startStopLock);
 }
 
+/*
+ * The current thread is going away.  If a trace is running, hand the
+ * writer our partial chunk so its records make it into the file; the
+ * chunk is freed with the rest at stop time.  Otherwise stop already
+ * took it from us, unless something went wrong, in which case there's
+ * nobody to write it and we just free it.
+ *
+ * This must happen while we're still on the thread list: once we're off
+ * it flushTraceChunks() can't see us, and a chunk left over from one
+ * trace could end up in the next.
+ */
+void dvmMethodTraceThreadExit(Thread* self)
+{
+    MethodTraceState* state = &gDvm.methodTrace;
+
+    lockStartStop(state);
+    dvmLockMutex(&state->writerLock);
+    if (state->traceEnabled) {
+        retireTraceChunk(state, self);
+    } else {
+        free(self->traceChunk);
+        self->traceChunk = NULL;
+    }
+    dvmUnlockMutex(&state->writerLock);
+    dvmUnlockMutex(&state->startStopLock);
+}
+
 
 /*
  * We just did something with a method.  Emit a record.
  *
- * Multiple threads may be banging on this all at once.  We use atomic ops
- * rather than mutexes for speed.
+ * Multiple threads may be banging on this all at once.  Each one writes
+ * to its own chunk, and only takes a lock when the chunk fills up.
  */
 void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
 {
     MethodTraceState* state = &gDvm.methodTrace;
-    u4 clockDiff, methodVal;
-    int oldOffset, newOffset;
+    MethodTraceChunk* chunk;
+    u4 clockDiff;
+    u8 methodVal;
     u1* ptr;
 
     /*
@@ -599,38 +841,32 @@ void dvmMethodTraceAdd(Thread* self, const Method* method, int action)
         //    self->threadId, self->cpuClockBase);
     }
 
-    /*
-     * Advance "curOffset" atomically.
-     */
-    do {
-        oldOffset = state->curOffset;
-        newOffset = oldOffset + TRACE_REC_SIZE;
-        if (newOffset > state->bufferSize) {
+    chunk = self->traceChunk;
+    if (chunk == NULL || chunk->used + TRACE_REC_SIZE > TRACE_CHUNK_SIZE) {
+        chunk = swapTraceChunk(state, self);
+        if (chunk == NULL) {
             state->overflow = true;
             return;
         }
-    } while (android_atomic_cmpxchg((oldOffset), (newOffset), (&state->curOffset)) != 0);
+    }
 
-    //assert(METHOD_ACTION((u4) method) == 0);
+    //assert(METHOD_ACTION((uintptr_t) method) == 0);
 
     u8 now = getClock();
     clockDiff = (u4) (now - self->cpuClockBase);
 
-    methodVal = METHOD_COMBINE((u4) method, action);
+    methodVal = METHOD_COMBINE((u8) (uintptr_t) method, action);
 
-    /*
-     * Write data into "oldOffset".
-     */
-    ptr = state->buf + oldOffset;
-    *ptr++ = self->threadId;
-    *ptr++ = (u1) methodVal;
-    *ptr++ = (u1) (methodVal >> 8);
-    *ptr++ = (u1) (methodVal >> 16);
-    *ptr++ = (u1) (methodVal >> 24);
+    ptr = chunk->data + chunk->used;
+    storeShortLE(ptr, (u2) self->threadId);
+    storeLongLE(ptr + 2, methodVal);
+    ptr += 10;
     *ptr++ = (u1) clockDiff;
     *ptr++ = (u1) (clockDiff >> 8);
     *ptr++ = (u1) (clockDiff >> 16);
     *ptr++ = (u1) (clockDiff >> 24);
+
+    chunk->used += TRACE_REC_SIZE;
 }
 
 /*
@@ -800,4 +1036,220 @@ void dvmStopAllocCounting(void)
     gDvm.allocProf.enabled = false;
 }
 
+/*
+ * ===========================================================================
+ *      Sampling profiler
+ * ===========================================================================
+ */
+
+#define SAMPLE_MAX_DEPTH    128
+
+/*
+ * One distinct stack and the number of times we've seen it.  Only the
+ * first "depth" methods are used; entries in the table are allocated
+ * with just that many.
+ */
+typedef struct StackSample {
+    int     count;
+    int     depth;
+    const Method* methods[SAMPLE_MAX_DEPTH];    /* innermost first */
+} StackSample;
+
+static u4 hashStackSample(const StackSample* sample)
+{
+    return dvmHashSampleStack(0, sample->methods, sample->depth);
+}
+
+static int compareStackSamples(const void* vsample1, const void* vsample2)
+{
+    const StackSample* sample1 = (const StackSample*) vsample1;
+    const StackSample* sample2 = (const StackSample*) vsample2;
+
+    return dvmCompareSampleStacks(sample1->methods, sample1->depth,
+        sample2->methods, sample2->depth);
+}
+
+/*
+ * Walk our interpreted stack and count it.
+ *
+ * We're at a suspend check in the interpreter, so self->curFrame is the
+ * frame of the method we're running.
+ */
+void dvmRecordStackSample(Thread* self)
+{
+    SampleProfState* state = &gDvm.sampleProf;
+    StackSample sample;
+    StackSample* found;
+    u4 hash;
+
+    self->samplePending = false;
+
+    sample.count = 1;
+    sample.depth = dvmFillSampleStack(self->curFrame, sample.methods,
+        SAMPLE_MAX_DEPTH);
+    if (sample.depth == 0)
+        return;
+    hash = hashStackSample(&sample);
+
+    dvmLockMutex(&state->lock);
+    if (state->enabled) {
+        state->numSamples++;
+        found = (StackSample*) dvmHashTableLookup(state->stacks, hash,
+                    &sample, compareStackSamples, false);
+        if (found != NULL) {
+            found->count++;
+        } else {
+            size_t size = offsetof(StackSample, methods) +
+                sample.depth * sizeof(sample.methods[0]);
+
+            found = (StackSample*) malloc(size);
+            if (found != NULL) {
+                memcpy(found, &sample, size);
+                dvmHashTableLookup(state->stacks, hash, found,
+                    compareStackSamples, true);
+            }
+        }
+    }
+    dvmUnlockMutex(&state->lock);
+}
+
+/*
+ * The sampler thread.  Every interval, flag each running thread to take
+ * a sample at its next suspend check.  Threads that are waiting or in
+ * native code aren't using interpreter CPU time, so they're left alone.
+ */
+static void* samplerThreadStart(void* arg)
+{
+    SampleProfState* state = &gDvm.sampleProf;
+    Thread* self = dvmThreadSelf();
+    int generation = (int) (intptr_t) arg;
+    Thread* thread;
+
+    dvmChangeStatus(self, THREAD_VMWAIT);
+    while (true) {
+        usleep(state->intervalUsec);
+        if (state->generation != generation)
+            break;
+
+        dvmLockThreadList(self);
+        for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+            if (thread != self && thread->status == THREAD_RUNNING)
+                thread->samplePending = true;
+        }
+        dvmUnlockThreadList();
+    }
+    dvmChangeStatus(self, THREAD_RUNNING);
+
+    return NULL;
+}
+
+/*
+ * Start the sampling profiler, taking a sample from each running thread
+ * every "intervalUsec" microseconds.
+ */
+bool dvmSampleProfStart(const char* fileName, int intervalUsec)
+{
+    SampleProfState* state = &gDvm.sampleProf;
+    pthread_t samplerHandle;
+    int generation;
+
+    assert(intervalUsec > 0);
+
+    dvmLockMutex(&state->lock);
+    if (state->enabled) {
+        LOGI("Sampling profiler already running\n");
+        dvmUnlockMutex(&state->lock);
+        return false;
+    }
+    state->stacks = dvmHashTableCreate(1024, free);
+    state->fileName = strdup(fileName);
+    if (state->stacks == NULL || state->fileName == NULL) {
+        dvmHashTableFree(state->stacks);
+        state->stacks = NULL;
+        free(state->fileName);
+        state->fileName = NULL;
+        dvmUnlockMutex(&state->lock);
+        return false;
+    }
+    state->intervalUsec = intervalUsec;
+    state->numSamples = 0;
+    state->enabled = true;
+    generation = state->generation;
+    dvmUnlockMutex(&state->lock);
+
+    /* the thread finds its own way out when the generation changes */
+    if (!dvmCreateInternalThread(&samplerHandle, "Sampling profiler",
+            samplerThreadStart, (void*) (intptr_t) generation))
+    {
+        LOGE("Unable to start sampling profiler thread\n");
+        dvmSampleProfStop();
+        return false;
+    }
+
+    LOGI("Sampling profiler started: every %d usec, to '%s'\n",
+        intervalUsec, fileName);
+    return true;
+}
+
+/*
+ * Write one stack, outermost method first.
+ */
+static int writeStackSample(void* vsample, void* vfp)
+{
+    const StackSample* sample = (const StackSample*) vsample;
+    FILE* fp = (FILE*) vfp;
+    int i;
+
+    for (i = sample->depth - 1; i >= 0; i--) {
+        const Method* method = sample->methods[i];
+        char* className = dvmDescriptorToDot(method->clazz->descriptor);
+
+        fprintf(fp, "%s.%s%c", className, method->name, (i > 0) ? ';' : ' ');
+        free(className);
+    }
+    fprintf(fp, "%d\n", sample->count);
+    return 0;
+}
+
+/*
+ * Write every stack.  (This is a dvmWriteSampleFile callback.)
+ */
+static void writeStackSamples(FILE* fp, void* vstacks)
+{
+    dvmHashForeach((HashTable*) vstacks, writeStackSample, fp);
+}
+
+/*
+ * Stop the sampling profiler and write out what it collected.
+ */
+void dvmSampleProfStop(void)
+{
+    SampleProfState* state = &gDvm.sampleProf;
+    HashTable* stacks;
+    char* fileName;
+    int numSamples;
+
+    dvmLockMutex(&state->lock);
+    if (!state->enabled) {
+        dvmUnlockMutex(&state->lock);
+        return;
+    }
+    state->enabled = false;
+    state->generation++;
+    stacks = state->stacks;
+    state->stacks = NULL;
+    fileName = state->fileName;
+    state->fileName = NULL;
+    numSamples = state->numSamples;
+    dvmUnlockMutex(&state->lock);
+
+    if (dvmWriteSampleFile(fileName, writeStackSamples, stacks)) {
+        LOGI("Sampling profiler stopped: %d samples, %d stacks in '%s'\n",
+            numSamples, dvmHashTableNumEntries(stacks), fileName);
+    }
+
+    dvmHashTableFree(stacks);
+    free(fileName);
+}
+
 #endif /*WITH_PROFILER*/
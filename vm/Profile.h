@@ -37,9 +37,20 @@ bool dvmProfilingStartup(void);
 void dvmProfilingShutdown(void);
 
 /*
- * Method trace state.  This is currently global.  In theory we could make
- * most of this per-thread.
- *
+ * A chunk of method trace records.  Each thread fills its own chunk and
+ * hands it to the trace writer thread when it's full.
+ */
+#define TRACE_CHUNK_SIZE    (32 * 1024)
+
+typedef struct MethodTraceChunk {
+    struct MethodTraceChunk* next;
+    int     used;
+    u1      data[TRACE_CHUNK_SIZE];
+} MethodTraceChunk;
+
+/*
+ * Method trace state.  Records go into per-thread chunks; the rest of
+ * this is global.
  */
 typedef struct MethodTraceState {
     /* these are set during VM init */
@@ -50,16 +61,48 @@ typedef struct MethodTraceState {
     pthread_mutex_t startStopLock;
     pthread_cond_t  threadExitCond;
     FILE*   traceFile;
-    int     bufferSize;
+    FILE*   dataFile;           /* records, as the writer streams them out */
+    int     bufferSize;         /* cap on chunk memory */
     int     flags;
 
     bool    traceEnabled;
-    u1*     buf;
-    volatile int curOffset;
     u8      startWhen;
     int     overflow;
+
+    /*
+     * The writer thread and its queue.  Everything below is guarded by
+     * writerLock, except that the writer owns the chunks it has taken
+     * off the queue until it puts them back on the free list.
+     */
+    pthread_t       writerHandle;
+    bool            hasWriter;
+    pthread_mutex_t writerLock;
+    pthread_cond_t  writerCond;     /* chunks to write */
+    pthread_cond_t  drainedCond;    /* queue is empty and writer idle */
+    MethodTraceChunk* fullChunks;   /* oldest first */
+    MethodTraceChunk* lastFullChunk;
+    MethodTraceChunk* freeChunks;
+    int     chunkBytes;             /* allocated, whatever their state */
+    bool    writerBusy;
+    bool    writeFailed;
+    u8      bytesWritten;
 } MethodTraceState;
 
+/*
+ * Sampling profiler state.  A timer thread periodically asks each running
+ * thread to record its interpreted stack; identical stacks are counted
+ * together in "stacks".
+ */
+typedef struct SampleProfState {
+    pthread_mutex_t lock;           /* guards everything below */
+    bool        enabled;
+    int         generation;         /* bumped on stop; old samplers exit */
+    int         intervalUsec;
+    char*       fileName;
+    struct HashTable* stacks;       /* StackSample* entries */
+    int         numSamples;
+} SampleProfState;
+
 /*
  * Memory allocation profiler state.  This is used both globally and
  * per-thread.
@@ -101,6 +144,26 @@ void dvmMethodTraceStart(const char* traceFileName, int traceFd, int bufferSize,
 bool dvmIsMethodTraceActive(void);
 void dvmMethodTraceStop(void);
 
+/*
+ * Flush or free an exiting thread's trace records.  Call before the
+ * thread comes off the thread list.
+ */
+void dvmMethodTraceThreadExit(struct Thread* self);
+
+/*
+ * Start/stop the sampling profiler.  Stopping writes the samples to the
+ * file named at start, one line per distinct stack, in the "collapsed"
+ * format flame graph tools take: "outer;...;inner count".
+ */
+bool dvmSampleProfStart(const char* fileName, int intervalUsec);
+void dvmSampleProfStop(void);
+
+/*
+ * Record the current thread's stack for the sampling profiler.  Called
+ * from dvmCheckSuspendQuick() when the sampler has asked for it.
+ */
+void dvmRecordStackSample(struct Thread* self);
+
 /*
  * Start/stop emulator tracing.
  */
@@ -186,7 +249,7 @@ enum {
 };
 
 #define TOKEN_CHAR      '*'
-#define TRACE_VERSION   1
+#define TRACE_VERSION   3
 
 /*
  * Common definitions, shared with the dump tool.
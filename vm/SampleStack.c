@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Stack keys and file output for the sampling profilers.
+ */
+#include "Dalvik.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * Record the interpreted stack starting at "fp".
+ */
+int dvmFillSampleStack(const void* fp, const Method** methods, int maxDepth)
+{
+    int depth = 0;
+
+    for ( ; fp != NULL && depth < maxDepth;
+        fp = SAVEAREA_FROM_FP(fp)->prevFrame)
+    {
+        if (!dvmIsBreakFrame((const u8*) fp))
+            methods[depth++] = SAVEAREA_FROM_FP(fp)->method;
+    }
+    return depth;
+}
+
+/*
+ * Hash a recorded stack.
+ */
+u4 dvmHashSampleStack(u4 hash, const Method* const* methods, int depth)
+{
+    int i;
+
+    hash = hash * 31 + depth;
+    for (i = 0; i < depth; i++)
+        hash = hash * 31 + (u4) ((uintptr_t) methods[i] >> 3);
+    return hash;
+}
+
+/*
+ * Compare two recorded stacks.
+ */
+int dvmCompareSampleStacks(const Method* const* methods1, int depth1,
+    const Method* const* methods2, int depth2)
+{
+    if (depth1 != depth2)
+        return depth1 - depth2;
+    return memcmp(methods1, methods2, depth1 * sizeof(methods1[0]));
+}
+
+/*
+ * Write a file through a temporary one.
+ */
+bool dvmWriteSampleFile(const char* fileName, SampleFileWriteFunc writeFunc,
+    void* arg)
+{
+    char* tmpName;
+    FILE* fp;
+    bool result;
+
+    tmpName = (char*) malloc(strlen(fileName) + 16);
+    if (tmpName == NULL)
+        return false;
+    sprintf(tmpName, "%s.%d", fileName, (int) getpid());
+
+    fp = fopen(tmpName, "w");
+    if (fp == NULL) {
+        LOGE("Unable to open sample file '%s': %s\n",
+            tmpName, strerror(errno));
+        free(tmpName);
+        return false;
+    }
+    (*writeFunc)(fp, arg);
+    result = (ferror(fp) == 0);
+    if (fclose(fp) != 0)
+        result = false;
+    if (result && rename(tmpName, fileName) != 0)
+        result = false;
+    if (!result) {
+        LOGW("Unable to write sample file '%s': %s\n",
+            fileName, strerror(errno));
+        unlink(tmpName);
+    }
+    free(tmpName);
+    return result;
+}
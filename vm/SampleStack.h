@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Support shared by the sampling profilers (Profile.c samples running
+ * methods, AllocTracker.c samples allocations): interpreted stacks used
+ * as hash table keys, and writing the results out.
+ */
+#ifndef _DALVIK_SAMPLESTACK
+#define _DALVIK_SAMPLESTACK
+
+/*
+ * Record up to "maxDepth" methods of the interpreted stack that starts
+ * at frame "fp", innermost first.  Break frames are skipped, so native
+ * code shows up as a gap between the interpreted frames around it.
+ *
+ * Returns the number of methods stored in "methods".
+ */
+int dvmFillSampleStack(const void* fp, const Method** methods, int maxDepth);
+
+/*
+ * Fold a recorded stack into "hash".
+ */
+u4 dvmHashSampleStack(u4 hash, const Method* const* methods, int depth);
+
+/*
+ * Compare two recorded stacks.  Returns zero if they're the same, with
+ * the usual strcmp() ordering otherwise.
+ */
+int dvmCompareSampleStacks(const Method* const* methods1, int depth1,
+    const Method* const* methods2, int depth2);
+
+/*
+ * Write a profiler's results to "fileName" by calling "writeFunc" on a
+ * temporary file and renaming it, so a reader never sees a partial file.
+ * Failures are logged.
+ *
+ * Returns "true" on success.
+ */
+typedef void (*SampleFileWriteFunc)(FILE* fp, void* arg);
+bool dvmWriteSampleFile(const char* fileName, SampleFileWriteFunc writeFunc,
+    void* arg);
+
+#endif /*_DALVIK_SAMPLESTACK*/
@@ -53,6 +53,22 @@
 #include <time.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <limits.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+/*
+ * Darwin's futex equivalent.  It isn't in any public header, but
+ * libSystem exports it (since 10.12) and libc++ uses it the same way.
+ */
+#define UL_COMPARE_AND_WAIT     1
+#define ULF_WAKE_ALL            0x00000100
+#define ULF_NO_ERRNO            0x01000000
+extern int __ulock_wait(uint32_t operation, void *addr, uint64_t value,
+    uint32_t timeout_us);
+extern int __ulock_wake(uint32_t operation, void *addr, uint64_t wake_value);
+#endif
 
 #define LOG_THIN    LOGV
 
@@ -102,19 +118,22 @@ static void expandObjClear(ExpandingObjectList* pList);
  *     typedef union Lock {
  *         u4          thin;
  *         Monitor*    mon;
+ *         s8          word;
  *     } Lock;
  *
  * It is possible to tell the current state of the lock from the actual
  * value, so we do not need to store any additional state.  When the
  * lock is "thin", it has the form:
  *
- *     [31 ---- 16] [15 ---- 1] [0]
- *      lock count   thread id   1
+ *     [31] [30] [29 ---- 16] [15 ---- 1] [0]
+ *      0    C    lock count   thread id   1
  *
- * When it is "fat", the field is simply a (Monitor *).  Since the pointer
- * will always be 4-byte-aligned, bits 1 and 0 will always be zero when
- * the field holds a pointer.  Hence, we can tell the current fat-vs-thin
- * state by checking the least-significant bit.
+ * where C (LW_CONTENDED) is set when some other thread is parked
+ * waiting for the lock to be released.  When it is "fat", the field is
+ * simply a (Monitor *).  Since the pointer will always be 4-byte-aligned,
+ * bits 1 and 0 will always be zero when the field holds a pointer.
+ * Hence, we can tell the current fat-vs-thin state by checking the
+ * least-significant bit.
  *
  * For an in-depth description of the mechanics of thin-vs-fat locking,
  * read the paper referred to above.
@@ -123,7 +142,52 @@ static void expandObjClear(ExpandingObjectList* pList);
  * Thread.threadId is guaranteed to have bit 0 set, and all new Objects
  * have their lock fields initialized to the value 0x1, or
  * DVM_LOCK_INITIAL_THIN_VALUE, via DVM_OBJECT_INIT().
+ *
+ * Most objects are only ever locked by one thread, so unless biased
+ * locking is turned off (-Xlockbias:off), the first thread to lock an
+ * object keeps its lock word and locks and unlocks it from then on
+ * without a compare and exchange.  Such a "biased" thin lock has the
+ * form:
+ *
+ *     [31] [30] [29 ---- 16] [15 ---- 1] [0]
+ *      1    0    hold count   thread id   1
+ *
+ * where, unlike in an ordinary thin lock, the count is the number of
+ * times the owner holds the lock; zero means nobody does.
+ *
+ * A thread that wants a lock biased toward some other thread revokes
+ * the bias: it suspends the owner and rewrites the lock word as an
+ * ordinary thin lock that the owner holds just as many times (see
+ * revokeBias()).  The lock stays unbiased, and once instances of a
+ * class have been revoked BIAS_REVOCATION_LIMIT times, new locks on
+ * instances of that class aren't biased to begin with.
+ *
+ * The LW_ macros that pick the lock word apart are in Sync.h.
  */
+#define BIAS_REVOCATION_LIMIT   16
+
+/*
+ * A thread that finds a thin lock held by another thread spins for up
+ * to THIN_SPIN_LIMIT rounds, since most locks are only held briefly.
+ * If the lock still isn't free, the thread sets LW_CONTENDED and parks
+ * on the lock word (a futex on Linux, a ulock on Darwin), and whoever
+ * lets go of a lock word with LW_CONTENDED set wakes everybody parked
+ * on it.  Because of that flag, the owner has to update an ordinary
+ * thin lock atomically too.  A thread that had to park fattens the
+ * lock as soon as it gets it, so later contention blocks on the
+ * monitor's mutex instead.
+ */
+#define THIN_SPIN_LIMIT     128
+#define PARK_POLL_USEC      50
+
+/*
+ * A thread that finds a fat lock held spins on the monitor's mutex
+ * before blocking on it.  Each monitor adapts its own spin limit,
+ * doubling it when spinning pays off and halving it when it doesn't.
+ */
+#define MONITOR_SPIN_MIN        16
+#define MONITOR_SPIN_INITIAL    256
+#define MONITOR_SPIN_MAX        4096
 
 /*
  * Monitors provide:
@@ -148,6 +212,11 @@ struct Monitor {
     pthread_mutex_t lock;
     pthread_cond_t cond;
 
+    /* how long to spin on "lock", and how spinning has gone so far */
+    int spinLimit;
+    u4 spinSuccesses;
+    u4 spinFailures;
+
     Monitor *next;
 
 #ifdef WITH_DEADLOCK_PREDICTION
@@ -175,6 +244,61 @@ struct Monitor {
 };
 
 
+/*
+ * Returns true if there's more than one CPU to spin on.
+ */
+static bool isMultiprocessor(void) {
+    static long numCpus = 0;
+
+    if (numCpus == 0) {
+        numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return numCpus > 1;
+}
+
+/*
+ * Tell the CPU that we're spinning.  Also keeps the compiler from
+ * caching memory reads across it.
+ */
+static inline void cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*
+ * Sleep until somebody calls unparkLockWord() on "addr", unless it no
+ * longer holds "val".  May return early.  Where the OS has nothing to
+ * wait on an address with, this just sleeps for a moment.
+ */
+static void parkOnLockWord(volatile u4 *addr, u4 val) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#elif defined(__APPLE__)
+    __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, (void *) addr, val, 0);
+#else
+    if (*addr == val) {
+        usleep(PARK_POLL_USEC);
+    }
+#endif
+}
+
+/*
+ * Wake every thread parked on "addr".
+ */
+static void unparkLockWord(volatile u4 *addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#elif defined(__APPLE__)
+    __ulock_wake(UL_COMPARE_AND_WAIT | ULF_WAKE_ALL | ULF_NO_ERRNO,
+        (void *) addr, 0);
+#endif
+}
+
 /*
  * Create and initialize a monitor.
  */
@@ -189,6 +313,7 @@ Monitor *dvmCreateMonitor(Object *obj) {
     mon->obj = obj;
     dvmInitMutex(&mon->lock);
     pthread_cond_init(&mon->cond, NULL);
+    mon->spinLimit = isMultiprocessor() ? MONITOR_SPIN_INITIAL : 0;
 
     /* replace the head of the list with the new monitor */
     do {
@@ -239,18 +364,23 @@ void dvmDumpMonitorInfo(const char *msg) {
 
     int totalCount;
     int liveCount;
+    u4 spinSuccesses, spinFailures;
 
     totalCount = liveCount = 0;
+    spinSuccesses = spinFailures = 0;
     Monitor *mon = gDvm.monitorList;
     while (mon != NULL) {
         totalCount++;
         if (mon->obj != NULL)
             liveCount++;
+        spinSuccesses += mon->spinSuccesses;
+        spinFailures += mon->spinFailures;
         mon = mon->next;
     }
 
-    LOGD("%s: monitor list has %d entries (%d live)\n",
-         msg, totalCount, liveCount);
+    LOGD("%s: monitor list has %d entries (%d live), "
+         "spinning won %u times and lost %u\n",
+         msg, totalCount, liveCount, spinSuccesses, spinFailures);
 }
 
 /*
@@ -279,6 +409,9 @@ bool dvmHoldsLock(Thread *thread, Object *obj) {
     Lock lock = obj->lock;
     if (IS_LOCK_FAT(&lock)) {
         return thread == lock.mon->owner;
+    } else if (LW_IS_BIASED(lock.thin)) {
+        return thread->threadId == LW_OWNER(lock.thin) &&
+            LW_COUNT(lock.thin) != 0;
     } else {
         return thread->threadId == (lock.thin & 0xffff);
     }
@@ -332,6 +465,37 @@ void dvmFreeObjectMonitor_internal(Lock *lock) {
 }
 
 
+/*
+ * Spin on a monitor's mutex for a while, and adjust how long to spin
+ * next time by how it went.  The statistics aren't updated atomically,
+ * so they're only approximate.
+ *
+ * Returns "true" if we got the mutex.
+ */
+static bool spinOnMonitor(Monitor *mon) {
+    int limit = mon->spinLimit;
+    int i;
+
+    if (limit == 0) {
+        return false;
+    }
+    for (i = 0; i < limit; i++) {
+        cpuRelax();
+        if (mon->owner == NULL && pthread_mutex_trylock(&mon->lock) == 0) {
+            mon->spinSuccesses++;
+            if (limit < MONITOR_SPIN_MAX) {
+                mon->spinLimit = limit * 2;
+            }
+            return true;
+        }
+    }
+    mon->spinFailures++;
+    if (limit > MONITOR_SPIN_MIN) {
+        mon->spinLimit = limit / 2;
+    }
+    return false;
+}
+
 /*
  * Lock a monitor.
  */
@@ -343,7 +507,7 @@ static void lockMonitor(Thread *self, Monitor *mon) {
     } else {
         ThreadStatus oldStatus;
 
-        if (pthread_mutex_trylock(&mon->lock) != 0) {
+        if (pthread_mutex_trylock(&mon->lock) != 0 && !spinOnMonitor(mon)) {
             /* mutex is locked, switch to wait status and sleep on it */
             oldStatus = dvmChangeStatus(self, THREAD_MONITOR);
             cc = pthread_mutex_lock(&mon->lock);
@@ -720,6 +884,139 @@ static void notifyAllMonitor(Thread *self, Monitor *mon) {
  * Thin locking support
  */
 
+/*
+ * Returns true if the thin (possibly biased) lock word "thin" is held
+ * by the thread with ID "threadId".
+ */
+static bool holdsThinLock(u4 thin, u4 threadId) {
+    if (LW_OWNER(thin) != threadId) {
+        return false;
+    }
+    return !LW_IS_BIASED(thin) || LW_COUNT(thin) != 0;
+}
+
+/*
+ * The recursion count a monitor needs to stand in for a thin or biased
+ * lock word that its owner holds.  A biased lock counts every hold; an
+ * ordinary thin lock counts the ones past the first.
+ */
+static int heldThinLockCount(u4 thin) {
+    return LW_IS_BIASED(thin) ? LW_COUNT(thin) - 1 : LW_COUNT(thin);
+}
+
+/*
+ * Fatten a thin or biased lock that 'self' holds, giving the new
+ * monitor a recursion count of "lockCount".  Other threads may set
+ * LW_CONTENDED in the meantime, but nothing else, so the monitor is
+ * swapped in once it's in the right state, and anyone parked on the
+ * thin lock is woken up to go block on the monitor.
+ */
+static Monitor *fattenHeldLock(Thread *self, Object *obj, int lockCount) {
+    Monitor *mon = dvmCreateMonitor(obj);
+    s8 old;
+
+    lockMonitor(self, mon);
+    mon->lockCount = lockCount;
+            LOG_THIN("(%d) lock 0x%08llx fattened by owner to count %d\n",
+                     self->threadId, (u8) &obj->lock, lockCount);
+    old = android_quasiatomic_swap_64((s8) mon, &obj->lock.word);
+    if (((u4) old & LW_CONTENDED) != 0) {
+        unparkLockWord(&obj->lock.thin);
+    }
+    return mon;
+}
+
+/*
+ * Add "delta" to the count of a thin lock that the caller holds.  The
+ * word is updated with compare and exchange, since other threads may
+ * set LW_CONTENDED at any time.
+ *
+ * Returns "false", changing nothing, if the count would be out of range.
+ */
+static bool addThinCount(volatile s4 *thinp, int delta) {
+    s4 thin, newThin;
+    int count;
+
+    do {
+        thin = *thinp;
+        count = LW_COUNT(thin) + delta;
+        if (count < 0 || count > LW_COUNT_MAX) {
+            return false;
+        }
+        newThin = thin + delta * (1 << LW_COUNT_SHIFT);
+    } while (android_atomic_cmpxchg(thin, newThin, thinp) != 0);
+    return true;
+}
+
+/*
+ * The value that 'self' stores into an unlocked lock word to lock it
+ * for the first time.
+ */
+static s4 firstLockWord(Thread *self, const Object *obj) {
+    if (gDvm.biasedLocking && obj->clazz != NULL &&
+        obj->clazz->biasRevocations < BIAS_REVOCATION_LIMIT)
+    {
+        return LW_BIASED | (1 << LW_COUNT_SHIFT) | self->threadId;
+    }
+    return self->threadId;
+}
+
+/*
+ * Turn a lock that's biased toward another thread into an ordinary thin
+ * lock, held by that thread as many times as it held the biased one.
+ *
+ * The owner locks and unlocks a biased lock with plain loads and stores
+ * while it's running, so it has to be suspended while the word is
+ * rewritten.  The thread list lock keeps its ID from being reused while
+ * we look at it, and keeps other revokers out.  'self' mustn't be in
+ * the RUNNING state, since it may have to wait for the owner.
+ */
+static void revokeBias(Thread *self, Object *obj) {
+    volatile u4 *thinp = &obj->lock.thin;
+    Thread *owner;
+    u4 thin;
+
+    dvmLockThreadList(self);
+
+    thin = *thinp;
+    if (!LW_IS_BIASED(thin)) {
+        /* somebody beat us to it */
+        dvmUnlockThreadList();
+        return;
+    }
+    for (owner = gDvm.threadList; owner != NULL; owner = owner->next) {
+        if (owner->threadId == LW_OWNER(thin)) {
+            break;
+        }
+    }
+    if (owner == self) {
+        /* the previous thread with our ID exited without revoking it */
+        owner = NULL;
+    }
+    if (owner != NULL) {
+        dvmSuspendThread(owner);
+    }
+
+    /* Now that it's stopped, see how many times the owner holds it.
+     */
+    thin = *thinp;
+    if (LW_COUNT(thin) == 0) {
+        *thinp = DVM_LOCK_INITIAL_THIN_VALUE;
+    } else {
+        *thinp = ((LW_COUNT(thin) - 1) << LW_COUNT_SHIFT) | LW_OWNER(thin);
+    }
+    if (obj->clazz != NULL) {
+        obj->clazz->biasRevocations++;
+    }
+            LOG_THIN("(%d) revoked bias of lock 0x%08llx: 0x%08x -> 0x%08x\n",
+                     self->threadId, (u8) &obj->lock, thin, *thinp);
+
+    if (owner != NULL) {
+        dvmResumeThread(owner);
+    }
+    dvmUnlockThreadList();
+}
+
 /*
  * Implements monitorenter for "synchronized" stuff.
  *
@@ -729,91 +1026,106 @@ static void notifyAllMonitor(Thread *self, Monitor *mon) {
 void dvmLockObject(Thread *self, Object *obj) {
     volatile s4 *thinp = (volatile s4 *) &obj->lock.thin;
     u4 threadId = self->threadId;
+    u4 thin = *thinp;
 
-    /* First, try to grab the lock as if it's thin;
-     * this is the common case and will usually succeed.
-     */
-    if (android_atomic_cmpxchg(((s4) (0x1)), ((s4) threadId), (thinp)) != 0) {
-        /* The lock is either a thin lock held by someone (possibly 'self'),
-         * or a fat lock.
+    if ((thin & (LW_BIASED | LW_OWNER_MASK)) == (LW_BIASED | threadId)) {
+        /* The lock is biased toward 'self'.  Nobody else writes the
+         * lock word while we're running, so just bump the count.
+         */
+        if (LW_COUNT(thin) < LW_COUNT_MAX) {
+            *thinp = thin + (1 << LW_COUNT_SHIFT);
+        } else {
+            lockMonitor(self, fattenHeldLock(self, obj, LW_COUNT(thin) - 1));
+        }
+    } else if (android_atomic_cmpxchg(((s4) (DVM_LOCK_INITIAL_THIN_VALUE)),
+                   firstLockWord(self, obj), (thinp)) != 0) {
+        /* Next, try to grab the lock as if it's thin.  If that fails,
+         * the lock is either a thin lock held by someone (possibly
+         * 'self'), a lock biased toward someone else, or a fat lock.
          */
         if ((*thinp & 0xffff) == threadId) {
             /* 'self' is already holding the thin lock; we can just
-             * bump the count.  Atomic operations are not necessary
-             * because only the thread holding the lock is allowed
-             * to modify the Lock field.
+             * bump the count.
              */
-            *thinp += 1 << 16;
-        } else {
-            /* If this is a thin lock we need to spin on it, if it's fat
-             * we need to acquire the monitor.
+            if (!addThinCount(thinp, 1)) {
+                lockMonitor(self, fattenHeldLock(self, obj, LW_COUNT_MAX));
+            }
+        } else if ((*thinp & 1) != 0) {
+            /* The lock is still thin, but some other thread is
+             * holding it.  Let the VM know that we're about
+             * to wait on another thread.
              */
-            if ((*thinp & 1) != 0) {
-                ThreadStatus oldStatus;
-                static const unsigned long maxSleepDelay = 1 * 1024 * 1024;
-                unsigned long sleepDelay;
-
-                        LOG_THIN("(%d) spin on lock 0x%08llx: 0x%08x (0x%08x) 0x%08x\n",
-                                 threadId, &obj->lock,
-                                 DVM_LOCK_INITIAL_THIN_VALUE, *thinp, threadId);
-
-                /* The lock is still thin, but some other thread is
-                 * holding it.  Let the VM know that we're about
-                 * to wait on another thread.
-                 */
-                oldStatus = dvmChangeStatus(self, THREAD_MONITOR);
+            ThreadStatus oldStatus;
+            int spinLimit = isMultiprocessor() ? THIN_SPIN_LIMIT : 0;
+            int spins = 0;
+            bool parked = false;
+
+                    LOG_THIN("(%d) spin on lock 0x%08llx: 0x%08x (0x%08x) 0x%08x\n",
+                             threadId, (u8) &obj->lock,
+                             DVM_LOCK_INITIAL_THIN_VALUE, *thinp, threadId);
+            oldStatus = dvmChangeStatus(self, THREAD_MONITOR);
 
-                /* Spin until the other thread lets go.
-                 */
-                sleepDelay = 0;
-                do {
-                    /* In addition to looking for an unlock,
-                     * we need to watch out for some other thread
-                     * fattening the lock behind our back.
-                     */
-                    while (*thinp != DVM_LOCK_INITIAL_THIN_VALUE) {
-                        if ((*thinp & 1) == 0) {
-                            /* The lock has been fattened already.
-                             */
-                                    LOG_THIN("(%d) lock 0x%08llx surprise-fattened\n",
-                                             threadId, (u8) &obj->lock);
-                            dvmChangeStatus(self, oldStatus);
-                            goto fat_lock;
-                        }
-
-                        if (sleepDelay == 0) {
-                            sched_yield();
-                            sleepDelay = 1 * 1000;
-                        } else {
-                            usleep(sleepDelay);
-                            if (sleepDelay < maxSleepDelay / 2) {
-                                sleepDelay *= 2;
-                            }
-                        }
+            for (;;) {
+                thin = *thinp;
+                if (thin == DVM_LOCK_INITIAL_THIN_VALUE) {
+                    if (android_atomic_cmpxchg(((s4) (0x1)),
+                            ((s4) threadId), (thinp)) == 0) {
+                        break;
                     }
-                } while (android_atomic_cmpxchg(((s4) (0x1)), ((s4) threadId), (thinp)) != 0);
-                        LOG_THIN("(%d) spin on lock done 0x%08llx: "
-                                 "0x%08x (0x%08x) 0x%08x\n",
-                                 threadId, (u8) &obj->lock,
-                                 DVM_LOCK_INITIAL_THIN_VALUE, *thinp, threadId);
-
-                /* We've got the thin lock; let the VM know that we're
-                 * done waiting.
-                 */
-                dvmChangeStatus(self, oldStatus);
+                    continue;
+                }
 
-                /* Fatten the lock.  Note this relinquishes ownership.
-                 * We could also create the monitor in an "owned" state
-                 * to avoid "re-locking" it in fat_lock.
+                /* In addition to looking for an unlock, we need to
+                 * watch out for some other thread fattening the lock
+                 * behind our back, and for locks that will never be
+                 * let go because they're biased.
                  */
-                obj->lock.mon = dvmCreateMonitor(obj);
-                        LOG_THIN("(%d) lock 0x%08x fattened\n",
-                                 threadId, (uint) &obj->lock);
-
-                /* Fall through to acquire the newly fat lock.
+                if ((thin & 1) == 0) {
+                            LOG_THIN("(%d) lock 0x%08llx surprise-fattened\n",
+                                     threadId, (u8) &obj->lock);
+                    dvmChangeStatus(self, oldStatus);
+                    goto fat_lock;
+                }
+                if (LW_IS_BIASED(thin)) {
+                    revokeBias(self, obj);
+                    continue;
+                }
+
+                if (spins < spinLimit) {
+                    spins++;
+                    cpuRelax();
+                    continue;
+                }
+
+                /* Spinning didn't help; ask to be woken up when the
+                 * owner lets go, and sleep until then.
                  */
+                if ((thin & LW_CONTENDED) == 0) {
+                    if (android_atomic_cmpxchg(thin, thin | LW_CONTENDED,
+                            (thinp)) != 0) {
+                        continue;
+                    }
+                    thin |= LW_CONTENDED;
+                }
+                parked = true;
+                parkOnLockWord((volatile u4 *) thinp, thin);
             }
+                    LOG_THIN("(%d) spin on lock done 0x%08llx: "
+                             "0x%08x (0x%08x) 0x%08x\n",
+                             threadId, (u8) &obj->lock,
+                             DVM_LOCK_INITIAL_THIN_VALUE, *thinp, threadId);
 
+            /* We've got the thin lock; let the VM know that we're
+             * done waiting.
+             */
+            dvmChangeStatus(self, oldStatus);
+
+            /* If we had to sleep for it, it's worth a monitor.
+             */
+            if (parked) {
+                fattenHeldLock(self, obj, 0);
+            }
+        } else {
             /* The lock is already fat, which means
              * that obj->lock.mon is a regular (Monitor *).
              */
@@ -822,7 +1134,8 @@ void dvmLockObject(Thread *self, Object *obj) {
             lockMonitor(self, obj->lock.mon);
         }
     }
-    // else, the lock was acquired with the ATOMIC_CMP_SWAP().
+    // else, the lock was acquired through its bias or with the
+    // ATOMIC_CMP_SWAP().
 
 #ifdef WITH_DEADLOCK_PREDICTION
     /*
@@ -884,19 +1197,25 @@ void dvmLockObject(Thread *self, Object *obj) {
 bool dvmUnlockObject(Thread *self, Object *obj) {
     volatile u4 *thinp = &obj->lock.thin;
     u4 threadId = self->threadId;
+    u4 thin = *thinp;
 
-    /* Check the common case, where 'self' has locked 'obj' once, first.
+    /* Check the common case, where the lock is biased toward 'self',
+     * first.
      */
-    if (*thinp == threadId) {
-        /* Unlock 'obj' by clearing our threadId from 'thin'.
-         * The lock protects the lock field itself, so it's
-         * safe to update non-atomically.
+    if ((thin & (LW_BIASED | LW_OWNER_MASK)) == (LW_BIASED | threadId)) {
+        /* Biased toward 'self'; just drop the count.  The bias
+         * stays even when it reaches zero.
          */
-        *thinp = DVM_LOCK_INITIAL_THIN_VALUE;
-    } else if ((*thinp & 1) != 0) {
+        if (LW_COUNT(thin) == 0) {
+            dvmThrowException("Ljava/lang/IllegalMonitorStateException;",
+                              "unlock of unowned monitor");
+            return false;
+        }
+        *thinp = thin - (1 << LW_COUNT_SHIFT);
+    } else if ((thin & 1) != 0) {
         /* If the object is locked, it had better be locked by us.
          */
-        if ((*thinp & 0xffff) != threadId) {
+        if ((thin & 0xffff) != threadId) {
             /* The JNI spec says that we should throw an exception
              * in this case.
              */
@@ -907,10 +1226,21 @@ bool dvmUnlockObject(Thread *self, Object *obj) {
             return false;
         }
 
-        /* It's a thin lock, but 'self' has locked 'obj'
-         * more than once.  Decrement the count.
-         */
-        *thinp -= 1 << 16;
+        if (LW_COUNT(thin) != 0) {
+            /* It's a thin lock, but 'self' has locked 'obj'
+             * more than once.  Decrement the count.
+             */
+            addThinCount((volatile s4 *) thinp, -1);
+        } else {
+            /* Unlock 'obj' by clearing our threadId from 'thin',
+             * and wake up anyone who's given up spinning on it.
+             */
+            thin = android_atomic_swap(DVM_LOCK_INITIAL_THIN_VALUE,
+                    (volatile s4 *) thinp);
+            if ((thin & LW_CONTENDED) != 0) {
+                unparkLockWord(thinp);
+            }
+        }
     } else {
         /* It's a fat lock.
          */
@@ -944,30 +1274,17 @@ void dvmObjectWait(Thread *self, Object *obj, s8 msec, s4 nsec,
     if ((thin & 1) != 0) {
         /* Make sure that 'self' holds the lock.
          */
-        if ((thin & 0xffff) != self->threadId) {
+        if (!holdsThinLock(thin, self->threadId)) {
             dvmThrowException("Ljava/lang/IllegalMonitorStateException;",
                               "object not locked by thread before wait()");
             return;
         }
 
         /* This thread holds the lock.  We need to fatten the lock
-         * so 'self' can block on it.  Don't update the object lock
-         * field yet, because 'self' needs to acquire the lock before
-         * any other thread gets a chance.
-         */
-        mon = dvmCreateMonitor(obj);
-
-        /* 'self' has actually locked the object one or more times;
-         * make sure that the monitor reflects this.
+         * so 'self' can block on it, with the monitor reflecting
+         * the number of times 'self' has actually locked the object.
          */
-        lockMonitor(self, mon);
-        mon->lockCount = thin >> 16;
-                LOG_THIN("(%d) lock 0x%08x fattened by wait() to count %d\n",
-                         self->threadId, (uint) &obj->lock, mon->lockCount);
-
-        /* Make the monitor public now that it's in the right state.
-         */
-        obj->lock.mon = mon;
+        mon = fattenHeldLock(self, obj, heldThinLockCount(thin));
     }
 
     waitMonitor(self, mon, msec, nsec, interruptShouldThrow);
@@ -986,7 +1303,7 @@ void dvmObjectNotify(Thread *self, Object *obj) {
     if ((thin & 1) != 0) {
         /* Make sure that 'self' holds the lock.
          */
-        if ((thin & 0xffff) != self->threadId) {
+        if (!holdsThinLock(thin, self->threadId)) {
             dvmThrowException("Ljava/lang/IllegalMonitorStateException;",
                               "object not locked by thread before notify()");
             return;
@@ -1013,7 +1330,7 @@ void dvmObjectNotifyAll(Thread *self, Object *obj) {
     if ((thin & 1) != 0) {
         /* Make sure that 'self' holds the lock.
          */
-        if ((thin & 0xffff) != self->threadId) {
+        if (!holdsThinLock(thin, self->threadId)) {
             dvmThrowException("Ljava/lang/IllegalMonitorStateException;",
                               "object not locked by thread before notifyAll()");
             return;
@@ -1642,12 +1959,12 @@ static void updateDeadlockPrediction(Thread* self, Object* acqObj)
      * without worrying that something will change out from under us.
      */
     if (!IS_LOCK_FAT(&acqObj->lock)) {
+        u4 thin = acqObj->lock.thin;
+
+        assert(holdsThinLock(thin, self->threadId));
         LOGVV("fattening lockee %p (recur=%d)\n",
-            acqObj, acqObj->lock.thin >> 16);
-        Monitor* newMon = dvmCreateMonitor(acqObj);
-        lockMonitor(self, newMon);      // can't stall, don't need VMWAIT
-        newMon->lockCount += acqObj->lock.thin >> 16;
-        acqObj->lock.mon = newMon;
+            acqObj, heldThinLockCount(thin));
+        fattenHeldLock(self, acqObj, heldThinLockCount(thin));
     }
 
     /* if we don't have a stack trace for this monitor, establish one */
@@ -1689,12 +2006,12 @@ static void updateDeadlockPrediction(Thread* self, Object* acqObj)
      * without worrying that something will change out from under us.
      */
     if (!IS_LOCK_FAT(&mrl->obj->lock)) {
+        u4 thin = mrl->obj->lock.thin;
+
+        assert(holdsThinLock(thin, self->threadId));
         LOGVV("fattening parent %p f/b/o child %p (recur=%d)\n",
-            mrl->obj, acqObj, mrl->obj->lock.thin >> 16);
-        Monitor* newMon = dvmCreateMonitor(mrl->obj);
-        lockMonitor(self, newMon);      // can't stall, don't need VMWAIT
-        newMon->lockCount += mrl->obj->lock.thin >> 16;
-        mrl->obj->lock.mon = newMon;
+            mrl->obj, acqObj, heldThinLockCount(thin));
+        fattenHeldLock(self, mrl->obj, heldThinLockCount(thin));
     }
 
     /*
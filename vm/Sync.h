@@ -36,6 +36,7 @@ typedef struct Monitor Monitor;
 typedef union Lock {
     u4          thin;
     Monitor*    mon;
+    s8          word;       /* all of it, for 64-bit atomic swaps */
 } Lock;
 
 /*
@@ -56,6 +57,18 @@ typedef union Lock {
  */
 #define IS_LOCK_FAT(lock)   (((lock)->thin & 1) == 0 && (lock)->mon != NULL)
 
+/*
+ * Pieces of a thin lock word.  See the comment at the top of Sync.c.
+ */
+#define LW_BIASED           0x80000000
+#define LW_CONTENDED        0x40000000
+#define LW_OWNER_MASK       0xffff
+#define LW_COUNT_SHIFT      16
+#define LW_COUNT_MAX        0x3fff
+#define LW_IS_BIASED(thin)  (((thin) & (LW_BIASED | 1)) == (LW_BIASED | 1))
+#define LW_OWNER(thin)      ((thin) & LW_OWNER_MASK)
+#define LW_COUNT(thin)      (((thin) >> LW_COUNT_SHIFT) & LW_COUNT_MAX)
+
 /*
  * Acquire the object's monitor.
  */
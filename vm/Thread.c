@@ -2036,7 +2036,11 @@ void dvmDetachCurrentThread(void) {
      * We're done manipulating objects, so it's okay if the GC runs in
      * parallel with us from here out.  It's important to do this if
      * profiling is enabled, since we can wait indefinitely.
+     *
+     * Give back the rest of our TLABs first; once we're off the thread
+     * list the GC can't reclaim them for us.
      */
+    dvmHeapRetireThreadTlabs(self);
     self->status = THREAD_VMWAIT;
 
 #ifdef WITH_PROFILER
@@ -2066,6 +2070,8 @@ void dvmDetachCurrentThread(void) {
         }
     }
     dvmUnlockMutex(&traceState->startStopLock);
+
+    dvmMethodTraceThreadExit(self);
 #endif
 
     dvmLockThreadList(self);
@@ -2110,6 +2116,67 @@ void dvmDetachCurrentThread(void) {
 }
 
 
+/*
+ * Attach the current thread to the VM without a java.lang.Thread object.
+ *
+ * Used by dexopt, which can't run the code that creates one.  The thread
+ * goes on the thread list like any other, so a GC will wait for it.
+ */
+bool dvmAttachOptThread(void) {
+    Thread *self;
+    bool ok;
+
+    self = allocThread(gDvm.stackSize);
+    if (self == NULL)
+        return false;
+    self->status = THREAD_VMWAIT;
+
+    dvmLockThreadList(self);
+    ok = prepareThread(self);
+    if (ok) {
+        self->next = gDvm.threadList->next;
+        if (self->next != NULL)
+            self->next->prev = self;
+        self->prev = gDvm.threadList;
+        gDvm.threadList->next = self;
+    } else {
+        releaseThreadId(self);
+    }
+    dvmUnlockThreadList();
+
+    if (!ok) {
+        setThreadSelf(NULL);
+        freeThread(self);
+        return false;
+    }
+
+    LOG_THREAD("threadid=%d: attached for dexopt\n", self->threadId);
+
+    dvmChangeStatus(self, THREAD_RUNNING);
+    return true;
+}
+
+/*
+ * Undo dvmAttachOptThread.  The thread must not be holding any objects
+ * the GC needs to know about.
+ */
+void dvmDetachOptThread(void) {
+    Thread *self = dvmThreadSelf();
+
+    dvmHeapRetireThreadTlabs(self);
+    self->status = THREAD_VMWAIT;
+
+    dvmLockThreadList(self);
+    self->status = THREAD_ZOMBIE;
+    unlinkThread(self);
+    releaseThreadId(self);
+    dvmUnlockThreadList();
+
+    setThreadSelf(NULL);
+    freeThread(self);
+}
+
+
 /*
  * Suspend a single thread.  Do not use to suspend yourself.
  *
@@ -3240,10 +3307,68 @@ LockedObjectData *dvmFindInMonitorList(const Thread *self, const Object *obj) {
  * GC helper functions
  */
 
+/*
+ * Mark the registers in a frame that might hold references.  Registers
+ * are 64-bit slots; objects are at least 8-byte aligned.
+ */
+static void gcScanFrameConservative(const u8 *framePtr, int registersSize) {
+    int i;
+
+    for (i = 0; i < registersSize; i++) {
+        u8 rval = framePtr[i];
+
+        if (rval != 0 && (rval & 0x7) == 0) {
+            dvmMarkIfObject((Object *) rval);
+        }
+    }
+}
+
+/*
+ * Mark the registers that the register map line "regVector" says hold
+ * references.
+ */
+static void gcScanFramePrecise(const u8 *framePtr, int registersSize,
+                               const u1 *regVector) {
+    u1 bits = 0;
+    int i;
+
+    for (i = 0; i < registersSize; i++) {
+        if ((i & 0x07) == 0)
+            bits = *regVector++;
+
+        if ((bits & 0x01) != 0 && framePtr[i] != 0) {
+            Object *obj = (Object *) framePtr[i];
+
+#ifdef WITH_EXTRA_OBJECT_VALIDATION
+            if (!dvmIsValidObject(obj)) {
+                LOGE("GC: invalid object %p in register v%d\n", obj, i);
+                dvmAbort();
+            }
+#endif
+            dvmMarkObjectNonNull(obj);
+        }
+        bits >>= 1;
+    }
+}
+
+/*
+ * Mark the objects referenced from the interpreted stack.
+ *
+ * A frame's registers can be scanned precisely if its method has a
+ * register map and we know which instruction the frame is stopped at.
+ * We know that for every frame that has called another method: the
+ * callee's "savedPc" points at the invoke, which is a GC point.  The
+ * frame on top of the stack, and frames that called into the VM through
+ * a break frame, only export their PC at instructions that can throw,
+ * so it may be stale; those are scanned conservatively, as are native
+ * frames.  Interpreted methods without a map are scanned conservatively
+ * and queued so the HeapWorker can generate one after the GC.
+ */
 static void gcScanInterpStackReferences(Thread *thread) {
-    const u4 *framePtr;
+    const u8 *framePtr;
+    const u2 *currentPc = NULL;
 
-    framePtr = (const u4 *) thread->curFrame;
+    framePtr = (const u8 *) thread->curFrame;
     while (framePtr != NULL) {
         const StackSaveArea *saveArea;
         const Method *method;
@@ -3251,6 +3376,8 @@ static void gcScanInterpStackReferences(Thread *thread) {
         saveArea = SAVEAREA_FROM_FP(framePtr);
         method = saveArea->method;
         if (method != NULL) {
+            const u1 *regVector = NULL;
+
 #ifdef COUNT_PRECISE_METHODS
             /* the GC is running, so no lock required */
             if (!dvmIsNativeMethod(method)) {
@@ -3259,18 +3386,30 @@ static void gcScanInterpStackReferences(Thread *thread) {
                         method->clazz->descriptor, method->name, method);
             }
 #endif
-            int i;
-            for (i = method->registersSize - 1; i >= 0; i--) {
-                u4 rval = *framePtr++;
-//TODO: wrap markifobject in a macro that does pointer checks
-                if (rval != 0 && (rval & 0x3) == 0) {
-                    dvmMarkIfObject((Object *) rval);
+            if (!dvmIsNativeMethod(method)) {
+                if (method->registerMap == NULL) {
+                    dvmQueueRegisterMap(method);
+                } else if (currentPc != NULL) {
+                    regVector = dvmRegisterMapGetLine(method->registerMap,
+                                                      currentPc - method->insns);
                 }
             }
+
+            if (regVector != NULL) {
+                gcScanFramePrecise(framePtr, method->registersSize,
+                                   regVector);
+            } else {
+                gcScanFrameConservative(framePtr, method->registersSize);
+            }
         }
         /* else this is a break frame; nothing to mark.
          */
 
+        /* The caller is stopped at the instruction that called us.  There's
+         * no saved PC in a break frame.
+         */
+        currentPc = saveArea->savedPc;
+
         /* Don't fall into an infinite loop if things get corrupted.
          */
         assert((u_int64_t) saveArea->prevFrame > (u_int64_t) framePtr ||
@@ -141,6 +141,9 @@ typedef struct Thread {
     /* current exception, or NULL if nothing pending */
     Object*     exception;
 
+    /* exceptions thrown since the last dvmClearOptException, during init */
+    int         initExceptionCount;
+
     /* the java/lang/Thread that we are associated with */
     Object*     threadObj;
 
@@ -159,6 +162,9 @@ typedef struct Thread {
     /* hack to make JNI_OnLoad work right */
     Object*     classLoaderOverride;
 
+    /* dexopt: class treated as having a foreign loader in access checks */
+    const ClassObject* optForeignClass;
+
     /* pointer to the monitor lock we're currently waiting on */
     /* (do not set or clear unless the Monitor itself is held) */
     /* TODO: consider changing this to Object* for better JDWP interaction */
@@ -181,6 +187,18 @@ typedef struct Thread {
     /* JDWP invoke-during-breakpoint support */
     DebugInvokeReq  invokeReq;
 
+    /* thread-local allocation buffers, one per size class */
+    Tlab        tlabs[TLAB_NUM_SIZE_CLASSES];
+
+    /* chunk of the LinearAlloc region we hand out small blocks from */
+    struct LinearAllocSeg* linearAllocSeg;
+    int         linearAllocOffset;
+    int         linearAllocEnd;
+
+    /* allocation sampler: bytes to go before our next sample */
+    int         allocSampleBytesLeft;
+    int         allocSampleGeneration;
+
 #ifdef WITH_MONITOR_TRACKING
     /* objects locked by this thread; most recent is at head of list */
     struct LockedObjectData* pLockedObjects;
@@ -196,6 +214,12 @@ typedef struct Thread {
     bool        cpuClockBaseSet;
     u8          cpuClockBase;
 
+    /* method trace records not yet handed to the writer */
+    struct MethodTraceChunk* traceChunk;
+
+    /* set by the sampling profiler; record our stack at the next check */
+    volatile bool samplePending;
+
     /* memory allocation profiling state */
     AllocProfState allocProf;
 #endif
@@ -283,6 +307,10 @@ bool dvmCheckSuspendPending(Thread* self);
 INLINE void dvmCheckSuspendQuick(Thread* self) {
     if (self->suspendCount != 0)
         dvmCheckSuspendPending(self);
+#ifdef WITH_PROFILER
+    if (self->samplePending)
+        dvmRecordStackSample(self);
+#endif
 }
 
 /*
@@ -363,6 +391,15 @@ bool dvmCreateInternalThread(pthread_t* pHandle, const char* name,
 bool dvmAttachCurrentThread(const JavaVMAttachArgs* pArgs, bool isDaemon);
 void dvmDetachCurrentThread(void);
 
+/*
+ * Attach or detach the current thread without a java.lang.Thread.  Used
+ * by dexopt's worker threads, which run before any Thread objects can be
+ * created.  The thread is on the thread list, so it can be suspended for
+ * GC, and is left in THREAD_RUNNING.
+ */
+bool dvmAttachOptThread(void);
+void dvmDetachOptThread(void);
+
 /*
  * Get the "main" or "system" thread group.
  */
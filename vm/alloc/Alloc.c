@@ -34,6 +34,7 @@
 bool dvmGcStartup(void)
 {
     dvmInitMutex(&gDvm.gcHeapLock);
+    pthread_cond_init(&gDvm.gcHeapCond, NULL);
 
     return dvmHeapStartup();
 }
@@ -50,6 +51,14 @@ bool dvmGcStartupAfterZygote(void)
     return dvmHeapStartupAfterZygote();
 }
 
+/*
+ * Stop the concurrent GC daemon, if it was started.
+ */
+void dvmGcThreadShutdown(void)
+{
+    dvmHeapThreadShutdown();
+}
+
 /*
  * Shut the GC down.
  */
@@ -64,7 +73,16 @@ void dvmGcShutdown(void)
  */
 bool dvmGcPreZygoteFork(void)
 {
-    return dvmHeapSourceStartupBeforeFork();
+    bool ok;
+
+    /* Allocation moves to a new heap; don't keep filling old TLABs.
+     */
+    dvmLockHeap();
+    dvmHeapRetireAllTlabs();
+    ok = dvmHeapSourceStartupBeforeFork();
+    dvmUnlockHeap();
+
+    return ok;
 }
 
 /*
@@ -263,7 +281,8 @@ void dvmCollectGarbage(bool collectSoftReferences)
     dvmLockHeap();
 
     LOGVV("Explicit GC\n");
-    dvmCollectGarbageInternal(collectSoftReferences);
+    dvmWaitForConcurrentGcToComplete();
+    dvmCollectGarbageInternal(collectSoftReferences, GC_EXPLICIT);
 
     dvmUnlockHeap();
 }
@@ -26,6 +26,7 @@
  */
 bool dvmGcStartup(void);
 bool dvmGcStartupAfterZygote(void);
+void dvmGcThreadShutdown(void);
 void dvmGcShutdown(void);
 bool dvmGcLateInit(void);
 
@@ -54,6 +55,12 @@ void* dvmMalloc(size_t size, int flags);
  */
 Object* dvmAllocObject(ClassObject* clazz, int flags);
 
+/*
+ * Return the unused part of the calling thread's allocation buffers to
+ * the heap.  Called when the thread is done allocating for good.
+ */
+void dvmHeapRetireThreadTlabs(Thread* self);
+
 /*
  * Clear flags set by dvmMalloc.  Pass in a bit mask of the flags that
  * should be cleared.
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Card table for the concurrent collector's write barrier.
+ */
+#include "Dalvik.h"
+#include "alloc/HeapBitmap.h"
+#include "alloc/HeapInternal.h"
+#include "alloc/HeapSource.h"
+
+#include <sys/mman.h>   // for mmap()
+#include <ashmem.h>
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+#define ALIGN_UP_TO_PAGE_SIZE(p) \
+    (((size_t)(p) + (PAGE_SIZE - 1)) & ~(PAGE_SIZE - 1))
+
+/* The heaps are separate mappings, so the table has to span whatever
+ * lies between them.  Don't bother if that's much more than the heap
+ * could ever use.
+ */
+#define CARD_TABLE_MAX_SPAN_FACTOR  4
+
+bool dvmCardTableStartup()
+{
+    HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
+    ssize_t numBitmaps;
+    u_int64_t lo, hi;
+    size_t length, allocLen;
+    u1 *table;
+    ssize_t i;
+    int fd;
+
+    assert(gDvm.cardTableLength == 0);
+
+    numBitmaps = dvmHeapSourceGetObjectBitmaps(objectBitmaps,
+            HEAP_SOURCE_MAX_HEAP_COUNT);
+    if (numBitmaps <= 0) {
+        return false;
+    }
+    lo = ~(u_int64_t)0;
+    hi = 0;
+    for (i = 0; i < numBitmaps; i++) {
+        const HeapBitmap *hb = &objectBitmaps[i];
+
+        if (hb->base < lo) {
+            lo = hb->base;
+        }
+        if (hb->base + HB_MAX_OFFSET(hb) > hi) {
+            hi = hb->base + HB_MAX_OFFSET(hb);
+        }
+    }
+    if (hi - lo > (u_int64_t)gDvm.heapSizeMax * CARD_TABLE_MAX_SPAN_FACTOR) {
+        LOGI_HEAP("Heaps span %llu bytes; not using a card table\n",
+                (unsigned long long)(hi - lo));
+        return false;
+    }
+
+    length = (hi - lo + GC_CARD_SIZE - 1) >> GC_CARD_SHIFT;
+    allocLen = ALIGN_UP_TO_PAGE_SIZE(length);
+    fd = ashmem_create_region("dalvik-card-table", allocLen);
+    if (fd < 0) {
+        LOGE_HEAP("Could not create %zu-byte ashmem card table\n", allocLen);
+        return false;
+    }
+    table = mmap(NULL, allocLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        LOGE_HEAP("Could not mmap %zu-byte ashmem card table\n", allocLen);
+        return false;
+    }
+
+    /* Publish the length last; a zero length is what keeps
+     * dvmMarkCard() away from a table that isn't there yet.
+     */
+    gDvm.cardTable = table;
+    gDvm.cardTableOrigin = lo;
+    MEM_BARRIER();
+    gDvm.cardTableLength = length;
+
+    LOGV_HEAP("Card table: %zu cards from 0x%llx\n",
+            length, (unsigned long long)lo);
+    return true;
+}
+
+void dvmCardTableShutdown()
+{
+    size_t length = gDvm.cardTableLength;
+
+    if (length != 0) {
+        gDvm.cardTableLength = 0;
+        munmap(gDvm.cardTable, ALIGN_UP_TO_PAGE_SIZE(length));
+        gDvm.cardTable = NULL;
+    }
+}
+
+void dvmClearCardTable()
+{
+    if (gDvm.cardTableLength != 0) {
+        memset(gDvm.cardTable, GC_CARD_CLEAN, gDvm.cardTableLength);
+    }
+}
+
+void dvmMarkCard(const void *addr)
+{
+    size_t card = ((u_int64_t)addr - gDvm.cardTableOrigin) >> GC_CARD_SHIFT;
+
+    if (card < gDvm.cardTableLength) {
+        gDvm.cardTable[card] = GC_CARD_DIRTY;
+    }
+}
+
+u1 *dvmCardFromAddr(const void *addr)
+{
+    size_t card = ((u_int64_t)addr - gDvm.cardTableOrigin) >> GC_CARD_SHIFT;
+
+    assert(card < gDvm.cardTableLength);
+    return gDvm.cardTable + card;
+}
+
+void *dvmAddrFromCard(const u1 *card)
+{
+    assert(card >= gDvm.cardTable &&
+            card < gDvm.cardTable + gDvm.cardTableLength);
+    return (void *)(gDvm.cardTableOrigin +
+            ((u_int64_t)(card - gDvm.cardTable) << GC_CARD_SHIFT));
+}
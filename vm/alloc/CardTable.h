@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Card table for the concurrent collector's write barrier.
+ *
+ * The heap is divided into GC_CARD_SIZE-byte cards, each with one byte
+ * in the table.  Storing a non-NULL reference into an object dirties the
+ * card holding the start of that object (not the field), so the remark
+ * pause only has to look at objects whose first byte is on a dirty card.
+ * A card covers exactly one word of a mark bitmap.
+ */
+#ifndef _DALVIK_ALLOC_CARD_TABLE
+#define _DALVIK_ALLOC_CARD_TABLE
+
+#define GC_CARD_SHIFT   9
+#define GC_CARD_SIZE    (1 << GC_CARD_SHIFT)
+#define GC_CARD_CLEAN   0
+#define GC_CARD_DIRTY   0x70
+
+/*
+ * Create a card table covering every heap in the heap source.  Must be
+ * called once the set of heaps is final, i.e. after the zygote split.
+ * Returns false (and leaves the table empty, so the barrier does
+ * nothing) if the heaps are too spread out to cover cheaply.
+ */
+bool dvmCardTableStartup(void);
+void dvmCardTableShutdown(void);
+
+/*
+ * Mark every card clean.  Mutators must be suspended.
+ */
+void dvmClearCardTable(void);
+
+/*
+ * The write barrier: dirty the card holding <addr>.  Addresses outside
+ * the table are ignored, as is everything before the table exists.
+ */
+void dvmMarkCard(const void *addr);
+
+/*
+ * Convert between heap addresses and cards.
+ */
+u1 *dvmCardFromAddr(const void *addr);
+void *dvmAddrFromCard(const u1 *card);
+
+#endif /*_DALVIK_ALLOC_CARD_TABLE*/
@@ -29,12 +29,19 @@
 
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <limits.h>
 #include <errno.h>
 
 #define kNonCollectableRefDefault   16
 #define kFinalizableRefDefault      128
 
+/* A minor collection has to free at least 1/MINOR_GC_MIN_YIELD of the
+ * bytes allocated since the previous collection for the next one to be
+ * minor too.
+ */
+#define MINOR_GC_MIN_YIELD          4
+
 /*
  * Initialize the GC heap.
  *
@@ -53,9 +60,7 @@ bool dvmHeapStartup()
     if (gcHeap == NULL) {
         return false;
     }
-    gcHeap->heapWorkerCurrentObject = NULL;
-    gcHeap->heapWorkerCurrentMethod = NULL;
-    gcHeap->heapWorkerInterpStartTime = 0LL;
+    memset(gcHeap->heapWorkers, 0, sizeof(gcHeap->heapWorkers));
     gcHeap->softReferenceCollectionState = SR_COLLECT_NONE;
     gcHeap->softReferenceHeapSizeThreshold = gDvm.heapSizeStart;
     gcHeap->ddmHpifWhen = 0;
@@ -104,12 +109,34 @@ fail:
 
 bool dvmHeapStartupAfterZygote()
 {
+    bool ok;
+
     /* Update our idea of the last GC start time so that we
      * don't use the last time that Zygote happened to GC.
      */
     gDvm.gcHeap->gcStartTime = dvmGetRelativeTimeUsec();
 
-    return dvmHeapSourceStartupAfterZygote();
+    /* TLABs inherited from the zygote point into what's about to
+     * become an old heap.
+     */
+    dvmLockHeap();
+    dvmHeapRetireAllTlabs();
+    ok = dvmHeapSourceStartupAfterZygote();
+    dvmUnlockHeap();
+    if (!ok) {
+        return false;
+    }
+
+    /* The set of heaps won't change from here on, so this is where
+     * the card table can be laid over them.  Without one, every
+     * collection stops the world and traces the whole heap.
+     */
+    if ((gDvm.concurrentMarkSweep || gDvm.generationalGc) &&
+            dvmCardTableStartup() && gDvm.concurrentMarkSweep)
+    {
+        return dvmHeapSourceStartupGcDaemon();
+    }
+    return true;
 }
 
 void dvmHeapShutdown()
@@ -137,6 +164,9 @@ void dvmHeapShutdown()
         dvmHeapFreeLargeTable(gcHeap->referenceOperations);
         gcHeap->referenceOperations = NULL;
 
+        dvmHeapBitmapDeleteList(gcHeap->oldBitmaps, gcHeap->numOldBitmaps);
+        gcHeap->numOldBitmaps = 0;
+
         /* Destroy the heap.  Any outstanding pointers
          * will point to unmapped memory (unless/until
          * someone else maps it).  This frees gcHeap
@@ -144,6 +174,12 @@ void dvmHeapShutdown()
          */
         dvmHeapSourceShutdown(gcHeap);
     }
+    dvmCardTableShutdown();
+}
+
+void dvmHeapThreadShutdown()
+{
+    dvmHeapSourceThreadShutdown();
 }
 
 /*
@@ -193,22 +229,49 @@ void dvmUnlockHeap()
     dvmUnlockMutex(&gDvm.gcHeapLock);
 }
 
-/* Pop an object from the list of pending finalizations and
- * reference clears/enqueues, and return the object.
- * The caller must call dvmReleaseTrackedAlloc()
- * on the object when finished.
+/* Sleep on gcHeapCond until the collection in progress is done.
+ * Nothing else can start one while a collection is running, so
+ * gcRunning is only ever seen here when a collection has let go
+ * of the heap lock to mark or sweep.
+ */
+void dvmWaitForConcurrentGcToComplete()
+{
+    Thread *self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_VMWAIT;
+    int cc;
+
+    while (gDvm.gcHeap->gcRunning) {
+        if (self != NULL) {
+            oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        }
+        cc = pthread_cond_wait(&gDvm.gcHeapCond, &gDvm.gcHeapLock);
+        assert(cc == 0);
+        if (self != NULL) {
+            dvmChangeStatus(self, oldStatus);
+        }
+    }
+}
+
+/* Pop up to "max" objects from the list of pending finalizations and
+ * reference clears/enqueues, and fill in "work" with them.  A batch
+ * holds either reference operations or finalizations, never both.
+ * The caller must call dvmReleaseTrackedAlloc() on each object when
+ * finished, and must hold heapWorkerLock.
  *
- * Typically only called by the heap worker thread.
+ * Returns the number of entries filled in, which is zero if there's
+ * nothing the caller can do right now.
+ *
+ * Typically only called by the heap worker threads.
  */
-Object *dvmGetNextHeapWorkerObject(HeapWorkerOperation *op)
+int dvmGetNextHeapWorkerObjects(HeapWorkerWork *work, int max)
 {
-    Object *obj;
-    LargeHeapRefTable *table;
     GcHeap *gcHeap = gDvm.gcHeap;
+    int count, i;
 
-    assert(op != NULL);
+    assert(work != NULL);
+    assert(max > 0);
 
-    obj = NULL;
+    count = 0;
 
     dvmLockMutex(&gDvm.heapWorkerListLock);
 
@@ -221,38 +284,57 @@ Object *dvmGetNextHeapWorkerObject(HeapWorkerOperation *op)
      * on the reference before finalize() is called on the referent.
      * Both of these operations will always be scheduled at the same
      * time, so handling reference operations first will guarantee
-     * the required order.
+     * the required order.  With several worker threads, another one
+     * may still be running the reference operations it took, so no
+     * finalizations are handed out until those have finished too.
      */
-    obj = dvmHeapGetNextObjectFromLargeTable(&gcHeap->referenceOperations);
-    if (obj != NULL) {
+    while (count < max) {
+        Object *obj;
         u_int64_t workBits;
 
+        obj = dvmHeapGetNextObjectFromLargeTable(
+                &gcHeap->referenceOperations);
+        if (obj == NULL) {
+            break;
+        }
+
         workBits = (u_int64_t)obj & (WORKER_CLEAR | WORKER_ENQUEUE);
         assert(workBits != 0);
-        obj = (Object *)((u_int64_t)obj & ~(WORKER_CLEAR | WORKER_ENQUEUE));
+        work[count].obj =
+                (Object *)((u_int64_t)obj & ~(WORKER_CLEAR | WORKER_ENQUEUE));
+        work[count].op = workBits;
+        count++;
+    }
+    gcHeap->heapWorkerRefOpsInFlight += count;
 
-        *op = workBits;
-    } else {
-        obj = dvmHeapGetNextObjectFromLargeTable(
-                &gcHeap->pendingFinalizationRefs);
-        if (obj != NULL) {
-            *op = WORKER_FINALIZE;
+    if (count == 0 && gcHeap->heapWorkerRefOpsInFlight == 0) {
+        while (count < max) {
+            Object *obj;
+
+            obj = dvmHeapGetNextObjectFromLargeTable(
+                    &gcHeap->pendingFinalizationRefs);
+            if (obj == NULL) {
+                break;
+            }
+            work[count].obj = obj;
+            work[count].op = WORKER_FINALIZE;
+            count++;
         }
     }
 
-    if (obj != NULL) {
-        /* Don't let the GC collect the object until the
-         * worker thread is done with it.
-         *
-         * This call is safe;  it uses thread-local storage
-         * and doesn't acquire any locks.
-         */
-        dvmAddTrackedAlloc(obj, NULL);
+    /* Don't let the GC collect the objects until the
+     * worker thread is done with them.
+     *
+     * This call is safe;  it uses thread-local storage
+     * and doesn't acquire any locks.
+     */
+    for (i = 0; i < count; i++) {
+        dvmAddTrackedAlloc(work[i].obj, NULL);
     }
 
     dvmUnlockMutex(&gDvm.heapWorkerListLock);
 
-    return obj;
+    return count;
 }
 
 /* Used for a heap size change hysteresis to avoid collecting
@@ -317,7 +399,8 @@ static void gcForMalloc(bool collectSoftReferences)
      */
     LOGD_HEAP("dvmMalloc initiating GC%s\n",
             collectSoftReferences ? "(collect SoftReferences)" : "");
-    dvmCollectGarbageInternal(collectSoftReferences);
+    dvmWaitForConcurrentGcToComplete();
+    dvmCollectGarbageInternal(collectSoftReferences, GC_FOR_MALLOC);
 }
 
 /* Try as hard as possible to allocate some memory.
@@ -352,8 +435,20 @@ static DvmHeapChunk *tryMalloc(size_t size)
         return hc;
     }
 
+    /* A concurrent collection is already on its way to freeing
+     * some space; give it a chance to finish before starting
+     * another one.
+     */
+    if (gDvm.gcHeap->gcRunning) {
+        dvmWaitForConcurrentGcToComplete();
+        hc = dvmHeapSourceAlloc(size + sizeof(DvmHeapChunk));
+        if (hc != NULL) {
+            return hc;
+        }
+    }
+
     /* The allocation failed.  Free up some space by doing
-     * a full garbage collection.  This may grow the heap
+     * a garbage collection.  This may grow the heap
      * if the live set is sufficiently large.
      */
     gcForMalloc(false);
@@ -362,6 +457,18 @@ static DvmHeapChunk *tryMalloc(size_t size)
         return hc;
     }
 
+    /* If that only collected the young objects, try a full
+     * collection before growing the heap.
+     */
+    if (gDvm.gcHeap->lastGcWasMinor) {
+        gDvm.gcHeap->tryMinorGc = false;
+        gcForMalloc(false);
+        hc = dvmHeapSourceAlloc(size + sizeof(DvmHeapChunk));
+        if (hc != NULL) {
+            return hc;
+        }
+    }
+
     /* Even that didn't work;  this is an exceptional state.
      * Try harder, growing the heap if necessary.
      */
@@ -405,6 +512,77 @@ collect_soft_refs:
     return NULL;
 }
 
+/* Allocate <size> bytes from self's TLABs, refilling the one for this
+ * size class under the heap lock if it's empty.  Returns NULL if that
+ * doesn't work out, without trying to GC; dvmMalloc() then takes the
+ * normal path, which does.
+ */
+static void *tlabMalloc(Thread *self, size_t size)
+{
+    DvmHeapChunk *hc;
+    size_t n = size + sizeof(DvmHeapChunk);
+
+    hc = dvmHeapSourceAllocTlab(self->tlabs, n);
+    if (hc == NULL) {
+        dvmLockHeap();
+        /* A GC in progress has already retired everyone's TLABs;
+         * don't hand out new ones under it until it's down to
+         * sweeping.
+         */
+        if ((!gDvm.gcHeap->gcRunning || gDvm.gcHeap->sweeping) &&
+            dvmHeapSourceRefillTlab(self->tlabs, n))
+        {
+            hc = dvmHeapSourceAllocTlab(self->tlabs, n);
+        }
+        dvmUnlockHeap();
+        if (hc == NULL) {
+            return NULL;
+        }
+    }
+
+#if WITH_OBJECT_HEADERS
+    hc->header = OBJECT_HEADER;
+    hc->birthGeneration = gGeneration;
+#endif
+    return hc->data;
+}
+
+/* Give the unused part of every thread's TLABs back to the heap.
+ * Done at the start of each GC, so that the space can be swept and
+ * reused, and before the active heap changes, so that no thread keeps
+ * allocating out of the old one.
+ *
+ * The caller must hold the heap lock, and every other thread must be
+ * suspended or otherwise unable to allocate.
+ */
+void dvmHeapRetireAllTlabs()
+{
+    Thread *thread;
+    size_t i;
+
+    dvmLockThreadList(dvmThreadSelf());
+    for (thread = gDvm.threadList; thread != NULL; thread = thread->next) {
+        for (i = 0; i < TLAB_NUM_SIZE_CLASSES; i++) {
+            dvmHeapSourceRetireTlab(&thread->tlabs[i]);
+        }
+    }
+    dvmUnlockThreadList();
+}
+
+/* Give the unused part of self's TLABs back to the heap.  Called by a
+ * thread on its way out, once it's done allocating.
+ */
+void dvmHeapRetireThreadTlabs(Thread *self)
+{
+    size_t i;
+
+    dvmLockHeap();
+    for (i = 0; i < TLAB_NUM_SIZE_CLASSES; i++) {
+        dvmHeapSourceRetireTlab(&self->tlabs[i]);
+    }
+    dvmUnlockHeap();
+}
+
 /* Throw an OutOfMemoryError if there's a thread to attach it to.
  * Avoid recursing.
  *
@@ -537,6 +715,30 @@ void* dvmMalloc(size_t size, int flags)
     }
 #endif
 
+    /* Plain small objects come out of the thread's TLABs, which only
+     * need the heap lock when one runs dry.  Finalizable and ALLOC_NO_GC
+     * objects have to be entered in the heap's tables under the lock,
+     * and the allocation profiler wants every allocation counted there.
+     */
+    if ((flags & (ALLOC_FINALIZABLE | ALLOC_NO_GC)) == 0 &&
+        size + sizeof(DvmHeapChunk) <= TLAB_MAX_ALLOC_SIZE
+#ifdef WITH_PROFILER
+        && !gDvm.allocProf.enabled
+#endif
+        )
+    {
+        Thread* self = dvmThreadSelf();
+        if (self != NULL) {
+            ptr = tlabMalloc(self, size);
+            if (ptr != NULL) {
+                if ((flags & ALLOC_DONT_TRACK) == 0) {
+                    dvmAddTrackedAlloc(ptr, NULL);
+                }
+                return ptr;
+            }
+        }
+    }
+
     dvmLockHeap();
 
     /* Try as hard as possible to allocate some memory.
@@ -570,6 +772,15 @@ alloc_succeeded:
 #endif
         ptr = hc->data;
 
+        /* If a concurrent collection is marking, the new object
+         * has to survive it: it's born marked, and its card is
+         * dirtied so that the remark pause scans whatever gets
+         * stored into it in the meantime.
+         */
+        if (gcHeap->gcRunning && !gcHeap->sweeping) {
+            dvmHeapMarkNewObject(ptr);
+        }
+
         /* The caller may not want us to collect this object.
          * If not, throw it in the nonCollectableRefs table, which
          * will be added to the root set when we GC.
@@ -714,19 +925,47 @@ size_t dvmObjectSizeInHeap(const Object *obj)
  * is awkward because debugger requests can cause allocations.  The easiest
  * way to enforce this is to refuse to GC on an allocation made by the
  * JDWP thread -- we have to expand the heap or fail.
+ *
+ * A GC_CONCURRENT collection only stops the world twice: once to mark
+ * the roots, and once more at the end to mark them again and rescan
+ * the objects on dirty cards.  In between, the heap lock is released
+ * and the mutators run while this thread traces the heap.
+ *
+ * Collections for an allocation or on the concurrent trigger are
+ * minor when they can be: everything that survived the previous
+ * collection is left marked, and only the objects allocated since
+ * then are traced and swept.  They're found from the roots and from
+ * the remembered set (see dvmHeapScanRememberedSet()).  Minor
+ * collections always stop the world while marking.
+ *
+ * Unless an hprof dump is being written, the sweep of every kind of
+ * collection runs after the world has been resumed, with the heap
+ * lock only held while each batch of objects is freed.  gcRunning
+ * stays set until it's done, so nobody else starts a collection.
  */
-void dvmCollectGarbageInternal(bool collectSoftReferences)
+void dvmCollectGarbageInternal(bool collectSoftReferences,
+        enum GcReason reason)
 {
     GcHeap *gcHeap = gDvm.gcHeap;
+    Thread *self = dvmThreadSelf();
+    ThreadStatus oldStatus = THREAD_RUNNING;
     Object *softReferences;
     Object *weakReferences;
     Object *phantomReferences;
 
     u8 now;
+    u8 rootEnd = 0;
+    u8 dirtyStart = 0;
+    u8 pauseEnd = 0;
     s8 timeSinceLastGc;
     s8 gcElapsedTime;
     int numFreed;
     size_t sizeFreed;
+    size_t bytesAllocated;
+    bool concurrent;
+    bool concurrentSweep;
+    bool minor;
+    int cc;
 
 #if DVM_TRACK_HEAP_MARKING
     /* Since weak and soft references are always cleared,
@@ -757,10 +996,32 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
     }
     gcHeap->gcStartTime = now;
 
+    /* A minor collection needs an old generation to leave alone and
+     * a remembered set to find the young objects it points to, and
+     * can't be asked to clear SoftReferences.  Explicit requests and
+     * heap dumps always look at everything.
+     */
+    minor = ((reason == GC_FOR_MALLOC || reason == GC_CONCURRENT) &&
+            gDvm.generationalGc && gcHeap->tryMinorGc &&
+            !collectSoftReferences &&
+            gcHeap->softReferenceCollectionState == SR_COLLECT_NONE &&
+            gcHeap->numOldBitmaps == dvmHeapSourceGetNumHeaps() &&
+            gDvm.cardTableLength != 0);
+
+    /* Marking alongside the mutators relies on the card table.
+     */
+    concurrent = (reason == GC_CONCURRENT && gDvm.cardTableLength != 0 &&
+            self != NULL && !minor);
+
     LOGV_HEAP("GC starting -- suspending threads\n");
 
     dvmSuspendAllThreads(SUSPEND_FOR_GC);
 
+    /* Nobody can allocate now; reclaim what's left of their TLABs
+     * so that the sweep and the heap statistics see a settled heap.
+     */
+    dvmHeapRetireAllTlabs();
+
     /* Get the priority (the "nice" value) of the current thread.  The
      * getpriority() call can legitimately return -1, so we have to
      * explicitly test errno.
@@ -851,7 +1112,15 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
         gcHeap->hprofDumpOnGc = false;
         gcHeap->hprofFileName = NULL;
     }
+
+    /* The dump has to see the heap hold still, and all of it.
+     */
+    if (gcHeap->hprofContext != NULL) {
+        concurrent = false;
+        minor = false;
+    }
 #endif
+    bytesAllocated = dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
 
     if (timeSinceLastGc < 10000) {
         LOGD_HEAP("GC! (%dms since last GC)\n",
@@ -867,7 +1136,7 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
 
     /* Set up the marking context.
      */
-    dvmHeapBeginMarkStep();
+    dvmHeapBeginMarkStep(minor);
 
     /* Mark the set of objects that are strongly reachable from the roots.
      */
@@ -893,12 +1162,50 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
         gcHeap->softReferenceCollectionState = SR_COLLECT_ALL;
     }
 
+    if (concurrent) {
+        /* The roots are marked; let everyone else go while we trace
+         * from them.  From here until the remark, reference stores
+         * dirty cards and new objects are born marked (see dvmMalloc()).
+         * TLABs stay empty, since gcRunning keeps them from refilling.
+         */
+        dvmClearCardTable();
+        dvmUnlockMutex(&gDvm.heapWorkerListLock);
+        dvmUnlockMutex(&gDvm.heapWorkerLock);
+        dvmUnlockHeap();
+        dvmResumeAllThreads(SUSPEND_FOR_GC);
+        rootEnd = dvmGetRelativeTimeUsec();
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    }
+
     /* Recursively mark any objects that marked objects point to strongly.
      * If we're not collecting soft references, soft-reachable
      * objects will also be marked.
      */
-    LOGD_HEAP("Recursing...");
-    dvmHeapScanMarkedObjects();
+    if (minor) {
+        LOGD_HEAP("Scanning the remembered set...");
+        dvmHeapScanRememberedSet();
+    } else {
+        LOGD_HEAP("Recursing...");
+        dvmHeapScanMarkedObjects();
+    }
+
+    if (concurrent) {
+        /* Stop the world again, in the same lock order as above, and
+         * catch up with what the mutators did while we were marking:
+         * their roots may have changed, and anything they stored into
+         * an object left that object's card dirty.
+         */
+        dvmChangeStatus(self, oldStatus);
+        dvmLockHeap();
+        dirtyStart = dvmGetRelativeTimeUsec();
+        dvmSuspendAllThreads(SUSPEND_FOR_GC);
+        dvmLockMutex(&gDvm.heapWorkerLock);
+        dvmLockMutex(&gDvm.heapWorkerListLock);
+
+        LOGD_HEAP("Remarking...");
+        dvmHeapReMarkRootSet();
+        dvmHeapReScanMarkedObjects();
+    }
 #if DVM_TRACK_HEAP_MARKING
     strongMarkCount = gcHeap->markCount;
     strongMarkSize = gcHeap->markSize;
@@ -965,14 +1272,61 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
 #ifdef WITH_DEADLOCK_PREDICTION
     dvmDumpMonitorInfo("before sweep");
 #endif
+    dvmHeapSweepSystemWeaks();
+
+    /* The mark bitmaps become the object bitmaps from here on.
+     */
+    dvmHeapFinishMarkStep();
+
+    /* Let everyone go before sweeping, unless hprof still wants
+     * to see the unmarked objects.
+     */
+    concurrentSweep = (gDvm.concurrentMarkSweep && self != NULL);
+#if WITH_HPROF
+    if (gcHeap->hprofContext != NULL) {
+        concurrentSweep = false;
+    }
+#endif
+    if (concurrentSweep) {
+        gcHeap->sweeping = true;
+        dvmUnlockMutex(&gDvm.heapWorkerListLock);
+        dvmUnlockMutex(&gDvm.heapWorkerLock);
+        dvmResumeAllThreads(SUSPEND_FOR_GC);
+        pauseEnd = dvmGetRelativeTimeUsec();
+        dvmUnlockHeap();
+        oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    }
+
     LOGD_HEAP("Sweeping...");
-    dvmHeapSweepUnmarkedObjects(&numFreed, &sizeFreed);
+    dvmHeapSweepUnmarkedObjects(concurrentSweep, &numFreed, &sizeFreed);
 #ifdef WITH_DEADLOCK_PREDICTION
     dvmDumpMonitorInfo("after sweep");
 #endif
 
-    LOGD_HEAP("Cleaning up...");
-    dvmHeapFinishMarkStep();
+    if (concurrentSweep) {
+        dvmChangeStatus(self, oldStatus);
+        dvmLockHeap();
+        gcHeap->sweeping = false;
+    }
+
+    /* Keep doing minor collections while they pay for themselves;
+     * once one frees less than a MINOR_GC_MIN_YIELD'th of the young
+     * objects, the next collection is a full one.
+     */
+    if (minor) {
+        size_t youngBytes = 0;
+
+        if (bytesAllocated > gcHeap->oldBytesAllocated) {
+            youngBytes = bytesAllocated - gcHeap->oldBytesAllocated;
+        }
+
+        gcHeap->tryMinorGc = (sizeFreed * MINOR_GC_MIN_YIELD >= youngBytes);
+    } else {
+        gcHeap->tryMinorGc = true;
+    }
+    gcHeap->lastGcWasMinor = minor;
+    gcHeap->oldBytesAllocated =
+            dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
 
     LOGD_HEAP("Done.");
 
@@ -1013,10 +1367,27 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
 
     gcHeap->gcRunning = false;
 
-    dvmUnlockMutex(&gDvm.heapWorkerListLock);
-    dvmUnlockMutex(&gDvm.heapWorkerLock);
+    /* Wake up anyone who found a concurrent collection in progress.
+     * They'll get the heap lock when our caller lets go of it.
+     */
+    cc = pthread_cond_broadcast(&gDvm.gcHeapCond);
+    assert(cc == 0);
 
-    dvmResumeAllThreads(SUSPEND_FOR_GC);
+    if (!concurrentSweep) {
+        dvmUnlockMutex(&gDvm.heapWorkerListLock);
+        dvmUnlockMutex(&gDvm.heapWorkerLock);
+
+        dvmResumeAllThreads(SUSPEND_FOR_GC);
+        pauseEnd = dvmGetRelativeTimeUsec();
+    }
+    if (concurrent) {
+        LOGD_HEAP("Concurrent GC paused %dms + %dms\n",
+                (int)((rootEnd - gcHeap->gcStartTime) / 1000),
+                (int)((pauseEnd - dirtyStart) / 1000));
+    } else {
+        LOGD_HEAP("%s paused %dms\n", minor ? "Minor GC" : "GC",
+                (int)((pauseEnd - gcHeap->gcStartTime) / 1000));
+    }
     if (oldThreadPriority != kInvalidPriority) {
         if (setpriority(PRIO_PROCESS, 0, oldThreadPriority) != 0) {
             LOGW_HEAP("Unable to reset priority to %d: %s\n",
@@ -1054,8 +1425,153 @@ void dvmCollectGarbageInternal(bool collectSoftReferences)
 }
 
 #if WITH_HPROF
+/*
+ * Take or release the locks that marking takes, other than the ones a
+ * collection already holds, around a fork().  In the child, whoever
+ * held them is gone, so letting go of the copies is all we can do;
+ * that's safe with the default (non-error-checking) mutexes.
+ */
+static void lockForSnapshot(Thread *self)
+{
+    if (gDvm.loadedClasses != NULL) {
+        dvmLockLoadedClasses();
+    }
+    dvmLockMutex(&gDvm.jniGlobalRefLock);
+    if (gDvm.dbgRegistry != NULL) {
+        dvmHashTableLock(gDvm.dbgRegistry);
+    }
+    dvmLockThreadList(self);
+}
+
+static void unlockForSnapshot(void)
+{
+    dvmUnlockThreadList();
+    if (gDvm.dbgRegistry != NULL) {
+        dvmHashTableUnlock(gDvm.dbgRegistry);
+    }
+    dvmUnlockMutex(&gDvm.jniGlobalRefLock);
+    if (gDvm.loadedClasses != NULL) {
+        dvmUnlockLoadedClasses();
+    }
+}
+
+/*
+ * The child's half of a snapshot dump.  It's the only thread in its
+ * process and the heap is its own copy, so it can mark and dump the
+ * way a stop-the-world collection would.  Nothing is cleared or freed;
+ * the process exits when the file is written.  Referents are kept, since
+ * they were all still there when the snapshot was taken.
+ *
+ * Returns 0 on success.
+ */
+static int snapshotChildDump(const char *fileName)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    hprof_context_t *ctx;
+
+    ctx = hprofStartup(fileName);
+    if (ctx == NULL) {
+        return -1;
+    }
+    hprofStartHeapDump(ctx);
+    gcHeap->hprofContext = ctx;
+    gcHeap->gcRunning = true;
+
+    dvmHeapBeginMarkStep(false);
+    dvmHeapMarkRootSet();
+    gcHeap->softReferences = NULL;
+    gcHeap->weakReferences = NULL;
+    gcHeap->phantomReferences = NULL;
+    gcHeap->markAllReferents = true;
+    dvmHeapScanMarkedObjects();
+    dvmHeapDumpHprofObjects();
+
+    hprofFinishHeapDump(ctx);
+    gcHeap->hprofContext = NULL;
+    return hprofShutdown(ctx) ? 0 : -1;
+}
+
+/*
+ * Dump the heap from a fork()ed copy of the process.  The world is
+ * stopped only long enough to fork; the caller then waits for the
+ * child while everyone else runs.  The heap lock must be held; it's
+ * released before waiting.
+ */
+static int dumpHeapSnapshot(const char *fileName)
+{
+    Thread *self = dvmThreadSelf();
+    ThreadStatus oldStatus;
+    char nameBuf[128];
+    u8 start, pause;
+    pid_t pid;
+    int status;
+
+    if (fileName == NULL) {
+        /* no filename was provided; invent one */
+        sprintf(nameBuf, "/data/misc/heap-dump-tm%d-pid%d.hprof",
+            (int) time(NULL), (int) getpid());
+        fileName = nameBuf;
+    }
+
+    start = dvmGetRelativeTimeUsec();
+    dvmSuspendAllThreads(SUSPEND_FOR_GC);
+    dvmHeapRetireAllTlabs();
+
+    /* Same order as a collection; the child needs the pending lists
+     * and the tables it marks from to be in one piece.
+     */
+    dvmLockMutex(&gDvm.heapWorkerLock);
+    dvmLockMutex(&gDvm.heapWorkerListLock);
+    lockForSnapshot(self);
+
+    pid = fork();
+    if (pid == 0) {
+        unlockForSnapshot();
+        _exit(snapshotChildDump(fileName) == 0 ? 0 : 1);
+    }
+
+    unlockForSnapshot();
+    dvmUnlockMutex(&gDvm.heapWorkerListLock);
+    dvmUnlockMutex(&gDvm.heapWorkerLock);
+    dvmResumeAllThreads(SUSPEND_FOR_GC);
+    pause = dvmGetRelativeTimeUsec() - start;
+    dvmUnlockMutex(&gDvm.gcHeapLock);
+
+    if (pid < 0) {
+        LOGE("hprof: fork failed: %s\n", strerror(errno));
+        dvmLockMutex(&gDvm.gcHeapLock);
+        return -1;
+    }
+    LOGI("hprof: snapshot pid %d writing \"%s\", paused %dms\n",
+        (int) pid, fileName, (int) (pause / 1000));
+
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            /* Someone else reaped it (the zygote's SIGCHLD handler
+             * does that), so we can't tell how it went.
+             */
+            LOGW("hprof: can't wait for snapshot pid %d: %s\n",
+                (int) pid, strerror(errno));
+            status = 0;
+            break;
+        }
+    }
+    dvmChangeStatus(self, oldStatus);
+
+    dvmLockMutex(&gDvm.gcHeapLock);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        LOGE("hprof: snapshot pid %d failed (status 0x%x)\n",
+            (int) pid, status);
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * Perform garbage collection, writing heap information to the specified file.
+ * With -Xhprof:snapshot, write it from a fork()ed child instead, without
+ * collecting anything.
  *
  * If "fileName" is NULL, a suitable name will be generated automatically.
  *
@@ -1067,10 +1583,15 @@ int hprofDumpHeap(const char* fileName)
 
     dvmLockMutex(&gDvm.gcHeapLock);
 
-    gDvm.gcHeap->hprofDumpOnGc = true;
-    gDvm.gcHeap->hprofFileName = fileName;
-    dvmCollectGarbageInternal(false);
-    result = gDvm.gcHeap->hprofResult;
+    dvmWaitForConcurrentGcToComplete();
+    if (gDvm.hprofSnapshot) {
+        result = dumpHeapSnapshot(fileName);
+    } else {
+        gDvm.gcHeap->hprofDumpOnGc = true;
+        gDvm.gcHeap->hprofFileName = fileName;
+        dvmCollectGarbageInternal(false, GC_HPROF_DUMP_HEAP);
+        result = gDvm.gcHeap->hprofResult;
+    }
 
     dvmUnlockMutex(&gDvm.gcHeapLock);
 
@@ -52,9 +52,39 @@ void dvmHeapShutdown(void);
 size_t dvmObjectSizeInHeap(const Object *obj);
 #endif
 
+/*
+ * Return the unused part of every thread's TLABs to the heap.  The heap
+ * lock must be held and no other thread may be allocating.
+ */
+void dvmHeapRetireAllTlabs(void);
+
+/*
+ * Stop the concurrent GC daemon, if it was started.
+ */
+void dvmHeapThreadShutdown(void);
+
+/*
+ * Why a collection is being run.  Only GC_CONCURRENT collections, which
+ * come from the GC daemon, let the mutators run while marking.
+ */
+enum GcReason {
+    GC_FOR_MALLOC,
+    GC_CONCURRENT,
+    GC_EXPLICIT,
+    GC_EXTERNAL_ALLOC,
+    GC_HPROF_DUMP_HEAP
+};
+
 /*
  * Run the garbage collector without doing any locking.
  */
-void dvmCollectGarbageInternal(bool collectSoftReferences);
+void dvmCollectGarbageInternal(bool collectSoftReferences,
+        enum GcReason reason);
+
+/*
+ * If a concurrent collection is marking, wait for it to finish.  The
+ * heap lock must be held; it is released while waiting.
+ */
+void dvmWaitForConcurrentGcToComplete(void);
 
 #endif  // _DALVIK_ALLOC_HEAP
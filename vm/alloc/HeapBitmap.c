@@ -34,6 +34,101 @@
 #define LIKELY(exp)     (__builtin_expect((exp) != 0, true))
 #define UNLIKELY(exp)   (__builtin_expect((exp) != 0, false))
 
+/* Object pointers collected by the walks before calling back.
+ */
+#define HB_POINTER_BUF_SIZE 256
+
+/* Words tested per step when skipping over runs of empty words.  The
+ * loads are independent and OR-ed together, so the compiler can do a
+ * step in one or two vector operations where the target has them.
+ */
+#define HB_SCAN_WORDS       4
+
+/*
+ * Return the index of the first nonzero word of <bits> in [i, end),
+ * or <end> if they're all zero.
+ */
+static inline size_t
+findNonzeroWord(const unsigned long int *bits, size_t i, size_t end)
+{
+    while (i + HB_SCAN_WORDS <= end &&
+            (bits[i] | bits[i + 1] | bits[i + 2] | bits[i + 3]) == 0)
+    {
+        i += HB_SCAN_WORDS;
+    }
+    while (i < end && bits[i] == 0) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Return the index of the first word in [i, end) where <bits1> and
+ * <bits2> differ, or <end> if they're the same throughout.
+ */
+static inline size_t
+findDifferingWord(const unsigned long int *bits1,
+        const unsigned long int *bits2, size_t i, size_t end)
+{
+    while (i + HB_SCAN_WORDS <= end &&
+            ((bits1[i] ^ bits2[i]) | (bits1[i + 1] ^ bits2[i + 1]) |
+             (bits1[i + 2] ^ bits2[i + 2]) | (bits1[i + 3] ^ bits2[i + 3])) == 0)
+    {
+        i += HB_SCAN_WORDS;
+    }
+    while (i < end && bits1[i] == bits2[i]) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Return the index of the first word in [i, end) with a bit that is set
+ * in <live> but not in <mark>, or <end> if there isn't one.
+ */
+static inline size_t
+findGarbageWord(const unsigned long int *live, const unsigned long int *mark,
+        size_t i, size_t end)
+{
+    while (i + HB_SCAN_WORDS <= end &&
+            ((live[i] & ~mark[i]) | (live[i + 1] & ~mark[i + 1]) |
+             (live[i + 2] & ~mark[i + 2]) | (live[i + 3] & ~mark[i + 3])) == 0)
+    {
+        i += HB_SCAN_WORDS;
+    }
+    while (i < end && (live[i] & ~mark[i]) == 0) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Append the object pointers for the set bits of <word>, whose first bit
+ * is the object at <ptrBase>, to <pb>.  Returns the new end of the list.
+ */
+static inline void **
+decodeWord(unsigned long int word, u_int64_t ptrBase, void **pb)
+{
+    static const unsigned long kHighBit =
+            (unsigned long)1 << (HB_BITS_PER_WORD - 1);
+
+    while (word != 0) {
+        const int rshift = CLZL(word);
+        word &= ~(kHighBit >> rshift);
+        *pb++ = (void *)(ptrBase + rshift * HB_OBJECT_ALIGNMENT);
+    }
+    return pb;
+}
+
+/*
+ * True if the pointer list, currently ending at <pb>, has no room for
+ * the objects in <word>.  We only call back when a word won't fit, so
+ * the callback gets as many pointers per call as the buffer holds.
+ */
+#define HB_WORD_WONT_FIT(pointerBuf_, pb_, word_) \
+    ((size_t)((pointerBuf_) + HB_POINTER_BUF_SIZE - (pb_)) < \
+            (size_t)POPCOUNTL(word_))
+
 /*
  * Initialize a HeapBitmap so that it points to a bitmap large
  * enough to cover a heap at <base> of <maxSize> bytes, where
@@ -169,6 +264,54 @@ dvmHeapBitmapZero(HeapBitmap *hb)
     }
 }
 
+/*
+ * Make <dst> hold the same bits as <src>, which must cover the same
+ * extent.  Only the words up to either bitmap's max are touched.
+ */
+void
+dvmHeapBitmapCopy(HeapBitmap *dst, const HeapBitmap *src)
+{
+    size_t srcLen = 0;
+    size_t dstLen = 0;
+
+    assert(dst != NULL && dst->bits != NULL);
+    assert(src != NULL && src->bits != NULL);
+    assert(dst->base == src->base && dst->bitsLen == src->bitsLen);
+
+    if (src->max >= src->base) {
+        srcLen = (HB_OFFSET_TO_INDEX(src->max - src->base) + 1) *
+                sizeof(*src->bits);
+    }
+    if (dst->max >= dst->base) {
+        dstLen = (HB_OFFSET_TO_INDEX(dst->max - dst->base) + 1) *
+                sizeof(*dst->bits);
+    }
+    memcpy(dst->bits, src->bits, srcLen);
+    if (dstLen > srcLen) {
+        memset((char *)dst->bits + srcLen, 0, dstLen - srcLen);
+    }
+    dst->max = src->max;
+}
+
+void
+dvmHeapBitmapSlice(HeapBitmap *slice, const HeapBitmap *hb,
+        size_t firstWord, size_t numWords)
+{
+    size_t hbWords = hb->bitsLen / sizeof(*hb->bits);
+    u_int64_t end;
+
+    assert(firstWord <= hbWords);
+    if (numWords > hbWords - firstWord) {
+        numWords = hbWords - firstWord;
+    }
+
+    slice->bits = hb->bits + firstWord;
+    slice->bitsLen = numWords * sizeof(*hb->bits);
+    slice->base = hb->base + HB_INDEX_TO_OFFSET(firstWord);
+    end = slice->base + HB_INDEX_TO_OFFSET(numWords);
+    slice->max = (hb->max < end) ? hb->max : end - HB_OBJECT_ALIGNMENT;
+}
+
 /*
  * Walk through the bitmaps in increasing address order, and find the
  * object pointers that correspond to places where the bitmaps differ.
@@ -186,9 +329,9 @@ dvmHeapBitmapXorWalk(const HeapBitmap *hb1, const HeapBitmap *hb2,
                          const void *finger, void *arg),
         void *callbackArg)
 {
-    static const size_t kPointerBufSize = 128;
-    void *pointerBuf[kPointerBufSize];
+    void *pointerBuf[HB_POINTER_BUF_SIZE];
     void **pb = pointerBuf;
+    const HeapBitmap *longHb;
     size_t index;
     size_t i;
 
@@ -203,32 +346,6 @@ dvmHeapBitmapXorWalk(const HeapBitmap *hb1, const HeapBitmap *hb2,
         pb = pointerBuf; \
     } while (false)
 
-#define DECODE_BITS(hb_, bits_, update_index_) \
-    do { \
-        if (UNLIKELY(bits_ != 0)) { \
-            static const unsigned long kHighBit = \
-                    (unsigned long)1 << (HB_BITS_PER_WORD - 1); \
-            const u_int64_t ptrBase = HB_INDEX_TO_OFFSET(i) + hb_->base; \
-/*TODO: hold onto ptrBase so we can shrink max later if possible */ \
-/*TODO: see if this is likely or unlikely */ \
-            while (bits_ != 0) { \
-                const int rshift = CLZ(bits_); \
-                bits_ &= ~(kHighBit >> rshift); \
-                *pb++ = (void *)(ptrBase + rshift * HB_OBJECT_ALIGNMENT); \
-            } \
-            /* Make sure that there are always enough slots available */ \
-            /* for an entire word of 1s. */ \
-            if (kPointerBufSize - (pb - pointerBuf) < HB_BITS_PER_WORD) { \
-                FLUSH_POINTERBUF(ptrBase + \
-                        HB_BITS_PER_WORD * HB_OBJECT_ALIGNMENT); \
-                if (update_index_) { \
-                    /* The callback may have caused hb_->max to grow. */ \
-                    index = HB_OFFSET_TO_INDEX(hb_->max - hb_->base); \
-                } \
-            } \
-        } \
-    } while (false)
-
     assert(hb1 != NULL);
     assert(hb1->bits != NULL);
     assert(hb2 != NULL);
@@ -253,46 +370,54 @@ dvmHeapBitmapXorWalk(const HeapBitmap *hb1, const HeapBitmap *hb2,
     }
 
     /* First, walk along the section of the bitmaps that may be the same.
+     * A callback is only made with the finger at the start of the word
+     * we're about to decode, and the word is read again afterwards, so
+     * bits the callback sets at or above the finger are still seen.
      */
+    i = 0;
     if (hb1->max >= hb1->base && hb2->max >= hb2->base) {
-        unsigned long int *p1, *p2;
+        const unsigned long int *p1 = hb1->bits;
+        const unsigned long int *p2 = hb2->bits;
         u_int64_t offset;
 
         offset = ((hb1->max < hb2->max) ? hb1->max : hb2->max) - hb1->base;
 //TODO: keep track of which (and whether) one is longer for later
-        index = HB_OFFSET_TO_INDEX(offset);
-
-        p1 = hb1->bits;
-        p2 = hb2->bits;
-        for (i = 0; i <= index; i++) {
-//TODO: unroll this. pile up a few in locals?
-            unsigned long int diff = *p1++ ^ *p2++;
-            DECODE_BITS(hb1, diff, false);
+        index = HB_OFFSET_TO_INDEX(offset) + 1;
+
+        while ((i = findDifferingWord(p1, p2, i, index)) < index) {
+            const u_int64_t ptrBase = HB_INDEX_TO_OFFSET(i) + hb1->base;
+            unsigned long int diff = p1[i] ^ p2[i];
+
+            if (HB_WORD_WONT_FIT(pointerBuf, pb, diff)) {
+                FLUSH_POINTERBUF(ptrBase);
+                diff = p1[i] ^ p2[i];
 //BUG: if the callback was called, either max could have changed.
+            }
+            pb = decodeWord(diff, ptrBase, pb);
+            i++;
         }
-        /* The next index to look at.
-         */
-        index++;
-    } else {
-        /* One of the bitmaps is empty.
-         */
-        index = 0;
     }
 
     /* If one bitmap's max is larger, walk through the rest of the
      * set bits.
      */
-const HeapBitmap *longHb;
-unsigned long int *p;
 //TODO: may be the same size, in which case this is wasted work
     longHb = (hb1->max > hb2->max) ? hb1 : hb2;
-    i = index;
-    index = HB_OFFSET_TO_INDEX(longHb->max - longHb->base);
-    p = longHb->bits + i;
-    for (/* i = i */; i <= index; i++) {
-//TODO: unroll this
-        unsigned long bits = *p++;
-        DECODE_BITS(longHb, bits, true);
+    index = HB_OFFSET_TO_INDEX(longHb->max - longHb->base) + 1;
+    while ((i = findNonzeroWord(longHb->bits, i, index)) < index) {
+        const u_int64_t ptrBase = HB_INDEX_TO_OFFSET(i) + longHb->base;
+        unsigned long int bits = longHb->bits[i];
+
+        if (HB_WORD_WONT_FIT(pointerBuf, pb, bits)) {
+            FLUSH_POINTERBUF(ptrBase);
+            /* The callback may have set bits and caused longHb->max
+             * to grow.
+             */
+            bits = longHb->bits[i];
+            index = HB_OFFSET_TO_INDEX(longHb->max - longHb->base) + 1;
+        }
+        pb = decodeWord(bits, ptrBase, pb);
+        i++;
     }
 
     if (pb > pointerBuf) {
@@ -306,7 +431,6 @@ unsigned long int *p;
     return true;
 
 #undef FLUSH_POINTERBUF
-#undef DECODE_BITS
 }
 
 /*
@@ -368,6 +492,100 @@ dvmHeapBitmapXorWalkLists(const HeapBitmap hbs1[], const HeapBitmap hbs2[],
     return true;
 }
 
+/*
+ * Visits the bits that are set in <liveHb> but not in <markHb>, i.e.
+ * the garbage left by a collection.  Unlike dvmHeapBitmapXorWalk(),
+ * <markHb> may gain bits while this runs (it's the heap's object
+ * bitmap once the sweep no longer stops the world), so it's never
+ * used to bound the walk.  A bit that turns on under us was never
+ * set in <liveHb>, which doesn't change, so it can't be visited.
+ */
+bool
+dvmHeapBitmapSweepWalk(const HeapBitmap *liveHb, const HeapBitmap *markHb,
+        bool (*callback)(size_t numPtrs, void **ptrs,
+                         const void *finger, void *arg),
+        void *callbackArg)
+{
+    void *pointerBuf[HB_POINTER_BUF_SIZE];
+    void **pb = pointerBuf;
+    const unsigned long int *live, *mark;
+    size_t index, i;
+
+    assert(liveHb != NULL);
+    assert(liveHb->bits != NULL);
+    assert(markHb != NULL);
+    assert(markHb->bits != NULL);
+    assert(callback != NULL);
+
+    if (liveHb->base != markHb->base || liveHb->bitsLen != markHb->bitsLen) {
+        LOGW("dvmHeapBitmapSweepWalk: bitmaps don't match\n");
+        return false;
+    }
+    if (liveHb->max < liveHb->base) {
+        return true;
+    }
+
+    index = HB_OFFSET_TO_INDEX(liveHb->max - liveHb->base) + 1;
+    live = liveHb->bits;
+    mark = markHb->bits;
+    i = 0;
+    while ((i = findGarbageWord(live, mark, i, index)) < index) {
+        const u_int64_t ptrBase = HB_INDEX_TO_OFFSET(i) + liveHb->base;
+        const unsigned long int garbage = live[i] & ~mark[i];
+
+        if (HB_WORD_WONT_FIT(pointerBuf, pb, garbage)) {
+            if (!callback(pb - pointerBuf, pointerBuf, (void *)ptrBase,
+                    callbackArg))
+            {
+                LOGW("dvmHeapBitmapSweepWalk: callback failed\n");
+                return false;
+            }
+            pb = pointerBuf;
+        }
+        pb = decodeWord(garbage, ptrBase, pb);
+        i++;
+    }
+    if (pb > pointerBuf) {
+        if (!callback(pb - pointerBuf, pointerBuf,
+                (void *)(liveHb->base + HB_MAX_OFFSET(liveHb)),
+                callbackArg))
+        {
+            LOGW("dvmHeapBitmapSweepWalk: callback failed\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Similar to dvmHeapBitmapSweepWalk(), but for lists of congruent
+ * bitmaps, visited in address order.
+ */
+bool
+dvmHeapBitmapSweepWalkLists(const HeapBitmap liveHbs[],
+        const HeapBitmap markHbs[], size_t numBitmaps,
+        bool (*callback)(size_t numPtrs, void **ptrs,
+                         const void *finger, void *arg),
+        void *callbackArg)
+{
+    size_t indexList[numBitmaps];
+    size_t i;
+
+    createSortedBitmapIndexList(liveHbs, numBitmaps, indexList);
+    for (i = 0; i < numBitmaps; i++) {
+        bool ok;
+
+        ok = dvmHeapBitmapSweepWalk(&liveHbs[indexList[i]],
+                &markHbs[indexList[i]], callback, callbackArg);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /*
  * Similar to dvmHeapBitmapXorWalk(), but visit the set bits
  * in a single bitmap.
@@ -35,8 +35,9 @@
  * when using CLZ.
  */
 #define HB_OFFSET_TO_MASK(offset_) \
-    (1 << \
-        (31-(((u_int64_t)(offset_) / HB_OBJECT_ALIGNMENT) % HB_BITS_PER_WORD)))
+    ((unsigned long int)1 << \
+        (HB_BITS_PER_WORD - 1 - \
+            (((u_int64_t)(offset_) / HB_OBJECT_ALIGNMENT) % HB_BITS_PER_WORD)))
 
 /* Return the maximum offset (exclusive) that <hb> can represent.
  */
@@ -108,6 +109,20 @@ void dvmHeapBitmapDeleteList(HeapBitmap hbs[], size_t numBitmaps);
  */
 void dvmHeapBitmapZero(HeapBitmap *hb);
 
+/*
+ * Copy the contents of <src> into <dst>; both must cover the same
+ * range of addresses.
+ */
+void dvmHeapBitmapCopy(HeapBitmap *dst, const HeapBitmap *src);
+
+/*
+ * Make <slice> cover <numWords> words of <hb>'s bits, starting at word
+ * <firstWord>, so that the walks below can be run over part of a heap.
+ * The slice shares <hb>'s bits; don't delete it.
+ */
+void dvmHeapBitmapSlice(HeapBitmap *slice, const HeapBitmap *hb,
+        size_t firstWord, size_t numWords);
+
 /*
  * Walk through the bitmaps in increasing address order, and find the
  * object pointers that correspond to places where the bitmaps differ.
@@ -135,6 +150,21 @@ bool dvmHeapBitmapXorWalkLists(const HeapBitmap hbs1[], const HeapBitmap hbs2[],
                          const void *finger, void *arg),
         void *callbackArg);
 
+/*
+ * Visits the bits set in <liveHb> but not in <markHb>.  <markHb> may
+ * have bits set concurrently; see HeapBitmap.c.
+ */
+bool dvmHeapBitmapSweepWalk(const HeapBitmap *liveHb,
+        const HeapBitmap *markHb,
+        bool (*callback)(size_t numPtrs, void **ptrs,
+                         const void *finger, void *arg),
+        void *callbackArg);
+bool dvmHeapBitmapSweepWalkLists(const HeapBitmap liveHbs[],
+        const HeapBitmap markHbs[], size_t numBitmaps,
+        bool (*callback)(size_t numPtrs, void **ptrs,
+                         const void *finger, void *arg),
+        void *callbackArg);
+
 /*
  * Similar to dvmHeapBitmapXorWalk(), but visit the set bits
  * in a single bitmap.
@@ -211,17 +241,27 @@ HB_INLINE_PROTO(
 #endif
 
     if (setBit) {
-        if ((u_int64_t)obj > hb->max) {
-            hb->max = (u_int64_t)obj;
-        }
         if (returnOld) {
+            /* This is the marking path, which may run on several GC
+             * threads at once.  Skip the locked OR if the bit is already
+             * set, and never let a racing thread shrink .max.
+             */
             unsigned long int *p = hb->bits + index;
-            const unsigned long int word = *p;
-            *p |= mask;
-            return word & mask;
-        } else {
-            hb->bits[index] |= mask;
+            u_int64_t max;
+
+            if ((*p & mask) != 0) {
+                return mask;
+            }
+            do {
+                max = hb->max;
+            } while ((u_int64_t)obj > max &&
+                    !ATOMIC_CMP_SWAP_WORD(&hb->max, max, (u_int64_t)obj));
+            return ATOMIC_OR_WORD(p, mask) & mask;
+        }
+        if ((u_int64_t)obj > hb->max) {
+            hb->max = (u_int64_t)obj;
         }
+        hb->bits[index] |= mask;
     } else {
         hb->bits[index] &= ~mask;
     }
@@ -270,13 +310,25 @@ HB_INLINE_PROTO(
 /*
  * Sets the bit corresponding to <obj>, and widens the range of seen
  * pointers if necessary.  Does no range checking.
+ *
+ * The word is updated atomically, since threads allocating out of their
+ * TLABs set bits without holding the heap lock.  Those threads never
+ * widen .max; it already covers the whole TLAB.
  */
 HB_INLINE_PROTO(
     void
     dvmHeapBitmapSetObjectBit(HeapBitmap *hb, const void *obj)
 )
 {
-    (void)_heapBitmapModifyObjectBit(hb, obj, true, false);
+    const u_int64_t offset = (u_int64_t)obj - hb->base;
+
+    assert(dvmHeapBitmapCoversAddress(hb, obj));
+
+    if ((u_int64_t)obj > hb->max) {
+        hb->max = (u_int64_t)obj;
+    }
+    ATOMIC_OR_WORD(&hb->bits[HB_OFFSET_TO_INDEX(offset)],
+            HB_OFFSET_TO_MASK(offset));
 }
 
 /*
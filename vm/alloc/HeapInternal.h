@@ -52,6 +52,31 @@ typedef struct DvmHeapChunk {
     u8 data[0];
 } DvmHeapChunk;
 
+/* Upper bound on HeapWorker threads, whatever the CPU count.
+ */
+#define HEAP_WORKER_MAX_THREADS 4
+
+/* What one HeapWorker thread is doing, for the watchdog.
+ */
+typedef struct HeapWorkerState {
+    pthread_t handle;
+
+    /* If non-null, the method that the thread is currently
+     * executing, and the object it was called on.
+     */
+    Object *currentObject;
+    Method *currentMethod;
+
+    /* If currentObject is non-null, this gives the time when
+     * the thread started executing that method.  The time value must
+     * come from dvmGetRelativeTimeUsec().
+     *
+     * The "Cpu" entry tracks the per-thread CPU timer (when available).
+     */
+    u8 interpStartTime;
+    u8 interpCpuStartTime;
+} HeapWorkerState;
+
 struct GcHeap {
     HeapSource      *heapSource;
 
@@ -101,20 +126,30 @@ struct GcHeap {
      */
     LargeHeapRefTable  *referenceOperations;
 
-    /* If non-null, the method that the HeapWorker is currently
-     * executing.
+    /* The HeapWorker threads.  Entry 0 is the HeapWorker thread
+     * itself, which also trims the heap; the rest only run finalizers
+     * and reference operations.
+     *
+     * These fields are protected by gDvm.heapWorkerLock.
+     */
+    HeapWorkerState heapWorkers[HEAP_WORKER_MAX_THREADS];
+    int             numHeapWorkers;
+    int             numBusyHeapWorkers;
+
+    /* The number of reference operations that have been taken off
+     * referenceOperations but haven't finished yet.  No finalizations
+     * are handed out until this drops to zero.  Protected by
+     * gDvm.heapWorkerLock.
      */
-    Object *heapWorkerCurrentObject;
-    Method *heapWorkerCurrentMethod;
+    int             heapWorkerRefOpsInFlight;
 
-    /* If heapWorkerCurrentObject is non-null, this gives the time when
-     * HeapWorker started executing that method.  The time value must come
-     * from dvmGetRelativeTimeUsec().
-     *
-     * The "Cpu" entry tracks the per-thread CPU timer (when available).
+    /* Totals over all HeapWorker batches.  Protected by
+     * gDvm.heapWorkerLock.
      */
-    u8 heapWorkerInterpStartTime;
-    u8 heapWorkerInterpCpuStartTime;
+    u8              heapWorkerBatches;
+    u8              heapWorkerObjects;
+    u8              heapWorkerBatchUsec;
+    u8              heapWorkerMaxBatchUsec;
 
     /* If any fields are non-zero, indicates the next (absolute) time that
      * the HeapWorker thread should call dvmHeapSourceTrim().
@@ -137,6 +172,30 @@ struct GcHeap {
      */
     bool            gcRunning;
 
+    /* Is the GC sweeping with the other threads running?  gcRunning
+     * stays set until the sweep is done, but new objects no longer
+     * need to be marked, and TLABs may be refilled.
+     */
+    bool            sweeping;
+
+    /* The objects that survived the last collection: the old
+     * generation.  A minor collection starts out with these marked,
+     * so it can only free objects allocated since, and it finds the
+     * old objects that point to younger ones through the card table.
+     * numOldBitmaps is zero until a collection has run with a card
+     * table in place, and goes back to zero when a heap is added.
+     */
+    HeapBitmap      oldBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
+    size_t          numOldBitmaps;
+    size_t          oldBytesAllocated;
+
+    /* Whether the next collection may be a minor one, and whether the
+     * last one was.  A minor collection that frees too little of the
+     * young generation makes the next one a full collection.
+     */
+    bool            tryMinorGc;
+    bool            lastGcWasMinor;
+
     /* Set at the end of a GC to indicate the collection policy
      * for SoftReferences during the following GC.
      */
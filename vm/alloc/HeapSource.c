@@ -46,6 +46,13 @@ static void setIdealFootprint(size_t max);
 #define HEAP_IDEAL_FREE             (2 * 1024 * 1024)
 #define HEAP_MIN_FREE               (HEAP_IDEAL_FREE / 4)
 
+/* Wake the GC daemon once the active heap is within CONCURRENT_START
+ * bytes of its allocation limit, unless a collection has left less
+ * than CONCURRENT_MIN_FREE bytes free to begin with.
+ */
+#define CONCURRENT_START            (128 * 1024)
+#define CONCURRENT_MIN_FREE         (CONCURRENT_START + 128 * 1024)
+
 #define HS_BOILERPLATE() \
     do { \
         assert(gDvm.gcHeap != NULL); \
@@ -169,6 +176,19 @@ struct HeapSource {
     /* True if zygote mode was active when the HeapSource was created.
      */
     bool sawZygote;
+
+    /* Once the active heap has this many bytes allocated, wake up
+     * the GC daemon.  SIZE_MAX if there's no daemon.
+     */
+    size_t concurrentStartBytes;
+
+    /* The GC daemon thread, and what it waits on.
+     */
+    bool hasGcThread;
+    pthread_t gcThread;
+    bool gcThreadShutdown;
+    pthread_mutex_t gcThreadMutex;
+    pthread_cond_t gcThreadCond;
 };
 
 #define hs2heap(hs_) (&((hs_)->heaps[0]))
@@ -376,6 +396,18 @@ addNewHeap(HeapSource *hs, mspace *msp, size_t mspAbsoluteMaxSize)
     hs->heaps[0] = heap;
     hs->numHeaps++;
 
+    /* The old generation's bitmaps were laid over the old list of
+     * heaps, which just shifted.  The next collection must be a full
+     * one, which will save them again.
+     */
+    if (gDvm.gcHeap != NULL) {
+        GcHeap *gcHeap = gDvm.gcHeap;
+
+        dvmHeapBitmapDeleteList(gcHeap->oldBitmaps, gcHeap->numOldBitmaps);
+        gcHeap->numOldBitmaps = 0;
+        gcHeap->tryMinorGc = false;
+    }
+
     return true;
 
 fail:
@@ -438,6 +470,8 @@ dvmHeapSourceStartup(size_t startSize, size_t absoluteMaxSize)
     hs->softLimit = INT_MAX;    // no soft limit at first
     hs->numHeaps = 0;
     hs->sawZygote = gDvm.zygote;
+    hs->concurrentStartBytes = SIZE_MAX;
+    hs->hasGcThread = false;
     if (!addNewHeap(hs, msp, absoluteMaxSize)) {
         LOGE_HEAP("Can't add initial heap\n");
         goto fail;
@@ -506,6 +540,150 @@ dvmHeapSourceStartupBeforeFork()
     return true;
 }
 
+/*
+ * Recomputes the point at which the GC daemon should be woken, from
+ * the active heap's current allocation limit.
+ */
+static void
+setConcurrentStartBytes(HeapSource *hs)
+{
+    const Heap *heap = hs2heap(hs);
+    size_t limit;
+
+    if (!hs->hasGcThread) {
+        return;
+    }
+    if (softLimited(hs)) {
+        limit = hs->softLimit;
+    } else {
+        limit = mspace_max_allowed_footprint(heap->msp);
+    }
+    if (limit < heap->bytesAllocated + CONCURRENT_MIN_FREE) {
+        /* Too close to the limit for a concurrent collection to
+         * finish before the mutators run out of room; let the
+         * next failed allocation collect instead.
+         */
+        hs->concurrentStartBytes = SIZE_MAX;
+    } else {
+        hs->concurrentStartBytes = limit - CONCURRENT_START;
+    }
+}
+
+/*
+ * Called after every allocation from the active heap.  The signal is
+ * sent without holding gcThreadMutex, so it can be lost if the daemon
+ * is busy; the next allocation will just send another.
+ */
+static inline void
+checkConcurrentStart(HeapSource *hs, const Heap *heap)
+{
+    if (heap->bytesAllocated > hs->concurrentStartBytes) {
+        pthread_cond_signal(&hs->gcThreadCond);
+    }
+}
+
+/*
+ * The GC daemon sleeps until an allocation pushes the active heap past
+ * concurrentStartBytes, then runs a concurrent collection.
+ */
+static void *
+gcDaemonThreadStart(void *arg)
+{
+    HeapSource *hs = gHs;
+    int cc;
+
+    UNUSED_PARAMETER(arg);
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+    dvmLockMutex(&hs->gcThreadMutex);
+    while (!hs->gcThreadShutdown) {
+        cc = pthread_cond_wait(&hs->gcThreadCond, &hs->gcThreadMutex);
+        assert(cc == 0);
+        if (hs->gcThreadShutdown) {
+            break;
+        }
+        dvmUnlockMutex(&hs->gcThreadMutex);
+
+        /* dvmChangeStatus() may block; don't hold the heap lock.
+         */
+        dvmChangeStatus(NULL, THREAD_RUNNING);
+        dvmLockHeap();
+        /* Somebody may have collected while we were waking up.
+         */
+        if (!gDvm.gcHeap->gcRunning &&
+            hs2heap(hs)->bytesAllocated > hs->concurrentStartBytes)
+        {
+            dvmCollectGarbageInternal(false, GC_CONCURRENT);
+        }
+        dvmUnlockHeap();
+        dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+        dvmLockMutex(&hs->gcThreadMutex);
+    }
+    dvmUnlockMutex(&hs->gcThreadMutex);
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+
+    return NULL;
+}
+
+bool
+dvmHeapSourceStartupGcDaemon()
+{
+    HeapSource *hs = gHs;
+
+    HS_BOILERPLATE();
+
+    assert(!hs->hasGcThread);
+
+    dvmInitMutex(&hs->gcThreadMutex);
+    pthread_cond_init(&hs->gcThreadCond, NULL);
+    hs->gcThreadShutdown = false;
+    if (!dvmCreateInternalThread(&hs->gcThread, "GC",
+                gcDaemonThreadStart, NULL))
+    {
+        LOGE_HEAP("Can't create the GC daemon thread\n");
+        return false;
+    }
+    hs->hasGcThread = true;
+
+    dvmLockHeap();
+    setConcurrentStartBytes(hs);
+    dvmUnlockHeap();
+
+    return true;
+}
+
+void
+dvmHeapSourceThreadShutdown()
+{
+    HeapSource *hs = gHs;
+
+    if (hs != NULL && hs->hasGcThread) {
+        Thread *self = dvmThreadSelf();
+        ThreadStatus oldStatus = THREAD_VMWAIT;
+
+        dvmLockMutex(&hs->gcThreadMutex);
+        hs->gcThreadShutdown = true;
+        pthread_cond_signal(&hs->gcThreadCond);
+        dvmUnlockMutex(&hs->gcThreadMutex);
+
+        /* The daemon may be in the middle of a collection, which
+         * needs to suspend us.
+         */
+        if (self != NULL) {
+            oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        }
+        if (pthread_join(hs->gcThread, NULL) != 0) {
+            LOGW("GC daemon thread join failed\n");
+        }
+        if (self != NULL) {
+            dvmChangeStatus(self, oldStatus);
+        }
+        hs->hasGcThread = false;
+        hs->concurrentStartBytes = SIZE_MAX;
+    }
+}
+
 /*
  * Tears down the heap source and frees any resources associated with it.
  */
@@ -667,6 +845,7 @@ dvmHeapSourceAlloc(size_t n)
         ptr = mspace_calloc(heap->msp, 1, n);
         if (ptr != NULL) {
             countAllocation(heap, ptr, true);
+            checkConcurrentStart(hs, heap);
         }
     } else {
         /* This allocation would push us over the soft limit;
@@ -765,6 +944,158 @@ dvmHeapSourceAllocAndGrow(size_t n)
     return ptr;
 }
 
+/*
+ * TLAB size classes.  dlmalloc rounds every request up to a chunk of
+ * (n + HEAP_SOURCE_CHUNK_OVERHEAD) bytes aligned to 16, with a 32-byte
+ * minimum; a class holds all the requests that land on one chunk size.
+ */
+#define TLAB_CHUNK_ALIGN        16
+#define TLAB_MIN_CHUNK_SIZE     32
+
+/* Bytes of chunks to hand a thread per refill, and a cap on how many.
+ */
+#define TLAB_REFILL_BYTES       4096
+#define TLAB_MAX_CHUNKS         128
+
+static inline size_t
+tlabChunkSize(size_t n)
+{
+    size_t chunkSize = (n + HEAP_SOURCE_CHUNK_OVERHEAD + TLAB_CHUNK_ALIGN - 1)
+            & ~(TLAB_CHUNK_ALIGN - 1);
+    return chunkSize < TLAB_MIN_CHUNK_SIZE ? TLAB_MIN_CHUNK_SIZE : chunkSize;
+}
+
+static inline size_t
+tlabSizeClass(size_t n)
+{
+    return (tlabChunkSize(n) - TLAB_MIN_CHUNK_SIZE) / TLAB_CHUNK_ALIGN;
+}
+
+/*
+ * Takes the next chunk out of the caller's TLAB for an <n>-byte request,
+ * without locking.  Returns NULL if <n> is too big for a TLAB or the
+ * buffer for its size class is empty.
+ *
+ * The chunk is already zeroed and accounted for; all that's left is
+ * to mark it as an object.
+ */
+void *
+dvmHeapSourceAllocTlab(Tlab tlabs[], size_t n)
+{
+    Tlab *tlab;
+    void *ptr;
+
+    if (n > TLAB_MAX_ALLOC_SIZE) {
+        return NULL;
+    }
+    tlab = &tlabs[tlabSizeClass(n)];
+    ptr = tlab->cur;
+    if (ptr == tlab->end) {
+        return NULL;
+    }
+    tlab->cur += tlab->stride;
+
+    dvmHeapBitmapSetObjectBit(&hs2heap(gHs)->objectBitmap, ptr);
+    return ptr;
+}
+
+/*
+ * Refills the TLAB that serves <n>-byte requests with a fresh batch of
+ * zeroed chunks from the active heap, giving back whatever was left in
+ * it.  Returns false if <n> isn't TLAB-sized or the batch would push the
+ * heap over its soft limit; the caller should fall back to
+ * dvmHeapSourceAlloc(), which knows how to GC and grow.
+ *
+ * The batch comes from mspace_independent_calloc(), so each element is
+ * a separately freeable chunk and they sit one after another in memory.
+ * The whole batch is counted as allocated up front, and the object
+ * bitmap's max is widened past it, so dvmHeapSourceAllocTlab() never
+ * has to touch the shared counters.
+ *
+ * Caller must hold the heap lock.
+ */
+bool
+dvmHeapSourceRefillTlab(Tlab tlabs[], size_t n)
+{
+    HeapSource *hs = gHs;
+    Heap *heap;
+    Tlab *tlab;
+    void *chunks[TLAB_MAX_CHUNKS];
+    size_t chunkSize, numChunks, i;
+    u1 *last;
+
+    HS_BOILERPLATE();
+
+    if (n > TLAB_MAX_ALLOC_SIZE) {
+        return false;
+    }
+    heap = hs2heap(hs);
+    tlab = &tlabs[tlabSizeClass(n)];
+    dvmHeapSourceRetireTlab(tlab);
+
+    chunkSize = tlabChunkSize(n);
+    numChunks = TLAB_REFILL_BYTES / chunkSize;
+    if (numChunks > TLAB_MAX_CHUNKS) {
+        numChunks = TLAB_MAX_CHUNKS;
+    }
+    if (heap->bytesAllocated + numChunks * chunkSize > hs->softLimit) {
+        return false;
+    }
+    if (mspace_independent_calloc(heap->msp, numChunks,
+                chunkSize - HEAP_SOURCE_CHUNK_OVERHEAD, chunks) == NULL)
+    {
+        return false;
+    }
+    assert((u1 *)chunks[1] - (u1 *)chunks[0] == (ptrdiff_t)chunkSize);
+
+    last = chunks[numChunks - 1];
+    if ((u_int64_t)last > heap->objectBitmap.max) {
+        heap->objectBitmap.max = (u_int64_t)last;
+    }
+    for (i = 0; i < numChunks; i++) {
+        countAllocation(heap, chunks[i], false);
+    }
+    heap->objectsAllocated += numChunks;
+    checkConcurrentStart(hs, heap);
+
+    tlab->stride = chunkSize;
+    tlab->end = last + chunkSize;
+    MEM_BARRIER();
+    tlab->cur = chunks[0];
+    return true;
+}
+
+/*
+ * Frees the chunks still sitting unused in <tlab> and empties it.
+ * Their object bits were never set, so the sweep can't see them; this
+ * is the only way they get back to the mspace.
+ *
+ * Caller must hold the heap lock, and the TLAB's owner must not be
+ * allocating (it's the caller, or it's suspended).
+ */
+void
+dvmHeapSourceRetireTlab(Tlab *tlab)
+{
+    Heap *heap;
+    u1 *ptr;
+
+    HS_BOILERPLATE();
+
+    if (tlab->cur == tlab->end) {
+        return;
+    }
+    heap = ptr2heap(gHs, tlab->cur);
+    assert(heap != NULL);
+    for (ptr = tlab->cur; ptr < tlab->end; ptr += tlab->stride) {
+        countFree(heap, ptr, false);
+        if (heap->objectsAllocated > 0) {
+            heap->objectsAllocated--;
+        }
+        mspace_free(heap->msp, ptr);
+    }
+    tlab->cur = tlab->end = NULL;
+}
+
 /*
  * Frees the memory pointed to by <ptr>, which may be NULL.
  */
@@ -787,6 +1118,48 @@ dvmHeapSourceFree(void *ptr)
     }
 }
 
+/*
+ * Frees the <numPtrs> objects in <ptrs>, which must all be in the same
+ * heap, and returns the number of bytes that released.  Used by the
+ * sweep, which has already made sure that none of the objects are in
+ * the object bitmap; the bitmap isn't touched, since TLAB allocations
+ * may be setting bits in it without the heap lock.  <ptrs> is clobbered.
+ *
+ * Caller must hold the heap lock.
+ */
+size_t
+dvmHeapSourceFreeList(size_t numPtrs, void **ptrs)
+{
+    Heap *heap;
+    size_t origBytesAllocated;
+    size_t i;
+
+    HS_BOILERPLATE();
+
+    if (numPtrs == 0) {
+        return 0;
+    }
+    heap = ptr2heap(gHs, ptrs[0]);
+    assert(heap != NULL);
+    origBytesAllocated = heap->bytesAllocated;
+    for (i = 0; i < numPtrs; i++) {
+        assert(ptr2heap(gHs, ptrs[i]) == heap);
+        countFree(heap, ptrs[i], false);
+    }
+    if (heap->objectsAllocated > numPtrs) {
+        heap->objectsAllocated -= numPtrs;
+    } else {
+        heap->objectsAllocated = 0;
+    }
+    /* Only free objects that are in the active heap.
+     * Touching old heaps would pull pages into this process.
+     */
+    if (heap == gHs->heaps) {
+        mspace_bulk_free(heap->msp, ptrs, numPtrs);
+    }
+    return origBytesAllocated - heap->bytesAllocated;
+}
+
 /*
  * Returns true iff <ptr> was allocated from the heap source.
  */
@@ -1173,6 +1546,7 @@ void dvmHeapSourceGrowForUtilization()
     overhead = getSoftFootprint(false);
     oldIdealSize = hs->idealSize;
     setIdealFootprint(targetHeapSize + overhead);
+    setConcurrentStartBytes(hs);
 
     newHeapMax = mspace_max_allowed_footprint(heap->msp);
     if (softLimited(hs)) {
@@ -1404,7 +1778,8 @@ gcForExternalAlloc(bool collectSoftReferences)
         }
     }
 #endif
-    dvmCollectGarbageInternal(collectSoftReferences);
+    dvmWaitForConcurrentGcToComplete();
+    dvmCollectGarbageInternal(collectSoftReferences, GC_EXTERNAL_ALLOC);
 }
 
 /*
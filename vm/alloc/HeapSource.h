@@ -49,6 +49,18 @@ bool dvmHeapSourceStartupAfterZygote(void);
  */
 bool dvmHeapSourceStartupBeforeFork(void);
 
+/*
+ * Starts the GC daemon, which runs a concurrent collection whenever
+ * the active heap gets close to its allocation limit.  Needs the card
+ * table; see dvmCardTableStartup().
+ */
+bool dvmHeapSourceStartupGcDaemon(void);
+
+/*
+ * Stops the GC daemon, if it was started.
+ */
+void dvmHeapSourceThreadShutdown(void);
+
 /*
  * Tears down the heap source and frees any resources associated with it.
  */
@@ -99,11 +111,36 @@ void *dvmHeapSourceAlloc(size_t n);
  */
 void *dvmHeapSourceAllocAndGrow(size_t n);
 
+/*
+ * Takes an <n>-byte chunk from the thread-local buffers in <tlabs>
+ * without locking, or returns NULL if they can't serve it.  The memory
+ * is zeroed.
+ */
+void *dvmHeapSourceAllocTlab(Tlab tlabs[], size_t n);
+
+/*
+ * Refills the TLAB that serves <n>-byte requests.  Returns false if the
+ * heap can't spare a batch without a GC.  Caller must hold the heap lock.
+ */
+bool dvmHeapSourceRefillTlab(Tlab tlabs[], size_t n);
+
+/*
+ * Gives the unused part of <tlab> back to the heap.  Caller must hold
+ * the heap lock.
+ */
+void dvmHeapSourceRetireTlab(Tlab *tlab);
+
 /*
  * Frees the memory pointed to by <ptr>, which may be NULL.
  */
 void dvmHeapSourceFree(void *ptr);
 
+/*
+ * Frees a batch of unmarked objects from a single heap, returning
+ * the number of bytes released.  See HeapSource.c.
+ */
+size_t dvmHeapSourceFreeList(size_t numPtrs, void **ptrs);
+
 /*
  * Returns true iff <ptr> was allocated from the heap source.
  */
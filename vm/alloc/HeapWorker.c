@@ -24,11 +24,17 @@
 
 #include <sys/time.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
 #include <errno.h>  // for ETIMEDOUT, etc.
 
+/* the most objects a worker takes off the lists at once */
+#define HEAP_WORKER_BATCH_SIZE  16
+
 static void* heapWorkerThreadStart(void* arg);
+static void* finalizerThreadStart(void* arg);
 
 /*
  * Initialize any HeapWorker state that Heap.c
@@ -46,6 +52,44 @@ void dvmInitializeHeapWorkerState()
     gDvm.heapWorkerInitialized = true;
 }
 
+/*
+ * Start the threads that help the HeapWorker thread run finalizers and
+ * reference operations.  -Xfinalizerthreads counts the HeapWorker thread
+ * too, so "-Xfinalizerthreads:1" starts none.
+ */
+static void startFinalizerThreads(void)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    int numThreads, i;
+
+    numThreads = gDvm.finalizerThreads;
+    if (numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > HEAP_WORKER_MAX_THREADS) {
+        numThreads = HEAP_WORKER_MAX_THREADS;
+    }
+
+    for (i = 1; i < numThreads; i++) {
+        HeapWorkerState *state = &gcHeap->heapWorkers[i];
+        char name[32];
+
+        snprintf(name, sizeof(name), "FinalizerWorker %d", i);
+        if (!dvmCreateInternalThread(&state->handle, name,
+                    finalizerThreadStart, state))
+        {
+            LOGW("Unable to start finalizer thread\n");
+            break;
+        }
+
+        dvmLockMutex(&gDvm.heapWorkerLock);
+        gcHeap->numHeapWorkers = i + 1;
+        dvmUnlockMutex(&gDvm.heapWorkerLock);
+    }
+}
+
 /*
  * Crank up the heap worker thread.
  *
@@ -78,8 +122,12 @@ bool dvmHeapWorkerStartup(void)
         int cc = pthread_cond_wait(&gDvm.heapWorkerCond, &gDvm.heapWorkerLock);
         assert(cc == 0);
     }
+    gDvm.gcHeap->heapWorkers[0].handle = gDvm.heapWorkerHandle;
+    gDvm.gcHeap->numHeapWorkers = 1;
 
     dvmUnlockMutex(&gDvm.heapWorkerLock);
+
+    startFinalizerThreads();
     return true;
 }
 
@@ -88,7 +136,9 @@ bool dvmHeapWorkerStartup(void)
  */
 void dvmHeapWorkerShutdown(void)
 {
+    GcHeap *gcHeap = gDvm.gcHeap;
     void* threadReturn;
+    int i;
 
     /* note: assuming that (pthread_t)0 is not a valid thread handle */
     if (gDvm.heapWorkerHandle != 0) {
@@ -106,30 +156,52 @@ void dvmHeapWorkerShutdown(void)
         else
             LOGD("HeapWorker thread has shut down\n");
 
+        for (i = 1; i < gcHeap->numHeapWorkers; i++) {
+            if (pthread_join(gcHeap->heapWorkers[i].handle,
+                        &threadReturn) != 0)
+            {
+                LOGW("Finalizer thread join failed\n");
+            }
+        }
+
+        LOGD_HEAP("HeapWorker: %lld objects in %lld batches, %lldms "
+                "(longest batch %lldms)\n",
+                (long long) gcHeap->heapWorkerObjects,
+                (long long) gcHeap->heapWorkerBatches,
+                (long long) gcHeap->heapWorkerBatchUsec / 1000,
+                (long long) gcHeap->heapWorkerMaxBatchUsec / 1000);
+
         gDvm.heapWorkerReady = false;
     }
 }
 
-/* Make sure that the HeapWorker thread hasn't spent an inordinate
+/* Make sure that none of the HeapWorker threads has spent an inordinate
  * amount of time inside a finalizer.
  *
- * Aborts the VM if the thread appears to be wedged.
+ * Aborts the VM if a thread appears to be wedged.
  *
  * The caller must hold the heapWorkerLock to guarantee an atomic
  * read of the watchdog values.
  */
 void dvmAssertHeapWorkerThreadRunning()
 {
-    if (gDvm.gcHeap->heapWorkerCurrentObject != NULL) {
+    GcHeap *gcHeap = gDvm.gcHeap;
+    int i;
+
+    for (i = 0; i < gcHeap->numHeapWorkers; i++) {
+        HeapWorkerState *state = &gcHeap->heapWorkers[i];
         static const u8 HEAP_WORKER_WATCHDOG_TIMEOUT = 10*1000*1000LL; // 10sec
 
-        u8 heapWorkerInterpStartTime = gDvm.gcHeap->heapWorkerInterpStartTime;
+        if (state->currentObject == NULL) {
+            continue;
+        }
+
+        u8 heapWorkerInterpStartTime = state->interpStartTime;
         u8 now = dvmGetRelativeTimeUsec();
         u8 delta = now - heapWorkerInterpStartTime;
 
-        u8 heapWorkerInterpCpuStartTime =
-            gDvm.gcHeap->heapWorkerInterpCpuStartTime;
-        u8 nowCpu = dvmGetOtherThreadCpuTimeUsec(gDvm.heapWorkerHandle);
+        u8 heapWorkerInterpCpuStartTime = state->interpCpuStartTime;
+        u8 nowCpu = dvmGetOtherThreadCpuTimeUsec(state->handle);
         u8 deltaCpu = nowCpu - heapWorkerInterpCpuStartTime;
 
         if (delta > HEAP_WORKER_WATCHDOG_TIMEOUT &&
@@ -144,14 +216,14 @@ void dvmAssertHeapWorkerThreadRunning()
              * watchdog and just reset the timer.
              */
             LOGI("Debugger is attached -- suppressing HeapWorker watchdog\n");
-            heapWorkerInterpStartTime = now;        /* reset timer */
+            state->interpStartTime = now;       /* reset timer */
         } else if (delta > HEAP_WORKER_WATCHDOG_TIMEOUT) {
             char* desc = dexProtoCopyMethodDescriptor(
-                    &gDvm.gcHeap->heapWorkerCurrentMethod->prototype);
+                    &state->currentMethod->prototype);
             LOGE("HeapWorker is wedged: %lldms spent inside %s.%s%s\n",
                     delta / 1000,
-                    gDvm.gcHeap->heapWorkerCurrentObject->clazz->descriptor,
-                    gDvm.gcHeap->heapWorkerCurrentMethod->name, desc);
+                    state->currentObject->clazz->descriptor,
+                    state->currentMethod->name, desc);
             free(desc);
             dvmDumpAllThreads(true);
 
@@ -159,17 +231,18 @@ void dvmAssertHeapWorkerThreadRunning()
             dvmAbort();
         } else if (delta > HEAP_WORKER_WATCHDOG_TIMEOUT / 2) {
             char* desc = dexProtoCopyMethodDescriptor(
-                    &gDvm.gcHeap->heapWorkerCurrentMethod->prototype);
+                    &state->currentMethod->prototype);
             LOGW("HeapWorker may be wedged: %lldms spent inside %s.%s%s\n",
                     delta / 1000,
-                    gDvm.gcHeap->heapWorkerCurrentObject->clazz->descriptor,
-                    gDvm.gcHeap->heapWorkerCurrentMethod->name, desc);
+                    state->currentObject->clazz->descriptor,
+                    state->currentMethod->name, desc);
             free(desc);
         }
     }
 }
 
-static void callMethod(Thread *self, Object *obj, Method *method)
+static void callMethod(Thread *self, HeapWorkerState *state, Object *obj,
+        Method *method)
 {
     JValue unused;
 
@@ -177,10 +250,10 @@ static void callMethod(Thread *self, Object *obj, Method *method)
      * the current time so that other threads can detect
      * when this thread wedges and provide useful information.
      */
-    gDvm.gcHeap->heapWorkerInterpStartTime = dvmGetRelativeTimeUsec();
-    gDvm.gcHeap->heapWorkerInterpCpuStartTime = dvmGetThreadCpuTimeUsec();
-    gDvm.gcHeap->heapWorkerCurrentMethod = method;
-    gDvm.gcHeap->heapWorkerCurrentObject = obj;
+    state->interpStartTime = dvmGetRelativeTimeUsec();
+    state->interpCpuStartTime = dvmGetThreadCpuTimeUsec();
+    state->currentMethod = method;
+    state->currentObject = obj;
 
     /* Call the method.
      *
@@ -203,9 +276,9 @@ static void callMethod(Thread *self, Object *obj, Method *method)
     }
     dvmLockMutex(&gDvm.heapWorkerLock);
 
-    gDvm.gcHeap->heapWorkerCurrentObject = NULL;
-    gDvm.gcHeap->heapWorkerCurrentMethod = NULL;
-    gDvm.gcHeap->heapWorkerInterpStartTime = 0LL;
+    state->currentObject = NULL;
+    state->currentMethod = NULL;
+    state->interpStartTime = 0LL;
 
     /* Exceptions thrown during these calls interrupt
      * the method, but are otherwise ignored.
@@ -219,16 +292,34 @@ static void callMethod(Thread *self, Object *obj, Method *method)
     }
 }
 
+/* Add a finished batch to the HeapWorker totals.
+ *
+ * Caller must hold gDvm.heapWorkerLock.
+ */
+static void recordBatch(int count, u8 usec)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+
+    gcHeap->heapWorkerBatches++;
+    gcHeap->heapWorkerObjects += count;
+    gcHeap->heapWorkerBatchUsec += usec;
+    if (usec > gcHeap->heapWorkerMaxBatchUsec) {
+        gcHeap->heapWorkerMaxBatchUsec = usec;
+    }
+}
+
 /* Process all enqueued heap work, including finalizers and reference
- * clearing/enqueueing.
+ * clearing/enqueueing, a batch at a time.  Other worker threads may be
+ * doing the same.
  *
  * Caller must hold gDvm.heapWorkerLock.
  */
-static void doHeapWork(Thread *self)
+static void doHeapWork(Thread *self, HeapWorkerState *state)
 {
-    Object *obj;
-    HeapWorkerOperation op;
+    GcHeap *gcHeap = gDvm.gcHeap;
+    HeapWorkerWork work[HEAP_WORKER_BATCH_SIZE];
     int numFinalizersCalled, numReferencesEnqueued;
+    int count;
 #if FANCY_REFERENCE_SUBCLASS
     int numReferencesCleared = 0;
 #endif
@@ -243,62 +334,90 @@ static void doHeapWork(Thread *self)
 
     numFinalizersCalled = 0;
     numReferencesEnqueued = 0;
-    while ((obj = dvmGetNextHeapWorkerObject(&op)) != NULL) {
-        Method *method = NULL;
-
-        /* Make sure the object hasn't been collected since
-         * being scheduled.
-         */
-        assert(dvmIsValidObject(obj));
+    while ((count = dvmGetNextHeapWorkerObjects(work,
+                    HEAP_WORKER_BATCH_SIZE)) > 0)
+    {
+        bool isRefOps = (work[0].op != WORKER_FINALIZE);
+        u8 startWhen = dvmGetRelativeTimeUsec();
+        u8 usec;
+        int i;
+
+        for (i = 0; i < count; i++) {
+            Object *obj = work[i].obj;
+            HeapWorkerOperation op = work[i].op;
+            Method *method = NULL;
+
+            /* Make sure the object hasn't been collected since
+             * being scheduled.
+             */
+            assert(dvmIsValidObject(obj));
 
-        /* Call the appropriate method(s).
-         */
-        if (op == WORKER_FINALIZE) {
-            numFinalizersCalled++;
-            method = obj->clazz->vtable[gDvm.voffJavaLangObject_finalize];
-            assert(dvmCompareNameDescriptorAndMethod("finalize", "()V",
-                            method) == 0);
-            assert(method->clazz != gDvm.classJavaLangObject);
-            callMethod(self, obj, method);
-        } else {
-#if FANCY_REFERENCE_SUBCLASS
-            /* clear() *must* happen before enqueue(), otherwise
-             * a non-clear reference could appear on a reference
-             * queue.
+            /* Call the appropriate method(s).
              */
-            if (op & WORKER_CLEAR) {
-                numReferencesCleared++;
-                method = obj->clazz->vtable[
-                        gDvm.voffJavaLangRefReference_clear];
-                assert(dvmCompareNameDescriptorAndMethod("clear", "()V",
+            if (op == WORKER_FINALIZE) {
+                numFinalizersCalled++;
+                method = obj->clazz->vtable[gDvm.voffJavaLangObject_finalize];
+                assert(dvmCompareNameDescriptorAndMethod("finalize", "()V",
                                 method) == 0);
-                assert(method->clazz != gDvm.classJavaLangRefReference);
-                callMethod(self, obj, method);
-            }
-            if (op & WORKER_ENQUEUE) {
-                numReferencesEnqueued++;
-                method = obj->clazz->vtable[
-                        gDvm.voffJavaLangRefReference_enqueue];
-                assert(dvmCompareNameDescriptorAndMethod("enqueue", "()Z",
-                                method) == 0);
-                /* We call enqueue() even when it isn't overridden,
-                 * so don't assert(!classJavaLangRefReference) here.
+                assert(method->clazz != gDvm.classJavaLangObject);
+                callMethod(self, state, obj, method);
+            } else {
+#if FANCY_REFERENCE_SUBCLASS
+                /* clear() *must* happen before enqueue(), otherwise
+                 * a non-clear reference could appear on a reference
+                 * queue.
                  */
-                callMethod(self, obj, method);
-            }
+                if (op & WORKER_CLEAR) {
+                    numReferencesCleared++;
+                    method = obj->clazz->vtable[
+                            gDvm.voffJavaLangRefReference_clear];
+                    assert(dvmCompareNameDescriptorAndMethod("clear", "()V",
+                                    method) == 0);
+                    assert(method->clazz != gDvm.classJavaLangRefReference);
+                    callMethod(self, state, obj, method);
+                }
+                if (op & WORKER_ENQUEUE) {
+                    numReferencesEnqueued++;
+                    method = obj->clazz->vtable[
+                            gDvm.voffJavaLangRefReference_enqueue];
+                    assert(dvmCompareNameDescriptorAndMethod("enqueue", "()Z",
+                                    method) == 0);
+                    /* We call enqueue() even when it isn't overridden,
+                     * so don't assert(!classJavaLangRefReference) here.
+                     */
+                    callMethod(self, state, obj, method);
+                }
 #else
-            assert((op & WORKER_CLEAR) == 0);
-            if (op & WORKER_ENQUEUE) {
-                numReferencesEnqueued++;
-                callMethod(self, obj,
-                        gDvm.methJavaLangRefReference_enqueueInternal);
-            }
+                assert((op & WORKER_CLEAR) == 0);
+                if (op & WORKER_ENQUEUE) {
+                    numReferencesEnqueued++;
+                    callMethod(self, state, obj,
+                            gDvm.methJavaLangRefReference_enqueueInternal);
+                }
 #endif
+            }
+
+            /* Let the GC collect the object.
+             */
+            dvmReleaseTrackedAlloc(obj, self);
         }
 
-        /* Let the GC collect the object.
+        /* Once the last reference operation is done, finalizations
+         * can be handed out; wake up any idle workers to help.
          */
-        dvmReleaseTrackedAlloc(obj, self);
+        if (isRefOps) {
+            gcHeap->heapWorkerRefOpsInFlight -= count;
+            assert(gcHeap->heapWorkerRefOpsInFlight >= 0);
+            if (gcHeap->heapWorkerRefOpsInFlight == 0) {
+                dvmSignalHeapWorker(false);
+            }
+        }
+
+        usec = dvmGetRelativeTimeUsec() - startWhen;
+        recordBatch(count, usec);
+        LOGV("HeapWorker: batch of %d %s in %lldus\n", count,
+                isRefOps ? "reference operations" : "finalizers",
+                (long long) usec);
     }
     LOGV("Called %d finalizers\n", numFinalizersCalled);
     LOGV("Enqueued %d references\n", numReferencesEnqueued);
@@ -308,25 +427,16 @@ static void doHeapWork(Thread *self)
 }
 
 /*
- * The heap worker thread sits quietly until the GC tells it there's work
- * to do.
+ * Wait for work and do it, until the VM shuts down.  The HeapWorker
+ * thread ("state" is heapWorkers[0]) also trims the heap and generates
+ * register maps.
  */
-static void* heapWorkerThreadStart(void* arg)
+static void heapWorkerLoop(Thread *self, HeapWorkerState *state)
 {
-    Thread *self = dvmThreadSelf();
+    GcHeap *gcHeap = gDvm.gcHeap;
+    bool isPrimary = (state == &gcHeap->heapWorkers[0]);
     int cc;
 
-    UNUSED_PARAMETER(arg);
-
-    LOGV("HeapWorker thread started (threadid=%d)\n", self->threadId);
-
-    /* tell the main thread that we're ready */
-    dvmLockMutex(&gDvm.heapWorkerLock);
-    gDvm.heapWorkerReady = true;
-    cc = pthread_cond_signal(&gDvm.heapWorkerCond);
-    assert(cc == 0);
-    dvmUnlockMutex(&gDvm.heapWorkerLock);
-
     dvmLockMutex(&gDvm.heapWorkerLock);
     while (!gDvm.haltHeapWorker) {
         struct timespec trimtime;
@@ -336,12 +446,14 @@ static void* heapWorkerThreadStart(void* arg)
         dvmChangeStatus(NULL, THREAD_VMWAIT);
 
         /* Signal anyone who wants to know when we're done. */
-        cc = pthread_cond_broadcast(&gDvm.heapWorkerIdleCond);
-        assert(cc == 0);
+        if (gcHeap->numBusyHeapWorkers == 0) {
+            cc = pthread_cond_broadcast(&gDvm.heapWorkerIdleCond);
+            assert(cc == 0);
+        }
 
         /* Trim the heap if we were asked to. */
-        trimtime = gDvm.gcHeap->heapWorkerNextTrim;
-        if (trimtime.tv_sec != 0 && trimtime.tv_nsec != 0) {
+        trimtime = gcHeap->heapWorkerNextTrim;
+        if (isPrimary && trimtime.tv_sec != 0 && trimtime.tv_nsec != 0) {
             struct timeval now;
 
             gettimeofday(&now, NULL);
@@ -369,7 +481,7 @@ static void* heapWorkerThreadStart(void* arg)
 
                 trimtime.tv_sec = 0;
                 trimtime.tv_nsec = 0;
-                gDvm.gcHeap->heapWorkerNextTrim = trimtime;
+                gcHeap->heapWorkerNextTrim = trimtime;
             } else {
                 timedwait = true;
             }
@@ -394,16 +506,67 @@ static void* heapWorkerThreadStart(void* arg)
 
         /* Process any events in the queue.
          */
-        doHeapWork(self);
+        gcHeap->numBusyHeapWorkers++;
+        doHeapWork(self, state);
+
+        if (isPrimary) {
+            /* Generate register maps for the methods the GC had to
+             * scan conservatively.  Verification may load classes and
+             * so cause a GC; don't hold heapWorkerLock.
+             */
+            dvmUnlockMutex(&gDvm.heapWorkerLock);
+            dvmGeneratePendingRegisterMaps();
+            dvmLockMutex(&gDvm.heapWorkerLock);
+        }
+        gcHeap->numBusyHeapWorkers--;
     }
     dvmUnlockMutex(&gDvm.heapWorkerLock);
+}
+
+/*
+ * The heap worker thread sits quietly until the GC tells it there's work
+ * to do.
+ */
+static void* heapWorkerThreadStart(void* arg)
+{
+    Thread *self = dvmThreadSelf();
+    int cc;
+
+    UNUSED_PARAMETER(arg);
+
+    LOGV("HeapWorker thread started (threadid=%d)\n", self->threadId);
+
+    /* tell the main thread that we're ready */
+    dvmLockMutex(&gDvm.heapWorkerLock);
+    gDvm.heapWorkerReady = true;
+    cc = pthread_cond_signal(&gDvm.heapWorkerCond);
+    assert(cc == 0);
+    dvmUnlockMutex(&gDvm.heapWorkerLock);
+
+    heapWorkerLoop(self, &gDvm.gcHeap->heapWorkers[0]);
 
     LOGD("HeapWorker thread shutting down\n");
     return NULL;
 }
 
 /*
- * Wake up the heap worker to let it know that there's work to be done.
+ * The extra finalizer threads wait on the same condition as the
+ * HeapWorker thread, and take batches off the same lists.
+ */
+static void* finalizerThreadStart(void* arg)
+{
+    Thread *self = dvmThreadSelf();
+
+    LOGV("Finalizer thread started (threadid=%d)\n", self->threadId);
+
+    heapWorkerLoop(self, (HeapWorkerState*) arg);
+
+    LOGV("Finalizer thread shutting down\n");
+    return NULL;
+}
+
+/*
+ * Wake up the heap workers to let them know that there's work to be done.
  */
 void dvmSignalHeapWorker(bool shouldLock)
 {
@@ -413,7 +576,7 @@ void dvmSignalHeapWorker(bool shouldLock)
         dvmLockMutex(&gDvm.heapWorkerLock);
     }
 
-    cc = pthread_cond_signal(&gDvm.heapWorkerCond);
+    cc = pthread_cond_broadcast(&gDvm.heapWorkerCond);
     assert(cc == 0);
 
     if (shouldLock) {
@@ -462,7 +625,7 @@ void dvmRunFinalizationSync()
          * Do the work in the current thread.
          */
         dvmLockMutex(&gDvm.heapWorkerLock);
-        doHeapWork(dvmThreadSelf());
+        doHeapWork(dvmThreadSelf(), &gDvm.gcHeap->heapWorkers[0]);
         dvmUnlockMutex(&gDvm.heapWorkerLock);
     } else {
         /* Outside of zygote mode, we can just ask the
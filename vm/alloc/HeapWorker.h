@@ -27,13 +27,13 @@
 void dvmInitializeHeapWorkerState(void);
 
 /*
- * Initialization.  Starts/stops the worker thread.
+ * Initialization.  Starts/stops the worker threads.
  */
 bool dvmHeapWorkerStartup(void);
 void dvmHeapWorkerShutdown(void);
 
 /*
- * Tell the worker thread to wake up and do work.
+ * Tell the worker threads to wake up and do work.
  * If shouldLock is false, the caller must have already
  * acquired gDvm.heapWorkerLock.
  */
@@ -62,10 +62,10 @@ void dvmRunFinalizationSync(void);
  */
 void dvmScheduleHeapSourceTrim(size_t timeoutSec);
 
-/* Make sure that the HeapWorker thread hasn't spent an inordinate
+/* Make sure that none of the HeapWorker threads has spent an inordinate
  * amount of time inside interpreted code.
  *
- * Aborts the VM if the thread appears to be wedged.
+ * Aborts the VM if a thread appears to be wedged.
  *
  * The caller must hold the heapWorkerLock.
  */
@@ -85,13 +85,22 @@ typedef enum HeapWorkerOperation {
 } HeapWorkerOperation;
 
 /*
- * Called by the worker thread to get the next object
+ * An object taken off the HeapWorker lists, and what to do with it.
+ */
+typedef struct HeapWorkerWork {
+    Object              *obj;
+    HeapWorkerOperation op;
+} HeapWorkerWork;
+
+/*
+ * Called by a worker thread to get the next batch of objects
  * to finalize/enqueue/clear.  Implemented in Heap.c.
  *
- * @param op The operation to perform on the returned object.
- *           Must be non-NULL.
- * @return The object to operate on, or NULL.
+ * @param work Filled in with up to "max" objects and their operations.
+ * @param max The size of "work".
+ * @return The number of objects to operate on; 0 if there's nothing
+ *         the caller can do right now.
  */
-Object *dvmGetNextHeapWorkerObject(HeapWorkerOperation *op);
+int dvmGetNextHeapWorkerObjects(HeapWorkerWork *work, int max);
 
 #endif /*_DALVIK_ALLOC_HEAP_WORKER*/
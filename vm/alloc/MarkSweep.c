@@ -20,7 +20,9 @@
 #include "alloc/HeapSource.h"
 #include "alloc/MarkSweep.h"
 #include <limits.h>     // for ULONG_MAX
+#include <sched.h>      // for sched_yield()
 #include <sys/mman.h>   // for madvise(), mmap()
+#include <unistd.h>     // for sysconf()
 #include <ashmem.h>
 
 #define GC_DEBUG_PARANOID   2
@@ -69,6 +71,7 @@
 #if WITH_OBJECT_HEADERS
 u2 gGeneration = 0;
 static const Object *gMarkParent = NULL;
+static bool gRescanning = false;    // objects may be scanned twice
 #endif
 
 #ifndef PAGE_SIZE
@@ -136,8 +139,170 @@ destroyMarkStack(GcMarkStack *stack)
         *--(stack).top = (obj); \
     } while (false)
 
+/* Don't start helper threads for small heaps; thread start-up would
+ * eat most of what they save.
+ */
+#define PARALLEL_MARK_MIN_HEAP      (8 * 1024 * 1024)
+#define PARALLEL_MARK_MAX_THREADS   32
+
+/* Work-stealing deque for the parallel mark phase (Chase and Lev).
+ * The owning thread pushes and pops at .bottom without locking; other
+ * threads steal from .top with a compare-and-swap.  The ring is sized
+ * like the serial mark stack, so it can never wrap onto live entries.
+ */
+typedef struct {
+    const Object **entries;
+    size_t mask;
+    volatile long top;
+    volatile long bottom;
+} GcMarkDeque;
+
+typedef struct {
+    GcMarkDeque deque;
+    GcMarkContext *ctx;
+    size_t index;
+    pthread_t thread;
+
+    /* Keep neighbouring workers' deque indices off each other's
+     * cache lines.
+     */
+    char pad[64];
+} GcMarkWorker;
+
+/* State shared by the threads of one parallel mark phase.
+ */
+typedef struct {
+    GcMarkWorker *workers;
+    size_t numWorkers;
+
+    /* Workers that are out of local work and looking to steal.
+     */
+    volatile int32_t idleWorkers;
+
+    /* Helper threads wait on this until the deques are seeded.
+     */
+    pthread_mutex_t startLock;
+    pthread_cond_t startCond;
+    bool started;
+} GcParallelMark;
+
+static GcParallelMark gParallelMark = {
+    NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false
+};
+
+static bool
+createMarkDeque(GcMarkDeque *deque)
+{
+    const Object **entries;
+    size_t capacity;
+    size_t size;
+    int fd;
+
+    /* Same worst case as createMarkStack(), rounded up to a power
+     * of two so that indices can be masked.
+     */
+    size = dvmHeapSourceGetIdealFootprint() /
+            (sizeof(Object) + HEAP_SOURCE_CHUNK_OVERHEAD);
+    capacity = PAGE_SIZE / sizeof(Object*);
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    size = capacity * sizeof(Object*);
+    fd = ashmem_create_region("dalvik-heap-markdeque", size);
+    if (fd < 0) {
+        LOGE_GC("Could not create %zd-byte ashmem mark deque\n", size);
+        return false;
+    }
+    entries = (const Object **)mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (entries == MAP_FAILED) {
+        LOGE_GC("Could not mmap %zd-byte ashmem mark deque\n", size);
+        return false;
+    }
+
+    memset(deque, 0, sizeof(*deque));
+    deque->entries = entries;
+    deque->mask = capacity - 1;
+
+    return true;
+}
+
+static void
+destroyMarkDeque(GcMarkDeque *deque)
+{
+    munmap((char *)deque->entries, (deque->mask + 1) * sizeof(Object*));
+    memset(deque, 0, sizeof(*deque));
+}
+
+/* Owner only.
+ */
+static inline void
+pushMarkDeque(GcMarkDeque *deque, const Object *obj)
+{
+    const long b = deque->bottom;
+
+    deque->entries[b & deque->mask] = obj;
+    ATOMIC_STORE_RELEASE(&deque->bottom, b + 1);
+}
+
+/* Owner only.  Returns NULL if the deque is empty.
+ */
+static inline const Object *
+popMarkDeque(GcMarkDeque *deque)
+{
+    const long b = deque->bottom - 1;
+    const Object *obj;
+    long t;
+
+    deque->bottom = b;
+    MEM_FENCE();
+    t = deque->top;
+    if (t > b) {
+        deque->bottom = b + 1;
+        return NULL;
+    }
+    obj = deque->entries[b & deque->mask];
+    if (t == b) {
+        /* Last entry; a thief may be after it too.
+         */
+        if (!ATOMIC_CMP_SWAP_WORD(&deque->top, t, t + 1)) {
+            obj = NULL;
+        }
+        deque->bottom = b + 1;
+    }
+    return obj;
+}
+
+/* Any thread.  Returns NULL if the deque is empty or another thread
+ * won the race for the top entry.
+ */
+static const Object *
+stealMarkDeque(GcMarkDeque *deque)
+{
+    const Object *obj;
+    long t, b;
+
+    t = ATOMIC_LOAD_ACQUIRE(&deque->top);
+    MEM_FENCE();
+    b = ATOMIC_LOAD_ACQUIRE(&deque->bottom);
+    if (t >= b) {
+        return NULL;
+    }
+    obj = deque->entries[t & deque->mask];
+    if (!ATOMIC_CMP_SWAP_WORD(&deque->top, t, t + 1)) {
+        return NULL;
+    }
+    return obj;
+}
+
+/* Set up the mark context.  A minor collection starts with the old
+ * generation already marked; since the bitmaps won't be walked, the
+ * finger is parked past their end so that everything marked from the
+ * roots goes on the mark stack.
+ */
 bool
-dvmHeapBeginMarkStep()
+dvmHeapBeginMarkStep(bool minor)
 {
     GcMarkContext *mc = &gDvm.gcHeap->markContext;
     HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
@@ -165,6 +330,17 @@ dvmHeapBeginMarkStep()
     mc->numBitmaps = numBitmaps;
     mc->finger = NULL;
 
+    if (minor) {
+        GcHeap *gcHeap = gDvm.gcHeap;
+        size_t i;
+
+        assert(gcHeap->numOldBitmaps == numBitmaps);
+        for (i = 0; i < numBitmaps; i++) {
+            dvmHeapBitmapCopy(&mc->bitmaps[i], &gcHeap->oldBitmaps[i]);
+        }
+        mc->finger = (void *)ULONG_MAX;
+    }
+
 #if WITH_OBJECT_HEADERS
     gGeneration++;
 #endif
@@ -182,11 +358,11 @@ setAndReturnMarkBit(GcMarkContext *ctx, const DvmHeapChunk *hc)
 }
 
 static void _markObjectNonNullCommon(const Object *obj, GcMarkContext *ctx,
-        bool checkFinger, bool forceStack)
+        GcMarkDeque *deque, bool checkFinger, bool forceStack)
         __attribute__((always_inline));
 static void
 _markObjectNonNullCommon(const Object *obj, GcMarkContext *ctx,
-        bool checkFinger, bool forceStack)
+        GcMarkDeque *deque, bool checkFinger, bool forceStack)
 {
     DvmHeapChunk *hc;
 
@@ -202,7 +378,12 @@ _markObjectNonNullCommon(const Object *obj, GcMarkContext *ctx,
     if (!setAndReturnMarkBit(ctx, hc)) {
         /* This object was not previously marked.
          */
-        if (forceStack || (checkFinger && (void *)hc < ctx->finger)) {
+        if (deque != NULL) {
+            /* Parallel marking has no finger; everything newly
+             * marked gets queued for scanning.
+             */
+            pushMarkDeque(deque, obj);
+        } else if (forceStack || (checkFinger && (void *)hc < ctx->finger)) {
             /* This object will need to go on the mark stack.
              */
             MARK_STACK_PUSH(ctx->stack, obj);
@@ -256,16 +437,16 @@ _markObjectNonNullCommon(const Object *obj, GcMarkContext *ctx,
  * need to be added to the mark stack.
  */
 static void
-markObjectNonNull(const Object *obj, GcMarkContext *ctx)
+markObjectNonNull(const Object *obj, GcMarkContext *ctx, GcMarkDeque *deque)
 {
-    _markObjectNonNullCommon(obj, ctx, true, false);
+    _markObjectNonNullCommon(obj, ctx, deque, true, false);
 }
 
-#define markObject(obj, ctx) \
+#define markObject(obj, ctx, deque) \
     do { \
         Object *MO_obj_ = (Object *)(obj); \
         if (MO_obj_ != NULL) { \
-            markObjectNonNull(MO_obj_, (ctx)); \
+            markObjectNonNull(MO_obj_, (ctx), (deque)); \
         } \
     } while (false)
 
@@ -277,11 +458,17 @@ markObjectNonNull(const Object *obj, GcMarkContext *ctx)
  *
  * This function may only be called when marking the root
  * set.  When recursing, use the internal markObject[NonNull]().
+ *
+ * The finger is NULL during the initial root scan, so nothing gets
+ * pushed then; when the roots are marked again in the remark pause
+ * of a concurrent collection, the finger is past the end of the
+ * bitmaps and newly-marked roots go on the mark stack.
  */
 void
 dvmMarkObjectNonNull(const Object *obj)
 {
-    _markObjectNonNullCommon(obj, &gDvm.gcHeap->markContext, false, false);
+    _markObjectNonNullCommon(obj, &gDvm.gcHeap->markContext, NULL,
+            true, false);
 }
 
 /* Mark the set of root objects.
@@ -389,7 +576,8 @@ void dvmHeapMarkRootSet()
 
 /* Mark all of a ClassObject's interfaces.
  */
-static void markInterfaces(const ClassObject *clazz, GcMarkContext *ctx)
+static void markInterfaces(const ClassObject *clazz, GcMarkContext *ctx,
+        GcMarkDeque *deque)
 {
     ClassObject **interfaces;
     int interfaceCount;
@@ -400,14 +588,15 @@ static void markInterfaces(const ClassObject *clazz, GcMarkContext *ctx)
     interfaces = clazz->interfaces;
     interfaceCount = clazz->interfaceCount;
     for (i = 0; i < interfaceCount; i++) {
-        markObjectNonNull((Object *)*interfaces, ctx);
+        markObjectNonNull((Object *)*interfaces, ctx, deque);
         interfaces++;
     }
 }
 
 /* Mark all objects referred to by a ClassObject's static fields.
  */
-static void scanStaticFields(const ClassObject *clazz, GcMarkContext *ctx)
+static void scanStaticFields(const ClassObject *clazz, GcMarkContext *ctx,
+        GcMarkDeque *deque)
 {
     StaticField *f;
     int i;
@@ -419,7 +608,7 @@ static void scanStaticFields(const ClassObject *clazz, GcMarkContext *ctx)
         if (c == '[' || c == 'L') {
             /* It's an array or class reference.
              */
-            markObject((Object *)f->value.l, ctx);
+            markObject((Object *)f->value.l, ctx, deque);
         }
         f++;
     }
@@ -428,7 +617,7 @@ static void scanStaticFields(const ClassObject *clazz, GcMarkContext *ctx)
 /* Mark all objects referred to by a DataObject's instance fields.
  */
 static void scanInstanceFields(const DataObject *obj, ClassObject *clazz,
-        GcMarkContext *ctx)
+        GcMarkContext *ctx, GcMarkDeque *deque)
 {
 //TODO: Optimize this by avoiding walking the superclass chain
     while (clazz != NULL) {
@@ -447,7 +636,8 @@ static void scanInstanceFields(const DataObject *obj, ClassObject *clazz,
              * f->byteOffset is the offset from the beginning of
              * obj, not the offset into obj->instanceData.
              */
-            markObject(dvmGetFieldObject((Object*)obj, f->byteOffset), ctx);
+            markObject(dvmGetFieldObject((Object*)obj, f->byteOffset), ctx,
+                    deque);
             f++;
         }
 
@@ -459,7 +649,8 @@ static void scanInstanceFields(const DataObject *obj, ClassObject *clazz,
 
 /* Mark all objects referred to by the array's contents.
  */
-static void scanObjectArray(const ArrayObject *array, GcMarkContext *ctx)
+static void scanObjectArray(const ArrayObject *array, GcMarkContext *ctx,
+        GcMarkDeque *deque)
 {
     Object **contents;
     u4 length;
@@ -469,14 +660,15 @@ static void scanObjectArray(const ArrayObject *array, GcMarkContext *ctx)
     length = array->length;
 
     for (i = 0; i < length; i++) {
-        markObject(*contents, ctx); // may be NULL
+        markObject(*contents, ctx, deque); // may be NULL
         contents++;
     }
 }
 
 /* Mark all objects referred to by the ClassObject.
  */
-static void scanClassObject(const ClassObject *clazz, GcMarkContext *ctx)
+static void scanClassObject(const ClassObject *clazz, GcMarkContext *ctx,
+        GcMarkDeque *deque)
 {
     LOGV_SCAN("---------> %s\n", clazz->name);
 
@@ -488,7 +680,7 @@ static void scanClassObject(const ClassObject *clazz, GcMarkContext *ctx)
          * class by scanning the array contents;  the array may be
          * zero-length, or may only contain null objects.
          */
-        markObjectNonNull((Object *)clazz->elementClass, ctx);
+        markObjectNonNull((Object *)clazz->elementClass, ctx, deque);
     }
 
     /* We scan these explicitly in case the only remaining
@@ -496,30 +688,26 @@ static void scanClassObject(const ClassObject *clazz, GcMarkContext *ctx)
      * object;  we may not be guaranteed to reach all
      * live class objects via a classloader.
      */
-    markObject((Object *)clazz->super, ctx);  // may be NULL (java.lang.Object)
-    markObject(clazz->classLoader, ctx);      // may be NULL
+    markObject((Object *)clazz->super, ctx, deque); // may be NULL (j.l.Object)
+    markObject(clazz->classLoader, ctx, deque);     // may be NULL
 
-    scanStaticFields(clazz, ctx);
-    markInterfaces(clazz, ctx);
+    scanStaticFields(clazz, ctx, deque);
+    markInterfaces(clazz, ctx, deque);
 }
 
 /* Mark all objects that obj refers to.
  *
- * Called on every object in markList.
+ * Called on every object in markList.  <deque> is the calling
+ * thread's deque during parallel marking, and NULL otherwise.
  */
-static void scanObject(const Object *obj, GcMarkContext *ctx)
+static void scanObject(const Object *obj, GcMarkContext *ctx,
+        GcMarkDeque *deque)
 {
     ClassObject *clazz;
 
     assert(dvmIsValidObject(obj));
     LOGV_SCAN("0x%08x %s\n", (uint)obj, obj->clazz->name);
 
-#if WITH_HPROF
-    if (gDvm.gcHeap->hprofContext != NULL) {
-        hprofDumpHeapObject(gDvm.gcHeap->hprofContext, obj);
-    }
-#endif
-
     /* Get and mark the class object for this particular instance.
      */
     clazz = obj->clazz;
@@ -542,7 +730,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
     }
 #if WITH_OBJECT_HEADERS
     gMarkParent = obj;
-    if (ptr2chunk(obj)->scanGeneration == gGeneration) {
+    if (ptr2chunk(obj)->scanGeneration == gGeneration && !gRescanning) {
         LOGE("object 0x%08x was already scanned this generation\n",
                 (u_int64_t)obj);
         dvmAbort();
@@ -553,7 +741,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
 #endif
 
     assert(dvmIsValidObject((Object *)clazz));
-    markObjectNonNull((Object *)clazz, ctx);
+    markObjectNonNull((Object *)clazz, ctx, deque);
 
     /* Mark any references in this object.
      */
@@ -563,13 +751,13 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
         if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOBJECTARRAY)) {
             /* It's an array of object references.
              */
-            scanObjectArray((ArrayObject *)obj, ctx);
+            scanObjectArray((ArrayObject *)obj, ctx, deque);
         }
         // else there's nothing else to scan
     } else {
         /* It's a DataObject-compatible object.
          */
-        scanInstanceFields((DataObject *)obj, clazz, ctx);
+        scanInstanceFields((DataObject *)obj, clazz, ctx, deque);
 
         if (IS_CLASS_FLAG_SET(clazz, CLASS_ISREFERENCE)) {
             GcHeap *gcHeap = gDvm.gcHeap;
@@ -599,7 +787,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
                      * only be used when following objects that just
                      * became scheduled for finalization.
                      */
-                    markObjectNonNull(referent, ctx);
+                    markObjectNonNull(referent, ctx, deque);
                     goto skip_reference;
                 }
 
@@ -619,7 +807,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
                     //      this strength, in case the new refs refer
                     //      to the same referent.  Not a very common
                     //      case, though.
-                    markObjectNonNull(referent, ctx);
+                    markObjectNonNull(referent, ctx, deque);
                     goto skip_reference;
                 }
 
@@ -634,14 +822,21 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
             /* We use the vmData field of Reference objects
              * as a next pointer in a singly-linked list.
              * That way, we don't need to allocate any memory
-             * while we're doing a GC.
+             * while we're doing a GC.  The push is a CAS because
+             * several mark threads may be adding to the same list.
+             * The store bypasses the write barrier; a dirty card
+             * would get the reference rescanned at remark time.
              */
 #define ADD_REF_TO_LIST(list, ref) \
             do { \
                 Object *ARTL_ref_ = (/*de-const*/Object *)(ref); \
-                dvmSetFieldObject(ARTL_ref_, \
-                        gDvm.offJavaLangRefReference_vmData, list); \
-                list = ARTL_ref_; \
+                Object *ARTL_head_; \
+                do { \
+                    ARTL_head_ = (list); \
+                    ((JValue *)((u1 *)ARTL_ref_ + \
+                            gDvm.offJavaLangRefReference_vmData))->l = \
+                            ARTL_head_; \
+                } while (!ATOMIC_CMP_SWAP_WORD(&(list), ARTL_head_, ARTL_ref_)); \
             } while (false)
 
                 /* At this stage, we just keep track of all of
@@ -658,7 +853,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
                             SR_COLLECT_NONE)
                     {
                 sr_collect_none:
-                        markObjectNonNull(referent, ctx);
+                        markObjectNonNull(referent, ctx, deque);
                     } else if (gcHeap->softReferenceCollectionState ==
                             SR_COLLECT_ALL)
                     {
@@ -698,7 +893,7 @@ static void scanObject(const Object *obj, GcMarkContext *ctx)
          * including the java.lang.Class class object.
          */
         if (clazz == gDvm.classJavaLangClass) {
-            scanClassObject((ClassObject *)obj, ctx);
+            scanClassObject((ClassObject *)obj, ctx, deque);
         }
     }
 
@@ -718,7 +913,7 @@ processMarkStack(GcMarkContext *ctx)
      */
     ctx->finger = (void *)ULONG_MAX;
     while (ctx->stack.top != base) {
-        scanObject(*ctx->stack.top++, ctx);
+        scanObject(*ctx->stack.top++, ctx, NULL);
     }
 }
 
@@ -742,12 +937,210 @@ scanBitmapCallback(size_t numPtrs, void **ptrs, const void *finger, void *arg)
         /* The pointers we're getting back are DvmHeapChunks,
          * not Objects.
          */
-        scanObject(chunk2ptr(*ptrs++), ctx);
+        scanObject(chunk2ptr(*ptrs++), ctx, NULL);
     }
 
     return true;
 }
 
+/* Called with an empty local deque.  Steal an object from another
+ * worker, or return NULL once every worker is out of work.
+ *
+ * A worker counts itself idle while it looks.  Only workers that are
+ * not idle can push, so once every worker is idle, every deque is
+ * empty for good.
+ */
+static const Object *
+stealMarkWork(GcMarkWorker *self)
+{
+    GcParallelMark *pm = &gParallelMark;
+    const size_t numWorkers = pm->numWorkers;
+    size_t i;
+
+    android_atomic_inc(&pm->idleWorkers);
+    for (;;) {
+        for (i = 1; i < numWorkers; i++) {
+            GcMarkWorker *victim =
+                    &pm->workers[(self->index + i) % numWorkers];
+            const Object *obj;
+
+            if (victim->deque.top >= victim->deque.bottom) {
+                continue;
+            }
+            android_atomic_dec(&pm->idleWorkers);
+            obj = stealMarkDeque(&victim->deque);
+            if (obj != NULL) {
+                return obj;
+            }
+            android_atomic_inc(&pm->idleWorkers);
+        }
+        if (pm->idleWorkers == (int32_t)numWorkers) {
+            return NULL;
+        }
+        sched_yield();
+    }
+}
+
+static void
+drainMarkWork(GcMarkWorker *self)
+{
+    GcMarkContext *ctx = self->ctx;
+    const Object *obj;
+
+    for (;;) {
+        obj = popMarkDeque(&self->deque);
+        if (obj == NULL) {
+            obj = stealMarkWork(self);
+            if (obj == NULL) {
+                break;
+            }
+        }
+        scanObject(obj, ctx, &self->deque);
+    }
+}
+
+static void *
+markWorkerThreadStart(void *arg)
+{
+    GcParallelMark *pm = &gParallelMark;
+
+    dvmLockMutex(&pm->startLock);
+    while (!pm->started) {
+        pthread_cond_wait(&pm->startCond, &pm->startLock);
+    }
+    dvmUnlockMutex(&pm->startLock);
+
+    drainMarkWork((GcMarkWorker *)arg);
+    return NULL;
+}
+
+static bool
+seedMarkDequesCallback(size_t numPtrs, void **ptrs, const void *finger,
+        void *arg)
+{
+    GcParallelMark *pm = &gParallelMark;
+    size_t *next = (size_t *)arg;
+    size_t i;
+
+    for (i = 0; i < numPtrs; i++) {
+        pushMarkDeque(&pm->workers[*next].deque, chunk2ptr(*ptrs++));
+        if (++*next == pm->numWorkers) {
+            *next = 0;
+        }
+    }
+
+    return true;
+}
+
+/* Returns the number of threads to mark with; 1 means use the serial
+ * finger/stack scan.
+ */
+static size_t
+markThreadCount()
+{
+#if WITH_OBJECT_HEADERS || DVM_TRACK_HEAP_MARKING
+    /* Both keep unsynchronized bookkeeping in the marking path.
+     */
+    return 1;
+#else
+    long numThreads;
+
+    if (dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0) <
+            PARALLEL_MARK_MIN_HEAP)
+    {
+        return 1;
+    }
+
+    numThreads = gDvm.gcMarkThreads;
+    if (numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > PARALLEL_MARK_MAX_THREADS) {
+        numThreads = PARALLEL_MARK_MAX_THREADS;
+    }
+    return numThreads;
+#endif
+}
+
+/* Trace the heap from the marked root set with <numThreads> threads,
+ * the calling thread being one of them.  Each thread scans from its
+ * own deque and steals from the others when it runs dry.
+ *
+ * Returns false, having marked nothing, if the deques couldn't be
+ * set up.
+ */
+static bool
+scanMarkedObjectsParallel(GcMarkContext *ctx, size_t numThreads)
+{
+    GcParallelMark *pm = &gParallelMark;
+    size_t numStarted;
+    size_t next;
+    size_t i;
+    int cc;
+
+    pm->workers = (GcMarkWorker *)calloc(numThreads, sizeof(GcMarkWorker));
+    if (pm->workers == NULL) {
+        return false;
+    }
+    for (i = 0; i < numThreads; i++) {
+        if (!createMarkDeque(&pm->workers[i].deque)) {
+            while (i > 0) {
+                destroyMarkDeque(&pm->workers[--i].deque);
+            }
+            free(pm->workers);
+            pm->workers = NULL;
+            return false;
+        }
+        pm->workers[i].ctx = ctx;
+        pm->workers[i].index = i;
+    }
+    pm->idleWorkers = 0;
+    pm->started = false;
+
+    /* Start the helpers before handing out work, so that if we can't
+     * get as many threads as we asked for, nothing is stranded in the
+     * deque of a worker that doesn't exist.
+     */
+    for (numStarted = 1; numStarted < numThreads; numStarted++) {
+        cc = pthread_create(&pm->workers[numStarted].thread, NULL,
+                markWorkerThreadStart, &pm->workers[numStarted]);
+        if (cc != 0) {
+            LOGW_GC("Could not start GC mark thread %zd: %s\n",
+                    numStarted, strerror(cc));
+            break;
+        }
+    }
+    pm->numWorkers = numStarted;
+
+    /* Deal the root set out round-robin.
+     */
+    next = 0;
+    dvmHeapBitmapWalkList(ctx->bitmaps, ctx->numBitmaps,
+            seedMarkDequesCallback, &next);
+
+    dvmLockMutex(&pm->startLock);
+    pm->started = true;
+    pthread_cond_broadcast(&pm->startCond);
+    dvmUnlockMutex(&pm->startLock);
+
+    drainMarkWork(&pm->workers[0]);
+    for (i = 1; i < numStarted; i++) {
+        pthread_join(pm->workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < numThreads; i++) {
+        destroyMarkDeque(&pm->workers[i].deque);
+    }
+    free(pm->workers);
+    pm->workers = NULL;
+    pm->numWorkers = 0;
+
+    LOGD_GC("parallel mark: %zd threads\n", numStarted);
+    return true;
+}
+
 /* Given bitmaps with the root set marked, find and mark all
  * reachable objects.  When this returns, the entire set of
  * live objects will be marked and the mark stack will be empty.
@@ -755,9 +1148,21 @@ scanBitmapCallback(size_t numPtrs, void **ptrs, const void *finger, void *arg)
 void dvmHeapScanMarkedObjects()
 {
     GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+    size_t numThreads;
 
     assert(ctx->finger == NULL);
 
+    numThreads = markThreadCount();
+    if (numThreads > 1 && scanMarkedObjectsParallel(ctx, numThreads)) {
+        /* Anything marked from here on (references, finalizers)
+         * goes through the serial mark stack, which expects the
+         * finger to be past the end of the bitmaps.
+         */
+        ctx->finger = (void *)ULONG_MAX;
+        LOG_SCAN("done with marked objects\n");
+        return;
+    }
+
     /* The bitmaps currently have bits set for the root set.
      * Walk across the bitmaps and scan each object.
      */
@@ -775,6 +1180,123 @@ void dvmHeapScanMarkedObjects()
     LOG_SCAN("done with marked objects\n");
 }
 
+/* Mark an object that was allocated while a concurrent collection
+ * was tracing.  The mutators are running, so this can race with the
+ * mark threads; the bit is set atomically either way.  Dirtying the
+ * card makes sure the remark pause scans the object once it has been
+ * filled in.
+ */
+void dvmHeapMarkNewObject(const Object *obj)
+{
+    DvmHeapChunk *hc = ptr2chunk(obj);
+
+    setAndReturnMarkBit(&gDvm.gcHeap->markContext, hc);
+#if WITH_OBJECT_HEADERS
+    hc->markGeneration = gGeneration;
+#endif
+    dvmMarkCard(obj);
+}
+
+/* Mark the root set again after a concurrent trace.  Roots that
+ * weren't marked the first time go on the mark stack, to be scanned
+ * by dvmHeapReScanMarkedObjects().
+ */
+void dvmHeapReMarkRootSet()
+{
+    assert(gDvm.gcHeap->markContext.finger == (void *)ULONG_MAX);
+
+    dvmHeapMarkRootSet();
+}
+
+/* Scan every marked object whose first byte is on a dirty card.
+ */
+static void scanDirtyCards(GcMarkContext *ctx)
+{
+    const u1 *card, *end;
+
+    card = gDvm.cardTable;
+    end = card + gDvm.cardTableLength;
+    for (; card < end; card++) {
+        u1 *addr, *limit;
+
+        if (*card == GC_CARD_CLEAN) {
+            continue;
+        }
+        addr = dvmAddrFromCard(card);
+        limit = addr + GC_CARD_SIZE;
+        for (; addr < limit; addr += HB_OBJECT_ALIGNMENT) {
+            if (isMarked(ptr2chunk(addr), ctx)) {
+                scanObject((const Object *)addr, ctx, NULL);
+            }
+        }
+    }
+}
+
+/* Scan every marked object that starts on a dirty card, then finish
+ * tracing from whatever that (and dvmHeapReMarkRootSet()) marked.
+ * The world must be stopped.
+ *
+ * A Reference object on a dirty card may already be on one of the
+ * reference lists, so its referent is marked outright rather than
+ * letting scanObject() queue the reference a second time.
+ */
+void dvmHeapReScanMarkedObjects()
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    GcMarkContext *ctx = &gcHeap->markContext;
+
+    assert(ctx->finger == (void *)ULONG_MAX);
+
+    gcHeap->markAllReferents = true;
+#if WITH_OBJECT_HEADERS
+    gRescanning = true;
+#endif
+    scanDirtyCards(ctx);
+    processMarkStack(ctx);
+#if WITH_OBJECT_HEADERS
+    gRescanning = false;
+#endif
+    gcHeap->markAllReferents = false;
+
+    LOG_SCAN("done rescanning dirty cards\n");
+}
+
+static int scanClassCallback(void *clazz, void *arg)
+{
+    scanObject((const Object *)clazz, (GcMarkContext *)arg, NULL);
+    return 0;
+}
+
+/* The second half of a minor collection's marking, after
+ * dvmHeapMarkRootSet().  Old objects aren't scanned, so the young
+ * objects they point to are found through the remembered set: the
+ * old objects on dirty cards, plus every class object, since the VM
+ * fills in class objects and their static fields without always
+ * going through the write barrier.  Then trace from all of that.
+ */
+void dvmHeapScanRememberedSet()
+{
+    GcMarkContext *ctx = &gDvm.gcHeap->markContext;
+
+    assert(ctx->finger == (void *)ULONG_MAX);
+
+#if WITH_OBJECT_HEADERS
+    gRescanning = true;
+#endif
+    scanDirtyCards(ctx);
+    if (gDvm.loadedClasses != NULL) {
+        dvmLockLoadedClasses();
+        dvmForeachLoadedClass(scanClassCallback, ctx);
+        dvmUnlockLoadedClasses();
+    }
+    processMarkStack(ctx);
+#if WITH_OBJECT_HEADERS
+    gRescanning = false;
+#endif
+
+    LOG_SCAN("done with the remembered set\n");
+}
+
 /** @return true if we need to schedule a call to clear().
  */
 static bool clearReference(Object *reference)
@@ -973,7 +1495,7 @@ LOGD_HEAP("dvmHeapHandleReferences(): cleared %zd, enqueued %zd %s references\n"
             referent = dvmGetFieldObject(reference, offReferent);
 
             if (referent != NULL && !isMarked(ptr2chunk(referent), markContext)) {
-                markObjectNonNull(referent, markContext);
+                markObjectNonNull(referent, markContext, NULL);
                 scanRequired = true;
 
                 /* Let later GCs know not to reschedule this reference.
@@ -1101,7 +1623,7 @@ void dvmHeapScheduleFinalizations()
     assert(ref < lastRef);
     HPROF_SET_GC_SCAN_STATE(HPROF_ROOT_FINALIZING, 0);
     while (ref < lastRef) {
-        markObjectNonNull(*ref, markContext);
+        markObjectNonNull(*ref, markContext, NULL);
         ref++;
     }
     HPROF_CLEAR_GC_SCAN_STATE();
@@ -1118,35 +1640,131 @@ void dvmHeapScheduleFinalizations()
     dvmSignalHeapWorker(false);
 }
 
+/* Copy the new object bitmaps (i.e., the final marks) into the
+ * old-generation bitmaps, creating them the first time.
+ */
+static void saveOldGeneration()
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
+    size_t numBitmaps;
+    size_t i;
+
+    numBitmaps = dvmHeapSourceGetObjectBitmaps(objectBitmaps,
+            HEAP_SOURCE_MAX_HEAP_COUNT);
+    if (gcHeap->numOldBitmaps != numBitmaps) {
+        dvmHeapBitmapDeleteList(gcHeap->oldBitmaps, gcHeap->numOldBitmaps);
+        gcHeap->numOldBitmaps = 0;
+        if (!dvmHeapBitmapInitListFromTemplates(gcHeap->oldBitmaps,
+                objectBitmaps, numBitmaps, "old"))
+        {
+            LOGW_GC("Can't create old-generation bitmaps; "
+                    "minor collections disabled\n");
+            return;
+        }
+        gcHeap->numOldBitmaps = numBitmaps;
+    }
+    for (i = 0; i < numBitmaps; i++) {
+        dvmHeapBitmapCopy(&gcHeap->oldBitmaps[i], &objectBitmaps[i]);
+    }
+    dvmClearCardTable();
+}
+
 void dvmHeapFinishMarkStep()
 {
-    HeapBitmap *markBitmap;
-    HeapBitmap objectBitmap;
     GcMarkContext *markContext;
 
     markContext = &gDvm.gcHeap->markContext;
 
-    /* The sweep step freed every object that appeared in the
-     * HeapSource bitmaps that didn't appear in the mark bitmaps.
-     * The new state of the HeapSource is exactly the final
-     * mark bitmaps, so swap them in.
+    /* Once the sweep is done, the HeapSource will hold exactly
+     * the objects in the final mark bitmaps, so swap them in now;
+     * allocations made while the sweep runs set bits in them
+     * directly.
      *
-     * The old bitmaps will be swapped into the context so that
-     * we can clean them up.
+     * The old bitmaps are swapped into the context, where the
+     * sweep will use them to find the unmarked objects and then
+     * clean them up.
      */
     dvmHeapSourceReplaceObjectBitmaps(markContext->bitmaps,
             markContext->numBitmaps);
 
-    /* Clean up the old HeapSource bitmaps and anything else associated
-     * with the marking process.
-     */
-    dvmHeapBitmapDeleteList(markContext->bitmaps, markContext->numBitmaps);
     destroyMarkStack(&markContext->stack);
 
-    memset(markContext, 0, sizeof(*markContext));
+    /* Everything that survived is old now.  Remember which objects
+     * those are, and start recording stores into them afresh.
+     */
+    if (gDvm.generationalGc && gDvm.cardTableLength != 0) {
+        saveOldGeneration();
+    }
 }
 
-#if WITH_HPROF && WITH_HPROF_UNREACHABLE
+#if WITH_HPROF
+/* Each region of the heap that hprof dumps on its own covers this many
+ * words of the bitmaps (4MB of heap, with 64-bit words).
+ */
+#define HPROF_REGION_WORDS  8192
+
+/* The objects set in <bitmaps>, or, if <objectBitmaps> is set, the ones
+ * set there but not in <bitmaps>, cut up into regions.
+ */
+typedef struct {
+    const HeapBitmap *bitmaps;
+    const HeapBitmap *objectBitmaps;
+    size_t numBitmaps;
+    size_t firstRegion[HEAP_SOURCE_MAX_HEAP_COUNT + 1];
+} HprofRegions;
+
+static size_t
+hprofBitmapWords(const HeapBitmap *hb)
+{
+    if (hb->max < hb->base) {
+        return 0;
+    }
+    return HB_OFFSET_TO_INDEX(hb->max - hb->base) + 1;
+}
+
+static size_t
+hprofSetUpRegions(HprofRegions *regions, const HeapBitmap bitmaps[],
+        const HeapBitmap objectBitmaps[], size_t numBitmaps)
+{
+    size_t i;
+
+    assert(numBitmaps <= HEAP_SOURCE_MAX_HEAP_COUNT);
+
+    regions->bitmaps = bitmaps;
+    regions->objectBitmaps = objectBitmaps;
+    regions->numBitmaps = numBitmaps;
+    regions->firstRegion[0] = 0;
+    for (i = 0; i < numBitmaps; i++) {
+        size_t words = hprofBitmapWords(&bitmaps[i]);
+
+        if (objectBitmaps != NULL &&
+            hprofBitmapWords(&objectBitmaps[i]) > words)
+        {
+            words = hprofBitmapWords(&objectBitmaps[i]);
+        }
+        regions->firstRegion[i + 1] = regions->firstRegion[i] +
+                (words + HPROF_REGION_WORDS - 1) / HPROF_REGION_WORDS;
+    }
+
+    return regions->firstRegion[numBitmaps];
+}
+
+static bool
+hprofMarkedBitmapCallback(size_t numPtrs, void **ptrs,
+        const void *finger, void *arg)
+{
+    hprof_context_t *hctx = (hprof_context_t *)arg;
+    size_t i;
+
+    for (i = 0; i < numPtrs; i++) {
+        hprofDumpHeapObject(hctx, (Object *)chunk2ptr(ptrs[i]));
+    }
+
+    return true;
+}
+
+#if WITH_HPROF_UNREACHABLE
 static bool
 hprofUnreachableBitmapCallback(size_t numPtrs, void **ptrs,
         const void *finger, void *arg)
@@ -1168,12 +1786,67 @@ hprofUnreachableBitmapCallback(size_t numPtrs, void **ptrs,
 
     return true;
 }
+#endif
+
+/* Dump one region; called by hprof, from several threads at once.
+ */
+static bool
+hprofDumpRegion(hprof_context_t *hctx, size_t region, void *arg)
+{
+    const HprofRegions *regions = (const HprofRegions *)arg;
+    HeapBitmap slice;
+    size_t firstWord;
+    size_t i;
+
+    for (i = 0; region >= regions->firstRegion[i + 1]; i++) {
+        assert(i + 1 < regions->numBitmaps);
+    }
+    firstWord = (region - regions->firstRegion[i]) * HPROF_REGION_WORDS;
+
+    dvmHeapBitmapSlice(&slice, &regions->bitmaps[i], firstWord,
+            HPROF_REGION_WORDS);
+#if WITH_HPROF_UNREACHABLE
+    if (regions->objectBitmaps != NULL) {
+        HeapBitmap objectSlice;
+
+        dvmHeapBitmapSlice(&objectSlice, &regions->objectBitmaps[i],
+                firstWord, HPROF_REGION_WORDS);
+        return dvmHeapBitmapXorWalk(&slice, &objectSlice,
+                hprofUnreachableBitmapCallback, hctx);
+    }
+#endif
+    return dvmHeapBitmapWalk(&slice, hprofMarkedBitmapCallback, hctx);
+}
+
+/* Write out every marked object.  Marking is over by now, so the
+ * bitmaps can be split up and dumped in parallel.
+ */
+static void
+hprofDumpMarkedObjects(const HeapBitmap markBitmaps[], size_t numBitmaps)
+{
+    hprof_context_t *hctx = gDvm.gcHeap->hprofContext;
+    HprofRegions regions;
+    size_t numRegions;
+
+    if (hctx == NULL) {
+        return;
+    }
+
+    LOGI("hprof: dumping reachable objects\n");
+
+    numRegions = hprofSetUpRegions(&regions, markBitmaps, NULL, numBitmaps);
+    hprofDumpRegions(hctx, numRegions, hprofDumpRegion, &regions);
+}
 
+#if WITH_HPROF_UNREACHABLE
 static void
 hprofDumpUnmarkedObjects(const HeapBitmap markBitmaps[],
         const HeapBitmap objectBitmaps[], size_t numBitmaps)
 {
     hprof_context_t *hctx = gDvm.gcHeap->hprofContext;
+    HprofRegions regions;
+    size_t numRegions;
+
     if (hctx == NULL) {
         return;
     }
@@ -1182,17 +1855,29 @@ hprofDumpUnmarkedObjects(const HeapBitmap markBitmaps[],
 
     HPROF_SET_GC_SCAN_STATE(HPROF_UNREACHABLE, 0);
 
-    dvmHeapBitmapXorWalkLists(markBitmaps, objectBitmaps, numBitmaps,
-            hprofUnreachableBitmapCallback, hctx);
+    numRegions = hprofSetUpRegions(&regions, markBitmaps, objectBitmaps,
+            numBitmaps);
+    hprofDumpRegions(hctx, numRegions, hprofDumpRegion, &regions);
 
     HPROF_CLEAR_GC_SCAN_STATE();
 }
 #endif
+#endif /* WITH_HPROF */
+
+typedef struct {
+    /* If true, the heap lock isn't held; take it for each batch.
+     */
+    bool concurrent;
+    size_t numFreed;
+    size_t sizeFreed;
+} SweepContext;
 
 static bool
 sweepBitmapCallback(size_t numPtrs, void **ptrs, const void *finger, void *arg)
 {
     const ClassObject *const classJavaLangClass = gDvm.classJavaLangClass;
+    SweepContext *ctx = (SweepContext *)arg;
+    void **origPtrs = ptrs;
     size_t i;
 
     for (i = 0; i < numPtrs; i++) {
@@ -1257,11 +1942,20 @@ sweepBitmapCallback(size_t numPtrs, void **ptrs, const void *finger, void *arg)
         }
 #endif
 
-//TODO: provide a heapsource function that takes a list of pointers to free
-//      and call it outside of this loop.
-        dvmHeapSourceFree(hc);
     }
 
+    /* The batch never spans two heaps; the walk flushes it at the
+     * end of each bitmap.
+     */
+    if (ctx->concurrent) {
+        dvmLockHeap();
+    }
+    ctx->sizeFreed += dvmHeapSourceFreeList(numPtrs, origPtrs);
+    if (ctx->concurrent) {
+        dvmUnlockHeap();
+    }
+    ctx->numFreed += numPtrs;
+
     return true;
 }
 
@@ -1275,32 +1969,65 @@ static int isUnmarkedObject(void *object)
             &gDvm.gcHeap->markContext);
 }
 
-/* Walk through the list of objects that haven't been
- * marked and free them.
+/* Take care of the weakly-held things outside the object graph
+ * before the mark bitmaps stop being the mark bitmaps.  Must be
+ * called with the world stopped, before dvmHeapFinishMarkStep().
  */
 void
-dvmHeapSweepUnmarkedObjects(int *numFreed, size_t *sizeFreed)
+dvmHeapSweepSystemWeaks()
 {
-    const HeapBitmap *markBitmaps;
-    const GcMarkContext *markContext;
-    HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
-    size_t origObjectsAllocated;
-    size_t origBytesAllocated;
-    size_t numBitmaps;
-
     /* All reachable objects have been marked.
      * Detach any unreachable interned strings before
      * we sweep.
      */
     dvmGcDetachDeadInternedStrings(isUnmarkedObject);
 
-    /* Free any known objects that are not marked.
-     */
-    origObjectsAllocated = dvmHeapSourceGetValue(HS_OBJECTS_ALLOCATED, NULL, 0);
-    origBytesAllocated = dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
+#if WITH_HPROF
+    dvmHeapDumpHprofObjects();
+#endif
+}
+
+#if WITH_HPROF
+/* Write every object out to the hprof dump in progress, if there is
+ * one.  Marking must be complete.
+ */
+void
+dvmHeapDumpHprofObjects()
+{
+    const GcMarkContext *markContext = &gDvm.gcHeap->markContext;
+
+    hprofDumpMarkedObjects(markContext->bitmaps, markContext->numBitmaps);
+#if WITH_HPROF_UNREACHABLE
+    {
+        HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
+        size_t numBitmaps;
+
+        numBitmaps = dvmHeapSourceGetObjectBitmaps(objectBitmaps,
+                HEAP_SOURCE_MAX_HEAP_COUNT);
+        hprofDumpUnmarkedObjects(markContext->bitmaps, objectBitmaps,
+                numBitmaps);
+    }
+#endif
+}
+#endif
+
+/* Walk through the list of objects that haven't been
+ * marked and free them.  Must follow dvmHeapFinishMarkStep().
+ *
+ * Nothing looks at unmarked objects once the bitmaps are swapped,
+ * so this can run after the world has been resumed; the frees are
+ * made a batch at a time under the heap lock.  If <concurrent>
+ * is false, the caller already holds the heap lock.
+ */
+void
+dvmHeapSweepUnmarkedObjects(bool concurrent, int *numFreed, size_t *sizeFreed)
+{
+    GcMarkContext *markContext;
+    HeapBitmap objectBitmaps[HEAP_SOURCE_MAX_HEAP_COUNT];
+    SweepContext ctx;
+    size_t numBitmaps;
 
     markContext = &gDvm.gcHeap->markContext;
-    markBitmaps = markContext->bitmaps;
     numBitmaps = dvmHeapSourceGetObjectBitmaps(objectBitmaps,
             HEAP_SOURCE_MAX_HEAP_COUNT);
 #ifndef NDEBUG
@@ -1311,17 +2038,23 @@ dvmHeapSweepUnmarkedObjects(int *numFreed, size_t *sizeFreed)
     }
 #endif
 
-#if WITH_HPROF && WITH_HPROF_UNREACHABLE
-    hprofDumpUnmarkedObjects(markBitmaps, objectBitmaps, numBitmaps);
-#endif
+    /* Free everything that was in the old object bitmaps (now in the
+     * context) and isn't in the new ones.
+     */
+    ctx.concurrent = concurrent;
+    ctx.numFreed = 0;
+    ctx.sizeFreed = 0;
+    dvmHeapBitmapSweepWalkLists(markContext->bitmaps, objectBitmaps,
+            numBitmaps, sweepBitmapCallback, &ctx);
 
-    dvmHeapBitmapXorWalkLists(markBitmaps, objectBitmaps, numBitmaps,
-            sweepBitmapCallback, NULL);
+    /* Clean up the old HeapSource bitmaps and anything else associated
+     * with the marking process.
+     */
+    dvmHeapBitmapDeleteList(markContext->bitmaps, markContext->numBitmaps);
+    memset(markContext, 0, sizeof(*markContext));
 
-    *numFreed = origObjectsAllocated -
-            dvmHeapSourceGetValue(HS_OBJECTS_ALLOCATED, NULL, 0);
-    *sizeFreed = origBytesAllocated -
-            dvmHeapSourceGetValue(HS_BYTES_ALLOCATED, NULL, 0);
+    *numFreed = ctx.numFreed;
+    *sizeFreed = ctx.sizeFreed;
 
 #ifdef WITH_PROFILER
     if (gDvm.allocProf.enabled) {
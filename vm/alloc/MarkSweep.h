@@ -51,13 +51,22 @@ enum RefType {
     REF_WEAKGLOBAL
 };
 
-bool dvmHeapBeginMarkStep(void);
+bool dvmHeapBeginMarkStep(bool minor);
 void dvmHeapMarkRootSet(void);
 void dvmHeapScanMarkedObjects(void);
+void dvmHeapMarkNewObject(const Object *obj);
+void dvmHeapReMarkRootSet(void);
+void dvmHeapReScanMarkedObjects(void);
+void dvmHeapScanRememberedSet(void);
 void dvmHeapHandleReferences(Object *refListHead, enum RefType refType);
 void dvmHeapScheduleFinalizations(void);
+void dvmHeapSweepSystemWeaks(void);
+#if WITH_HPROF
+void dvmHeapDumpHprofObjects(void);
+#endif
 void dvmHeapFinishMarkStep(void);
 
-void dvmHeapSweepUnmarkedObjects(int *numFreed, size_t *sizeFreed);
+void dvmHeapSweepUnmarkedObjects(bool concurrent, int *numFreed,
+        size_t *sizeFreed);
 
 #endif  // _DALVIK_ALLOC_MARK_SWEEP
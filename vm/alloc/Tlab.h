@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Thread-local allocation buffers.
+ *
+ * Each thread keeps one buffer per small size class.  A buffer is a run
+ * of equal-sized, zeroed mspace chunks that the HeapSource handed out in
+ * one batch (see dvmHeapSourceRefillTlab()), so every object carved out
+ * of it is still an ordinary chunk as far as the sweep, dlmalloc and
+ * dvmHeapSourceChunkSize() are concerned.  Taking the next chunk is a
+ * pointer bump plus an atomic OR into the object bitmap; the heap lock
+ * is only needed to refill or retire a buffer.
+ */
+#ifndef _DALVIK_ALLOC_TLAB
+#define _DALVIK_ALLOC_TLAB
+
+/* largest dvmHeapSourceAlloc() request served from a TLAB */
+#define TLAB_MAX_ALLOC_SIZE     256
+
+/* one size class per 16-byte dlmalloc chunk size, from 32 up */
+#define TLAB_NUM_SIZE_CLASSES   16
+
+typedef struct Tlab {
+    /* next chunk to hand out; == end when the buffer is empty */
+    u1*         cur;
+    u1*         end;
+
+    /* distance between consecutive chunks */
+    size_t      stride;
+} Tlab;
+
+#endif /*_DALVIK_ALLOC_TLAB*/
@@ -41,4 +41,17 @@
 int dvmClzImpl(unsigned int x);
 #endif
 
+/*
+ * Same thing for a full unsigned long, which is what the heap bitmaps
+ * are made of.  Both gcc and clang have this on every host we build for.
+ */
+#define CLZL(x) __builtin_clzl(x)
+
+/*
+ * Number of set bits in an unsigned long.  This is a single instruction
+ * wherever the target has one, and a short bit-twiddling sequence where
+ * it doesn't.
+ */
+#define POPCOUNTL(x) __builtin_popcountl(x)
+
 #endif // _DALVIK_CLZ
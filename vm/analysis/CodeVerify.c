@@ -2780,12 +2780,11 @@ static void verifyFilledNewArrayRegs(const Method* meth,
  * Entry point for the detailed code-flow analysis.
  */
 bool dvmVerifyCodeFlow(const Method* meth, InsnFlags* insnFlags,
-    UninitInstanceMap* uninitMap)
+    UninitInstanceMap* uninitMap, bool generateRegisterMap)
 {
     bool result = false;
     const int insnsSize = dvmGetMethodInsnsSize(meth);
     const u2* insns = meth->insns;
-    const bool generateRegisterMap = gDvm.generateRegisterMaps;
     int i, offset;
     bool isConditional;
     RegisterTable regTable;
@@ -257,9 +257,10 @@ void dvmFreeUninitInstanceMap(UninitInstanceMap* uninitMap);
 
 /*
  * Verify bytecode in "meth".  "insnFlags" should be populated with
- * instruction widths and "in try" flags.
+ * instruction widths and "in try" flags.  If "generateRegisterMap" is set,
+ * the method's register map is computed and attached to it.
  */
 bool dvmVerifyCodeFlow(const Method* meth, InsnFlags* insnFlags,
-    UninitInstanceMap* uninitMap);
+    UninitInstanceMap* uninitMap, bool generateRegisterMap);
 
 #endif /*_DALVIK_CODEVERIFY*/
@@ -36,6 +36,10 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
+
+/* upper bound on worker threads, whatever the CPU count */
+#define DEXOPT_MAX_THREADS  16
 
 /*
  * Virtual/direct calls to "method" are replaced with an execute-inline
@@ -46,6 +50,24 @@ typedef struct InlineSub {
     int     inlineIdx;
 } InlineSub;
 
+/*
+ * Something to do to one class, identified by its class def index.
+ */
+typedef void (*ClassDefFunc)(DexFile* pDexFile, u4 idx, void* arg);
+
+/*
+ * A pass over every class def in a DEX file, shared by the dexopt
+ * worker threads.
+ */
+typedef struct ClassPool {
+    DexFile*        pDexFile;
+    ClassDefFunc    func;
+    void*           arg;
+    int             numClasses;
+
+    volatile int    nextIndex;      /* next class def to claim */
+} ClassPool;
+
 
 /* fwd */
 static int writeDependencies(int fd, u4 modWhen, u4 crc);
@@ -58,7 +80,11 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,\
     u4* pHeaderFlags, DexClassLookup** ppClassLookup);
 static void updateChecksum(u1* addr, int len, DexHeader* pHeader);
 static bool loadAllClasses(DvmDex* pDvmDex);
-static void optimizeLoadedClasses(DexFile* pDexFile);
+static int getOptThreadCount(DexFile* pDexFile);
+static void runClassPool(DexFile* pDexFile, ClassDefFunc func, void* arg,
+    int numThreads);
+static void verifyClassDef(DexFile* pDexFile, u4 idx, void* arg);
+static void optimizeLoadedClasses(DexFile* pDexFile, int numThreads);
 static void optimizeClass(ClassObject* clazz, const InlineSub* inlineSubs);
 static bool optimizeMethod(Method* method, const InlineSub* inlineSubs);
 static void rewriteInstField(Method* method, u2* insns, OpCode newOpc);
@@ -429,6 +455,10 @@ bool dvmOptimizeDexFile(int fd, off_t dexOffset, long dexLength,
             flags |= DEXOPT_IS_BOOTSTRAP;
         if (gDvm.generateRegisterMaps)
             flags |= DEXOPT_GEN_REGISTER_MAP;
+        if (gDvm.dexOptThreads < DEXOPT_THREADS_MAX)
+            flags |= gDvm.dexOptThreads << DEXOPT_THREADS_SHIFT;
+        else
+            flags |= DEXOPT_THREADS_MAX << DEXOPT_THREADS_SHIFT;
         sprintf(values[9], "%d", flags);
         argv[curArg++] = values[9];
 
@@ -1141,6 +1171,7 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
 {
     u8 prepWhen, loadWhen, verifyWhen, optWhen;
     DvmDex* pDvmDex = NULL;
+    int numThreads;
     bool result = false;
 
     *pHeaderFlags = 0;
@@ -1194,11 +1225,18 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
     loadWhen = dvmGetRelativeTimeUsec();
 
     /*
-     * Verify all classes in the DEX file.  Export the "is verified" flag
-     * to the DEX file we're creating.
+     * Verify all classes in the DEX file, in parallel.  Export the "is
+     * verified" flag to the DEX file we're creating.  Register maps are
+     * generated along the way and hang off the Methods.
+     *
+     * Every class is verified before any is optimized, since the verifier
+     * can't cope with optimized instructions.  Each class's results land
+     * in its own class def and methods, so the output doesn't depend on
+     * which thread did what, or in what order.
      */
+    numThreads = getOptThreadCount(pDvmDex->pDexFile);
     if (doVerify) {
-        dvmVerifyAllClasses(pDvmDex->pDexFile);
+        runClassPool(pDvmDex->pDexFile, verifyClassDef, NULL, numThreads);
         *pHeaderFlags |= DEX_FLAG_VERIFIED;
     }
     verifyWhen = dvmGetRelativeTimeUsec();
@@ -1210,16 +1248,16 @@ static bool rewriteDex(u1* addr, int len, bool doVerify, bool doOpt,
      */
 #ifndef PROFILE_FIELD_ACCESS
     if (doOpt) {
-        optimizeLoadedClasses(pDvmDex->pDexFile);
+        optimizeLoadedClasses(pDvmDex->pDexFile, numThreads);
         *pHeaderFlags |= DEX_OPT_FLAG_FIELDS | DEX_OPT_FLAG_INVOCATIONS;
     }
 #endif
     optWhen = dvmGetRelativeTimeUsec();
 
-    LOGD("DexOpt: load %dms, verify %dms, opt %dms\n",
+    LOGD("DexOpt: load %dms, verify %dms, opt %dms (%d threads)\n",
         (int) (loadWhen - prepWhen) / 1000,
         (int) (verifyWhen - loadWhen) / 1000,
-        (int) (optWhen - verifyWhen) / 1000);
+        (int) (optWhen - verifyWhen) / 1000, numThreads);
 
     result = true;
 
@@ -1323,6 +1361,112 @@ static bool loadAllClasses(DvmDex* pDvmDex)
     return true;
 }
 
+/*
+ * Decide how many threads to verify and optimize with.
+ */
+static int getOptThreadCount(DexFile* pDexFile)
+{
+    int numClasses = pDexFile->pHeader->classDefsSize;
+    int numThreads = gDvm.dexOptThreads;
+
+    if (numThreads == 0)
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > DEXOPT_MAX_THREADS)
+        numThreads = DEXOPT_MAX_THREADS;
+    if (numThreads > numClasses)
+        numThreads = numClasses;
+    if (numThreads < 1)
+        numThreads = 1;
+    return numThreads;
+}
+
+/*
+ * Claim classes and work on them until the pool runs dry.  Runs in the
+ * worker threads and in the thread that started them.
+ *
+ * Classes are handed out one at a time from a shared counter, so a
+ * thread that draws a few huge classes doesn't hold up the rest.
+ */
+static void workClassPool(ClassPool* pool)
+{
+    Thread* self = dvmThreadSelf();
+
+    while (true) {
+        int idx = android_atomic_inc(&pool->nextIndex);
+
+        if (idx >= pool->numClasses)
+            break;
+        (*pool->func)(pool->pDexFile, idx, pool->arg);
+
+        /* loading classes allocates; let the GC in between classes */
+        dvmCheckSuspendPending(self);
+    }
+}
+
+static void* classPoolThreadStart(void* arg)
+{
+    ClassPool* pool = (ClassPool*) arg;
+
+    if (!dvmAttachOptThread()) {
+        LOGW("DexOpt: unable to attach worker thread\n");
+        return NULL;
+    }
+    workClassPool(pool);
+    dvmDetachOptThread();
+    return NULL;
+}
+
+/*
+ * Call "func" on every class def in "pDexFile", using "numThreads"
+ * threads, and wait for them all to finish.
+ *
+ * We count as one of the workers, so start one fewer threads.  If some
+ * can't be started, the rest of us pick up the slack.
+ */
+static void runClassPool(DexFile* pDexFile, ClassDefFunc func, void* arg,
+    int numThreads)
+{
+    Thread* self = dvmThreadSelf();
+    ClassPool pool;
+    pthread_t handles[DEXOPT_MAX_THREADS];
+    int numStarted, oldStatus, i;
+
+    assert(numThreads >= 1 && numThreads <= DEXOPT_MAX_THREADS);
+
+    memset(&pool, 0, sizeof(pool));
+    pool.pDexFile = pDexFile;
+    pool.func = func;
+    pool.arg = arg;
+    pool.numClasses = pDexFile->pHeader->classDefsSize;
+
+    numStarted = 0;
+    for (i = 0; i < numThreads - 1; i++) {
+        if (pthread_create(&handles[numStarted], NULL, classPoolThreadStart,
+                &pool) != 0)
+        {
+            LOGW("DexOpt: unable to start worker thread\n");
+            break;
+        }
+        numStarted++;
+    }
+
+    workClassPool(&pool);
+
+    /* the others may still be busy; don't hold up a GC while we wait */
+    oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    for (i = 0; i < numStarted; i++)
+        pthread_join(handles[i], NULL);
+    dvmChangeStatus(self, oldStatus);
+}
+
+/*
+ * Verify one class.
+ */
+static void verifyClassDef(DexFile* pDexFile, u4 idx, void* arg)
+{
+    dvmVerifyClassDef(pDexFile, idx);
+}
+
 
 /*
  * Create a table of inline substitutions.
@@ -1399,53 +1543,61 @@ static InlineSub* createInlineSubsTable(void)
     return table;
 }
 
+/*
+ * Optimize the code sections of one class, if it was successfully loaded
+ * from this DEX file.  "arg" is the inline substitution table.
+ */
+static void optimizeClassDef(DexFile* pDexFile, u4 idx, void* arg)
+{
+    const InlineSub* inlineSubs = (const InlineSub*) arg;
+    const DexClassDef* pClassDef;
+    const char* classDescriptor;
+    ClassObject* clazz;
+
+    pClassDef = dexGetClassDef(pDexFile, idx);
+    classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+
+    /* all classes are loaded into the bootstrap class loader */
+    clazz = dvmLookupClass(classDescriptor, NULL, false);
+    if (clazz != NULL) {
+        if ((pClassDef->accessFlags & CLASS_ISPREVERIFIED) == 0 &&
+            gDvm.dexOptMode == OPTIMIZE_MODE_VERIFIED)
+        {
+            LOGV("DexOpt: not optimizing '%s': not verified\n",
+                classDescriptor);
+        } else if (clazz->pDvmDex->pDexFile != pDexFile) {
+            /* shouldn't be here -- verifier should have caught */
+            LOGD("DexOpt: not optimizing '%s': multiple definitions\n",
+                classDescriptor);
+        } else {
+            optimizeClass(clazz, inlineSubs);
+
+            /* set the flag whether or not we actually did anything */
+            ((DexClassDef*)pClassDef)->accessFlags |=
+                CLASS_ISOPTIMIZED;
+        }
+    } else {
+        LOGV("DexOpt: not optimizing unavailable class '%s'\n",
+            classDescriptor);
+    }
+}
+
 /*
  * Run through all classes that were successfully loaded from this DEX
- * file and optimize their code sections.
+ * file and optimize their code sections, using "numThreads" threads.
+ * Each class only rewrites its own methods' instructions.
  */
-static void optimizeLoadedClasses(DexFile* pDexFile)
+static void optimizeLoadedClasses(DexFile* pDexFile, int numThreads)
 {
-    u4 count = pDexFile->pHeader->classDefsSize;
-    u4 idx;
     InlineSub* inlineSubs = NULL;
 
-    LOGV("DexOpt: +++ optimizing up to %d classes\n", count);
+    LOGV("DexOpt: +++ optimizing up to %d classes\n",
+        pDexFile->pHeader->classDefsSize);
     assert(gDvm.dexOptMode != OPTIMIZE_MODE_NONE);
 
     inlineSubs = createInlineSubsTable();
 
-    for (idx = 0; idx < count; idx++) {
-        const DexClassDef* pClassDef;
-        const char* classDescriptor;
-        ClassObject* clazz;
-
-        pClassDef = dexGetClassDef(pDexFile, idx);
-        classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
-
-        /* all classes are loaded into the bootstrap class loader */
-        clazz = dvmLookupClass(classDescriptor, NULL, false);
-        if (clazz != NULL) {
-            if ((pClassDef->accessFlags & CLASS_ISPREVERIFIED) == 0 &&
-                gDvm.dexOptMode == OPTIMIZE_MODE_VERIFIED)
-            {
-                LOGV("DexOpt: not optimizing '%s': not verified\n",
-                    classDescriptor);
-            } else if (clazz->pDvmDex->pDexFile != pDexFile) {
-                /* shouldn't be here -- verifier should have caught */
-                LOGD("DexOpt: not optimizing '%s': multiple definitions\n",
-                    classDescriptor);
-            } else {
-                optimizeClass(clazz, inlineSubs);
-
-                /* set the flag whether or not we actually did anything */
-                ((DexClassDef*)pClassDef)->accessFlags |=
-                    CLASS_ISOPTIMIZED;
-            }
-        } else {
-            LOGV("DexOpt: not optimizing unavailable class '%s'\n",
-                classDescriptor);
-        }
-    }
+    runClassPool(pDexFile, optimizeClassDef, inlineSubs, numThreads);
 
     free(inlineSubs);
 }
@@ -1585,7 +1737,11 @@ static bool optimizeMethod(Method* method, const InlineSub* inlineSubs)
 /*
  * If "referrer" and "resClass" don't come from the same DEX file, and
  * the DEX we're working on is not destined for the bootstrap class path,
- * tweak the class loader so package-access checks work correctly.
+ * make the access checks treat "resClass" as coming from a different
+ * class loader, so package-access checks work correctly.
+ *
+ * This only affects checks made by the current thread; the other dexopt
+ * workers may be resolving against the same class.
  *
  * Only do this if we're doing pre-verification or optimization.
  */
@@ -1601,7 +1757,7 @@ static void tweakLoader(ClassObject* referrer, ClassObject* resClass)
         if (dvmIsArrayClass(resClass))
             resClass = resClass->elementClass;
         if (referrer->pDvmDex != resClass->pDvmDex)
-            resClass->classLoader = (Object*) 0xdead3333;
+            dvmThreadSelf()->optForeignClass = resClass;
     }
 }
 
@@ -1613,9 +1769,7 @@ static void untweakLoader(ClassObject* referrer, ClassObject* resClass)
     if (!gDvm.optimizing || gDvm.optimizingBootstrapClass)
         return;
 
-    if (dvmIsArrayClass(resClass))
-        resClass = resClass->elementClass;
-    resClass->classLoader = NULL;
+    dvmThreadSelf()->optForeignClass = NULL;
 }
 
 
@@ -50,59 +50,40 @@ void dvmVerificationShutdown(void)
 }
 
 /*
- * Induce verification on all classes loaded from this DEX file as part
- * of pre-verification and optimization.  This is never called from a
- * normally running VM.
+ * Induce verification on the class defined by entry "idx" of this DEX
+ * file's class def table, as part of pre-verification and optimization.
+ * This is never called from a normally running VM.
  *
- * Returns "true" when all classes have been processed.
+ * dexopt calls this from several threads at once, for different entries.
  */
-bool dvmVerifyAllClasses(DexFile* pDexFile)
+void dvmVerifyClassDef(DexFile* pDexFile, u4 idx)
 {
-    u4 count = pDexFile->pHeader->classDefsSize;
-    u4 idx;
+    const DexClassDef* pClassDef;
+    const char* classDescriptor;
+    ClassObject* clazz;
 
     assert(gDvm.optimizing);
 
-    if (gDvm.classVerifyMode == VERIFY_MODE_NONE) {
-        LOGV("+++ verification is disabled, skipping all classes\n");
-        return true;
-    }
-    if (gDvm.classVerifyMode == VERIFY_MODE_REMOTE &&
-        gDvm.optimizingBootstrapClass)
-    {
-        LOGV("+++ verification disabled for bootstrap classes\n");
-        return true;
-    }
+    pClassDef = dexGetClassDef(pDexFile, idx);
+    classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
 
-    for (idx = 0; idx < count; idx++) {
-        const DexClassDef* pClassDef;
-        const char* classDescriptor;
-        ClassObject* clazz;
-
-        pClassDef = dexGetClassDef(pDexFile, idx);
-        classDescriptor = dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
-
-        /* all classes are loaded into the bootstrap class loader */
-        clazz = dvmLookupClass(classDescriptor, NULL, false);
-        if (clazz != NULL) {
-            if (clazz->pDvmDex->pDexFile != pDexFile) {
-                LOGD("DexOpt: not verifying '%s': multiple definitions\n",
-                    classDescriptor);
-            } else {
-                if (dvmVerifyClass(clazz, VERIFY_DEFAULT)) {
-                    assert((clazz->accessFlags & JAVA_FLAGS_MASK) ==
-                        pClassDef->accessFlags);
-                    ((DexClassDef*)pClassDef)->accessFlags |=
-                        CLASS_ISPREVERIFIED;
-                }
-                /* keep going even if one fails */
-            }
+    /* all classes are loaded into the bootstrap class loader */
+    clazz = dvmLookupClass(classDescriptor, NULL, false);
+    if (clazz != NULL) {
+        if (clazz->pDvmDex->pDexFile != pDexFile) {
+            LOGD("DexOpt: not verifying '%s': multiple definitions\n",
+                classDescriptor);
         } else {
-            LOGV("DexOpt: +++  not verifying '%s'\n", classDescriptor);
+            if (dvmVerifyClass(clazz, VERIFY_DEFAULT)) {
+                assert((clazz->accessFlags & JAVA_FLAGS_MASK) ==
+                    pClassDef->accessFlags);
+                ((DexClassDef*)pClassDef)->accessFlags |=
+                    CLASS_ISPREVERIFIED;
+            }
         }
+    } else {
+        LOGV("DexOpt: +++  not verifying '%s'\n", classDescriptor);
     }
-
-    return true;
 }
 
 /*
@@ -143,6 +124,55 @@ bool dvmVerifyClass(ClassObject* clazz, int verifyFlags)
     return true;
 }
 
+/*
+ * Returns "true" if dexopt has replaced any of the method's instructions
+ * with optimized forms, which the code-flow analysis can't handle.
+ */
+static bool hasOptimizedInstructions(const Method* meth)
+{
+    const u2* insns = meth->insns;
+    const u2* end = insns + dvmGetMethodInsnsSize(meth);
+
+    while (insns < end) {
+        switch (*insns & 0xff) {
+        case OP_EXECUTE_INLINE:
+        case OP_INVOKE_DIRECT_EMPTY:
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+        case OP_INVOKE_VIRTUAL_QUICK:
+        case OP_INVOKE_VIRTUAL_QUICK_RANGE:
+        case OP_INVOKE_SUPER_QUICK:
+        case OP_INVOKE_SUPER_QUICK_RANGE:
+            return true;
+        default:
+            break;
+        }
+        insns += dexGetInstrOrTableWidthAbs(gDvm.instrWidth, insns);
+    }
+
+    return false;
+}
+
+/*
+ * Compute the register map for a method whose class has already been
+ * verified, by running the method through the verifier again.
+ *
+ * Returns "true" on success.
+ */
+bool dvmVerifyMethodForRegisterMap(Method* meth)
+{
+    assert(!dvmIsNativeMethod(meth) && !dvmIsAbstractMethod(meth));
+
+    if (hasOptimizedInstructions(meth))
+        return false;
+
+    return verifyMethod(meth, VERIFY_GEN_REGISTER_MAP);
+}
+
 /*
  * Perform verification on a single method.
  *
@@ -242,7 +272,10 @@ static bool verifyMethod(Method* meth, int verifyFlags)
      * analysis, but we still need to verify that nothing actually tries
      * to use a register.
      */
-    if (!dvmVerifyCodeFlow(meth, insnFlags, uninitMap)) {
+    if (!dvmVerifyCodeFlow(meth, insnFlags, uninitMap,
+            gDvm.generateRegisterMaps ||
+            (verifyFlags & VERIFY_GEN_REGISTER_MAP) != 0))
+    {
         //LOGD("+++ %s failed code flow\n", meth->name);
         goto bail;
     }
@@ -41,25 +41,54 @@ typedef enum {
 enum {
     VERIFY_DEFAULT              = 0,
     VERIFY_ALLOW_OPT_INSTRS     = 1,    // allow instrs emitted by optimizer
+    VERIFY_GEN_REGISTER_MAP     = 2,    // compute register maps regardless
 };
 
 bool dvmVerificationStartup(void);
 void dvmVerificationShutdown(void);
 
 /*
- * Perform verification on all classes loaded from this DEX file.  This
- * should be done before optimization.
+ * Perform verification on one of the classes loaded from this DEX file,
+ * identified by its class def index.  All classes should be verified
+ * before any are optimized.
  */
-bool dvmVerifyAllClasses(DexFile* pDexFile);
+void dvmVerifyClassDef(DexFile* pDexFile, u4 idx);
 
 /*
  * Verify a single class.
  */
 bool dvmVerifyClass(ClassObject* clazz, int verifyFlags);
 
+/*
+ * Run a method of an already-verified class back through the code-flow
+ * analysis to compute its register map, which is attached to the Method.
+ * Returns false if the method can't be analyzed, e.g. because dexopt has
+ * replaced some of its instructions with optimized forms.
+ */
+bool dvmVerifyMethodForRegisterMap(Method* meth);
+
 /*
  * Release the storage associated with a RegisterMap.
  */
 void dvmFreeRegisterMap(RegisterMap* pMap);
 
+/*
+ * Find the register map line for the instruction at "addr" (in code
+ * units).  Each line holds one bit per register, register 0 in the low
+ * bit of the first byte, set if the register holds a reference.  Returns
+ * NULL if "addr" isn't a GC point in the map.
+ */
+const u1* dvmRegisterMapGetLine(const RegisterMap* pMap, int addr);
+
+/*
+ * Lazily-generated register maps.  The GC queues each interpreted method
+ * it had to scan conservatively for want of a map; the HeapWorker later
+ * generates the maps and caches them in the Methods.  Methods whose maps
+ * can't be generated get an empty map, so they aren't queued again.
+ */
+bool dvmRegisterMapStartup(void);
+void dvmRegisterMapShutdown(void);
+void dvmQueueRegisterMap(const Method* meth);
+void dvmGeneratePendingRegisterMaps(void);
+
 #endif /*_DALVIK_DEXVERIFY*/
@@ -138,11 +138,13 @@ RegisterMap* dvmGenerateRegisterMapV(VerifierData* vdata)
     bufSize = offsetof(RegisterMap, data);
     bufSize += gcPointCount * (bytesForAddr + regWidth);
 
-    LOGD("+++ grm: %s.%s (adr=%d gpc=%d rwd=%d bsz=%d)\n",
+    LOGV("+++ grm: %s.%s (adr=%d gpc=%d rwd=%d bsz=%d)\n",
         vdata->method->clazz->descriptor, vdata->method->name,
         bytesForAddr, gcPointCount, regWidth, bufSize);
 
     pMap = (RegisterMap*) malloc(bufSize);
+    if (pMap == NULL)
+        goto bail;
     pMap->format = format;
     pMap->regWidth = regWidth;
     pMap->numEntries = gcPointCount;
@@ -165,7 +167,6 @@ RegisterMap* dvmGenerateRegisterMapV(VerifierData* vdata)
         }
     }
 
-    LOGI("mapData=%p pMap=%p bufSize=%d\n", mapData, pMap, bufSize);
     assert(mapData - (const u1*) pMap == bufSize);
 
 #if 1
@@ -174,8 +175,10 @@ RegisterMap* dvmGenerateRegisterMapV(VerifierData* vdata)
 #endif
 
     pResult = pMap;
+    pMap = NULL;
 
 bail:
+    free(pMap);
     return pResult;
 }
 
@@ -190,6 +193,165 @@ void dvmFreeRegisterMap(RegisterMap* pMap)
     free(pMap);
 }
 
+/*
+ * Find the line for the instruction at "addr".
+ *
+ * Entries are stored in address order, so we can do a binary search.
+ */
+const u1* dvmRegisterMapGetLine(const RegisterMap* pMap, int addr)
+{
+    int bytesForAddr, lineWidth, lo, hi;
+
+    switch (pMap->format) {
+    case kFormatCompact8:
+        bytesForAddr = 1;
+        break;
+    case kFormatCompact16:
+        bytesForAddr = 2;
+        break;
+    default:
+        LOGE("GLITCH: bad format (%d)\n", pMap->format);
+        dvmAbort();
+        return NULL;
+    }
+    lineWidth = bytesForAddr + pMap->regWidth;
+
+    lo = 0;
+    hi = pMap->numEntries - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        const u1* data = pMap->data + mid * lineWidth;
+        int lineAddr = data[0];
+
+        if (bytesForAddr == 2)
+            lineAddr |= data[1] << 8;
+
+        if (lineAddr < addr)
+            lo = mid + 1;
+        else if (lineAddr > addr)
+            hi = mid - 1;
+        else
+            return data + bytesForAddr;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * ===========================================================================
+ *      Lazy generation for the GC
+ * ===========================================================================
+ */
+
+/*
+ * Map given to methods we can't generate one for.  It has no entries, so
+ * every lookup misses and the GC scans the method's frames conservatively.
+ */
+static const RegisterMap sEmptyRegisterMap = { kFormatCompact8, 0, 0, { 0 } };
+
+/*
+ * Set up the queue of methods waiting for a map.
+ */
+bool dvmRegisterMapStartup(void)
+{
+    dvmInitMutex(&gDvm.registerMapLock);
+    gDvm.registerMapPending = dvmPointerSetAlloc(64);
+    return (gDvm.registerMapPending != NULL);
+}
+
+/*
+ * Free the queue.  (The maps themselves are owned by the Methods.)
+ */
+void dvmRegisterMapShutdown(void)
+{
+    if (gDvm.registerMapPending == NULL)
+        return;
+
+    dvmPointerSetFree(gDvm.registerMapPending);
+    gDvm.registerMapPending = NULL;
+    dvmDestroyMutex(&gDvm.registerMapLock);
+}
+
+/*
+ * Ask for a map for "meth".  Called by the GC, with the other threads
+ * suspended.
+ *
+ * The HeapWorker only holds the lock while it takes the queue, but we
+ * don't wait for it; if we miss the method here, the next GC will find
+ * it again.
+ */
+void dvmQueueRegisterMap(const Method* meth)
+{
+    if (gDvm.registerMapPending == NULL)
+        return;
+    if (pthread_mutex_trylock(&gDvm.registerMapLock) != 0)
+        return;
+
+    dvmPointerSetAddEntry(gDvm.registerMapPending, meth);
+
+    dvmUnlockMutex(&gDvm.registerMapLock);
+}
+
+/*
+ * Generate maps for the methods queued by the last GC.  Called by the
+ * HeapWorker after it's been signaled by the GC.
+ *
+ * Verification can load classes, which can cause a GC, so the caller
+ * must not hold the heap lock or heapWorkerLock.
+ */
+void dvmGeneratePendingRegisterMaps(void)
+{
+    Thread* self = dvmThreadSelf();
+    const Method** methods = NULL;
+    int count, numGenerated, i;
+
+    if (gDvm.registerMapPending == NULL)
+        return;
+
+    dvmLockMutex(&gDvm.registerMapLock);
+    count = dvmPointerSetGetCount(gDvm.registerMapPending);
+    if (count > 0) {
+        methods = (const Method**) malloc(count * sizeof(Method*));
+        if (methods != NULL) {
+            for (i = 0; i < count; i++) {
+                methods[i] = (const Method*)
+                    dvmPointerSetGetEntry(gDvm.registerMapPending, i);
+            }
+            dvmPointerSetClear(gDvm.registerMapPending);
+        } else {
+            count = 0;
+        }
+    }
+    dvmUnlockMutex(&gDvm.registerMapLock);
+
+    numGenerated = 0;
+    for (i = 0; i < count; i++) {
+        Method* meth = (Method*) methods[i];
+
+        /* may have been queued by more than one GC */
+        if (meth->registerMap != NULL)
+            continue;
+
+        if (dvmVerifyMethodForRegisterMap(meth) && meth->registerMap != NULL) {
+            numGenerated++;
+        } else {
+            LOGV("No register map for %s.%s\n",
+                meth->clazz->descriptor, meth->name);
+            dvmSetRegisterMap(meth, &sEmptyRegisterMap);
+        }
+
+        /* class lookups in the verifier may have left an exception */
+        if (dvmCheckException(self))
+            dvmClearException(self);
+    }
+
+    if (count > 0) {
+        LOGV("Generated %d of %d register maps\n", numGenerated, count);
+    }
+    free(methods);
+}
+
 /*
  * Determine if the RegType value is a reference type.
  *
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Baseline JIT: code cache management and interpreter glue.
+ */
+#include "Dalvik.h"
+
+#if defined(WITH_JIT)
+
+#include <sys/mman.h>
+#include <errno.h>
+
+/*
+ * Signature of the entry trampoline at the start of the code cache.  It
+ * saves the callee-saved registers the compiled code uses, loads them
+ * from the arguments, and jumps to "target".
+ */
+typedef u4 (*JitEntryFunc)(u8* fp, JValue* pResult, const u1* target,
+    volatile int* pSuspendCount);
+
+/*
+ * Map the code cache and emit the trampoline.
+ */
+bool dvmCompilerStartup(void)
+{
+    if (gDvm.executionMode != kExecutionModeJit)
+        return true;
+
+    dvmInitMutex(&gDvm.jitLock);
+
+    gDvm.jitCodeCache = mmap(NULL, gDvm.jitCodeCacheSize,
+        PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (gDvm.jitCodeCache == MAP_FAILED) {
+        LOGW("JIT code cache mmap(%d) failed: %s; interpreting only\n",
+            (int) gDvm.jitCodeCacheSize, strerror(errno));
+        gDvm.jitCodeCache = NULL;
+        gDvm.executionMode = kExecutionModeInterpFast;
+        return true;
+    }
+    gDvm.jitCodeCacheUsed = 0;
+
+    if (!dvmCompilerGenTrampoline()) {
+        LOGE("JIT trampoline generation failed\n");
+        return false;
+    }
+
+    LOGV("JIT code cache at %p (%d bytes), threshold %d\n",
+        gDvm.jitCodeCache, (int) gDvm.jitCodeCacheSize, gDvm.jitThreshold);
+    return true;
+}
+
+/*
+ * Release the code cache.  All threads must be stopped.
+ */
+void dvmCompilerShutdown(void)
+{
+    if (gDvm.jitCodeCache == NULL)
+        return;
+
+    LOGD("JIT: %d methods compiled, %d of %d code cache bytes used\n",
+        gDvm.jitMethodsCompiled, (int) gDvm.jitCodeCacheUsed,
+        (int) gDvm.jitCodeCacheSize);
+    munmap(gDvm.jitCodeCache, gDvm.jitCodeCacheSize);
+    gDvm.jitCodeCache = NULL;
+    dvmDestroyMutex(&gDvm.jitLock);
+}
+
+/*
+ * Compile "method" if nobody else has.
+ *
+ * Compiled code is published by setting method->jitCode after the code
+ * and entry table are in place, so other threads never see a partial
+ * translation.
+ */
+bool dvmJitCompileMethod(Method* method)
+{
+    bool result;
+
+    if (!dvmJitUsable()) {
+        /* try again later */
+        method->jitCounter = 0;
+        return false;
+    }
+    if (dvmIsNativeMethod(method) || dvmIsAbstractMethod(method))
+        return false;
+
+    dvmLockMutex(&gDvm.jitLock);
+    if (method->jitCode != NULL) {
+        result = true;
+    } else if (gDvm.jitCodeCacheFull) {
+        result = false;
+    } else {
+        result = dvmCompilerGenMethod(method);
+        if (result)
+            gDvm.jitMethodsCompiled++;
+    }
+    dvmUnlockMutex(&gDvm.jitLock);
+
+    LOGVV("JIT %s %s.%s\n", result ? "compiled" : "rejected",
+        method->clazz->descriptor, method->name);
+    return result;
+}
+
+/*
+ * Enter compiled code.
+ */
+u4 dvmJitExecute(Thread* self, const Method* method, u8* fp,
+    JValue* pResult, u4 relPc)
+{
+    JitEntryFunc entry = (JitEntryFunc) gDvm.jitCodeCache;
+    u4 offset;
+
+    assert(method->jitCode != NULL);
+    assert(relPc < dvmGetMethodInsnsSize(method));
+
+    offset = method->jitEntryOffsets[relPc];
+    if (offset == 0)
+        return relPc;
+    return (*entry)(fp, pResult, gDvm.jitCodeCache + offset,
+        &self->suspendCount);
+}
+
+#endif /*WITH_JIT*/
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Baseline method JIT.
+ *
+ * Methods that get hot (invocations plus backward branches reach
+ * gDvm.jitThreshold) are translated one Dalvik instruction at a time into
+ * x86-64 machine code.  The compiled code keeps every Dalvik register in
+ * the interpreter frame, so control can move between the interpreter and
+ * compiled code at any instruction boundary: anything the templates don't
+ * handle (invokes, allocation, monitors, floating point, anything that
+ * would throw) is an "exit" that hands the current pc back to the
+ * interpreter, which simply executes the instruction itself.
+ */
+#ifndef _DALVIK_COMPILER_COMPILER
+#define _DALVIK_COMPILER_COMPILER
+
+#if defined(WITH_JIT)
+
+#if !defined(__x86_64__)
+# error "WITH_JIT is only supported on x86-64"
+#endif
+
+/* default number of invocations + back-edges before a method is compiled */
+#define kJitDefaultThreshold        1000
+
+/* default size of the code cache */
+#define kJitDefaultCodeCacheSize    (1024 * 1024)
+
+/* dvmJitExecute() result: the compiled code executed a return */
+#define kJitMethodReturned          0xffffffff
+
+/*
+ * Subsystem startup/shutdown.  Startup maps the code cache and emits the
+ * shared entry trampoline.
+ */
+bool dvmCompilerStartup(void);
+void dvmCompilerShutdown(void);
+
+/*
+ * Compile "method" if it hasn't been already.  Returns true if compiled
+ * code is available.  Failures are sticky: the method's counter is left
+ * at the threshold so we don't retry it.
+ */
+bool dvmJitCompileMethod(Method* method);
+
+/*
+ * Run the compiled code for "method" starting at instruction "relPc".
+ * Returns the pc at which the interpreter should continue, or
+ * kJitMethodReturned if the method returned (result is in *pResult).
+ */
+u4 dvmJitExecute(Thread* self, const Method* method, u8* fp,
+    JValue* pResult, u4 relPc);
+
+/*
+ * Emit the entry trampoline and shared epilogue at the start of the code
+ * cache.
+ */
+bool dvmCompilerGenTrampoline(void);
+
+/*
+ * Translate "method" into the code cache.  Implemented by the codegen for
+ * the target (compiler/codegen/x86-64/Codegen.c).  Called with jitLock
+ * held.
+ */
+bool dvmCompilerGenMethod(Method* method);
+
+/*
+ * Compiled code can't be used while a debugger or profiler wants to see
+ * every instruction.
+ */
+INLINE bool dvmJitUsable(void)
+{
+    if (gDvm.executionMode != kExecutionModeJit || gDvm.debuggerActive)
+        return false;
+#ifdef WITH_PROFILER
+    if (gDvm.activeProfilers != 0)
+        return false;
+#endif
+    return true;
+}
+
+/*
+ * Called by the interpreter on method entry and on backward branches.
+ * Bumps the method's counter and returns true if the interpreter should
+ * switch to compiled code.
+ */
+INLINE bool dvmJitCheckEntry(const Method* meth)
+{
+    Method* method = (Method*) meth;
+
+    if (method->jitCode != NULL)
+        return dvmJitUsable();
+    if (method->jitCounter >= gDvm.jitThreshold)
+        return false;               /* already tried, or not compilable */
+    if (++method->jitCounter < gDvm.jitThreshold)
+        return false;
+    return dvmJitCompileMethod(method);
+}
+
+#endif /*WITH_JIT*/
+
+#endif /*_DALVIK_COMPILER_COMPILER*/
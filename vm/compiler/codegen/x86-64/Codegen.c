@@ -0,0 +1,917 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * x86-64 template code generator for the baseline JIT.
+ *
+ * Register usage in compiled code:
+ *
+ *   rbx  Dalvik frame pointer; vN lives at [rbx + N*8]
+ *   r12  JValue* for the method result
+ *   r13  &self->suspendCount
+ *   rax, rcx, rdx  scratch
+ *
+ * Each Dalvik instruction is translated on its own, reading its operands
+ * from the frame and writing the result back, so the frame is always up
+ * to date at instruction boundaries.  Int results are stored sign-extended
+ * to 64 bits, which is what the interpreter does for (s4) values.
+ *
+ * An "exit" loads a Dalvik pc into eax and jumps to the shared epilogue,
+ * which returns it to dvmJitExecute().  Nothing here throws: null, bounds
+ * and divide-by-zero checks exit at the faulting instruction and let the
+ * interpreter raise the exception.
+ */
+#include "Dalvik.h"
+
+#if defined(WITH_JIT)
+
+#include <stddef.h>
+
+/* worst-case bytes of machine code for one Dalvik instruction */
+#define kMaxInsnBytes   96
+
+/* bytes in one out-of-line exit stub ("mov eax, imm32; jmp rel32") */
+#define kExitStubBytes  10
+
+/* x86 registers used as scratch */
+enum {
+    kRegRax = 0,
+    kRegRcx = 1,
+    kRegRdx = 2,
+};
+
+/* second byte of the two-byte Jcc rel32 forms */
+enum {
+    kCondAE = 0x83,
+    kCondE  = 0x84,
+    kCondNE = 0x85,
+    kCondL  = 0x8c,
+    kCondGE = 0x8d,
+    kCondLE = 0x8e,
+    kCondG  = 0x8f,
+};
+
+/* if-eq .. if-le and if-eqz .. if-lez, in opcode order */
+static const u1 gIfConds[6] = {
+    kCondE, kCondNE, kCondL, kCondGE, kCondG, kCondLE
+};
+
+/*
+ * Arithmetic ops.  The first eleven are in the same order as the
+ * add-int .. ushr-int opcode groups.
+ */
+typedef enum AluOp {
+    kAluAdd = 0, kAluSub, kAluMul, kAluDiv, kAluRem,
+    kAluAnd, kAluOr, kAluXor, kAluShl, kAluShr, kAluUshr,
+    kAluRsub,
+} AluOp;
+
+/* a rel32 that must be pointed at a Dalvik pc or an exit stub */
+typedef struct CodeFixup {
+    u1*     pRel;
+    u4      pc;
+} CodeFixup;
+
+typedef struct CodegenState {
+    const Method*   method;
+    const u2*       insns;
+    u4              insnsSize;
+
+    u1*             cur;
+    u1*             limit;
+
+    /* machine code offset (from the cache base) of each instruction */
+    u4*             machineOffsets;
+
+    CodeFixup*      branches;
+    int             numBranches;
+    CodeFixup*      exits;
+    int             numExits;
+} CodegenState;
+
+
+/*
+ * ===========================================================================
+ *      Emitters
+ * ===========================================================================
+ */
+
+static inline void emit1(CodegenState* cs, u1 val)
+{
+    *cs->cur++ = val;
+}
+
+static inline void emit4(CodegenState* cs, u4 val)
+{
+    memcpy(cs->cur, &val, sizeof(val));
+    cs->cur += sizeof(val);
+}
+
+static inline void emit8(CodegenState* cs, u8 val)
+{
+    memcpy(cs->cur, &val, sizeof(val));
+    cs->cur += sizeof(val);
+}
+
+static inline void patchRel32(u1* pRel, const u1* target)
+{
+    s4 rel = (s4) (target - (pRel + 4));
+    memcpy(pRel, &rel, sizeof(rel));
+}
+
+/* patch the rel8 of a short jump at "pRel" to land at the current spot */
+static inline void patchRel8Here(CodegenState* cs, u1* pRel)
+{
+    *pRel = (u1) (cs->cur - (pRel + 1));
+}
+
+/* "reg" <- [rbx + vreg*8], 32 bits, zero-extended */
+static void loadInt(CodegenState* cs, int reg, u4 vreg)
+{
+    emit1(cs, 0x8b);
+    emit1(cs, 0x83 | (reg << 3));
+    emit4(cs, vreg * 8);
+}
+
+/* "reg" <- [rbx + vreg*8], 64 bits */
+static void loadWide(CodegenState* cs, int reg, u4 vreg)
+{
+    emit1(cs, 0x48);
+    loadInt(cs, reg, vreg);
+}
+
+/* [rbx + vreg*8] <- "reg", 64 bits */
+static void storeWide(CodegenState* cs, int reg, u4 vreg)
+{
+    emit1(cs, 0x48);
+    emit1(cs, 0x89);
+    emit1(cs, 0x83 | (reg << 3));
+    emit4(cs, vreg * 8);
+}
+
+/* [rbx + vreg*8] <- sign-extended eax */
+static void storeInt(CodegenState* cs, u4 vreg)
+{
+    emit1(cs, 0x48); emit1(cs, 0x63); emit1(cs, 0xc0);     /* movsxd rax,eax */
+    storeWide(cs, kRegRax, vreg);
+}
+
+/* rax <- sign-extended imm32 */
+static void movRaxImmS4(CodegenState* cs, s4 imm)
+{
+    emit1(cs, 0x48); emit1(cs, 0xc7); emit1(cs, 0xc0);
+    emit4(cs, (u4) imm);
+}
+
+/* rax <- zero-extended imm32 */
+static void movEaxImm(CodegenState* cs, u4 imm)
+{
+    emit1(cs, 0xb8);
+    emit4(cs, imm);
+}
+
+/* rax <- imm64 */
+static void movRaxImm64(CodegenState* cs, u8 imm)
+{
+    emit1(cs, 0x48); emit1(cs, 0xb8);
+    emit8(cs, imm);
+}
+
+/* ecx <- imm32 */
+static void movEcxImm(CodegenState* cs, u4 imm)
+{
+    emit1(cs, 0xb9);
+    emit4(cs, imm);
+}
+
+/*
+ * Unconditional exit to the interpreter at "pc".
+ */
+static void genExit(CodegenState* cs, u4 pc)
+{
+    movEaxImm(cs, pc);
+    emit1(cs, 0xe9);
+    patchRel32(cs->cur, gDvm.jitCodeCache + gDvm.jitEpilogueOffset);
+    cs->cur += 4;
+}
+
+/*
+ * Conditional exit to the interpreter at "pc".  The stub is emitted after
+ * the method body.
+ */
+static void genExitIf(CodegenState* cs, u1 cond, u4 pc)
+{
+    emit1(cs, 0x0f);
+    emit1(cs, cond);
+    cs->exits[cs->numExits].pRel = cs->cur;
+    cs->exits[cs->numExits].pc = pc;
+    cs->numExits++;
+    emit4(cs, 0);
+}
+
+/*
+ * Jump (conditional if "cond" != 0) to Dalvik instruction "target".
+ */
+static void genBranch(CodegenState* cs, u1 cond, u4 target)
+{
+    if (cond != 0) {
+        emit1(cs, 0x0f);
+        emit1(cs, cond);
+    } else {
+        emit1(cs, 0xe9);
+    }
+    cs->branches[cs->numBranches].pRel = cs->cur;
+    cs->branches[cs->numBranches].pc = target;
+    cs->numBranches++;
+    emit4(cs, 0);
+}
+
+/*
+ * Suspend check for backward branches: if self->suspendCount is nonzero,
+ * or the sampling profiler wants our stack, exit at the branch so the
+ * interpreter can do the full check.
+ */
+static void genSuspendPoll(CodegenState* cs, u4 pc)
+{
+    /* cmp dword [r13], 0 */
+    emit1(cs, 0x41); emit1(cs, 0x83); emit1(cs, 0x7d);
+    emit1(cs, 0x00); emit1(cs, 0x00);
+    genExitIf(cs, kCondNE, pc);
+#ifdef WITH_PROFILER
+    /* cmp byte [r13 + d], 0, where d gets us to self->samplePending */
+    emit1(cs, 0x41); emit1(cs, 0x80); emit1(cs, 0xbd);
+    emit4(cs, (u4) ((s4) offsetof(Thread, samplePending) -
+                    (s4) offsetof(Thread, suspendCount)));
+    emit1(cs, 0x00);
+    genExitIf(cs, kCondNE, pc);
+#endif
+}
+
+/*
+ * rax/eax <- rax/eax "op" rcx/ecx.  Divides exit at "pc" on a zero
+ * divisor; MIN_VALUE / -1 gives MIN_VALUE (remainder 0) like the
+ * interpreter, instead of faulting.
+ */
+static void genAlu(CodegenState* cs, AluOp op, bool wide, u4 pc)
+{
+    u1* pSkip;
+    u1* pDone;
+
+#define REX_W() do { if (wide) emit1(cs, 0x48); } while (0)
+    switch (op) {
+    case kAluAdd:  REX_W(); emit1(cs, 0x01); emit1(cs, 0xc8); break;
+    case kAluSub:  REX_W(); emit1(cs, 0x29); emit1(cs, 0xc8); break;
+    case kAluAnd:  REX_W(); emit1(cs, 0x21); emit1(cs, 0xc8); break;
+    case kAluOr:   REX_W(); emit1(cs, 0x09); emit1(cs, 0xc8); break;
+    case kAluXor:  REX_W(); emit1(cs, 0x31); emit1(cs, 0xc8); break;
+    case kAluMul:
+        REX_W(); emit1(cs, 0x0f); emit1(cs, 0xaf); emit1(cs, 0xc1);
+        break;
+    /* x86 masks the count in cl the same way Dalvik does */
+    case kAluShl:  REX_W(); emit1(cs, 0xd3); emit1(cs, 0xe0); break;
+    case kAluShr:  REX_W(); emit1(cs, 0xd3); emit1(cs, 0xf8); break;
+    case kAluUshr: REX_W(); emit1(cs, 0xd3); emit1(cs, 0xe8); break;
+    case kAluRsub:
+        REX_W(); emit1(cs, 0xf7); emit1(cs, 0xd8);          /* neg */
+        REX_W(); emit1(cs, 0x01); emit1(cs, 0xc8);          /* add */
+        break;
+    case kAluDiv:
+    case kAluRem:
+        REX_W(); emit1(cs, 0x85); emit1(cs, 0xc9);          /* test rcx,rcx */
+        genExitIf(cs, kCondE, pc);
+        REX_W(); emit1(cs, 0x83); emit1(cs, 0xf9); emit1(cs, 0xff);
+        emit1(cs, 0x75); pSkip = cs->cur; emit1(cs, 0);     /* jne */
+        if (op == kAluDiv) {
+            REX_W(); emit1(cs, 0xf7); emit1(cs, 0xd8);      /* neg */
+        } else {
+            emit1(cs, 0x31); emit1(cs, 0xc0);               /* xor eax,eax */
+        }
+        emit1(cs, 0xeb); pDone = cs->cur; emit1(cs, 0);     /* jmp */
+        patchRel8Here(cs, pSkip);
+        REX_W(); emit1(cs, 0x99);                           /* cdq/cqo */
+        REX_W(); emit1(cs, 0xf7); emit1(cs, 0xf9);          /* idiv rcx */
+        if (op == kAluRem) {
+            REX_W(); emit1(cs, 0x89); emit1(cs, 0xd0);      /* mov rax,rdx */
+        }
+        patchRel8Here(cs, pDone);
+        break;
+    }
+#undef REX_W
+}
+
+/*
+ * Null-check the array in vreg "vArray" and bounds-check the index in
+ * "vIndex".  Leaves the array in rax and the zero-extended index in rcx.
+ */
+static void genArrayCheck(CodegenState* cs, u4 vArray, u4 vIndex, u4 pc)
+{
+    loadWide(cs, kRegRax, vArray);
+    emit1(cs, 0x48); emit1(cs, 0x85); emit1(cs, 0xc0);     /* test rax,rax */
+    genExitIf(cs, kCondE, pc);
+    loadInt(cs, kRegRcx, vIndex);
+    emit1(cs, 0x3b); emit1(cs, 0x88);                      /* cmp ecx,[rax+d] */
+    emit4(cs, offsetof(ArrayObject, length));
+    genExitIf(cs, kCondAE, pc);
+}
+
+/*
+ * Null-check the object in vreg "vObj", leaving it in rax.
+ */
+static void genNullCheck(CodegenState* cs, u4 vObj, u4 pc)
+{
+    loadWide(cs, kRegRax, vObj);
+    emit1(cs, 0x48); emit1(cs, 0x85); emit1(cs, 0xc0);     /* test rax,rax */
+    genExitIf(cs, kCondE, pc);
+}
+
+/* rax <- [rax + offset], 32 bits sign-extended or 64 bits */
+static void genLoadField(CodegenState* cs, u4 offset, bool wide)
+{
+    emit1(cs, 0x48);
+    emit1(cs, wide ? 0x8b : 0x63);
+    emit1(cs, 0x80);
+    emit4(cs, offset);
+}
+
+/* [rax + offset] <- vreg "vSrc", 32 or 64 bits */
+static void genStoreField(CodegenState* cs, u4 offset, u4 vSrc, bool wide)
+{
+    if (wide) {
+        loadWide(cs, kRegRdx, vSrc);
+        emit1(cs, 0x48);
+    } else {
+        loadInt(cs, kRegRdx, vSrc);
+    }
+    emit1(cs, 0x89); emit1(cs, 0x90);
+    emit4(cs, offset);
+}
+
+
+/*
+ * ===========================================================================
+ *      Instruction translation
+ * ===========================================================================
+ */
+
+/*
+ * Translate the instruction at "pc".  Returns false if it isn't handled,
+ * in which case nothing has been emitted.
+ */
+static bool genInstruction(CodegenState* cs, u4 pc)
+{
+    const u2* insns = cs->insns + pc;
+    u2 inst = insns[0];
+    OpCode opCode = inst & 0xff;
+    DvmDex* pDvmDex = cs->method->clazz->pDvmDex;
+    u4 vA, vB, vC;
+    s4 offset;
+
+    switch (opCode) {
+    case OP_NOP:
+        return true;
+
+    case OP_MOVE:
+    case OP_MOVE_WIDE:
+    case OP_MOVE_OBJECT:
+        loadWide(cs, kRegRax, inst >> 12);
+        storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+    case OP_MOVE_FROM16:
+    case OP_MOVE_WIDE_FROM16:
+    case OP_MOVE_OBJECT_FROM16:
+        loadWide(cs, kRegRax, insns[1]);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_MOVE_16:
+    case OP_MOVE_WIDE_16:
+    case OP_MOVE_OBJECT_16:
+        loadWide(cs, kRegRax, insns[2]);
+        storeWide(cs, kRegRax, insns[1]);
+        return true;
+    case OP_MOVE_RESULT:
+    case OP_MOVE_RESULT_WIDE:
+    case OP_MOVE_RESULT_OBJECT:
+        /* mov rax,[r12] */
+        emit1(cs, 0x49); emit1(cs, 0x8b); emit1(cs, 0x04); emit1(cs, 0x24);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+
+    case OP_RETURN_VOID:
+        movEaxImm(cs, 0xabababab);
+        goto store_result;
+    case OP_RETURN:
+    case OP_RETURN_WIDE:
+    case OP_RETURN_OBJECT:
+        loadWide(cs, kRegRax, inst >> 8);
+    store_result:
+        /* mov [r12],rax */
+        emit1(cs, 0x49); emit1(cs, 0x89); emit1(cs, 0x04); emit1(cs, 0x24);
+        genExit(cs, kJitMethodReturned);
+        return true;
+
+    case OP_CONST_4:
+        movRaxImmS4(cs, (s4) ((u4) inst << 16) >> 28);
+        storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+    case OP_CONST_16:
+    case OP_CONST_WIDE_16:
+        movRaxImmS4(cs, (s2) insns[1]);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST:
+        movEaxImm(cs, insns[1] | ((u4) insns[2] << 16));
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST_HIGH16:
+        movRaxImmS4(cs, (s4) ((u4) insns[1] << 16));
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST_WIDE_32:
+        movRaxImmS4(cs, (s4) (insns[1] | ((u4) insns[2] << 16)));
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST_WIDE:
+        movRaxImm64(cs, insns[1] | ((u8) insns[2] << 16) |
+            ((u8) insns[3] << 32) | ((u8) insns[4] << 48));
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST_WIDE_HIGH16:
+        movRaxImm64(cs, (u8) insns[1] << 48);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_CONST_STRING: {
+        StringObject* strObj = dvmDexGetResolvedString(pDvmDex, insns[1]);
+        if (strObj == NULL)
+            return false;
+        movRaxImm64(cs, (u8) strObj);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    }
+
+    case OP_GOTO:
+        offset = (s1) (inst >> 8);
+        goto do_goto;
+    case OP_GOTO_16:
+        offset = (s2) insns[1];
+        goto do_goto;
+    case OP_GOTO_32:
+        offset = (s4) (insns[1] | ((u4) insns[2] << 16));
+    do_goto:
+        if (offset <= 0)
+            genSuspendPoll(cs, pc);
+        genBranch(cs, 0, pc + offset);
+        return true;
+
+    case OP_IF_EQ:
+    case OP_IF_NE:
+    case OP_IF_LT:
+    case OP_IF_GE:
+    case OP_IF_GT:
+    case OP_IF_LE:
+        offset = (s2) insns[1];
+        if (offset <= 0)
+            genSuspendPoll(cs, pc);
+        loadInt(cs, kRegRax, (inst >> 8) & 0x0f);
+        emit1(cs, 0x3b); emit1(cs, 0x83);                  /* cmp eax,[rbx+d] */
+        emit4(cs, (inst >> 12) * 8);
+        genBranch(cs, gIfConds[opCode - OP_IF_EQ], pc + offset);
+        return true;
+    case OP_IF_EQZ:
+    case OP_IF_NEZ:
+    case OP_IF_LTZ:
+    case OP_IF_GEZ:
+    case OP_IF_GTZ:
+    case OP_IF_LEZ:
+        offset = (s2) insns[1];
+        if (offset <= 0)
+            genSuspendPoll(cs, pc);
+        emit1(cs, 0x83); emit1(cs, 0xbb);                  /* cmp [rbx+d],0 */
+        emit4(cs, (inst >> 8) * 8);
+        emit1(cs, 0x00);
+        genBranch(cs, gIfConds[opCode - OP_IF_EQZ], pc + offset);
+        return true;
+
+    case OP_CMP_LONG:
+        vB = insns[1] & 0xff;
+        vC = insns[1] >> 8;
+        loadWide(cs, kRegRcx, vB);
+        loadWide(cs, kRegRdx, vC);
+        emit1(cs, 0x31); emit1(cs, 0xc0);                  /* xor eax,eax */
+        emit1(cs, 0x48); emit1(cs, 0x39); emit1(cs, 0xd1); /* cmp rcx,rdx */
+        emit1(cs, 0x0f); emit1(cs, 0x95); emit1(cs, 0xc0); /* setne al */
+        emit1(cs, 0xba); emit4(cs, 0xffffffff);            /* mov edx,-1 */
+        emit1(cs, 0x0f); emit1(cs, 0x4c); emit1(cs, 0xc2); /* cmovl eax,edx */
+        storeInt(cs, inst >> 8);
+        return true;
+
+    case OP_ARRAY_LENGTH:
+        genNullCheck(cs, inst >> 12, pc);
+        emit1(cs, 0x8b); emit1(cs, 0x80);                  /* mov eax,[rax+d] */
+        emit4(cs, offsetof(ArrayObject, length));
+        storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+
+    case OP_AGET:
+    case OP_AGET_WIDE:
+    case OP_AGET_OBJECT:
+    case OP_AGET_BOOLEAN:
+    case OP_AGET_BYTE:
+    case OP_AGET_CHAR:
+    case OP_AGET_SHORT:
+        genArrayCheck(cs, insns[1] & 0xff, insns[1] >> 8, pc);
+        switch (opCode) {
+        case OP_AGET_BOOLEAN:   /* movzx eax, byte [rax+rcx+d] */
+            emit1(cs, 0x0f); emit1(cs, 0xb6); emit1(cs, 0x84); emit1(cs, 0x08);
+            break;
+        case OP_AGET_BYTE:      /* movsx eax, byte [rax+rcx+d] */
+            emit1(cs, 0x0f); emit1(cs, 0xbe); emit1(cs, 0x84); emit1(cs, 0x08);
+            break;
+        case OP_AGET_CHAR:      /* movzx eax, word [rax+rcx*2+d] */
+            emit1(cs, 0x0f); emit1(cs, 0xb7); emit1(cs, 0x84); emit1(cs, 0x48);
+            break;
+        case OP_AGET_SHORT:     /* movsx eax, word [rax+rcx*2+d] */
+            emit1(cs, 0x0f); emit1(cs, 0xbf); emit1(cs, 0x84); emit1(cs, 0x48);
+            break;
+        default:                /* mov rax, [rax+rcx*8+d] */
+            emit1(cs, 0x48); emit1(cs, 0x8b); emit1(cs, 0x84); emit1(cs, 0xc8);
+            break;
+        }
+        emit4(cs, offsetof(ArrayObject, contents));
+        if (opCode == OP_AGET_BYTE || opCode == OP_AGET_SHORT)
+            storeInt(cs, inst >> 8);
+        else
+            storeWide(cs, kRegRax, inst >> 8);
+        return true;
+
+    case OP_APUT:
+    case OP_APUT_WIDE:
+    case OP_APUT_BOOLEAN:
+    case OP_APUT_BYTE:
+    case OP_APUT_CHAR:
+    case OP_APUT_SHORT:
+        genArrayCheck(cs, insns[1] & 0xff, insns[1] >> 8, pc);
+        switch (opCode) {
+        case OP_APUT_BOOLEAN:
+        case OP_APUT_BYTE:      /* mov [rax+rcx+d], dl */
+            loadInt(cs, kRegRdx, inst >> 8);
+            emit1(cs, 0x88); emit1(cs, 0x94); emit1(cs, 0x08);
+            break;
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:     /* mov [rax+rcx*2+d], dx */
+            loadInt(cs, kRegRdx, inst >> 8);
+            emit1(cs, 0x66); emit1(cs, 0x89); emit1(cs, 0x94); emit1(cs, 0x48);
+            break;
+        default:                /* mov [rax+rcx*8+d], rdx */
+            loadWide(cs, kRegRdx, inst >> 8);
+            emit1(cs, 0x48); emit1(cs, 0x89); emit1(cs, 0x94); emit1(cs, 0xc8);
+            break;
+        }
+        emit4(cs, offsetof(ArrayObject, contents));
+        return true;
+
+    case OP_IGET:
+    case OP_IGET_WIDE:
+    case OP_IGET_OBJECT:
+    case OP_IGET_BOOLEAN:
+    case OP_IGET_BYTE:
+    case OP_IGET_CHAR:
+    case OP_IGET_SHORT:
+    case OP_IPUT:
+    case OP_IPUT_WIDE:
+    case OP_IPUT_BOOLEAN:
+    case OP_IPUT_BYTE:
+    case OP_IPUT_CHAR:
+    case OP_IPUT_SHORT: {
+        InstField* ifield =
+            (InstField*) dvmDexGetResolvedField(pDvmDex, insns[1]);
+        bool wide = (opCode == OP_IGET_WIDE || opCode == OP_IGET_OBJECT ||
+                     opCode == OP_IPUT_WIDE);
+        if (ifield == NULL)
+            return false;
+        genNullCheck(cs, inst >> 12, pc);
+        if (opCode <= OP_IGET_SHORT) {
+            genLoadField(cs, ifield->byteOffset, wide);
+            storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        } else {
+            genStoreField(cs, ifield->byteOffset, (inst >> 8) & 0x0f, wide);
+        }
+        return true;
+    }
+    case OP_IGET_QUICK:
+    case OP_IGET_WIDE_QUICK:
+    case OP_IGET_OBJECT_QUICK:
+        genNullCheck(cs, inst >> 12, pc);
+        genLoadField(cs, insns[1], opCode != OP_IGET_QUICK);
+        storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+    case OP_IPUT_QUICK:
+    case OP_IPUT_WIDE_QUICK:
+        genNullCheck(cs, inst >> 12, pc);
+        genStoreField(cs, insns[1], (inst >> 8) & 0x0f,
+            opCode == OP_IPUT_WIDE_QUICK);
+        return true;
+
+    case OP_SGET:
+    case OP_SGET_WIDE:
+    case OP_SGET_OBJECT:
+    case OP_SGET_BOOLEAN:
+    case OP_SGET_BYTE:
+    case OP_SGET_CHAR:
+    case OP_SGET_SHORT:
+    case OP_SPUT:
+    case OP_SPUT_WIDE:
+    case OP_SPUT_BOOLEAN:
+    case OP_SPUT_BYTE:
+    case OP_SPUT_CHAR:
+    case OP_SPUT_SHORT: {
+        /* only resolved after the class is initialized */
+        StaticField* sfield =
+            (StaticField*) dvmDexGetResolvedField(pDvmDex, insns[1]);
+        bool wide = (opCode == OP_SGET_WIDE || opCode == OP_SGET_OBJECT ||
+                     opCode == OP_SPUT_WIDE);
+        if (sfield == NULL)
+            return false;
+        movRaxImm64(cs, (u8) &sfield->value);
+        if (opCode <= OP_SGET_SHORT) {
+            genLoadField(cs, 0, wide);
+            storeWide(cs, kRegRax, inst >> 8);
+        } else {
+            genStoreField(cs, 0, inst >> 8, wide);
+        }
+        return true;
+    }
+
+    case OP_NEG_INT:
+    case OP_NOT_INT:
+    case OP_NEG_LONG:
+    case OP_NOT_LONG:
+        loadWide(cs, kRegRax, inst >> 12);
+        emit1(cs, 0x48); emit1(cs, 0xf7);
+        emit1(cs, (opCode == OP_NEG_INT || opCode == OP_NEG_LONG) ? 0xd8 : 0xd0);
+        if (opCode == OP_NEG_INT || opCode == OP_NOT_INT)
+            storeInt(cs, (inst >> 8) & 0x0f);
+        else
+            storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+    case OP_INT_TO_LONG:
+    case OP_LONG_TO_INT:
+        /* movsxd rax, dword [rbx+d] */
+        emit1(cs, 0x48); emit1(cs, 0x63); emit1(cs, 0x83);
+        emit4(cs, (inst >> 12) * 8);
+        storeWide(cs, kRegRax, (inst >> 8) & 0x0f);
+        return true;
+    case OP_INT_TO_BYTE:
+    case OP_INT_TO_CHAR:
+    case OP_INT_TO_SHORT:
+        loadInt(cs, kRegRax, inst >> 12);
+        emit1(cs, 0x0f);
+        emit1(cs, opCode == OP_INT_TO_BYTE ? 0xbe :
+                  opCode == OP_INT_TO_CHAR ? 0xb7 : 0xbf);
+        emit1(cs, 0xc0);
+        storeInt(cs, (inst >> 8) & 0x0f);
+        return true;
+
+    case OP_ADD_INT: case OP_SUB_INT: case OP_MUL_INT: case OP_DIV_INT:
+    case OP_REM_INT: case OP_AND_INT: case OP_OR_INT: case OP_XOR_INT:
+    case OP_SHL_INT: case OP_SHR_INT: case OP_USHR_INT:
+        vB = insns[1] & 0xff;
+        vC = insns[1] >> 8;
+        loadInt(cs, kRegRax, vB);
+        loadInt(cs, kRegRcx, vC);
+        genAlu(cs, opCode - OP_ADD_INT, false, pc);
+        storeInt(cs, inst >> 8);
+        return true;
+    case OP_ADD_LONG: case OP_SUB_LONG: case OP_MUL_LONG: case OP_DIV_LONG:
+    case OP_REM_LONG: case OP_AND_LONG: case OP_OR_LONG: case OP_XOR_LONG:
+    case OP_SHL_LONG: case OP_SHR_LONG: case OP_USHR_LONG:
+        vB = insns[1] & 0xff;
+        vC = insns[1] >> 8;
+        loadWide(cs, kRegRax, vB);
+        loadWide(cs, kRegRcx, vC);
+        genAlu(cs, opCode - OP_ADD_LONG, true, pc);
+        storeWide(cs, kRegRax, inst >> 8);
+        return true;
+    case OP_ADD_INT_2ADDR: case OP_SUB_INT_2ADDR: case OP_MUL_INT_2ADDR:
+    case OP_DIV_INT_2ADDR: case OP_REM_INT_2ADDR: case OP_AND_INT_2ADDR:
+    case OP_OR_INT_2ADDR: case OP_XOR_INT_2ADDR: case OP_SHL_INT_2ADDR:
+    case OP_SHR_INT_2ADDR: case OP_USHR_INT_2ADDR:
+        vA = (inst >> 8) & 0x0f;
+        loadInt(cs, kRegRax, vA);
+        loadInt(cs, kRegRcx, inst >> 12);
+        genAlu(cs, opCode - OP_ADD_INT_2ADDR, false, pc);
+        storeInt(cs, vA);
+        return true;
+    case OP_ADD_LONG_2ADDR: case OP_SUB_LONG_2ADDR: case OP_MUL_LONG_2ADDR:
+    case OP_DIV_LONG_2ADDR: case OP_REM_LONG_2ADDR: case OP_AND_LONG_2ADDR:
+    case OP_OR_LONG_2ADDR: case OP_XOR_LONG_2ADDR: case OP_SHL_LONG_2ADDR:
+    case OP_SHR_LONG_2ADDR: case OP_USHR_LONG_2ADDR:
+        vA = (inst >> 8) & 0x0f;
+        loadWide(cs, kRegRax, vA);
+        loadWide(cs, kRegRcx, inst >> 12);
+        genAlu(cs, opCode - OP_ADD_LONG_2ADDR, true, pc);
+        storeWide(cs, kRegRax, vA);
+        return true;
+    case OP_ADD_INT_LIT16: case OP_RSUB_INT: case OP_MUL_INT_LIT16:
+    case OP_DIV_INT_LIT16: case OP_REM_INT_LIT16: case OP_AND_INT_LIT16:
+    case OP_OR_INT_LIT16: case OP_XOR_INT_LIT16: {
+        int idx = opCode - OP_ADD_INT_LIT16;
+        s4 lit = (s2) insns[1];
+        if (lit == 0 && (idx == kAluDiv || idx == kAluRem))
+            return false;
+        loadInt(cs, kRegRax, inst >> 12);
+        movEcxImm(cs, (u4) lit);
+        genAlu(cs, idx == 1 ? kAluRsub : idx, false, pc);
+        storeInt(cs, (inst >> 8) & 0x0f);
+        return true;
+    }
+    case OP_ADD_INT_LIT8: case OP_RSUB_INT_LIT8: case OP_MUL_INT_LIT8:
+    case OP_DIV_INT_LIT8: case OP_REM_INT_LIT8: case OP_AND_INT_LIT8:
+    case OP_OR_INT_LIT8: case OP_XOR_INT_LIT8: case OP_SHL_INT_LIT8:
+    case OP_SHR_INT_LIT8: case OP_USHR_INT_LIT8: {
+        int idx = opCode - OP_ADD_INT_LIT8;
+        s4 lit = (s1) (insns[1] >> 8);
+        if (lit == 0 && (idx == kAluDiv || idx == kAluRem))
+            return false;
+        loadInt(cs, kRegRax, insns[1] & 0xff);
+        movEcxImm(cs, (u4) lit);
+        genAlu(cs, idx == 1 ? kAluRsub : idx, false, pc);
+        storeInt(cs, inst >> 8);
+        return true;
+    }
+
+    default:
+        /*
+         * Invokes, allocation, type checks, monitors, switches, floating
+         * point, object stores and anything else: let the interpreter do
+         * it.
+         */
+        return false;
+    }
+}
+
+
+/*
+ * ===========================================================================
+ *      Entry points
+ * ===========================================================================
+ */
+
+/*
+ * Emit the trampoline called by dvmJitExecute():
+ *
+ *   u4 entry(u8* fp, JValue* pResult, const u1* target, int* pSuspendCount)
+ *
+ * followed by the epilogue every exit jumps to.
+ */
+bool dvmCompilerGenTrampoline(void)
+{
+    static const u1 kTrampoline[] = {
+        0x53,                   /* push rbx */
+        0x41, 0x54,             /* push r12 */
+        0x41, 0x55,             /* push r13 */
+        0x48, 0x89, 0xfb,       /* mov rbx,rdi */
+        0x49, 0x89, 0xf4,       /* mov r12,rsi */
+        0x49, 0x89, 0xcd,       /* mov r13,rcx */
+        0xff, 0xe2,             /* jmp rdx */
+    };
+    static const u1 kEpilogue[] = {
+        0x41, 0x5d,             /* pop r13 */
+        0x41, 0x5c,             /* pop r12 */
+        0x5b,                   /* pop rbx */
+        0xc3,                   /* ret */
+    };
+    u1* cur = gDvm.jitCodeCache;
+
+    memcpy(cur, kTrampoline, sizeof(kTrampoline));
+    cur += sizeof(kTrampoline);
+    gDvm.jitEpilogueOffset = cur - gDvm.jitCodeCache;
+    memcpy(cur, kEpilogue, sizeof(kEpilogue));
+    cur += sizeof(kEpilogue);
+
+    gDvm.jitCodeCacheUsed = (cur - gDvm.jitCodeCache + 15) & ~15;
+    return true;
+}
+
+/*
+ * Translate "method" into the code cache.
+ *
+ * The cache gets an entry-offset table (one u4 per code unit) followed by
+ * the code.  If anything doesn't fit, the cache is marked full and the
+ * space is given back.
+ */
+bool dvmCompilerGenMethod(Method* method)
+{
+    CodegenState cs;
+    const InstructionWidth* widths = gDvm.instrWidth;
+    u1* cacheEnd = gDvm.jitCodeCache + gDvm.jitCodeCacheSize;
+    u1* tableStart;
+    u1* codeStart;
+    u4* entryOffsets;
+    u4 pc, width;
+    int i, numSupported = 0;
+    bool result = false;
+
+    memset(&cs, 0, sizeof(cs));
+    cs.method = method;
+    cs.insns = method->insns;
+    cs.insnsSize = dvmGetMethodInsnsSize(method);
+    if (cs.insnsSize == 0)
+        return false;
+
+    tableStart = gDvm.jitCodeCache + gDvm.jitCodeCacheUsed;
+    codeStart = (u1*) (((uintptr_t) tableStart + cs.insnsSize * sizeof(u4)
+        + 15) & ~(uintptr_t) 15);
+    if (codeStart >= cacheEnd)
+        goto cache_full;
+    entryOffsets = (u4*) tableStart;
+
+    /* every instruction is at least one code unit, so these are bounds */
+    cs.machineOffsets = (u4*) calloc(cs.insnsSize, sizeof(u4));
+    cs.branches = (CodeFixup*) malloc(cs.insnsSize * sizeof(CodeFixup));
+    cs.exits = (CodeFixup*) malloc(cs.insnsSize * 3 * sizeof(CodeFixup));
+    if (cs.machineOffsets == NULL || cs.branches == NULL || cs.exits == NULL)
+        goto bail;
+
+    cs.cur = codeStart;
+    cs.limit = cacheEnd;
+    memset(entryOffsets, 0, cs.insnsSize * sizeof(u4));
+
+    for (pc = 0; pc < cs.insnsSize; pc += width) {
+        u2 inst = cs.insns[pc];
+
+        width = dexGetInstrOrTableWidthAbs(widths, cs.insns + pc);
+        if (width == 0) {
+            LOGW("JIT: bad instruction 0x%04x at %s.%s:0x%x\n", inst,
+                method->clazz->descriptor, method->name, pc);
+            goto bail;
+        }
+        if ((inst & 0xff) == OP_NOP && inst != OP_NOP)
+            continue;                   /* switch or array-data payload */
+
+        if (cs.limit - cs.cur < kMaxInsnBytes)
+            goto cache_full;
+
+        cs.machineOffsets[pc] = cs.cur - gDvm.jitCodeCache;
+        if (genInstruction(&cs, pc)) {
+            entryOffsets[pc] = cs.machineOffsets[pc];
+            numSupported++;
+        } else {
+            genExit(&cs, pc);
+        }
+        assert(cs.numExits <= (int) (pc + width) * 3);
+    }
+
+    if (numSupported == 0)
+        goto bail;
+
+    /* out-of-line exit stubs; consecutive exits to the same pc share one */
+    if (cs.limit - cs.cur < cs.numExits * kExitStubBytes)
+        goto cache_full;
+    for (i = 0; i < cs.numExits; i++) {
+        if (i == 0 || cs.exits[i].pc != cs.exits[i-1].pc)
+            genExit(&cs, cs.exits[i].pc);
+        patchRel32(cs.exits[i].pRel, cs.cur - kExitStubBytes);
+    }
+
+    for (i = 0; i < cs.numBranches; i++) {
+        u4 target = cs.branches[i].pc;
+        assert(target < cs.insnsSize && cs.machineOffsets[target] != 0);
+        patchRel32(cs.branches[i].pRel,
+            gDvm.jitCodeCache + cs.machineOffsets[target]);
+    }
+
+    gDvm.jitCodeCacheUsed = ((cs.cur - gDvm.jitCodeCache) + 15) & ~15;
+    if (gDvm.jitCodeCacheUsed > gDvm.jitCodeCacheSize)
+        gDvm.jitCodeCacheUsed = gDvm.jitCodeCacheSize;
+
+    method->jitEntryOffsets = entryOffsets;
+    MEM_BARRIER();
+    method->jitCode = codeStart;
+    result = true;
+    goto bail;
+
+cache_full:
+    LOGW("JIT: code cache full (%d bytes), no more compilation\n",
+        (int) gDvm.jitCodeCacheSize);
+    gDvm.jitCodeCacheFull = true;
+
+bail:
+    free(cs.machineOffsets);
+    free(cs.branches);
+    free(cs.exits);
+    return result;
+}
+
+#endif /*WITH_JIT*/
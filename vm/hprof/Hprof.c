@@ -15,11 +15,11 @@
  */
 
 /*
- * Preparation and completion of hprof data generation.  The output is
- * written into two files and then combined.  This is necessary because
- * we generate some of the data (strings and classes) while we dump the
- * heap, and some analysis tools require that the class and string data
- * appear first.
+ * Preparation and completion of hprof data generation.  Some analysis
+ * tools require that the class and string data appear first, so before
+ * the heap is dumped we fill the string and class tables from the
+ * loaded classes and write them out.  The few strings and classes that
+ * turn up for the first time during the dump are written at the end.
  */
 #include "Hprof.h"
 
@@ -30,113 +30,58 @@
 #include <time.h>
 
 
-#define kHeadSuffix "-hptemp"
-
 hprof_context_t *
 hprofStartup(const char *outputFileName)
 {
     hprof_context_t *ctx;
+    hprof_writer_t *writer;
+    char *fileName;
 
     ctx = malloc(sizeof(*ctx));
-    if (ctx != NULL) {
-        int len = strlen(outputFileName);
-        char fileName[len + sizeof(kHeadSuffix)];
-        FILE *fp;
-
-        /* Construct the temp file name.  This wasn't handed to us by the
-         * application, so we need to be careful about stomping on it.
-         */
-        sprintf(fileName, "%s" kHeadSuffix, outputFileName);
-        if (access(fileName, F_OK) == 0) {
-            LOGE("hprof: temp file %s exists, bailing\n", fileName);
-            free(ctx);
-            return NULL;
-        }
-
-        fp = fopen(fileName, "w+");
-        if (fp == NULL) {
-            LOGE("hprof: can't open %s: %s.\n", fileName, strerror(errno));
-            free(ctx);
-            return NULL;
-        }
-        if (unlink(fileName) != 0) {
-            LOGW("hprof: WARNING: unable to remove temp file %s\n", fileName);
-            /* keep going */
-        }
-        LOGI("hprof: dumping VM heap to \"%s\".\n", fileName);
-
-        hprofStartup_String();
-        hprofStartup_Class();
-#if WITH_HPROF_STACK
-        hprofStartup_StackFrame();
-        hprofStartup_Stack();
-#endif
-
-        /* pass in "fp" for the temp file, and the name of the output file */
-        hprofContextInit(ctx, strdup(outputFileName), fp, false);
-    } else {
+    fileName = strdup(outputFileName);
+    if (ctx == NULL || fileName == NULL) {
         LOGE("hprof: can't allocate context.\n");
+        free(ctx);
+        free(fileName);
+        return NULL;
     }
 
-    return ctx;
-}
-
-/*
- * Copy the entire contents of "srcFp" to "dstFp".
- *
- * Returns "true" on success.
- */
-static bool
-copyFileToFile(FILE *dstFp, FILE *srcFp)
-{
-    char buf[65536];
-    size_t dataRead, dataWritten;
-
-    while (true) {
-        dataRead = fread(buf, 1, sizeof(buf), srcFp);
-        if (dataRead > 0) {
-            dataWritten = fwrite(buf, 1, dataRead, dstFp);
-            if (dataWritten != dataRead) {
-                LOGE("hprof: failed writing data (%d of %d): %s\n",
-                    dataWritten, dataRead, strerror(errno));
-                return false;
-            }
-        } else {
-            if (feof(srcFp))
-                return true;
-            LOGE("hprof: failed reading data (res=%d): %s\n",
-                dataRead, strerror(errno));
-            return false;
-        }
+    writer = hprofWriterOpen(fileName);
+    if (writer == NULL) {
+        free(ctx);
+        free(fileName);
+        return NULL;
     }
-}
+    LOGI("hprof: dumping VM heap to \"%s\".\n", fileName);
 
-/*
- * Finish up the hprof dump.  Returns true on success.
- */
-bool
-hprofShutdown(hprof_context_t *ctx)
-{
-    FILE *tempFp = ctx->fp;
-    FILE *fp;
+    hprofStartup_String();
+    hprofStartup_Class();
+#if WITH_HPROF_STACK
+    hprofStartup_StackFrame();
+    hprofStartup_Stack();
+#endif
 
-    /* flush output to the temp file, then prepare the output file */
-    hprofFlushCurrentRecord(ctx);
-    free(ctx->curRec.body);
-    ctx->curRec.body = NULL;
-    ctx->curRec.allocLen = 0;
-    ctx->fp = NULL;
-
-    LOGI("hprof: dumping heap strings to \"%s\".\n", ctx->fileName);
-    fp = fopen(ctx->fileName, "w");
-    if (fp == NULL) {
-        LOGE("can't open %s: %s\n", ctx->fileName, strerror(errno));
-        fclose(tempFp);
-        free(ctx->fileName);
+    if (hprofContextInit(ctx, fileName, writer, true) != 0) {
+        LOGE("hprof: can't allocate record buffer.\n");
+        hprofWriterClose(ctx);
+        hprofShutdown_Class();
+        hprofShutdown_String();
+#if WITH_HPROF_STACK
+        hprofShutdown_Stack();
+        hprofShutdown_StackFrame();
+#endif
         free(ctx);
-        return false;
+        free(fileName);
+        return NULL;
     }
-    hprofContextInit(ctx, ctx->fileName, fp, true);
+
+    /* Everything the heap dump will refer to is known now, short of
+     * objects with no class yet: the loaded classes, their field names,
+     * the heap names, and the allocation stack traces.
+     */
+    hprofAddLoadedClasses();
+    hprofLookupStringId("app");
+    hprofLookupStringId("zygote");
 
     hprofDumpStrings(ctx);
     hprofDumpClasses(ctx);
@@ -156,6 +101,24 @@ hprofShutdown(hprof_context_t *ctx)
 
     hprofFlushCurrentRecord(ctx);
 
+    return ctx;
+}
+
+/*
+ * Finish up the hprof dump.  Returns true on success.
+ */
+bool
+hprofShutdown(hprof_context_t *ctx)
+{
+    bool ok;
+
+    /* Anything the dump came across that wasn't in the tables yet.
+     * Strings first, since the classes refer to them.
+     */
+    hprofDumpStrings(ctx);
+    hprofDumpClasses(ctx);
+    hprofFlushCurrentRecord(ctx);
+
     hprofShutdown_Class();
     hprofShutdown_String();
 #if WITH_HPROF_STACK
@@ -163,24 +126,16 @@ hprofShutdown(hprof_context_t *ctx)
     hprofShutdown_StackFrame();
 #endif
 
-    /*
-     * Append the contents of the temp file to the output file.  The temp
-     * file was removed immediately after being opened, so it will vanish
-     * when we close it.
-     */
-    rewind(tempFp);
-    if (!copyFileToFile(ctx->fp, tempFp)) {
-        LOGW("hprof: file copy failed, hprof data may be incomplete\n");
-        /* finish up anyway */
+    ok = hprofWriterClose(ctx);
+    if (!ok) {
+        LOGW("hprof: write failed, hprof data may be incomplete\n");
     }
 
-    fclose(tempFp);
-    fclose(ctx->fp);
     free(ctx->fileName);
     free(ctx->curRec.body);
     free(ctx);
 
     /* throw out a log message for the benefit of "runhat" */
-    LOGI("hprof: heap dump completed, temp file removed\n");
-    return true;
+    LOGI("hprof: heap dump completed\n");
+    return ok;
 }
@@ -121,13 +121,28 @@ typedef enum {
     HPROF_HEAP_APP = 'A'
 } HprofHeapId;
 
+/* Hands full output buffers to a background thread, which compresses
+ * them (if asked to) and writes them to the dump file.  See HprofOutput.c.
+ */
+typedef struct hprof_writer_t hprof_writer_t;
+
 typedef struct hprof_context_t {
     /* curRec *must* be first so that we
      * can cast from a context to a record.
      */
     hprof_record_t curRec;
     char *fileName;
-    FILE *fp;
+
+    /* Finished records are copied into outBuf.  If there's a writer,
+     * outBuf is one of its buffers and goes to the file when it fills;
+     * otherwise outBuf just grows, and its owner decides where the
+     * bytes go (see hprofDumpRegions()).
+     */
+    hprof_writer_t *writer;
+    unsigned char *outBuf;
+    size_t outLen;
+    size_t outAllocLen;
+
     u4 gcThreadSerialNumber;
     u1 gcScanState;
     HprofHeapId currentHeap;    // which heap we're currently emitting
@@ -142,6 +157,9 @@ typedef struct hprof_context_t {
 
 hprof_string_id hprofLookupStringId(const char *str);
 
+/* The first call writes every string seen so far; later calls write
+ * only the strings that were added since.
+ */
 int hprofDumpStrings(hprof_context_t *ctx);
 
 int hprofStartup_String(void);
@@ -154,6 +172,14 @@ int hprofShutdown_String(void);
 
 hprof_class_object_id hprofLookupClassId(const ClassObject *clazz);
 
+/* Enter every loaded class, and the names of its fields, into the
+ * class and string tables.  The world must be stopped.
+ */
+int hprofAddLoadedClasses(void);
+
+/* Like hprofDumpStrings(), the first call writes every class and later
+ * calls write only the ones that were added since.
+ */
 int hprofDumpClasses(hprof_context_t *ctx);
 
 int hprofStartup_Class(void);
@@ -174,14 +200,41 @@ int hprofMarkRootObject(hprof_context_t *ctx,
 
 int hprofDumpHeapObject(hprof_context_t *ctx, const Object *obj);
 
+/* Dumps the objects in one region of the heap into <ctx>, which is
+ * private to the calling thread.  Returns false on failure.
+ */
+typedef bool (*hprof_region_func_t)(hprof_context_t *ctx, size_t region,
+                                    void *arg);
+
+/* Call <func> for regions 0 through <numRegions> - 1, from as many
+ * threads as the parallel mark uses, and append their output to <ctx>
+ * in region order.
+ */
+int hprofDumpRegions(hprof_context_t *ctx, size_t numRegions,
+                     hprof_region_func_t func, void *arg);
+
 /*
  * HprofOutput.c functions
  */
 
-void hprofContextInit(hprof_context_t *ctx, char *fileName, FILE *fp,
-                      bool writeHeader);
+/* Open <fileName> for writing and start the writer thread.  If the name
+ * ends in ".gz", the output is gzip-compressed.
+ */
+hprof_writer_t *hprofWriterOpen(const char *fileName);
+
+/* Write out whatever is left in <ctx>, wait for the writer thread to
+ * finish, and close the file.  Returns false if anything failed to
+ * get written.
+ */
+bool hprofWriterClose(hprof_context_t *ctx);
+
+/* If <writer> is NULL, the context collects its output in memory.
+ */
+int hprofContextInit(hprof_context_t *ctx, char *fileName,
+                     hprof_writer_t *writer, bool writeHeader);
+
+int hprofAppendOutput(hprof_context_t *ctx, const void *data, size_t length);
 
-int hprofFlushRecord(hprof_record_t *rec, FILE *fp);
 int hprofFlushCurrentRecord(hprof_context_t *ctx);
 int hprofStartNewRecord(hprof_context_t *ctx, u1 tag, u4 time);
 
@@ -21,6 +21,14 @@
 
 static HashTable *gClassHashTable;
 
+/* Classes added after the table was written out; they go at the end
+ * of the file.  Guarded by the table's lock.
+ */
+static bool gClassesDumped;
+static const ClassObject **gLateClasses;
+static size_t gLateClassCount;
+static size_t gLateClassAlloc;
+
 int
 hprofStartup_Class()
 {
@@ -28,6 +36,9 @@ hprofStartup_Class()
     if (gClassHashTable == NULL) {
         return UNIQUE_ERROR();
     }
+    gClassesDumped = false;
+    gLateClasses = NULL;
+    gLateClassCount = gLateClassAlloc = 0;
     return 0;
 }
 
@@ -35,10 +46,30 @@ int
 hprofShutdown_Class()
 {
     dvmHashTableFree(gClassHashTable);
+    free(gLateClasses);
+    gLateClasses = NULL;
 
     return 0;
 }
 
+static void
+addLateClass(const ClassObject *clazz)
+{
+    if (gLateClassCount == gLateClassAlloc) {
+        size_t newAlloc = (gLateClassAlloc == 0) ? 16 : gLateClassAlloc * 2;
+        const ClassObject **newClasses;
+
+        newClasses = realloc(gLateClasses, newAlloc * sizeof(*newClasses));
+        if (newClasses == NULL) {
+            LOGE("hprof: can't remember late class %s\n", clazz->descriptor);
+            return;
+        }
+        gLateClasses = newClasses;
+        gLateClassAlloc = newAlloc;
+    }
+    gLateClasses[gLateClassCount++] = clazz;
+}
+
 static u4
 computeClassHash(const ClassObject *clazz)
 {
@@ -47,7 +78,7 @@ computeClassHash(const ClassObject *clazz)
     char c;
 
     cp = clazz->descriptor;
-    hash = (u4)clazz->classLoader;
+    hash = (u4)(uintptr_t)clazz->classLoader;
     while ((c = *cp++) != '\0') {
         hash = hash * 31 + c;
     }
@@ -69,6 +100,15 @@ classCmp(const void *v1, const void *v2)
     return diff;
 }
 
+/* We use the address of the class object structure as its ID.  IDs
+ * are only 32 bits wide, so this keeps the low half of the address.
+ */
+static hprof_class_object_id
+classObjectId(const ClassObject *clazz)
+{
+    return (hprof_class_object_id)(uintptr_t)clazz;
+}
+
 static int
 getPrettyClassNameId(const char *descriptor)
 {
@@ -150,6 +190,7 @@ hprof_class_object_id
 hprofLookupClassId(const ClassObject *clazz)
 {
     void *val;
+    u4 hash;
 
     if (clazz == NULL) {
         /* Someone's probably looking up the superclass
@@ -163,9 +204,21 @@ hprofLookupClassId(const ClassObject *clazz)
     /* We're using the hash table as a list.
      * TODO: replace the hash table with a more suitable structure
      */
-    val = dvmHashTableLookup(gClassHashTable, computeClassHash(clazz),
-            (void *)clazz, classCmp, true);
+    hash = computeClassHash(clazz);
+    val = dvmHashTableLookup(gClassHashTable, hash, (void *)clazz, classCmp,
+            false);
+    if (val != NULL) {
+        /* Its name went into the string table when it was added.
+         */
+        dvmHashTableUnlock(gClassHashTable);
+        return classObjectId(clazz);
+    }
+    val = dvmHashTableLookup(gClassHashTable, hash, (void *)clazz, classCmp,
+            true);
     assert(val != NULL);
+    if (gClassesDumped) {
+        addLateClass(clazz);
+    }
 
     dvmHashTableUnlock(gClassHashTable);
 
@@ -176,43 +229,102 @@ hprofLookupClassId(const ClassObject *clazz)
      */
     getPrettyClassNameId(clazz->descriptor);
 
-    return (hprof_class_object_id)clazz;
+    return classObjectId(clazz);
+}
+
+static int
+addLoadedClass(void *data, void *arg)
+{
+    const ClassObject *clazz = (const ClassObject *)data;
+    int i;
+
+    UNUSED_PARAMETER(arg);
+
+    hprofLookupClassId(clazz);
+    for (i = 0; i < clazz->sfieldCount; i++) {
+        hprofLookupStringId(clazz->sfields[i].field.name);
+    }
+    for (i = 0; i < clazz->ifieldCount; i++) {
+        hprofLookupStringId(clazz->ifields[i].field.name);
+    }
+
+    return 0;
+}
+
+int
+hprofAddLoadedClasses()
+{
+    int i;
+
+    if (gDvm.loadedClasses != NULL) {
+        dvmLockLoadedClasses();
+        dvmForeachLoadedClass(addLoadedClass, NULL);
+        dvmUnlockLoadedClasses();
+    }
+
+    /* The primitive classes aren't in the loaded class table.
+     */
+    for (i = 0; i < PRIM_MAX; i++) {
+        if (gDvm.primitiveClass[i] != NULL) {
+            addLoadedClass(gDvm.primitiveClass[i], NULL);
+        }
+    }
+
+    return 0;
+}
+
+static int
+dumpClass(hprof_context_t *ctx, const ClassObject *clazz)
+{
+    hprof_record_t *rec = &ctx->curRec;
+    int err;
+
+    err = hprofStartNewRecord(ctx, HPROF_TAG_LOAD_CLASS, HPROF_TIME);
+    if (err == 0) {
+        /* LOAD CLASS format:
+         *
+         * u4:     class serial number (always > 0)
+         * ID:     class object ID
+         * u4:     stack trace serial number
+         * ID:     class name string ID
+         * 
+         * We use the address of the class object structure as its ID.
+         */
+        hprofAddU4ToRecord(rec, clazz->serialNumber);
+        hprofAddIdToRecord(rec, classObjectId(clazz));
+        hprofAddU4ToRecord(rec, HPROF_NULL_STACK_TRACE);
+        hprofAddIdToRecord(rec, getPrettyClassNameId(clazz->descriptor));
+    }
+
+    return err;
 }
 
 int
 hprofDumpClasses(hprof_context_t *ctx)
 {
     HashIter iter;
-    hprof_record_t *rec = &ctx->curRec;
+    size_t i;
     int err;
 
     dvmHashTableLock(gClassHashTable);
 
-    for (err = 0, dvmHashIterBegin(gClassHashTable, &iter);
-         err == 0 && !dvmHashIterDone(&iter);
-         dvmHashIterNext(&iter))
-    {
-        err = hprofStartNewRecord(ctx, HPROF_TAG_LOAD_CLASS, HPROF_TIME);
-        if (err == 0) {
+    if (gClassesDumped) {
+        for (err = 0, i = 0; err == 0 && i < gLateClassCount; i++) {
+            err = dumpClass(ctx, gLateClasses[i]);
+        }
+        gLateClassCount = 0;
+    } else {
+        for (err = 0, dvmHashIterBegin(gClassHashTable, &iter);
+             err == 0 && !dvmHashIterDone(&iter);
+             dvmHashIterNext(&iter))
+        {
             const ClassObject *clazz;
 
             clazz = (const ClassObject *)dvmHashIterData(&iter);
             assert(clazz != NULL);
-
-            /* LOAD CLASS format:
-             *
-             * u4:     class serial number (always > 0)
-             * ID:     class object ID
-             * u4:     stack trace serial number
-             * ID:     class name string ID
-             * 
-             * We use the address of the class object structure as its ID.
-             */
-            hprofAddU4ToRecord(rec, clazz->serialNumber);
-            hprofAddIdToRecord(rec, (hprof_class_object_id)clazz);
-            hprofAddU4ToRecord(rec, HPROF_NULL_STACK_TRACE);
-            hprofAddIdToRecord(rec, getPrettyClassNameId(clazz->descriptor));
+            err = dumpClass(ctx, clazz);
         }
+        gClassesDumped = true;
     }
 
     dvmHashTableUnlock(gClassHashTable);
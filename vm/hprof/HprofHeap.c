@@ -21,6 +21,8 @@
 #include "alloc/HeapInternal.h"
 #include "alloc/HeapSource.h"
 
+#include <unistd.h>
+
 /* Set DUMP_PRIM_DATA to 1 if you want to include the contents
  * of primitive arrays (byte arrays, character arrays, etc.)
  * in heap dumps.  This can be a large amount of data.
@@ -30,6 +32,13 @@
 #define OBJECTS_PER_SEGMENT     ((size_t)128)
 #define BYTES_PER_SEGMENT       ((size_t)4096)
 
+/* Most threads to dump regions with, and how many regions per thread
+ * may be done but not yet written out.  The latter bounds how much
+ * output is held in memory.
+ */
+#define REGION_DUMP_MAX_THREADS 8
+#define REGIONS_AHEAD_PER_THREAD 4
+
 int
 hprofStartHeapDump(hprof_context_t *ctx)
 {
@@ -482,3 +491,186 @@ hprofDumpHeapObject(hprof_context_t *ctx, const Object *obj)
 
     return 0;
 }
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    bool done;
+} RegionOutput;
+
+typedef struct {
+    hprof_context_t *ctx;
+    hprof_region_func_t func;
+    void *arg;
+
+    /* Everything below is guarded by lock.  Regions are handed out in
+     * order, but only up to window ahead of the next one to be written,
+     * and only the calling thread writes them.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    RegionOutput *outputs;
+    size_t numRegions;
+    size_t nextRegion;
+    size_t nextWrite;
+    size_t window;
+    int err;
+} RegionDump;
+
+/*
+ * Dump one region into a private context, and leave its output for
+ * the writing thread.  Called and returns with the lock held.
+ */
+static void
+dumpOneRegion(RegionDump *dump, size_t region)
+{
+    hprof_context_t rctx;
+    int err;
+
+    dvmUnlockMutex(&dump->lock);
+
+    err = hprofContextInit(&rctx, NULL, NULL, false);
+    if (err == 0) {
+        rctx.gcScanState = dump->ctx->gcScanState;
+        rctx.gcThreadSerialNumber = dump->ctx->gcThreadSerialNumber;
+        hprofStartHeapDump(&rctx);
+        if (!(*dump->func)(&rctx, region, dump->arg)) {
+            err = UNIQUE_ERROR();
+        } else {
+            err = hprofFlushCurrentRecord(&rctx);
+        }
+    }
+    free(rctx.curRec.body);
+
+    dvmLockMutex(&dump->lock);
+    if (err == 0) {
+        dump->outputs[region].data = rctx.outBuf;
+        dump->outputs[region].length = rctx.outLen;
+    } else {
+        free(rctx.outBuf);
+        dump->err = err;
+    }
+    dump->outputs[region].done = true;
+    pthread_cond_broadcast(&dump->cond);
+}
+
+/*
+ * Dump regions until there are none left.  If "writer" is set, also
+ * append finished regions to the output, in order, and don't return
+ * until they've all been written.
+ */
+static void
+dumpRegions(RegionDump *dump, bool writer)
+{
+    dvmLockMutex(&dump->lock);
+    while (true) {
+        if (writer && dump->nextWrite < dump->numRegions &&
+            dump->outputs[dump->nextWrite].done)
+        {
+            RegionOutput *out = &dump->outputs[dump->nextWrite];
+            int err;
+
+            dvmUnlockMutex(&dump->lock);
+            err = hprofAppendOutput(dump->ctx, out->data, out->length);
+            free(out->data);
+            out->data = NULL;
+            dvmLockMutex(&dump->lock);
+
+            if (err != 0) {
+                dump->err = err;
+            }
+            dump->nextWrite++;
+            pthread_cond_broadcast(&dump->cond);
+        } else if (dump->nextRegion < dump->numRegions &&
+            dump->nextRegion < dump->nextWrite + dump->window)
+        {
+            dumpOneRegion(dump, dump->nextRegion++);
+        } else if (dump->nextRegion == dump->numRegions &&
+            (!writer || dump->nextWrite == dump->numRegions))
+        {
+            break;
+        } else {
+            pthread_cond_wait(&dump->cond, &dump->lock);
+        }
+    }
+    dvmUnlockMutex(&dump->lock);
+}
+
+static void *
+regionThreadStart(void *arg)
+{
+    dumpRegions((RegionDump *)arg, false);
+    return NULL;
+}
+
+int
+hprofDumpRegions(hprof_context_t *ctx, size_t numRegions,
+                 hprof_region_func_t func, void *arg)
+{
+    RegionDump dump;
+    pthread_t threads[REGION_DUMP_MAX_THREADS];
+    long numThreads;
+    int numStarted;
+    int i, err;
+
+    /* The regions' records go after whatever this context has so far,
+     * and anything it adds afterwards starts a new segment.
+     */
+    err = hprofFlushCurrentRecord(ctx);
+    if (err != 0) {
+        return err;
+    }
+    ctx->objectsInSegment = OBJECTS_PER_SEGMENT;
+    if (numRegions == 0) {
+        return 0;
+    }
+
+    numThreads = gDvm.gcMarkThreads;
+    if (numThreads == 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    } else if (numThreads > REGION_DUMP_MAX_THREADS) {
+        numThreads = REGION_DUMP_MAX_THREADS;
+    }
+
+    memset(&dump, 0, sizeof(dump));
+    dump.ctx = ctx;
+    dump.func = func;
+    dump.arg = arg;
+    dump.numRegions = numRegions;
+    dump.window = numThreads * REGIONS_AHEAD_PER_THREAD;
+    dump.outputs = (RegionOutput *)calloc(numRegions, sizeof(RegionOutput));
+    if (dump.outputs == NULL) {
+        return UNIQUE_ERROR();
+    }
+    dvmInitMutex(&dump.lock);
+    pthread_cond_init(&dump.cond, NULL);
+
+    /* If we can't get as many threads as we asked for, the rest of
+     * us pick up the slack.
+     */
+    for (numStarted = 0; numStarted < numThreads - 1; numStarted++) {
+        int cc = pthread_create(&threads[numStarted], NULL,
+                regionThreadStart, &dump);
+        if (cc != 0) {
+            LOGW("hprof: could not start dump thread %d: %s\n",
+                numStarted, strerror(cc));
+            break;
+        }
+    }
+
+    dumpRegions(&dump, true);
+    for (i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&dump.cond);
+    dvmDestroyMutex(&dump.lock);
+    free(dump.outputs);
+
+    LOGV("hprof: dumped %zd regions with %d threads\n",
+        numRegions, numStarted + 1);
+    return dump.err;
+}
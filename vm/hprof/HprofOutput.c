@@ -13,12 +13,64 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+/*
+ * Record construction and the output stream.
+ *
+ * Records are built in the context's current record, then copied into
+ * one of the writer's buffers.  A full buffer goes to the writer thread,
+ * which compresses it (for ".gz" files) and writes it out while the
+ * dump goes on filling the next one.
+ */
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <time.h>
+#include <unistd.h>
+#include <zlib.h>
 #include "Hprof.h"
 
 #define HPROF_MAGIC_STRING  "JAVA PROFILE 1.0.3"
 
+/* The writer's buffers are page-aligned, and large enough that each
+ * write() or deflate() call has plenty to chew on.
+ */
+#define WRITER_BUFFER_SIZE      ((size_t)(1024 * 1024))
+#define WRITER_BUFFER_COUNT     4
+
+/* A context without a writer starts its in-memory output this big.
+ */
+#define MEMORY_OUTPUT_MIN_SIZE  ((size_t)(64 * 1024))
+
+struct hprof_writer_t {
+    int fd;
+    bool compress;
+    z_stream zstream;
+    unsigned char *zbuf;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* Buffers tail through tail + numFull - 1 are waiting for the
+     * writer thread; the dumping thread is filling buffer head.
+     * numFull and closing are guarded by lock.
+     */
+    unsigned char *bufs[WRITER_BUFFER_COUNT];
+    size_t lengths[WRITER_BUFFER_COUNT];
+    int head;
+    int tail;
+    int numFull;
+    bool closing;
+
+    /* Only touched by the writer thread until it's joined.
+     */
+    bool failed;
+    u8 bytesIn;
+    u8 bytesOut;
+};
+
 #define U2_TO_BUF_BE(buf, offset, value) \
     do { \
         unsigned char *buf_ = (unsigned char *)(buf); \
@@ -54,17 +106,271 @@
         buf_[offset_ + 7] = (unsigned char)(value_      ); \
     } while (0)
 
-void
-hprofContextInit(hprof_context_t *ctx, char *fileName, FILE *fp,
+static bool
+writeFully(int fd, const unsigned char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t actual = write(fd, data, length);
+
+        if (actual < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("hprof: write failed: %s\n", strerror(errno));
+            return false;
+        }
+        data += actual;
+        length -= actual;
+    }
+
+    return true;
+}
+
+/*
+ * Compress (if we're compressing) and write out one buffer.  If
+ * "finish" is set, also write out the end of the gzip stream.
+ */
+static bool
+writeBuffer(hprof_writer_t *writer, const unsigned char *data, size_t length,
+    bool finish)
+{
+    z_stream *zs = &writer->zstream;
+    int zerr;
+
+    writer->bytesIn += length;
+    if (!writer->compress) {
+        writer->bytesOut += length;
+        return writeFully(writer->fd, data, length);
+    }
+
+    zs->next_in = (Bytef *)data;
+    zs->avail_in = length;
+    do {
+        size_t produced;
+
+        zs->next_out = writer->zbuf;
+        zs->avail_out = WRITER_BUFFER_SIZE;
+        zerr = deflate(zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (zerr == Z_STREAM_ERROR) {
+            LOGE("hprof: deflate failed\n");
+            return false;
+        }
+        produced = WRITER_BUFFER_SIZE - zs->avail_out;
+        writer->bytesOut += produced;
+        if (!writeFully(writer->fd, writer->zbuf, produced)) {
+            return false;
+        }
+    } while (zs->avail_out == 0 || (finish && zerr != Z_STREAM_END));
+
+    return true;
+}
+
+static void *
+writerThreadStart(void *arg)
+{
+    hprof_writer_t *writer = (hprof_writer_t *)arg;
+
+    dvmLockMutex(&writer->lock);
+    while (true) {
+        const unsigned char *data;
+        size_t length;
+
+        while (writer->numFull == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->numFull == 0) {
+            break;
+        }
+        data = writer->bufs[writer->tail];
+        length = writer->lengths[writer->tail];
+        dvmUnlockMutex(&writer->lock);
+
+        /* After a failure, keep taking buffers so that the dump
+         * doesn't stall, but don't bother writing them.
+         */
+        if (!writer->failed && !writeBuffer(writer, data, length, false)) {
+            writer->failed = true;
+        }
+
+        dvmLockMutex(&writer->lock);
+        writer->tail = (writer->tail + 1) % WRITER_BUFFER_COUNT;
+        writer->numFull--;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    dvmUnlockMutex(&writer->lock);
+
+    if (writer->compress && !writer->failed &&
+        !writeBuffer(writer, NULL, 0, true))
+    {
+        writer->failed = true;
+    }
+
+    return NULL;
+}
+
+static void
+freeWriter(hprof_writer_t *writer)
+{
+    int i;
+
+    for (i = 0; i < WRITER_BUFFER_COUNT; i++) {
+        if (writer->bufs[i] != NULL) {
+            munmap(writer->bufs[i], WRITER_BUFFER_SIZE);
+        }
+    }
+    if (writer->zbuf != NULL) {
+        deflateEnd(&writer->zstream);
+        free(writer->zbuf);
+    }
+    if (writer->fd >= 0) {
+        close(writer->fd);
+    }
+    free(writer);
+}
+
+hprof_writer_t *
+hprofWriterOpen(const char *fileName)
+{
+    hprof_writer_t *writer;
+    size_t nameLen = strlen(fileName);
+    int i, cc;
+
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        LOGE("hprof: can't allocate writer\n");
+        return NULL;
+    }
+    writer->fd = -1;
+    writer->compress =
+            (nameLen > 3 && strcmp(fileName + nameLen - 3, ".gz") == 0);
+
+    for (i = 0; i < WRITER_BUFFER_COUNT; i++) {
+        void *buf = mmap(NULL, WRITER_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (buf == MAP_FAILED) {
+            LOGE("hprof: can't map output buffer: %s\n", strerror(errno));
+            goto fail;
+        }
+        writer->bufs[i] = buf;
+    }
+
+    if (writer->compress) {
+        unsigned char *zbuf = malloc(WRITER_BUFFER_SIZE);
+
+        /* 16 + MAX_WBITS asks for a gzip header and trailer.  Dumps
+         * are big and repetitive, so take the fastest level.
+         */
+        if (zbuf == NULL ||
+            deflateInit2(&writer->zstream, Z_BEST_SPEED, Z_DEFLATED,
+                    16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            LOGE("hprof: can't set up compression\n");
+            free(zbuf);
+            goto fail;
+        }
+        writer->zbuf = zbuf;
+    }
+
+    writer->fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        LOGE("hprof: can't open %s: %s\n", fileName, strerror(errno));
+        goto fail;
+    }
+
+    dvmInitMutex(&writer->lock);
+    pthread_cond_init(&writer->cond, NULL);
+    cc = pthread_create(&writer->thread, NULL, writerThreadStart, writer);
+    if (cc != 0) {
+        LOGE("hprof: can't start writer thread: %s\n", strerror(cc));
+        pthread_cond_destroy(&writer->cond);
+        dvmDestroyMutex(&writer->lock);
+        goto fail;
+    }
+
+    return writer;
+
+fail:
+    freeWriter(writer);
+    return NULL;
+}
+
+/*
+ * Hand the current output buffer to the writer thread and start on
+ * the next one, waiting for it to be written out if need be.
+ */
+static void
+submitBuffer(hprof_context_t *ctx)
+{
+    hprof_writer_t *writer = ctx->writer;
+
+    dvmLockMutex(&writer->lock);
+    writer->lengths[writer->head] = ctx->outLen;
+    writer->head = (writer->head + 1) % WRITER_BUFFER_COUNT;
+    writer->numFull++;
+    pthread_cond_broadcast(&writer->cond);
+    while (writer->numFull == WRITER_BUFFER_COUNT) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    dvmUnlockMutex(&writer->lock);
+
+    ctx->outBuf = writer->bufs[writer->head];
+    ctx->outLen = 0;
+}
+
+bool
+hprofWriterClose(hprof_context_t *ctx)
+{
+    hprof_writer_t *writer = ctx->writer;
+    bool ok;
+
+    if (ctx->outLen > 0) {
+        submitBuffer(ctx);
+    }
+    ctx->writer = NULL;
+    ctx->outBuf = NULL;
+    ctx->outLen = 0;
+    ctx->outAllocLen = 0;
+
+    dvmLockMutex(&writer->lock);
+    writer->closing = true;
+    pthread_cond_broadcast(&writer->cond);
+    dvmUnlockMutex(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    ok = !writer->failed;
+    if (close(writer->fd) != 0) {
+        LOGE("hprof: close failed: %s\n", strerror(errno));
+        ok = false;
+    }
+    writer->fd = -1;
+    if (writer->compress) {
+        LOGI("hprof: compressed %lld bytes to %lld\n",
+            (long long)writer->bytesIn, (long long)writer->bytesOut);
+    }
+
+    pthread_cond_destroy(&writer->cond);
+    dvmDestroyMutex(&writer->lock);
+    freeWriter(writer);
+    return ok;
+}
+
+int
+hprofContextInit(hprof_context_t *ctx, char *fileName, hprof_writer_t *writer,
     bool writeHeader)
 {
     memset(ctx, 0, sizeof (*ctx));
     ctx->fileName = fileName;
-    ctx->fp = fp;
+    ctx->writer = writer;
+    if (writer != NULL) {
+        ctx->outBuf = writer->bufs[writer->head];
+        ctx->outAllocLen = WRITER_BUFFER_SIZE;
+    }
 
     ctx->curRec.allocLen = 128;
     ctx->curRec.body = malloc(ctx->curRec.allocLen);
-//xxx check for/return an error
+    if (ctx->curRec.body == NULL) {
+        return UNIQUE_ERROR();
+    }
 
     if (writeHeader) {
         char magic[] = HPROF_MAGIC_STRING;
@@ -76,13 +382,13 @@ hprofContextInit(hprof_context_t *ctx, char *fileName, FILE *fp,
          *
          * [u1]*: NUL-terminated magic string.
          */
-        fwrite(magic, 1, sizeof(magic), fp);
+        hprofAppendOutput(ctx, magic, sizeof(magic));
 
         /* u4: size of identifiers.  We're using addresses
          *     as IDs, so make sure a pointer fits.
          */
         U4_TO_BUF_BE(buf, 0, sizeof(void *));
-        fwrite(buf, 1, sizeof(u4), fp);
+        hprofAppendOutput(ctx, buf, sizeof(u4));
 
         /* The current time, in milliseconds since 0:00 GMT, 1/1/70.
          */
@@ -95,55 +401,95 @@ hprofContextInit(hprof_context_t *ctx, char *fileName, FILE *fp,
         /* u4: high word of the 64-bit time.
          */
         U4_TO_BUF_BE(buf, 0, (u4)(nowMs >> 32));
-        fwrite(buf, 1, sizeof(u4), fp);
+        hprofAppendOutput(ctx, buf, sizeof(u4));
 
         /* u4: low word of the 64-bit time.
          */
         U4_TO_BUF_BE(buf, 0, (u4)(nowMs & 0xffffffffULL));
-        fwrite(buf, 1, sizeof(u4), fp); //xxx fix the time
+        hprofAppendOutput(ctx, buf, sizeof(u4)); //xxx fix the time
     }
+
+    return 0;
 }
 
 int
-hprofFlushRecord(hprof_record_t *rec, FILE *fp)
+hprofAppendOutput(hprof_context_t *ctx, const void *data, size_t length)
 {
+    const unsigned char *src = (const unsigned char *)data;
+
+    while (length > 0) {
+        size_t room;
+
+        if (ctx->outLen == ctx->outAllocLen) {
+            if (ctx->writer != NULL) {
+                submitBuffer(ctx);
+            } else {
+                unsigned char *newBuf;
+                size_t newAllocLen;
+
+                newAllocLen = ctx->outAllocLen * 2;
+                if (newAllocLen < ctx->outLen + length) {
+                    newAllocLen = ctx->outLen + length;
+                }
+                if (newAllocLen < MEMORY_OUTPUT_MIN_SIZE) {
+                    newAllocLen = MEMORY_OUTPUT_MIN_SIZE;
+                }
+                newBuf = realloc(ctx->outBuf, newAllocLen);
+                if (newBuf == NULL) {
+                    return UNIQUE_ERROR();
+                }
+                ctx->outBuf = newBuf;
+                ctx->outAllocLen = newAllocLen;
+            }
+        }
+
+        room = ctx->outAllocLen - ctx->outLen;
+        if (room > length) {
+            room = length;
+        }
+        memcpy(ctx->outBuf + ctx->outLen, src, room);
+        ctx->outLen += room;
+        src += room;
+        length -= room;
+    }
+
+    return 0;
+}
+
+int
+hprofFlushCurrentRecord(hprof_context_t *ctx)
+{
+    hprof_record_t *rec = &ctx->curRec;
+
     if (rec->dirty) {
         unsigned char headBuf[sizeof (u1) + 2 * sizeof (u4)];
-        int nb;
+        int err;
 
         headBuf[0] = rec->tag;
         U4_TO_BUF_BE(headBuf, 1, rec->time);
         U4_TO_BUF_BE(headBuf, 5, rec->length);
 
-        nb = fwrite(headBuf, 1, sizeof(headBuf), fp);
-        if (nb != sizeof(headBuf)) {
-            return UNIQUE_ERROR();
+        err = hprofAppendOutput(ctx, headBuf, sizeof(headBuf));
+        if (err == 0) {
+            err = hprofAppendOutput(ctx, rec->body, rec->length);
         }
-        nb = fwrite(rec->body, 1, rec->length, fp);
-        if (nb != (int)rec->length) {
-            return UNIQUE_ERROR();
+        if (err != 0) {
+            return err;
         }
 
         rec->dirty = false;
     }
-//xxx if we used less than half (or whatever) of allocLen, shrink the buffer.
 
     return 0;
 }
 
-int
-hprofFlushCurrentRecord(hprof_context_t *ctx)
-{
-    return hprofFlushRecord(&ctx->curRec, ctx->fp);
-}
-
 int
 hprofStartNewRecord(hprof_context_t *ctx, u1 tag, u4 time)
 {
     hprof_record_t *rec = &ctx->curRec;
     int err;
 
-    err = hprofFlushRecord(rec, ctx->fp);
+    err = hprofFlushCurrentRecord(ctx);
     if (err != 0) {
         return err;
     } else if (rec->dirty) {
@@ -226,6 +572,10 @@ hprofAddUtf8StringToRecord(hprof_record_t *rec, const char *str)
     return hprofAddU1ListToRecord(rec, (const u1 *)str, strlen(str));
 }
 
+/* The list versions store each value with memcpy(), which the compiler
+ * turns into a plain (possibly unaligned) store; hton*() is a byte swap
+ * on little-endian hosts and nothing on big-endian ones.
+ */
 int
 hprofAddU2ListToRecord(hprof_record_t *rec, const u2 *values, size_t numValues)
 {
@@ -238,12 +588,10 @@ hprofAddU2ListToRecord(hprof_record_t *rec, const u2 *values, size_t numValues)
         return err;
     }
 
-//xxx this can be way smarter
-//xxx also, don't do this bytewise if aligned and on a matching-endian arch
     insert = rec->body + rec->length;
     for (i = 0; i < numValues; i++) {
-        U2_TO_BUF_BE(insert, 0, *values++);
-        insert += sizeof(*values);
+        u2 value = htons(values[i]);
+        memcpy(insert + i * 2, &value, 2);
     }
     rec->length += numValues * 2;
 
@@ -253,7 +601,17 @@ hprofAddU2ListToRecord(hprof_record_t *rec, const u2 *values, size_t numValues)
 int
 hprofAddU2ToRecord(hprof_record_t *rec, u2 value)
 {
-    return hprofAddU2ListToRecord(rec, &value, 1);
+    int err;
+
+    err = guaranteeRecordAppend(rec, 2);
+    if (err != 0) {
+        return err;
+    }
+
+    U2_TO_BUF_BE(rec->body, rec->length, value);
+    rec->length += 2;
+
+    return 0;
 }
 
 int
@@ -268,12 +626,10 @@ hprofAddU4ListToRecord(hprof_record_t *rec, const u4 *values, size_t numValues)
         return err;
     }
 
-//xxx this can be way smarter
-//xxx also, don't do this bytewise if aligned and on a matching-endian arch
     insert = rec->body + rec->length;
     for (i = 0; i < numValues; i++) {
-        U4_TO_BUF_BE(insert, 0, *values++);
-        insert += sizeof(*values);
+        u4 value = htonl(values[i]);
+        memcpy(insert + i * 4, &value, 4);
     }
     rec->length += numValues * 4;
 
@@ -283,7 +639,17 @@ hprofAddU4ListToRecord(hprof_record_t *rec, const u4 *values, size_t numValues)
 int
 hprofAddU4ToRecord(hprof_record_t *rec, u4 value)
 {
-    return hprofAddU4ListToRecord(rec, &value, 1);
+    int err;
+
+    err = guaranteeRecordAppend(rec, 4);
+    if (err != 0) {
+        return err;
+    }
+
+    U4_TO_BUF_BE(rec->body, rec->length, value);
+    rec->length += 4;
+
+    return 0;
 }
 
 int
@@ -298,12 +664,12 @@ hprofAddU8ListToRecord(hprof_record_t *rec, const u8 *values, size_t numValues)
         return err;
     }
 
-//xxx this can be way smarter
-//xxx also, don't do this bytewise if aligned and on a matching-endian arch
     insert = rec->body + rec->length;
     for (i = 0; i < numValues; i++) {
-        U8_TO_BUF_BE(insert, 0, *values++);
-        insert += sizeof(*values);
+        u4 high = htonl((u4)(values[i] >> 32));
+        u4 low = htonl((u4)values[i]);
+        memcpy(insert + i * 8, &high, 4);
+        memcpy(insert + i * 8 + 4, &low, 4);
     }
     rec->length += numValues * 8;
 
@@ -313,5 +679,15 @@ hprofAddU8ListToRecord(hprof_record_t *rec, const u8 *values, size_t numValues)
 int
 hprofAddU8ToRecord(hprof_record_t *rec, u8 value)
 {
-    return hprofAddU8ListToRecord(rec, &value, 1);
+    int err;
+
+    err = guaranteeRecordAppend(rec, 8);
+    if (err != 0) {
+        return err;
+    }
+
+    U8_TO_BUF_BE(rec->body, rec->length, value);
+    rec->length += 8;
+
+    return 0;
 }
@@ -20,6 +20,14 @@
 
 static HashTable *gStringHashTable;
 
+/* Strings added after the table was written out; they go at the end
+ * of the file.  Guarded by the table's lock.
+ */
+static bool gStringsDumped;
+static const char **gLateStrings;
+static size_t gLateStringCount;
+static size_t gLateStringAlloc;
+
 int
 hprofStartup_String()
 {
@@ -27,6 +35,9 @@ hprofStartup_String()
     if (gStringHashTable == NULL) {
         return UNIQUE_ERROR();
     }
+    gStringsDumped = false;
+    gLateStrings = NULL;
+    gLateStringCount = gLateStringAlloc = 0;
     return 0;
 }
 
@@ -34,9 +45,29 @@ int
 hprofShutdown_String()
 {
     dvmHashTableFree(gStringHashTable);
+    free(gLateStrings);
+    gLateStrings = NULL;
     return 0;
 }
 
+static void
+addLateString(const char *str)
+{
+    if (gLateStringCount == gLateStringAlloc) {
+        size_t newAlloc = (gLateStringAlloc == 0) ? 16 : gLateStringAlloc * 2;
+        const char **newStrings;
+
+        newStrings = realloc(gLateStrings, newAlloc * sizeof(*newStrings));
+        if (newStrings == NULL) {
+            LOGE("hprof: can't remember late string \"%s\"\n", str);
+            return;
+        }
+        gLateStrings = newStrings;
+        gLateStringAlloc = newAlloc;
+    }
+    gLateStrings[gLateStringCount++] = str;
+}
+
 static u4
 computeUtf8Hash(const char *str)
 {
@@ -70,6 +101,9 @@ hprofLookupStringId(const char *str)
         val = dvmHashTableLookup(gStringHashTable, hashValue, (void *)newStr,
                 (HashCompareFunc)strcmp, true);
         assert(val != NULL);
+        if (gStringsDumped) {
+            addLateString(val);
+        }
     }
 
     dvmHashTableUnlock(gStringHashTable);
@@ -77,39 +111,57 @@ hprofLookupStringId(const char *str)
     return (hprof_string_id)val;
 }
 
+static int
+dumpString(hprof_context_t *ctx, const char *str)
+{
+    hprof_record_t *rec = &ctx->curRec;
+    int err;
+
+    err = hprofStartNewRecord(ctx, HPROF_TAG_STRING, HPROF_TIME);
+    if (err == 0) {
+        /* STRING format:
+         *
+         * ID:     ID for this string
+         * [u1]*:  UTF8 characters for string (NOT NULL terminated)
+         *         (the record format encodes the length)
+         * 
+         * We use the address of the string data as its ID.
+         */
+        err = hprofAddU4ToRecord(rec, (u4)str);
+        if (err == 0) {
+            err = hprofAddUtf8StringToRecord(rec, str);
+        }
+    }
+
+    return err;
+}
+
 int
 hprofDumpStrings(hprof_context_t *ctx)
 {
     HashIter iter;
-    hprof_record_t *rec = &ctx->curRec;
+    size_t i;
     int err;
 
     dvmHashTableLock(gStringHashTable);
 
-    for (err = 0, dvmHashIterBegin(gStringHashTable, &iter);
-         err == 0 && !dvmHashIterDone(&iter);
-         dvmHashIterNext(&iter))
-    {
-        err = hprofStartNewRecord(ctx, HPROF_TAG_STRING, HPROF_TIME);
-        if (err == 0) {
+    if (gStringsDumped) {
+        for (err = 0, i = 0; err == 0 && i < gLateStringCount; i++) {
+            err = dumpString(ctx, gLateStrings[i]);
+        }
+        gLateStringCount = 0;
+    } else {
+        for (err = 0, dvmHashIterBegin(gStringHashTable, &iter);
+             err == 0 && !dvmHashIterDone(&iter);
+             dvmHashIterNext(&iter))
+        {
             const char *str;
 
             str = (const char *)dvmHashIterData(&iter);
             assert(str != NULL);
-
-            /* STRING format:
-             *
-             * ID:     ID for this string
-             * [u1]*:  UTF8 characters for string (NOT NULL terminated)
-             *         (the record format encodes the length)
-             * 
-             * We use the address of the string data as its ID.
-             */
-            err = hprofAddU4ToRecord(rec, (u4)str);
-            if (err == 0) {
-                err = hprofAddUtf8StringToRecord(rec, str);
-            }
+            err = dumpString(ctx, str);
         }
+        gStringsDumped = true;
     }
 
     dvmHashTableUnlock(gStringHashTable);
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Per-call-site inline caches for invoke-interface.
+ */
+#include "Dalvik.h"
+#include "interp/InterpDefs.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+/*
+ * Serializes adding entries to inline caches.  Lookups don't take it;
+ * an entry's method is stored before its class, and neither changes
+ * after that.
+ */
+static pthread_mutex_t gInlineCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool isInterfaceInvoke(u2 inst)
+{
+    OpCode opCode = inst & 0xff;
+
+    return opCode == OP_INVOKE_INTERFACE ||
+        opCode == OP_INVOKE_INTERFACE_RANGE;
+}
+
+/*
+ * Create the inline cache table for "method", with one site for each
+ * invoke-interface instruction, in address order.
+ */
+static InlineCacheTable* createTable(const Method* method)
+{
+    const u2* insns = method->insns;
+    u4 insnsSize = dvmGetMethodInsnsSize(method);
+    InlineCacheTable* table;
+    u4 numSites, offset;
+    int width;
+
+    numSites = 0;
+    for (offset = 0; offset < insnsSize; offset += width) {
+        width = dexGetInstrOrTableWidthAbs(gDvm.instrWidth, insns + offset);
+        if (width <= 0)
+            break;
+        if (isInterfaceInvoke(insns[offset]))
+            numSites++;
+    }
+
+    table = (InlineCacheTable*) calloc(1,
+        offsetof(InlineCacheTable, sites) + numSites * sizeof(InlineCache));
+    if (table == NULL)
+        return NULL;
+
+    table->numSites = 0;
+    for (offset = 0; offset < insnsSize; offset += width) {
+        width = dexGetInstrOrTableWidthAbs(gDvm.instrWidth, insns + offset);
+        if (width <= 0)
+            break;
+        if (isInterfaceInvoke(insns[offset]))
+            table->sites[table->numSites++].offset = offset;
+    }
+    assert(table->numSites == numSites);
+
+    return table;
+}
+
+/*
+ * Get the inline cache for the instruction at "offset" in "method",
+ * creating the method's table if it doesn't have one yet.
+ *
+ * Returns NULL if there's no table and one can't be allocated.
+ */
+static InlineCache* findSite(const Method* method, u4 offset)
+{
+    InlineCacheTable* table = ATOMIC_LOAD_ACQUIRE(&method->inlineCaches);
+    int lo, hi;
+
+    if (table == NULL) {
+        table = createTable(method);
+        if (table == NULL)
+            return NULL;
+        if (!ATOMIC_CMP_SWAP_WORD(&((Method*) method)->inlineCaches,
+                NULL, table))
+        {
+            /* somebody else got there first */
+            free(table);
+            table = ATOMIC_LOAD_ACQUIRE(&method->inlineCaches);
+        }
+    }
+
+    lo = 0;
+    hi = (int) table->numSites - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+
+        if (table->sites[mid].offset < offset)
+            lo = mid + 1;
+        else if (table->sites[mid].offset > offset)
+            hi = mid - 1;
+        else
+            return &table->sites[mid];
+    }
+
+    assert(false);      // every invoke-interface has a site
+    return NULL;
+}
+
+/*
+ * Record that "thisClass" dispatches to "methodToCall" at "site", if
+ * there's still room.
+ */
+static void addEntry(InlineCache* site, ClassObject* thisClass,
+    Method* methodToCall)
+{
+    int i;
+
+    dvmLockMutex(&gInlineCacheLock);
+    for (i = 0; i < INLINE_CACHE_WAYS; i++) {
+        InlineCacheEntry* entry = &site->entries[i];
+
+        if (entry->clazz == thisClass)
+            break;
+        if (entry->clazz == NULL) {
+            entry->method = methodToCall;
+            ATOMIC_STORE_RELEASE(&entry->clazz, thisClass);
+            break;
+        }
+    }
+    dvmUnlockMutex(&gInlineCacheLock);
+}
+
+/*
+ * Look the method up in the per-DEX interface cache shared by all sites.
+ *
+ * This is ATOMIC_CACHE_LOOKUP written out with full-width keys and
+ * value; the macro squeezes them through u4, which loses the top half
+ * of the class and method pointers.
+ */
+static Method* findInSharedCache(ClassObject* thisClass, u4 methodIdx,
+    const Method* method, DvmDex* methodClassDex)
+{
+    AtomicCache* cache = methodClassDex->pInterfaceCache;
+    AtomicCacheEntry* pEntry;
+    u8 hash, firstVersion, value;
+
+    hash = (((u8) thisClass >> 2) ^ (u8) methodIdx) &
+        (DEX_INTERFACE_CACHE_SIZE - 1);
+    pEntry = cache->entries + hash;
+
+    /* volatile read */
+    firstVersion = pEntry->version;
+
+    if (pEntry->key1 == (u8) thisClass && pEntry->key2 == (u8) methodIdx) {
+        /* grab the value, then make sure we didn't see a partial update */
+        value = pEntry->value;
+        if ((firstVersion & 0x01) != 0 || firstVersion != pEntry->version) {
+            value = (u8) dvmInterpFindInterfaceMethod(thisClass, methodIdx,
+                        method, methodClassDex);
+        }
+    } else {
+        value = (u8) dvmInterpFindInterfaceMethod(thisClass, methodIdx,
+                    method, methodClassDex);
+        dvmUpdateAtomicCache((u8) thisClass, (u8) methodIdx, value, pEntry,
+            firstVersion);
+    }
+
+    return (Method*) value;
+}
+
+/*
+ * Find the concrete method for an invoke-interface through the call
+ * site's inline cache.
+ *
+ * A miss on a site with a free entry goes straight to the iftable
+ * search and fills the entry in.  Megamorphic sites (and any site we
+ * couldn't allocate a table for) use the shared per-DEX cache instead,
+ * which is what every site did before.
+ */
+Method* dvmFindInterfaceMethodAtSite(ClassObject* thisClass, u4 methodIdx,
+    const Method* method, const u2* pc, DvmDex* methodClassDex)
+{
+    InlineCache* site;
+    Method* methodToCall;
+    int i;
+
+    site = findSite(method, pc - method->insns);
+    if (site == NULL)
+        return findInSharedCache(thisClass, methodIdx, method, methodClassDex);
+
+    for (i = 0; i < INLINE_CACHE_WAYS; i++) {
+        const InlineCacheEntry* entry = &site->entries[i];
+        ClassObject* clazz = ATOMIC_LOAD_ACQUIRE(&entry->clazz);
+
+        if (clazz == thisClass)
+            return entry->method;
+        if (clazz == NULL) {
+            methodToCall = dvmInterpFindInterfaceMethod(thisClass, methodIdx,
+                method, methodClassDex);
+            if (methodToCall != NULL)
+                addEntry(site, thisClass, methodToCall);
+            return methodToCall;
+        }
+    }
+
+    return findInSharedCache(thisClass, methodIdx, method, methodClassDex);
+}
+
+/*
+ * Free a method's inline caches.
+ */
+void dvmFreeInlineCaches(Method* method)
+{
+    free(method->inlineCaches);
+    method->inlineCaches = NULL;
+}
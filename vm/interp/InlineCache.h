@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Per-call-site inline caches for invoke-interface.
+ *
+ * Each method that executes invoke-interface gets a side table with one
+ * InlineCache per invoke-interface instruction, sorted by instruction
+ * offset.  A site remembers the concrete method for up to
+ * INLINE_CACHE_WAYS receiver classes (one for a monomorphic site, more
+ * for a polymorphic one).  Entries are only ever added, never replaced;
+ * once a site has seen more classes than that, it's megamorphic and
+ * falls back to the shared per-DEX interface cache.
+ */
+#ifndef _DALVIK_INTERP_INLINECACHE
+#define _DALVIK_INTERP_INLINECACHE
+
+#define INLINE_CACHE_WAYS   4
+
+typedef struct InlineCacheEntry {
+    /* release-stored after "method"; NULL while the entry is free */
+    ClassObject*    clazz;
+    Method*         method;
+} InlineCacheEntry;
+
+typedef struct InlineCache {
+    u4                  offset;     /* of the invoke, in code units */
+    InlineCacheEntry    entries[INLINE_CACHE_WAYS];
+} InlineCache;
+
+typedef struct InlineCacheTable {
+    u4              numSites;
+    InlineCache     sites[1];
+} InlineCacheTable;
+
+/*
+ * Find the concrete method for the invoke-interface at "pc" in "method",
+ * with "thisClass" as the receiver's class, going through the call
+ * site's inline cache.
+ *
+ * Returns NULL with an exception raised on failure.
+ */
+Method* dvmFindInterfaceMethodAtSite(ClassObject* thisClass, u4 methodIdx,
+    const Method* method, const u2* pc, DvmDex* methodClassDex);
+
+/*
+ * Free a method's inline caches, if it has any.
+ */
+void dvmFreeInlineCaches(Method* method);
+
+#endif /*_DALVIK_INTERP_INLINECACHE*/
@@ -515,7 +515,15 @@ void dvmInterpret(Thread *self, const Method *method, JValue *pResult) {
     }
 
     typedef bool (*Interpreter)(Thread *, InterpState *);
-    Interpreter stdInterp = dvmInterpretStd;
+    Interpreter stdInterp;
+    if (gDvm.executionMode == kExecutionModeInterpFast)
+        stdInterp = dvmInterpretFast;
+#if defined(WITH_JIT)
+    else if (gDvm.executionMode == kExecutionModeJit)
+        stdInterp = dvmInterpretFast;       /* has the JIT entry hooks */
+#endif
+    else
+        stdInterp = dvmInterpretStd;
 
     change = true;
     while (change) {
@@ -77,9 +77,11 @@ typedef struct InterpState {
 } InterpState;
 
 /*
- * These are generated from InterpCore.h.
+ * These are generated from InterpCore.h.  "Fast" is the same interpreter
+ * built with threaded (computed goto) dispatch; see InterpC-fast.c.
  */
 extern bool dvmInterpretStd(Thread* self, InterpState* interpState);
+extern bool dvmInterpretFast(Thread* self, InterpState* interpState);
 #define INTERP_STD 0
 #define INTERP_DBG 1
 
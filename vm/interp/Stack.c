@@ -540,7 +540,7 @@ void dvmCallMethodA(Thread *self, const Method *method, Object *obj,
             case 'D':
             case 'J': {
                 memcpy(ins, &args->j, 8);   /* EABI prevents direct store */
-                ins += 1;
+                ins += 2;
                 verifyCount += 2;
                 args++;
                 break;
@@ -5,6 +5,59 @@
 #include "interp/InterpDefs.h"
 #include <math.h>
 
+/*
+ * The same source builds two interpreters.  By default every instruction
+ * is decoded through one "switch"; with THREADED_INTERP defined (see
+ * InterpC-fast.c) each handler ends with its own indirect jump through a
+ * label-address table, which gives the branch predictor one site per
+ * opcode instead of a single shared one.  Requires GCC "labels as values".
+ */
+#ifndef INTERP_FUNC_NAME
+# define INTERP_FUNC_NAME dvmInterpretStd
+#endif
+
+#if defined(THREADED_INTERP)
+# define H(_op)             &&op_##_op
+# define HANDLE_OPCODE(_op) op_##_op:
+# define FINISH(_offset) {                                                  \
+        pc += (_offset);                                                    \
+        inst = pc[0];                                                       \
+        goto *handlerTable[inst & 0xff];                                    \
+    }
+#else
+# define HANDLE_OPCODE(_op) case _op:
+# define FINISH(_offset)    { pc += (_offset); break; }
+#endif
+
+/*
+ * Baseline JIT hooks, only in the threaded build (which is what
+ * kExecutionModeJit runs).  Method entry and backward branches bump the
+ * method's counter and switch to compiled code once there is some;
+ * returning into a compiled method goes back to its compiled code.
+ */
+#if defined(WITH_JIT) && defined(THREADED_INTERP)
+# define JIT_CHECK_ENTRY() {                                                \
+        if (dvmJitCheckEntry(curMethod))                                    \
+            goto jitEnter;                                                  \
+    }
+# define JIT_CHECK_BACKEDGE(_offset) {                                      \
+        if (dvmJitCheckEntry(curMethod)) {                                  \
+            pc += (_offset);                                                \
+            goto jitEnter;                                                  \
+        }                                                                   \
+    }
+# define JIT_RESUME(_offset) {                                              \
+        if (curMethod->jitCode != NULL && dvmJitUsable()) {                 \
+            pc += (_offset);                                                \
+            goto jitEnter;                                                  \
+        }                                                                   \
+    }
+#else
+# define JIT_CHECK_ENTRY()              ((void) 0)
+# define JIT_CHECK_BACKEDGE(_offset)    ((void) 0)
+# define JIT_RESUME(_offset)            ((void) 0)
+#endif
+
 static inline s8 getLongFromArray(const u_int64_t *ptr, int idx) {
     return *((s8 *) &ptr[idx]);
 }
@@ -69,7 +122,10 @@ static inline bool checkForNullExportPC(Object *obj, u_int64_t *fp, const u_int1
     return true;
 }
 
-bool dvmInterpretStd(Thread *self, InterpState *interpState) {
+bool INTERP_FUNC_NAME(Thread *self, InterpState *interpState) {
+#if defined(THREADED_INTERP)
+    DEFINE_GOTO_TABLE(handlerTable);
+#endif
     DvmDex *methodClassDex;
     JValue retval;
     const Method *curMethod;
@@ -85,7 +141,7 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
     fp = interpState->fp;
     retval = interpState->retval;
     methodClassDex = curMethod->clazz->pDvmDex;
-            LOGVV("dvmInterpretStd: threadid=%d: entry(%s) %s.%s pc=0x%lx fp=%p ep=%d\n",
+            LOGVV("threadid=%d: entry(%s) %s.%s pc=0x%lx fp=%p ep=%d\n",
                   self->threadId, (interpState->nextMode == INTERP_STD) ? "STD" : "DBG",
                   curMethod->clazz->descriptor, curMethod->name, pc - curMethod->insns,
                   fp, interpState->entryPoint);
@@ -100,187 +156,132 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
         default:
             dvmAbort();
     }
+#if defined(THREADED_INTERP)
+    FINISH(0);                  /* fetch and execute first instruction */
+#else
     while (1) {
         inst = (pc[(0)]);
         switch (((inst) & 0xff)) {
-            case OP_NOP: {
-                (pc += 1);
-                break;
-            }
-            case OP_MOVE:
+#endif
+            HANDLE_OPCODE(OP_NOP)
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_FROM16:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_FROM16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MOVE_16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_MOVE_16)
                 vdst = (pc[(1)]);
                 vsrc1 = (pc[(2)]);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_MOVE_WIDE:
+                FINISH(3);
+            HANDLE_OPCODE(OP_MOVE_WIDE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), (getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_WIDE_FROM16:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_WIDE_FROM16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 putLongToArray(fp, (vdst), (getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MOVE_WIDE_16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_MOVE_WIDE_16)
                 vdst = (pc[(1)]);
                 vsrc1 = (pc[(2)]);
                 putLongToArray(fp, (vdst), (getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_MOVE_OBJECT:
+                FINISH(3);
+            HANDLE_OPCODE(OP_MOVE_OBJECT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_OBJECT_FROM16:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_OBJECT_FROM16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MOVE_OBJECT_16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_MOVE_OBJECT_16)
                 vdst = (pc[(1)]);
                 vsrc1 = (pc[(2)]);
                 (fp[(vdst)] = ((fp[(vsrc1)])));
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_MOVE_RESULT:
+                FINISH(3);
+            HANDLE_OPCODE(OP_MOVE_RESULT)
                 vdst = ((inst) >> 8);
                 (fp[(vdst)] = (retval.j));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_RESULT_WIDE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_RESULT_WIDE)
                 vdst = ((inst) >> 8);
                 putLongToArray(fp, (vdst), (retval.j));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_RESULT_OBJECT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_RESULT_OBJECT)
                 vdst = ((inst) >> 8);
                 (fp[(vdst)] = (retval.j));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MOVE_EXCEPTION:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MOVE_EXCEPTION)
                 vdst = ((inst) >> 8);
                 assert(self->exception != NULL);
                 (fp[(vdst)] = ((u8) self->exception));
                 dvmClearException(self);
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_RETURN_VOID:
+                FINISH(1);
+            HANDLE_OPCODE(OP_RETURN_VOID)
                 retval.j = 0xababababULL;
                 goto returnFromMethod;
-            case OP_RETURN:
+            HANDLE_OPCODE(OP_RETURN)
                 vsrc1 = ((inst) >> 8);
                 retval.j = (fp[(vsrc1)]);
                 goto returnFromMethod;
-            case OP_RETURN_WIDE:
+            HANDLE_OPCODE(OP_RETURN_WIDE)
                 vsrc1 = ((inst) >> 8);
                 retval.j = getLongFromArray(fp, (vsrc1));
                 goto returnFromMethod;
-            case OP_RETURN_OBJECT:
+            HANDLE_OPCODE(OP_RETURN_OBJECT)
                 vsrc1 = ((inst) >> 8);
                 retval.j = (fp[(vsrc1)]);
                 goto returnFromMethod;
-            case OP_CONST_4: {
+            HANDLE_OPCODE(OP_CONST_4) {
                 int32_t tmp;
                 vdst = (((inst) >> 8) & 0x0f);
                 tmp = (int32_t) (((inst) >> 12) << 28) >> 28;
                 (fp[(vdst)] = (tmp));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_CONST_16:
+                FINISH(1);
+            HANDLE_OPCODE(OP_CONST_16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 (fp[(vdst)] = ((int16_t) vsrc1));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CONST: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CONST) {
                 u_int32_t tmp;
                 vdst = ((inst) >> 8);
                 tmp = (pc[(1)]);
                 tmp |= (u_int32_t) (pc[(2)]) << 16;
                 (fp[(vdst)] = (tmp));
             }
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_CONST_HIGH16:
+                FINISH(3);
+            HANDLE_OPCODE(OP_CONST_HIGH16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 (fp[(vdst)] = (vsrc1 << 16));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CONST_WIDE_16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_CONST_WIDE_16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 putLongToArray(fp, (vdst), ((int16_t) vsrc1));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CONST_WIDE_32: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CONST_WIDE_32) {
                 u_int32_t tmp;
                 vdst = ((inst) >> 8);
                 tmp = (pc[(1)]);
                 tmp |= (u_int32_t) (pc[(2)]) << 16;
                 putLongToArray(fp, (vdst), ((int32_t) tmp));
             }
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_CONST_WIDE: {
+                FINISH(3);
+            HANDLE_OPCODE(OP_CONST_WIDE) {
                 u_int64_t tmp;
                 vdst = ((inst) >> 8);
                 tmp = (pc[(1)]);
@@ -289,19 +290,13 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 tmp |= (u_int64_t) (pc[(4)]) << 48;
                 putLongToArray(fp, (vdst), (tmp));
             }
-                {
-                    (pc += 5);
-                    break;
-                }
-            case OP_CONST_WIDE_HIGH16:
+                FINISH(5);
+            HANDLE_OPCODE(OP_CONST_WIDE_HIGH16)
                 vdst = ((inst) >> 8);
                 vsrc1 = (pc[(1)]);
                 putLongToArray(fp, (vdst), (((u_int64_t) vsrc1) << 48));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CONST_STRING: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CONST_STRING) {
                 StringObject *strObj;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -314,11 +309,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = ((u_int64_t) strObj));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CONST_STRING_JUMBO: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CONST_STRING_JUMBO) {
                 StringObject *strObj;
                 u_int32_t tmp;
                 vdst = ((inst) >> 8);
@@ -333,11 +325,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = ((u_int64_t) strObj));
             }
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_CONST_CLASS: {
+                FINISH(3);
+            HANDLE_OPCODE(OP_CONST_CLASS) {
                 ClassObject *clazz;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -350,11 +339,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = ((u_int64_t) clazz));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MONITOR_ENTER: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MONITOR_ENTER) {
                 Object *obj;
                 vsrc1 = ((inst) >> 8);
                 obj = (Object *) (fp[(vsrc1)]);
@@ -362,11 +348,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     goto exceptionThrown;
                 dvmLockObject(self, obj);
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MONITOR_EXIT: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_MONITOR_EXIT) {
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
                 vsrc1 = ((inst) >> 8);
@@ -381,11 +364,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     goto exceptionThrown;
                 }
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_CHECK_CAST: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_CHECK_CAST) {
                 ClassObject *clazz;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -406,11 +386,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     }
                 }
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_INSTANCE_OF: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_INSTANCE_OF) {
                 ClassObject *clazz;
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
@@ -430,11 +407,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     (fp[(vdst)] = (dvmInstanceof(obj->clazz, clazz)));
                 }
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ARRAY_LENGTH: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_ARRAY_LENGTH) {
                 ArrayObject *arrayObj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -443,11 +417,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     goto exceptionThrown;
                 (fp[(vdst)] = (arrayObj->length));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NEW_INSTANCE: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_NEW_INSTANCE) {
                 ClassObject *clazz;
                 Object *newObj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -471,11 +442,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     goto exceptionThrown;
                 (fp[(vdst)] = ((u8) newObj));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_NEW_ARRAY: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_NEW_ARRAY) {
                 ClassObject *arrayClass;
                 ArrayObject *newArray;
                 int32_t length;
@@ -501,17 +469,14 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     goto exceptionThrown;
                 (fp[(vdst)] = ((u8) newArray));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_FILLED_NEW_ARRAY:
+                FINISH(2);
+            HANDLE_OPCODE(OP_FILLED_NEW_ARRAY)
                 methodCallRange = false;
                 goto filledNewArray;
-            case OP_FILLED_NEW_ARRAY_RANGE:
+            HANDLE_OPCODE(OP_FILLED_NEW_ARRAY_RANGE)
                 methodCallRange = true;
                 goto filledNewArray;
-            case OP_FILL_ARRAY_DATA: {
+            HANDLE_OPCODE(OP_FILL_ARRAY_DATA) {
                 const u_int16_t *arrayData;
                 int32_t offset;
                 ArrayObject *arrayObj;
@@ -529,12 +494,9 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!dvmInterpHandleFillArrayData(arrayObj, arrayData)) {
                     goto exceptionThrown;
                 }
-                {
-                    (pc += 3);
-                    break;
-                }
+                FINISH(3);
             }
-            case OP_THROW: {
+            HANDLE_OPCODE(OP_THROW) {
                 Object *obj;
                 vsrc1 = ((inst) >> 8);
                 obj = (Object *) (fp[(vsrc1)]);
@@ -545,37 +507,31 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 goto exceptionThrown;
             }
-            case OP_GOTO:
+            HANDLE_OPCODE(OP_GOTO)
                 vdst = ((inst) >> 8);
                 if ((s1) vdst < 0) {
                     dvmCheckSuspendQuick(self);
+                    JIT_CHECK_BACKEDGE((s1) vdst);
                 }
-                {
-                    (pc += (s1) vdst);
-                    break;
-                }
-            case OP_GOTO_16: {
+                FINISH((s1) vdst);
+            HANDLE_OPCODE(OP_GOTO_16) {
                 int32_t offset = (int16_t) (pc[(1)]);
                 if (offset < 0) {
                     dvmCheckSuspendQuick(self);
+                    JIT_CHECK_BACKEDGE(offset);
                 }
-                {
-                    (pc += offset);
-                    break;
-                }
+                FINISH(offset);
             }
-            case OP_GOTO_32: {
+            HANDLE_OPCODE(OP_GOTO_32) {
                 int32_t offset = (pc[(1)]);
                 offset |= ((int32_t) (pc[(2)])) << 16;
                 if (offset <= 0) {
                     dvmCheckSuspendQuick(self);
+                    JIT_CHECK_BACKEDGE(offset);
                 }
-                {
-                    (pc += offset);
-                    break;
-                }
+                FINISH(offset);
             }
-            case OP_PACKED_SWITCH: {
+            HANDLE_OPCODE(OP_PACKED_SWITCH) {
                 const u_int16_t *switchData;
                 u_int32_t testVal;
                 int32_t offset;
@@ -593,12 +549,9 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (offset <= 0) {
                     dvmCheckSuspendQuick(self);
                 }
-                {
-                    (pc += offset);
-                    break;
-                }
+                FINISH(offset);
             }
-            case OP_SPARSE_SWITCH: {
+            HANDLE_OPCODE(OP_SPARSE_SWITCH) {
                 const u_int16_t *switchData;
                 u_int32_t testVal;
                 int32_t offset;
@@ -617,12 +570,9 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (offset <= 0) {
                     dvmCheckSuspendQuick(self);
                 }
-                {
-                    (pc += offset);
-                    break;
-                }
+                FINISH(offset);
             }
-            case OP_CMPL_FLOAT: {
+            HANDLE_OPCODE(OP_CMPL_FLOAT) {
                 int result;
                 u_int16_t regs;
                 float val1, val2;
@@ -639,11 +589,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (-1);
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CMPG_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CMPG_FLOAT) {
                 int result;
                 u_int16_t regs;
                 float val1, val2;
@@ -660,11 +607,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (1);
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CMPL_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CMPL_DOUBLE) {
                 int result;
                 u_int16_t regs;
                 double val1, val2;
@@ -681,11 +625,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (-1);
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CMPG_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CMPG_DOUBLE) {
                 int result;
                 u_int16_t regs;
                 double val1, val2;
@@ -702,11 +643,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (1);
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_CMP_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_CMP_LONG) {
                 int result;
                 u_int16_t regs;
                 s8 val1, val2;
@@ -723,230 +661,164 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (0);
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IF_EQ:
+                FINISH(2);
+            HANDLE_OPCODE(OP_IF_EQ)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) == (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
-
-                    }
-                    {
-                        (pc += branchOffset);
-                        break;
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_NE:
+            HANDLE_OPCODE(OP_IF_NE)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) != (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
-
-                    }
-                    {
-                        (pc += branchOffset);
-                        break;
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_LT:
+            HANDLE_OPCODE(OP_IF_LT)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) < (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_GE:
+            HANDLE_OPCODE(OP_IF_GE)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) >= (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_GT:
+            HANDLE_OPCODE(OP_IF_GT)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) > (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_LE:
+            HANDLE_OPCODE(OP_IF_LE)
                 vsrc1 = (((inst) >> 8) & 0x0f);
                 vsrc2 = ((inst) >> 12);
                 if ((int32_t) (fp[(vsrc1)]) <= (int32_t) (fp[(vsrc2)])) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_EQZ:
+            HANDLE_OPCODE(OP_IF_EQZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) == 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_NEZ:
+            HANDLE_OPCODE(OP_IF_NEZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) != 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_LTZ:
+            HANDLE_OPCODE(OP_IF_LTZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) < 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
-
-                    }
-                    {
-                        (pc += branchOffset);
-                        break;
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_GEZ:
+            HANDLE_OPCODE(OP_IF_GEZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) >= 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_GTZ:
+            HANDLE_OPCODE(OP_IF_GTZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) > 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
+                    FINISH(2);
                 }
-            case OP_IF_LEZ:
+            HANDLE_OPCODE(OP_IF_LEZ)
                 vsrc1 = ((inst) >> 8);
                 if ((int32_t) (fp[(vsrc1)]) <= 0) {
                     int branchOffset = (int16_t) (pc[(1)]);
                     if (branchOffset < 0) {
                         dvmCheckSuspendQuick(self);
+                        JIT_CHECK_BACKEDGE(branchOffset);
                     }
-                    {
-                        (pc += branchOffset);
-                        break;
-                    }
+                    FINISH(branchOffset);
                 } else {
-                    {
-                        (pc += 2);
-                        break;
-                    }
-                }
-            case OP_UNUSED_3E:
-            case OP_UNUSED_3F:
-            case OP_UNUSED_40:
-            case OP_UNUSED_41:
-            case OP_UNUSED_42:
-            case OP_UNUSED_43:
-            case OP_AGET: {
+                    FINISH(2);
+                }
+            HANDLE_OPCODE(OP_UNUSED_3E)
+            HANDLE_OPCODE(OP_UNUSED_3F)
+            HANDLE_OPCODE(OP_UNUSED_40)
+            HANDLE_OPCODE(OP_UNUSED_41)
+            HANDLE_OPCODE(OP_UNUSED_42)
+            HANDLE_OPCODE(OP_UNUSED_43)
+            HANDLE_OPCODE(OP_AGET) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -963,11 +835,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (((u8 *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_WIDE) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -984,11 +853,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 putLongToArray(fp, (vdst), (((s8 *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_OBJECT) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1005,11 +871,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (((u8 *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_BOOLEAN) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1026,11 +889,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (((u_int8_t *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_BYTE) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1048,11 +908,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 //this point MUST be byte *
                 fp[(vdst)] = ((s1 *) arrayObj->contents)[(fp[vsrc2])];
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_CHAR) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1069,11 +926,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (((u_int16_t *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AGET_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AGET_SHORT) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1090,11 +944,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (((int16_t *) arrayObj->contents)[(fp[(vsrc2)])]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1110,11 +961,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((u8 *) arrayObj->contents)[(fp[(vsrc2)])] = (fp[(vdst)]);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_WIDE) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1130,11 +978,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((s8 *) arrayObj->contents)[(fp[(vsrc2)])] = getLongFromArray(fp, (vdst));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_OBJECT) {
                 ArrayObject *arrayObj;
                 Object *obj;
                 u_int16_t arrayInfo;
@@ -1165,12 +1010,11 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((u8 *) arrayObj->contents)[(fp[(vsrc2)])] =
                         (fp[(vdst)]);
+                if (obj != NULL)
+                    dvmMarkCard(arrayObj);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_BOOLEAN) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1186,11 +1030,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((u_int8_t *) arrayObj->contents)[(fp[(vsrc2)])] = (fp[(vdst)]);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_BYTE) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1206,11 +1047,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((s1 *) arrayObj->contents)[(fp[(vsrc2)])] = (fp[(vdst)]);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_CHAR) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1226,11 +1064,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((u_int16_t *) arrayObj->contents)[(fp[(vsrc2)])] = (fp[(vdst)]);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_APUT_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_APUT_SHORT) {
                 ArrayObject *arrayObj;
                 u_int16_t arrayInfo;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1246,11 +1081,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 ((int16_t *) arrayObj->contents)[(fp[(vsrc2)])] = (fp[(vdst)]);
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1266,11 +1098,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_WIDE) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1286,11 +1115,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 putLongToArray(fp, (vdst), (dvmGetFieldLong(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_OBJECT) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1306,11 +1132,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (u8) (dvmGetFieldObject(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_BOOLEAN) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1326,11 +1149,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_BYTE) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1346,11 +1166,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_CHAR) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1366,11 +1183,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_SHORT) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1386,11 +1200,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ifield->byteOffset)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1406,11 +1217,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldInt(obj, ifield->byteOffset, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_WIDE) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1426,11 +1234,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldLong(obj, ifield->byteOffset, getLongFromArray(fp, (vdst)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_OBJECT) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1446,11 +1251,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldObject(obj, ifield->byteOffset, ((Object *) fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_BOOLEAN) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1466,11 +1268,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldInt(obj, ifield->byteOffset, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_BYTE) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1486,11 +1285,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldInt(obj, ifield->byteOffset, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_CHAR) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1506,11 +1302,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldInt(obj, ifield->byteOffset, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_SHORT) {
                 InstField *ifield;
                 Object *obj;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
@@ -1526,11 +1319,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetFieldInt(obj, ifield->byteOffset, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1542,11 +1332,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetStaticFieldInt(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_WIDE) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1558,11 +1345,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 putLongToArray(fp, (vdst), (dvmGetStaticFieldLong(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_OBJECT) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1574,11 +1358,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (u8) (dvmGetStaticFieldObject(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_BOOLEAN) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1590,11 +1371,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetStaticFieldInt(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_BYTE) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1606,11 +1384,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetStaticFieldInt(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_CHAR) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1622,11 +1397,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetStaticFieldInt(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SGET_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SGET_SHORT) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1638,11 +1410,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 (fp[(vdst)] = (dvmGetStaticFieldInt(sfield)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1654,11 +1423,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldInt(sfield, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_WIDE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_WIDE) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1670,11 +1436,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldLong(sfield, getLongFromArray(fp, (vdst)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_OBJECT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_OBJECT) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1686,11 +1449,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldObject(sfield, ((Object *) fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_BOOLEAN: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_BOOLEAN) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1702,11 +1462,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldInt(sfield, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_BYTE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_BYTE) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1718,11 +1475,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldInt(sfield, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_CHAR: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_CHAR) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1734,11 +1488,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldInt(sfield, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SPUT_SHORT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SPUT_SHORT) {
                 StaticField *sfield;
                 vdst = ((inst) >> 8);
                 ref = (pc[(1)]);
@@ -1750,141 +1501,102 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 dvmSetStaticFieldInt(sfield, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_INVOKE_VIRTUAL:
+                FINISH(2);
+            HANDLE_OPCODE(OP_INVOKE_VIRTUAL)
                 methodCallRange = false;
                 goto invokeVirtual;
-            case OP_INVOKE_SUPER:
+            HANDLE_OPCODE(OP_INVOKE_SUPER)
 
                 methodCallRange = false;
                 goto invokeSuper;
-            case OP_INVOKE_DIRECT:
+            HANDLE_OPCODE(OP_INVOKE_DIRECT)
                 methodCallRange = false;
                 goto invokeDirect;
-            case OP_INVOKE_STATIC:
+            HANDLE_OPCODE(OP_INVOKE_STATIC)
                 methodCallRange = false;
                 goto invokeStatic;
-            case OP_INVOKE_INTERFACE:
+            HANDLE_OPCODE(OP_INVOKE_INTERFACE)
                 methodCallRange = false;
                 goto invokeInterface;
-            case OP_UNUSED_73:
-            case OP_INVOKE_VIRTUAL_RANGE:
+            HANDLE_OPCODE(OP_UNUSED_73)
+            HANDLE_OPCODE(OP_INVOKE_VIRTUAL_RANGE)
                 methodCallRange = true;
                 goto invokeVirtual;
-            case OP_INVOKE_SUPER_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_SUPER_RANGE)
                 methodCallRange = true;
                 goto invokeSuper;
-            case OP_INVOKE_DIRECT_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_DIRECT_RANGE)
                 methodCallRange = true;
                 goto invokeDirect;
-            case OP_INVOKE_STATIC_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_STATIC_RANGE)
                 methodCallRange = true;
                 goto invokeStatic;
-            case OP_INVOKE_INTERFACE_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_INTERFACE_RANGE)
                 methodCallRange = true;
                 goto invokeInterface;
-            case OP_UNUSED_79:
-            case OP_UNUSED_7A:
-            case OP_NEG_INT:
+            HANDLE_OPCODE(OP_UNUSED_79)
+            HANDLE_OPCODE(OP_UNUSED_7A)
+            HANDLE_OPCODE(OP_NEG_INT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = (-(fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NOT_INT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_NOT_INT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((fp[(vsrc1)]) ^ 0xffffffff));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NEG_LONG:
+                FINISH(1);
+            HANDLE_OPCODE(OP_NEG_LONG)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), (-getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NOT_LONG:
+                FINISH(1);
+            HANDLE_OPCODE(OP_NOT_LONG)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), (getLongFromArray(fp, (vsrc1)) ^ 0xffffffffffffffffULL));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NEG_FLOAT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_NEG_FLOAT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = (-(*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_NEG_DOUBLE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_NEG_DOUBLE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (-getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_LONG:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_LONG)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), (((int32_t) (fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_FLOAT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_FLOAT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = (((int32_t) (fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_DOUBLE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_DOUBLE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (((int32_t) (fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_LONG_TO_INT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_LONG_TO_INT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_LONG_TO_FLOAT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_LONG_TO_FLOAT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = (getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_LONG_TO_DOUBLE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_LONG_TO_DOUBLE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_FLOAT_TO_INT: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_FLOAT_TO_INT) {
                 float val;
                 int32_t intMin, intMax, result;
                 vdst = (((inst) >> 8) & 0x0f);
@@ -1900,11 +1612,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (int32_t) val;
                 (fp[(vdst)] = ((int32_t) result));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_FLOAT_TO_LONG: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_FLOAT_TO_LONG) {
                 float val;
                 s8 intMin, intMax, result;
                 vdst = (((inst) >> 8) & 0x0f);
@@ -1920,19 +1629,13 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (s8) val;
                 putLongToArray(fp, (vdst), (result));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_FLOAT_TO_DOUBLE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_FLOAT_TO_DOUBLE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), ((*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DOUBLE_TO_INT: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_DOUBLE_TO_INT) {
                 double val;
                 int32_t intMin, intMax, result;
                 vdst = (((inst) >> 8) & 0x0f);
@@ -1948,11 +1651,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (int32_t) val;
                 (fp[(vdst)] = ((int32_t) result));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DOUBLE_TO_LONG: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_DOUBLE_TO_LONG) {
                 double val;
                 s8 intMin, intMax, result;
                 vdst = (((inst) >> 8) & 0x0f);
@@ -1968,43 +1668,28 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 else result = (s8) val;
                 putLongToArray(fp, (vdst), (result));
             }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DOUBLE_TO_FLOAT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_DOUBLE_TO_FLOAT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = (getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_BYTE:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_BYTE)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((s1) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_CHAR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_CHAR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((u_int16_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_INT_TO_SHORT:
+                FINISH(1);
+            HANDLE_OPCODE(OP_INT_TO_SHORT)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int16_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_ADD_INT: {
+                FINISH(1);
+            HANDLE_OPCODE(OP_ADD_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2012,11 +1697,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) + (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SUB_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SUB_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2024,11 +1706,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) - (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2036,11 +1715,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) * (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2059,11 +1735,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 } else { result = firstVal / secondVal; }
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2082,11 +1755,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 } else { result = firstVal % secondVal; }
                 (fp[(vdst)] = (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AND_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AND_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2094,11 +1764,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) & (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_OR_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_OR_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2106,11 +1773,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) | (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_XOR_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_XOR_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2118,11 +1782,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) ^ (int32_t) (fp[(vsrc2)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHL_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHL_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2130,11 +1791,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) << ((fp[(vsrc2)]) & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHR_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHR_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2142,11 +1800,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) >> ((fp[(vsrc2)]) & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_USHR_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_USHR_INT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2154,11 +1809,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (fp[(vdst)] = ((u_int32_t) (fp[(vsrc1)]) >> ((fp[(vsrc2)]) & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ADD_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_ADD_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2167,11 +1819,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) + (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SUB_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SUB_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2180,11 +1829,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) - (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2193,11 +1839,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) * (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2216,11 +1859,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 } else { result = firstVal / secondVal; }
                 putLongToArray(fp, (vdst), (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2239,11 +1879,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 } else { result = firstVal % secondVal; }
                 putLongToArray(fp, (vdst), (result));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AND_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AND_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2252,11 +1889,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) & (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_OR_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_OR_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2265,11 +1899,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) | (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_XOR_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_XOR_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2278,11 +1909,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vsrc1)) ^ (s8) getLongFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHL_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHL_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2290,11 +1918,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putLongToArray(fp, (vdst), ((s8) getLongFromArray(fp, (vsrc1)) << ((fp[(vsrc2)]) & 0x3f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHR_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHR_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2302,11 +1927,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putLongToArray(fp, (vdst), ((s8) getLongFromArray(fp, (vsrc1)) >> ((fp[(vsrc2)]) & 0x3f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_USHR_LONG: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_USHR_LONG) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2314,11 +1936,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putLongToArray(fp, (vdst), ((u_int64_t) getLongFromArray(fp, (vsrc1)) >> ((fp[(vsrc2)]) & 0x3f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ADD_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_ADD_FLOAT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2326,11 +1945,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vsrc1)])) + (*((float *) &fp[(vsrc2)]))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SUB_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SUB_FLOAT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2338,11 +1954,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vsrc1)])) - (*((float *) &fp[(vsrc2)]))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_FLOAT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2350,11 +1963,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vsrc1)])) * (*((float *) &fp[(vsrc2)]))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_FLOAT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2362,11 +1972,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vsrc1)])) / (*((float *) &fp[(vsrc2)]))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_FLOAT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_FLOAT) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2374,11 +1981,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 (*((float *) &fp[(vdst)]) = (fmodf((*((float *) &fp[(vsrc1)])), (*((float *) &fp[(vsrc2)])))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ADD_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_ADD_DOUBLE) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2386,11 +1990,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vsrc1)) + getDoubleFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SUB_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SUB_DOUBLE) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2398,11 +1999,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vsrc1)) - getDoubleFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_DOUBLE) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2410,11 +2008,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vsrc1)) * getDoubleFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_DOUBLE) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2422,11 +2017,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vsrc1)) / getDoubleFromArray(fp, (vsrc2))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_DOUBLE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_DOUBLE) {
                 u_int16_t srcRegs;
                 vdst = ((inst) >> 8);
                 srcRegs = (pc[(1)]);
@@ -2434,35 +2026,23 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = srcRegs >> 8;
                 putDoubleToArray(fp, (vdst), (fmod(getDoubleFromArray(fp, (vsrc1)), getDoubleFromArray(fp, (vsrc2)))));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ADD_INT_2ADDR:
+                FINISH(2);
+            HANDLE_OPCODE(OP_ADD_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) + (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SUB_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SUB_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) - (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MUL_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MUL_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) * (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DIV_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_DIV_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 {
@@ -2479,11 +2059,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal / secondVal; }
                     (fp[(vdst)] = (result));
                 }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_REM_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_REM_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 {
@@ -2500,86 +2077,56 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal % secondVal; }
                     (fp[(vdst)] = (result));
                 }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_AND_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_AND_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) & (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_OR_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_OR_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) | (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_XOR_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_XOR_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) ^ (int32_t) (fp[(vsrc1)])));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SHL_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SHL_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) << ((fp[(vsrc1)]) & 0x1f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SHR_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SHR_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((int32_t) (fp[(vdst)]) >> ((fp[(vsrc1)]) & 0x1f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_USHR_INT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_USHR_INT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (fp[(vdst)] = ((u_int32_t) (fp[(vdst)]) >> ((fp[(vsrc1)]) & 0x1f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_ADD_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_ADD_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) + (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SUB_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SUB_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) - (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MUL_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MUL_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) * (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DIV_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_DIV_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 {
@@ -2596,11 +2143,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal / secondVal; }
                     putLongToArray(fp, (vdst), (result));
                 }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_REM_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_REM_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 {
@@ -2617,170 +2161,110 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal % secondVal; }
                     putLongToArray(fp, (vdst), (result));
                 }
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_AND_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_AND_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) & (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_OR_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_OR_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) | (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_XOR_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_XOR_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst),
                                ((s8) getLongFromArray(fp, (vdst)) ^ (s8) getLongFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SHL_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SHL_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), ((s8) getLongFromArray(fp, (vdst)) << ((fp[(vsrc1)]) & 0x3f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SHR_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SHR_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), ((s8) getLongFromArray(fp, (vdst)) >> ((fp[(vsrc1)]) & 0x3f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_USHR_LONG_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_USHR_LONG_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putLongToArray(fp, (vdst), ((u_int64_t) getLongFromArray(fp, (vdst)) >> ((fp[(vsrc1)]) & 0x3f)));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_ADD_FLOAT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_ADD_FLOAT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vdst)])) + (*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SUB_FLOAT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SUB_FLOAT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vdst)])) - (*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MUL_FLOAT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MUL_FLOAT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vdst)])) * (*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DIV_FLOAT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_DIV_FLOAT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = ((*((float *) &fp[(vdst)])) / (*((float *) &fp[(vsrc1)]))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_REM_FLOAT_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_REM_FLOAT_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 (*((float *) &fp[(vdst)]) = (fmodf((*((float *) &fp[(vdst)])), (*((float *) &fp[(vsrc1)])))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_ADD_DOUBLE_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_ADD_DOUBLE_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vdst)) + getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_SUB_DOUBLE_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_SUB_DOUBLE_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vdst)) - getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_MUL_DOUBLE_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_MUL_DOUBLE_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vdst)) * getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_DIV_DOUBLE_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_DIV_DOUBLE_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (getDoubleFromArray(fp, (vdst)) / getDoubleFromArray(fp, (vsrc1))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_REM_DOUBLE_2ADDR:
+                FINISH(1);
+            HANDLE_OPCODE(OP_REM_DOUBLE_2ADDR)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 putDoubleToArray(fp, (vdst), (fmod(getDoubleFromArray(fp, (vdst)), getDoubleFromArray(fp, (vsrc1)))));
-                {
-                    (pc += 1);
-                    break;
-                }
-            case OP_ADD_INT_LIT16:
+                FINISH(1);
+            HANDLE_OPCODE(OP_ADD_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)]) + (int16_t) vsrc2));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_RSUB_INT: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_RSUB_INT) {
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((int16_t) vsrc2 - (int32_t) (fp[(vsrc1)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)]) * (int16_t) vsrc2));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
@@ -2797,11 +2281,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal / (int16_t) vsrc2; }
                     (fp[(vdst)] = (result));
                 }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
@@ -2818,38 +2299,26 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     } else { result = firstVal % (int16_t) vsrc2; }
                     (fp[(vdst)] = (result));
                 }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AND_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_AND_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)]) & (int16_t) vsrc2));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_OR_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_OR_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)]) | (int16_t) vsrc2));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_XOR_INT_LIT16:
+                FINISH(2);
+            HANDLE_OPCODE(OP_XOR_INT_LIT16)
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
                 vsrc2 = (pc[(1)]);
                 (fp[(vdst)] = ((fp[(vsrc1)]) ^ (int16_t) vsrc2));
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_ADD_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_ADD_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2857,11 +2326,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) + (s1) vsrc2));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_RSUB_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_RSUB_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2869,11 +2335,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((s1) vsrc2 - (int32_t) (fp[(vsrc1)])));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_MUL_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_MUL_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2881,11 +2344,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) * (s1) vsrc2));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_DIV_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_DIV_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2905,11 +2365,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     (fp[(vdst)] = (result));
                 }
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_REM_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_REM_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2929,11 +2386,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                     (fp[(vdst)] = (result));
                 }
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_AND_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_AND_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2941,11 +2395,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) & (s1) vsrc2));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_OR_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_OR_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2953,11 +2404,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) | (s1) vsrc2));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_XOR_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_XOR_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2965,11 +2413,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) ^ (s1) vsrc2));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHL_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHL_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2977,11 +2422,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) << (vsrc2 & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_SHR_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_SHR_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -2989,11 +2431,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((int32_t) (fp[(vsrc1)]) >> (vsrc2 & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_USHR_INT_LIT8: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_USHR_INT_LIT8) {
                 u_int16_t litInfo;
                 vdst = ((inst) >> 8);
                 litInfo = (pc[(1)]);
@@ -3001,22 +2440,19 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 vsrc2 = litInfo >> 8;
                 (fp[(vdst)] = ((u_int32_t) (fp[(vsrc1)]) >> (vsrc2 & 0x1f)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_UNUSED_E3:
-            case OP_UNUSED_E4:
-            case OP_UNUSED_E5:
-            case OP_UNUSED_E6:
-            case OP_UNUSED_E7:
-            case OP_UNUSED_E8:
-            case OP_UNUSED_E9:
-            case OP_UNUSED_EA:
-            case OP_UNUSED_EB:
-            case OP_UNUSED_EC:
-            case OP_UNUSED_ED:
-            case OP_EXECUTE_INLINE: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_UNUSED_E3)
+            HANDLE_OPCODE(OP_UNUSED_E4)
+            HANDLE_OPCODE(OP_UNUSED_E5)
+            HANDLE_OPCODE(OP_UNUSED_E6)
+            HANDLE_OPCODE(OP_UNUSED_E7)
+            HANDLE_OPCODE(OP_UNUSED_E8)
+            HANDLE_OPCODE(OP_UNUSED_E9)
+            HANDLE_OPCODE(OP_UNUSED_EA)
+            HANDLE_OPCODE(OP_UNUSED_EB)
+            HANDLE_OPCODE(OP_UNUSED_EC)
+            HANDLE_OPCODE(OP_UNUSED_ED)
+            HANDLE_OPCODE(OP_EXECUTE_INLINE) {
                 u8 arg0, arg1, arg2, arg3;
                 (SAVEAREA_FROM_FP(fp)->xtra.currentPc = pc);
                 vsrc1 = ((inst) >> 12);
@@ -3038,21 +2474,17 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!dvmPerformInlineOp4Std(arg0, arg1, arg2, arg3, &retval, ref))
                     goto exceptionThrown;
             }
-                {
-                    (pc += 3);
-                    break;
-                }
-            case OP_UNUSED_EF:
-            case OP_INVOKE_DIRECT_EMPTY:
+                FINISH(3);
+            HANDLE_OPCODE(OP_UNUSED_EF)
+            HANDLE_OPCODE(OP_INVOKE_DIRECT_EMPTY)
                 if (!gDvm.debuggerActive) {
-                    (pc += 3);
-                    break;
+                    FINISH(3);
                 } else {
                     methodCallRange = false;
                     goto invokeDirect;
                 }
-            case OP_UNUSED_F1:
-            case OP_IGET_QUICK: {
+            HANDLE_OPCODE(OP_UNUSED_F1)
+            HANDLE_OPCODE(OP_IGET_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3061,11 +2493,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 (fp[(vdst)] = (dvmGetFieldInt(obj, ref)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_WIDE_QUICK: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_WIDE_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3074,11 +2503,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 putLongToArray(fp, (vdst), (dvmGetFieldLong(obj, ref)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IGET_OBJECT_QUICK: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IGET_OBJECT_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3087,11 +2513,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 (fp[(vdst)] = (u8) (dvmGetFieldObject(obj, ref)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_QUICK: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3100,11 +2523,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 dvmSetFieldInt(obj, ref, (fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_WIDE_QUICK: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_WIDE_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3113,11 +2533,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 dvmSetFieldLong(obj, ref, getLongFromArray(fp, (vdst)));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_IPUT_OBJECT_QUICK: {
+                FINISH(2);
+            HANDLE_OPCODE(OP_IPUT_OBJECT_QUICK) {
                 Object *obj;
                 vdst = (((inst) >> 8) & 0x0f);
                 vsrc1 = ((inst) >> 12);
@@ -3126,32 +2543,26 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNullExportPC(obj, fp, pc)) goto exceptionThrown;
                 dvmSetFieldObject(obj, ref, ((Object *) fp[(vdst)]));
             }
-                {
-                    (pc += 2);
-                    break;
-                }
-            case OP_INVOKE_VIRTUAL_QUICK:
+                FINISH(2);
+            HANDLE_OPCODE(OP_INVOKE_VIRTUAL_QUICK)
                 methodCallRange = false;
                 goto invokeVirtualQuick;
-            case OP_INVOKE_VIRTUAL_QUICK_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_VIRTUAL_QUICK_RANGE)
                 methodCallRange = true;
                 goto invokeVirtualQuick;
-            case OP_INVOKE_SUPER_QUICK:
+            HANDLE_OPCODE(OP_INVOKE_SUPER_QUICK)
                 methodCallRange = false;
                 goto invokeSuperQuick;
-            case OP_INVOKE_SUPER_QUICK_RANGE:
+            HANDLE_OPCODE(OP_INVOKE_SUPER_QUICK_RANGE)
                 methodCallRange = true;
                 goto invokeSuperQuick;
-            case OP_UNUSED_FC:
-            case OP_UNUSED_FD:
-            case OP_UNUSED_FE:
-            case OP_UNUSED_FF:
+            HANDLE_OPCODE(OP_UNUSED_FC)
+            HANDLE_OPCODE(OP_UNUSED_FD)
+            HANDLE_OPCODE(OP_UNUSED_FE)
+            HANDLE_OPCODE(OP_UNUSED_FF)
                 LOGE("unknown opcode 0x%02x\n", ((inst) & 0xff));
                 dvmAbort();
-                {
-                    (pc += 1);
-                    break;
-                }
+                FINISH(1);
             filledNewArray:
             {
                 ClassObject *arrayClass;
@@ -3210,10 +2621,7 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 retval.l = newArray;
             }
-                {
-                    (pc += 3);
-                    break;
-                }
+                FINISH(3);
             invokeVirtual:
             {
                 Method *baseMethod;
@@ -3304,8 +2712,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if (!checkForNull(thisPtr))
                     goto exceptionThrown;
                 thisClass = thisPtr->clazz;
-                methodToCall = dvmFindInterfaceMethodInCache(thisClass, ref, curMethod,
-                                                             methodClassDex);
+                methodToCall = dvmFindInterfaceMethodAtSite(thisClass, ref,
+                                                            curMethod, pc, methodClassDex);
                 if (methodToCall == NULL) {
                     assert(dvmCheckException(self));
                     goto exceptionThrown;
@@ -3421,8 +2829,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 }
                 methodClassDex = curMethod->clazz->pDvmDex;
                 pc = saveArea->savedPc;
-                (pc += 3);
-                break;
+                JIT_RESUME(3);
+                FINISH(3);
             }
             exceptionThrown:
             {
@@ -3451,10 +2859,7 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                 if ((((pc[(0)])) & 0xff) == OP_MOVE_EXCEPTION)
                     dvmSetException(self, exception);
                 dvmReleaseTrackedAlloc(exception, self);
-                {
-                    (pc += 0);
-                    break;
-                }
+                FINISH(0);
             }
             invokeMethod:
             {
@@ -3514,10 +2919,8 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                         methodClassDex = curMethod->clazz->pDvmDex;
                         pc = methodToCall->insns;
                         fp = self->curFrame = newFp;
-                        {
-                            (pc += 0);
-                            break;
-                        }
+                        JIT_CHECK_ENTRY();
+                        FINISH(0);
                     } else {
                         newSaveArea->xtra.localRefTop = self->jniLocalRefTable.nextEntry;
                         self->curFrame = newFp;
@@ -3528,15 +2931,26 @@ bool dvmInterpretStd(Thread *self, InterpState *interpState) {
                             LOGV("Exception thrown by/below native code\n");
                             goto exceptionThrown;
                         }
-                        {
-                            (pc += 3);
-                            break;
-                        }
+                        JIT_RESUME(3);
+                        FINISH(3);
                     }
                 }
                 assert(false);
-        }
-    }
+#if defined(WITH_JIT) && defined(THREADED_INTERP)
+            jitEnter:
+            {
+                u_int32_t resume = dvmJitExecute(self, curMethod, fp, &retval,
+                                                 pc - curMethod->insns);
+                if (resume == kJitMethodReturned)
+                    goto returnFromMethod;
+                pc = curMethod->insns + resume;
+                FINISH(0);
+            }
+#endif
+#if !defined(THREADED_INTERP)
+        }   /* end of switch */
+    }       /* end of while */
+#endif
     bail:
     interpState->retval = retval;
     return false;
@@ -0,0 +1,20 @@
+//
+// Threaded ("computed goto") build of the portable interpreter.
+//
+// Same handlers as InterpC-easy.c; only the dispatch differs.  Selected
+// with "-Xint:fast", or by default when built with WITH_THREADED_INTERP.
+//
+
+/*
+ * GCC folds all the "goto *" sites back into one shared indirect jump and
+ * only splits them up again in a pass gated on expensive-optimizations,
+ * which our -O1 build doesn't enable.  Without it this is no faster than
+ * the switch.  (clang keeps them separate on its own.)
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("expensive-optimizations")
+#endif
+
+#define THREADED_INTERP
+#define INTERP_FUNC_NAME dvmInterpretFast
+#include "InterpC-easy.c"
@@ -73,11 +73,10 @@ static bool validateCookie(u8 cookie)
     if (pDexOrJar == NULL)
         return false;
 
+    /* lookups don't need the lock */
     u4 hash = dvmComputeUtf8Hash(pDexOrJar->fileName);
-    dvmHashTableLock(gDvm.userDexFiles);
     void* result = dvmHashTableLookup(gDvm.userDexFiles, hash, pDexOrJar,
                 hashcmpDexOrJar, false);
-    dvmHashTableUnlock(gDvm.userDexFiles);
     if (result == NULL)
         return false;
 
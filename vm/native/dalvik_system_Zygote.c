@@ -19,6 +19,7 @@
  */
 #include "Dalvik.h"
 #include "native/InternalNativePriv.h"
+#include "test/Test.h"
 
 #include <signal.h>
 #include <sys/types.h>
@@ -220,6 +221,28 @@ static int setrlimitsFromArray(ArrayObject* rlimits)
     return 0;
 }
 
+/*
+ * Get the heap ready for a fork.  The first time, that splits off the
+ * heap the zygote has filled so far.
+ */
+static void gcPreFork()
+{
+#ifndef NDEBUG
+    bool firstSplit = !gDvm.newZygoteHeapAllocated;
+#endif
+
+    if (!dvmGcPreZygoteFork()) {
+        LOGE("pre-fork heap failed\n");
+        dvmAbort();
+    }
+
+#ifndef NDEBUG
+    /* the split happens once and for real, so test it here */
+    if (firstSplit)
+        dvmTestZygoteHeap();
+#endif
+}
+
 /* native public static int fork(); */
 static void Dalvik_dalvik_system_Zygote_fork(const u8* args, JValue* pResult)
 {
@@ -233,10 +256,7 @@ static void Dalvik_dalvik_system_Zygote_fork(const u8* args, JValue* pResult)
         RETURN_VOID();
     }
 
-    if (!dvmGcPreZygoteFork()) {
-        LOGE("pre-fork heap failed\n");
-        dvmAbort();
-    }
+    gcPreFork();
 
     setSignalHandler();      
 
@@ -307,10 +327,7 @@ static pid_t forkAndSpecializeCommon(const u4* args)
         return -1;
     }
 
-    if (!dvmGcPreZygoteFork()) {
-        LOGE("pre-fork heap failed\n");
-        dvmAbort();
-    }
+    gcPreFork();
 
     setSignalHandler();      
 
@@ -52,6 +52,8 @@ static void Dalvik_java_lang_Runtime_nativeExit(const u8* args,
         dvmChangeStatus(NULL, THREAD_RUNNING);
         LOGW("JNI exit hook returned\n");
     }
+    if (isExit)
+        dvmAllocSamplerStop();
     LOGD("Calling exit(%d)\n", status);
     exit(status);
 }
@@ -143,6 +143,8 @@ static void Dalvik_java_lang_System_arraycopy(const u8* args, JValue* pResult)
             (*copyFunc)((u1*)dstArray->contents + dstPos * width,
                     (const u1*)srcArray->contents + srcPos * width,
                     length * width);
+            if (length > 0)
+                dvmMarkCard(dstArray);
         } else {
             /*
              * The arrays are not fundamentally compatible.  However, we may
@@ -189,6 +191,8 @@ static void Dalvik_java_lang_System_arraycopy(const u8* args, JValue* pResult)
             (*copyFunc)((u1*)dstArray->contents + dstPos * width,
                     (const u1*)srcArray->contents + srcPos * width,
                     copyCount * width);
+            if (copyCount > 0)
+                dvmMarkCard(dstArray);
 
             if (copyCount != length) {
                 dvmThrowException("Ljava/lang/ArrayStoreException;", NULL);
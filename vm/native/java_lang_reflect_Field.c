@@ -235,6 +235,10 @@ static void Dalvik_java_lang_reflect_Field_setField(const u8* args,
         fieldPtr->i = value.i;
     }
 
+    /* static fields live in the declaring class */
+    if (fieldType->primitiveType == PRIM_NOT && valueObj != NULL)
+        dvmMarkCard(obj != NULL ? obj : (Object*) declaringClass);
+
     RETURN_VOID();
 }
 
@@ -128,6 +128,8 @@ static void Dalvik_sun_misc_Unsafe_compareAndSwapObject(const u8* args,
     // Note: android_atomic_cmpxchg() returns 0 on success, not failure.
     int result = android_quasiatomic_cmpxchg_64((s8) expectedValue,
             (s8) newValue, address);
+    if (result == 0 && newValue != NULL)
+        dvmMarkCard(obj);
     
     RETURN_BOOLEAN(result == 0);
 }
@@ -220,6 +222,8 @@ static void Dalvik_sun_misc_Unsafe_putObjectVolatile(const u8* args,
     volatile Object** address = (volatile Object**) (((u1*) obj) + offset);
 
     *address = value;
+    if (value != NULL)
+        dvmMarkCard(obj);
     RETURN_VOID();
 }
             
@@ -304,6 +308,8 @@ static void Dalvik_sun_misc_Unsafe_putObject(const u8* args, JValue* pResult)
     Object** address = (Object**) (((u1*) obj) + offset);
 
     *address = value;
+    if (value != NULL)
+        dvmMarkCard(obj);
     RETURN_VOID();
 }
 
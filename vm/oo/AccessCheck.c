@@ -33,6 +33,24 @@ static int strcmpCount(const char* str1, const char* str2)
     }
 }
 
+/*
+ * Get the class loader that defines "clazz" for access checks.
+ *
+ * dexopt loads everything with the bootstrap loader, and marks a class
+ * as foreign for the duration of a check when it comes from a different
+ * DEX file (see tweakLoader in DexOptimize.c).  The mark is per-thread,
+ * since other threads may be checking against the same class.
+ */
+static inline const Object* accessLoader(const ClassObject* clazz)
+{
+    if (gDvm.optimizing) {
+        Thread* self = dvmThreadSelf();
+        if (self != NULL && self->optForeignClass == clazz)
+            return (const Object*) 0xdead3333;
+    }
+    return clazz->classLoader;
+}
+
 /*
  * Returns "true" if the two classes are in the same runtime package.
  */
@@ -43,7 +61,7 @@ bool dvmInSamePackage(const ClassObject* class1, const ClassObject* class2)
         return true;
 
     /* class loaders must match */
-    if (class1->classLoader != class2->classLoader)
+    if (accessLoader(class1) != accessLoader(class2))
         return false;
 
     /*
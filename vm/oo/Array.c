@@ -682,6 +682,8 @@ bool dvmCopyObjectArray(ArrayObject* dstArray, const ArrayObject* srcArray,
         (dstArray->obj.clazz->elementClass == dstElemClass->elementClass &&
          dstArray->obj.clazz->arrayDim == dstElemClass->arrayDim+1));
 
+    if (count != 0)
+        dvmMarkCard(dstArray);
     while (count--) {
         if (!dvmInstanceof((*src)->clazz, dstElemClass)) {
             LOGW("dvmCopyObjectArray: can't store %s in %s\n",
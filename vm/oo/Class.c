@@ -202,6 +202,10 @@ static bool computeFieldOffsets(ClassObject *clazz);
 
 static void throwEarlierClassFailure(ClassObject *clazz);
 
+static bool classTablesStartup(void);
+
+static void classTablesShutdown(void);
+
 #if LOG_CLASS_LOADING
 /*
  * Logs information about a class loading with given timestamp.
@@ -302,8 +306,8 @@ bool dvmClassStartup(void) {
         return false;
     }
 
-    gDvm.loadedClasses =
-            dvmHashTableCreate(256, (HashFreeFunc) dvmFreeClassInnards);
+    if (!classTablesStartup())
+        return false;
 
     gDvm.pBootLoaderAlloc = dvmLinearAllocCreate(NULL);
     if (gDvm.pBootLoaderAlloc == NULL)
@@ -369,9 +373,8 @@ bool dvmClassStartup(void) {
 void dvmClassShutdown(void) {
     int i;
 
-    /* discard all system-loaded classes */
-    dvmHashTableFree(gDvm.loadedClasses);
-    gDvm.loadedClasses = NULL;
+    /* discard all loaded classes */
+    classTablesShutdown();
 
     /* discard primitive classes created for arrays */
     for (i = 0; i < PRIM_MAX; i++)
@@ -937,11 +940,264 @@ StringObject *dvmGetBootPathResource(const char *name, int idx) {
  * ===========================================================================
  */
 
-/* search for these criteria in the Class hash table */
-typedef struct ClassMatchCriteria {
-    const char *descriptor;
-    Object *loader;
-} ClassMatchCriteria;
+/*
+ * Loaded classes are kept in one table per class loader.  A loader's
+ * table holds the classes it defined plus the ones it's an initiating
+ * loader for, so a lookup only has to match on descriptor.  The tables
+ * for loaders other than the bootstrap loader are found through a map
+ * keyed on the ClassLoader object.
+ *
+ * All of them are Hash.c tables, which readers probe without locking.
+ * Everything that changes a table, or a class' initiating loader list,
+ * holds ClassTables.lock rather than the tables' own locks.  Classes are
+ * never unloaded, so the generations of entries the tables outgrow are
+ * kept until shutdown.
+ */
+typedef struct LoaderClassTable {
+    Object *loader;                     /* NULL for the bootstrap loader */
+    HashTable *classes;                 /* ClassObject* entries */
+} LoaderClassTable;
+
+struct ClassTables {
+    pthread_mutex_t lock;
+    LoaderClassTable bootTable;
+    HashTable *loaders;                 /* LoaderClassTable* entries */
+    u4 numClasses;                      /* counted by defining loader */
+};
+
+#define kClassTableInitialSize      64
+#define kLoaderMapInitialSize       16
+
+static u4 hashLoader(const Object *loader) {
+    return (u4) (((u_int64_t) loader >> 3) * 0x9e3779b1);
+}
+
+/*
+ * Compare a class table entry with a descriptor.  (This is a
+ * dvmHashTableLookup callback.)
+ */
+static int hashcmpClassByDescriptor(const void *vclazz,
+                                    const void *vdescriptor) {
+    return strcmp(((const ClassObject *) vclazz)->descriptor,
+                  (const char *) vdescriptor);
+}
+
+/*
+ * Like hashcmpClassByDescriptor, but passing in a fully-formed
+ * ClassObject instead of a descriptor.
+ */
+static int hashcmpClassByClass(const void *vclazz, const void *vaddclazz) {
+    return strcmp(((const ClassObject *) vclazz)->descriptor,
+                  ((const ClassObject *) vaddclazz)->descriptor);
+}
+
+/*
+ * Compare a loader map entry with a ClassLoader object.
+ */
+static int hashcmpLoaderTableByLoader(const void *vtable,
+                                      const void *vloader) {
+    return ((const LoaderClassTable *) vtable)->loader != vloader;
+}
+
+/*
+ * Like hashcmpLoaderTableByLoader, but passing in another loader table.
+ */
+static int hashcmpLoaderTableByTable(const void *vtable,
+                                     const void *vaddtable) {
+    return ((const LoaderClassTable *) vtable)->loader !=
+           ((const LoaderClassTable *) vaddtable)->loader;
+}
+
+static void freeLoaderTable(void *vtable) {
+    LoaderClassTable *table = (LoaderClassTable *) vtable;
+
+    dvmHashTableFree(table->classes);
+    free(table);
+}
+
+/*
+ * Find the class table for "loader", without locking.  Returns NULL if
+ * the loader hasn't had any classes added yet.
+ */
+static LoaderClassTable *findLoaderTable(const Object *loader) {
+    if (loader == NULL)
+        return &gDvm.loadedClasses->bootTable;
+
+    return (LoaderClassTable *) dvmHashTableLookup(gDvm.loadedClasses->loaders,
+            hashLoader(loader), (void *) loader, hashcmpLoaderTableByLoader,
+            false);
+}
+
+/*
+ * Find the class table for "loader", creating it if necessary.  Call with
+ * the lock held.
+ *
+ * Returns NULL if we ran out of memory.
+ */
+static LoaderClassTable *findOrAddLoaderTable(Object *loader) {
+    LoaderClassTable *table;
+
+    table = findLoaderTable(loader);
+    if (table != NULL)
+        return table;
+
+    table = (LoaderClassTable *) calloc(1, sizeof(LoaderClassTable));
+    if (table == NULL)
+        return NULL;
+    table->loader = loader;
+    table->classes = dvmHashTableCreate(kClassTableInitialSize, NULL);
+    if (table->classes == NULL) {
+        free(table);
+        return NULL;
+    }
+
+    dvmHashTableLookup(gDvm.loadedClasses->loaders, hashLoader(loader), table,
+                       hashcmpLoaderTableByTable, true);
+    return table;
+}
+
+/*
+ * Add "clazz" to "table" unless a class with the same descriptor is
+ * already there.  Call with the lock held.
+ *
+ * Returns the class now in the table.
+ */
+static ClassObject *addToLoaderTable(LoaderClassTable *table, u4 hash,
+                                     ClassObject *clazz) {
+    return (ClassObject *) dvmHashTableLookup(table->classes, hash, clazz,
+                                              hashcmpClassByClass, true);
+}
+
+/*
+ * Set up the loaded-class tables.
+ */
+static bool classTablesStartup(void) {
+    ClassTables *tables;
+
+    tables = (ClassTables *) calloc(1, sizeof(ClassTables));
+    if (tables == NULL)
+        return false;
+    dvmInitMutex(&tables->lock);
+    tables->bootTable.classes = dvmHashTableCreate(kClassTableInitialSize, NULL);
+    tables->loaders = dvmHashTableCreate(kLoaderMapInitialSize, freeLoaderTable);
+    if (tables->bootTable.classes == NULL || tables->loaders == NULL) {
+        dvmHashTableFree(tables->bootTable.classes);
+        dvmHashTableFree(tables->loaders);
+        dvmDestroyMutex(&tables->lock);
+        free(tables);
+        return false;
+    }
+
+    gDvm.loadedClasses = tables;
+    return true;
+}
+
+/*
+ * Free the innards of every loaded class, then the tables themselves.
+ */
+static int freeClassCallback(void *vclazz, void *arg) {
+    UNUSED_PARAMETER(arg);
+
+    dvmFreeClassInnards((ClassObject *) vclazz);
+    return 0;
+}
+
+static void classTablesShutdown(void) {
+    ClassTables *tables = gDvm.loadedClasses;
+
+    if (tables == NULL)
+        return;
+
+    dvmForeachLoadedClass(freeClassCallback, NULL);
+
+    dvmHashTableFree(tables->bootTable.classes);
+    dvmHashTableFree(tables->loaders);      /* frees the loader tables */
+
+    dvmDestroyMutex(&tables->lock);
+    free(tables);
+    gDvm.loadedClasses = NULL;
+}
+
+/*
+ * What dvmForeachLoadedClass() passes through dvmHashForeach().
+ */
+typedef struct ClassForeachContext {
+    HashForeachFunc func;
+    void *arg;
+    const Object *loader;       /* only classes it defines */
+} ClassForeachContext;
+
+static int foreachDefinedClass(void *vclazz, void *vctx) {
+    const ClassForeachContext *pCtx = (const ClassForeachContext *) vctx;
+
+    if (((const ClassObject *) vclazz)->classLoader != pCtx->loader)
+        return 0;
+    return (*pCtx->func)(vclazz, pCtx->arg);
+}
+
+/*
+ * Call "func" on the classes "table" defines, stopping early if it returns
+ * nonzero.
+ */
+static int foreachInLoaderTable(const LoaderClassTable *table,
+                                HashForeachFunc func, void *arg) {
+    ClassForeachContext ctx;
+
+    ctx.func = func;
+    ctx.arg = arg;
+    ctx.loader = table->loader;
+    return dvmHashForeach(table->classes, foreachDefinedClass, &ctx);
+}
+
+static int foreachLoaderTable(void *vtable, void *vctx) {
+    const ClassForeachContext *pCtx = (const ClassForeachContext *) vctx;
+
+    return foreachInLoaderTable((const LoaderClassTable *) vtable,
+                                pCtx->func, pCtx->arg);
+}
+
+void dvmLockLoadedClasses(void) {
+    dvmLockMutex(&gDvm.loadedClasses->lock);
+}
+
+void dvmUnlockLoadedClasses(void) {
+    dvmUnlockMutex(&gDvm.loadedClasses->lock);
+}
+
+/*
+ * Call "func" once on every loaded class, stopping early (and returning
+ * its value) if it returns nonzero.
+ *
+ * Call with the loaded-class lock held, or with the world stopped.
+ */
+int dvmForeachLoadedClass(HashForeachFunc func, void *arg) {
+    const ClassTables *tables = gDvm.loadedClasses;
+    ClassForeachContext ctx;
+    int val;
+
+    val = foreachInLoaderTable(&tables->bootTable, func, arg);
+    if (val != 0)
+        return val;
+
+    ctx.func = func;
+    ctx.arg = arg;
+    ctx.loader = NULL;
+    return dvmHashForeach(tables->loaders, foreachLoaderTable, &ctx);
+}
+
+/*
+ * Call "func" on every class visible to "loader", i.e. every class it's
+ * the defining or an initiating loader of.  Same rules as
+ * dvmForeachLoadedClass().
+ */
+int dvmForeachClassVisibleTo(const Object *loader, HashForeachFunc func,
+                             void *arg) {
+    const LoaderClassTable *table = findLoaderTable(loader);
+
+    if (table == NULL)
+        return 0;
+    return dvmHashForeach(table->classes, func, arg);
+}
 
 #define kInitLoaderInc  4       /* must be power of 2 */
 
@@ -959,12 +1215,10 @@ static InitiatingLoaderList *dvmGetInitiatingLoaderList(ClassObject *clazz) {
 /*
  * Determine if "loader" appears in clazz' initiating loader list.
  *
- * The class hash table lock must be held when calling here, since
- * it's also used when updating a class' initiating loader list.
- *
- * TODO: switch to some sort of lock-free data structure so we don't have
- * to grab the lock to do a lookup.  Among other things, this would improve
- * the speed of compareDescriptorClasses().
+ * The loaded-class lock must be held when calling here, since it's also
+ * used when updating a class' initiating loader list.  (Lookups don't
+ * need this: a class is also in the class table of each of its
+ * initiating loaders.)
  */
 bool dvmLoaderInInitiatingList(const ClassObject *clazz, const Object *loader) {
     /*
@@ -1000,15 +1254,17 @@ bool dvmLoaderInInitiatingList(const ClassObject *clazz, const Object *loader) {
  * In the common case this will be a short list, so we don't need to do
  * anything too fancy here.
  *
- * This locks gDvm.loadedClasses for synchronization, so don't hold it
- * when calling here.
+ * This also adds the class to "loader"'s class table, so later lookups
+ * through "loader" find it directly.
+ *
+ * This takes the loaded-class lock, so don't hold it when calling here.
  */
 void dvmAddInitiatingLoader(ClassObject *clazz, Object *loader) {
     if (loader != clazz->classLoader) {
         assert(loader != NULL);
 
                 LOGVV("Adding %p to '%s' init list\n", loader, clazz->descriptor);
-        dvmHashTableLock(gDvm.loadedClasses);
+        dvmLockLoadedClasses();
 
         /*
          * Make sure nobody snuck in.  The penalty for adding twice is
@@ -1049,65 +1305,25 @@ void dvmAddInitiatingLoader(ClassObject *clazz, Object *loader) {
         loaderList->initiatingLoaders[loaderList->initiatingLoaderCount++] =
                 loader;
 
+        LoaderClassTable *table = findOrAddLoaderTable(loader);
+        if (table != NULL) {
+            addToLoaderTable(table, dvmComputeUtf8Hash(clazz->descriptor),
+                             clazz);
+        } else {
+            /* as above; lookups through "loader" just take the slow path */
+            LOGW("Unable to add '%s' to class table of %p\n",
+                 clazz->descriptor, loader);
+        }
+
         bail_unlock:
-        dvmHashTableUnlock(gDvm.loadedClasses);
+        dvmUnlockLoadedClasses();
     }
 }
 
 /*
- * (This is a dvmHashTableLookup callback.)
- *
- * Entries in the class hash table are stored as { descriptor, d-loader }
- * tuples.  If the hashed class descriptor matches the requested descriptor,
- * and the hashed defining class loader matches the requested class
- * loader, we're good.  If only the descriptor matches, we check to see if the
- * loader is in the hashed class' initiating loader list.  If so, we
- * can return "true" immediately and skip some of the loadClass melodrama.
- *
- * The caller must lock the hash table before calling here.
- *
- * Returns 0 if a matching entry is found, nonzero otherwise.
- */
-static int hashcmpClassByCrit(const void *vclazz, const void *vcrit) {
-    const ClassObject *clazz = (const ClassObject *) vclazz;
-    const ClassMatchCriteria *pCrit = (const ClassMatchCriteria *) vcrit;
-    bool match;
-
-    match = (strcmp(clazz->descriptor, pCrit->descriptor) == 0 &&
-             (clazz->classLoader == pCrit->loader ||
-              (pCrit->loader != NULL &&
-               dvmLoaderInInitiatingList(clazz, pCrit->loader))));
-    //if (match)
-    //    LOGI("+++ %s %p matches existing %s %p\n",
-    //        pCrit->descriptor, pCrit->loader,
-    //        clazz->descriptor, clazz->classLoader);
-    return !match;
-}
-
-/*
- * Like hashcmpClassByCrit, but passing in a fully-formed ClassObject
- * instead of a ClassMatchCriteria.
- */
-static int hashcmpClassByClass(const void *vclazz, const void *vaddclazz) {
-    const ClassObject *clazz = (const ClassObject *) vclazz;
-    const ClassObject *addClazz = (const ClassObject *) vaddclazz;
-    bool match;
-
-    match = (strcmp(clazz->descriptor, addClazz->descriptor) == 0 &&
-             (clazz->classLoader == addClazz->classLoader ||
-              (addClazz->classLoader != NULL &&
-               dvmLoaderInInitiatingList(clazz, addClazz->classLoader))));
-    return !match;
-}
-
-/*
- * Search through the hash table to find an entry with a matching descriptor
- * and an initiating class loader that matches "loader".
- *
- * The table entries are hashed on descriptor only, because they're unique
- * on *defining* class loader, not *initiating* class loader.  This isn't
- * great, because it guarantees we will have to probe when multiple
- * class loaders are used.
+ * Find the class with a matching descriptor in the class table of
+ * "loader", which holds the classes "loader" is the defining or an
+ * initiating loader of.  This doesn't take any locks.
  *
  * Note this does NOT try to load a class; it just finds a class that
  * has already been loaded.
@@ -1121,20 +1337,18 @@ static int hashcmpClassByClass(const void *vclazz, const void *vaddclazz) {
  */
 ClassObject *dvmLookupClass(const char *descriptor, Object *loader,
                             bool unprepOkay) {
-    ClassMatchCriteria crit;
-    void *found;
-    u4 hash;
-
-    crit.descriptor = descriptor;
-    crit.loader = loader;
-    hash = dvmComputeUtf8Hash(descriptor);
+    const LoaderClassTable *table;
+    ClassObject *found;
 
             LOGVV("threadid=%d: dvmLookupClass searching for '%s' %p\n",
                   dvmThreadSelf()->threadId, descriptor, loader);
-    dvmHashTableLock(gDvm.loadedClasses);
-    found = dvmHashTableLookup(gDvm.loadedClasses, hash, &crit,
-                               hashcmpClassByCrit, false);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    table = findLoaderTable(loader);
+    if (table == NULL)
+        return NULL;
+
+    found = (ClassObject *) dvmHashTableLookup(table->classes,
+            dvmComputeUtf8Hash(descriptor), (void *) descriptor,
+            hashcmpClassByDescriptor, false);
 
     /*
      * The class has been added to the hash table but isn't ready for use.
@@ -1146,67 +1360,42 @@ ClassObject *dvmLookupClass(const char *descriptor, Object *loader,
      */
     if (found != NULL && !unprepOkay && !dvmIsClassLinked(found)) {
         LOGV("Ignoring not-yet-ready %s, using slow path\n",
-             ((ClassObject *) found)->descriptor);
+             found->descriptor);
         found = NULL;
     }
 
-    return (ClassObject *) found;
+    return found;
 }
 
 /*
- * Add a new class to the hash table.
+ * Add a new class to the class table of its defining loader.
  *
- * The class is considered "new" if it doesn't match on both the class
- * descriptor and the defining class loader.
- *
- * TODO: we should probably have separate hash tables for each
- * ClassLoader. This could speed up dvmLookupClass and
- * other common operations. It does imply a VM-visible data structure
- * for each ClassLoader object with loaded classes, which we don't
- * have yet.
+ * The class is considered "new" if that loader doesn't already see a
+ * class with the same descriptor, as its defining or initiating loader.
  */
 bool dvmAddClassToHash(ClassObject *clazz) {
-    void *found;
+    LoaderClassTable *table;
+    ClassObject *found = NULL;
     u4 hash;
 
     hash = dvmComputeUtf8Hash(clazz->descriptor);
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    found = dvmHashTableLookup(gDvm.loadedClasses, hash, clazz,
-                               hashcmpClassByClass, true);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    table = findOrAddLoaderTable(clazz->classLoader);
+    if (table != NULL)
+        found = addToLoaderTable(table, hash, clazz);
+    if (found == clazz)
+        gDvm.loadedClasses->numClasses++;
+    dvmUnlockLoadedClasses();
 
     LOGV("+++ dvmAddClassToHash '%s' %p (isnew=%d) --> %p\n",
          clazz->descriptor, clazz->classLoader,
-         (found == (void *) clazz), clazz);
-
-    //dvmCheckClassTablePerf();
+         (found == clazz), clazz);
 
     /* can happen if two threads load the same class simultaneously */
-    return (found == (void *) clazz);
+    return (found == clazz);
 }
 
-#if 0
-/*
- * Compute hash value for a class.
- */
-u4 hashcalcClass(const void* item)
-{
-    return dvmComputeUtf8Hash(((const ClassObject*) item)->descriptor);
-}
-
-/*
- * Check the performance of the "loadedClasses" hash table.
- */
-void dvmCheckClassTablePerf(void)
-{
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashTableProbeCount(gDvm.loadedClasses, hashcalcClass,
-        hashcmpClassByClass);
-    dvmHashTableUnlock(gDvm.loadedClasses);
-}
-#endif
-
 /*
  * Remove a class object from the hash table.
  */
@@ -1214,11 +1403,16 @@ static void removeClassFromHash(ClassObject *clazz) {
     LOGV("+++ removeClassFromHash '%s'\n", clazz->descriptor);
 
     u4 hash = dvmComputeUtf8Hash(clazz->descriptor);
+    LoaderClassTable *table;
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    if (!dvmHashTableRemove(gDvm.loadedClasses, hash, clazz))
+    dvmLockLoadedClasses();
+    table = findLoaderTable(clazz->classLoader);
+    if (table != NULL && dvmHashTableRemove(table->classes, hash, clazz)) {
+        gDvm.loadedClasses->numClasses--;
+    } else {
         LOGW("Hash table remove failed on class '%s'\n", clazz->descriptor);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    }
+    dvmUnlockLoadedClasses();
 }
 
 
@@ -2053,8 +2247,8 @@ static void freeMethodInnards(Method *meth) {
 #else
     // TODO: call dvmFreeRegisterMap() if meth->registerMap was allocated
     //       on the system heap
-    UNUSED_PARAMETER(meth);
 #endif
+    dvmFreeInlineCaches(meth);
 }
 
 /*
@@ -2063,6 +2257,7 @@ static void freeMethodInnards(Method *meth) {
  */
 static void cloneMethod(Method *dst, const Method *src) {
     memcpy(dst, src, sizeof(Method));
+    dst->inlineCaches = NULL;
 #if 0
     /* for current usage, these are never set, so no need to implement copy */
     assert(dst->exceptions == NULL);
@@ -2604,8 +2799,12 @@ bool dvmLinkClass(ClassObject *clazz, bool classesResolved) {
      * - class->classLoader
      * - clazz->sfields
      * - clazz->interfaces
+     *
+     * A concurrent mark may already have skipped this object while
+     * it was unlinked, so make sure the remark pause looks at it.
      */
     clazz->obj.clazz = gDvm.classJavaLangClass;
+    dvmMarkCard(clazz);
 
     if (false) {
         bail_during_resolve:
@@ -3841,8 +4040,6 @@ static void initSFields(ClassObject *clazz) {
  * Determine whether "descriptor" yields the same class object in the
  * context of clazz1 and clazz2.
  *
- * The caller must hold gDvm.loadedClasses.
- *
  * Returns "true" if they match.
  */
 static bool compareDescriptorClasses(const char *descriptor,
@@ -3856,8 +4053,9 @@ static bool compareDescriptorClasses(const char *descriptor,
     result1 = dvmFindClassNoInit(descriptor, clazz1->classLoader);
 
     /*
-     * We can skip a second lookup by name if the second class loader is
-     * in the initiating loader list of the class object we retrieved.
+     * We can skip a second lookup by name if the second class loader
+     * already sees the class object we retrieved, as its defining loader
+     * or because it's in the class' initiating loader list.
      * (This means that somebody already did a lookup of this class through
      * the second loader, and it resolved to the same class.)  If it's not
      * there, we may simply not have had an opportunity to add it yet, so
@@ -3866,16 +4064,15 @@ static bool compareDescriptorClasses(const char *descriptor,
      * The initiating loader test should catch the majority of cases
      * (in particular, the zillions of references to String/Object).
      *
-     * Unfortunately we're still stuck grabbing a mutex to do the lookup.
+     * The class table lookup doesn't take any locks.
      *
      * For this to work, the superclass/interface should be the first
      * argument, so that way if it's from the bootstrap loader this test
      * will work.  (The bootstrap loader, by definition, never shows up
      * as the initiating loader of a class defined by some other loader.)
      */
-    dvmHashTableLock(gDvm.loadedClasses);
-    bool isInit = dvmLoaderInInitiatingList(result1, clazz2->classLoader);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    bool isInit = result1 != NULL &&
+            dvmLookupClass(descriptor, clazz2->classLoader, true) == result1;
 
     if (isInit) {
         //printf("%s(obj=%p) / %s(cl=%p): initiating\n",
@@ -4058,6 +4255,87 @@ bool dvmIsClassInitializing(const ClassObject *clazz) {
             clazz->initThreadId == dvmThreadSelf()->threadId);
 }
 
+/*
+ * Verify a class that hasn't been verified yet.  The caller must hold
+ * the class's monitor.
+ *
+ * Classes we've been told not to verify are left as they are.
+ *
+ * On failure, returns "false" with an exception raised, and the class
+ * is marked erroneous.
+ */
+static bool verifyClassLocked(Thread *self, ClassObject *clazz) {
+    assert(clazz->status < CLASS_VERIFIED);
+
+    /*
+     * If we're in an "erroneous" state, throw an exception and bail.
+     */
+    if (clazz->status == CLASS_ERROR) {
+        throwEarlierClassFailure(clazz);
+        return false;
+    }
+
+    assert(clazz->status == CLASS_RESOLVED);
+    assert(!IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED));
+
+    if (gDvm.classVerifyMode == VERIFY_MODE_NONE ||
+        (gDvm.classVerifyMode == VERIFY_MODE_REMOTE &&
+         clazz->classLoader == NULL)) {
+        LOGV("+++ not verifying class %s (cl=%p)\n",
+             clazz->descriptor, clazz->classLoader);
+        return true;
+    }
+
+    if (!gDvm.optimizing)
+        LOGV("+++ late verify on %s\n", clazz->descriptor);
+
+    /*
+     * We're not supposed to optimize an unverified class, but during
+     * development this mode was useful.  We can't verify an optimized
+     * class because the optimization process discards information.
+     */
+    if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOPTIMIZED)) {
+        LOGW("Class '%s' was optimized without verification; "
+             "not verifying now\n",
+             clazz->descriptor);
+        LOGW("  ('rm /data/dalvik-cache/*' and restart to fix this)");
+        goto verify_failed;
+    }
+
+    clazz->status = CLASS_VERIFYING;
+    if (!dvmVerifyClass(clazz, VERIFY_DEFAULT)) {
+        verify_failed:
+        dvmThrowExceptionWithClassMessage("Ljava/lang/VerifyError;",
+                                          clazz->descriptor);
+        clazz->verifyErrorClass = dvmGetException(self)->clazz;
+        clazz->status = CLASS_ERROR;
+        return false;
+    }
+
+    clazz->status = CLASS_VERIFIED;
+    return true;
+}
+
+/*
+ * Verify a linked class now, the same way dvmInitClass would, but don't
+ * initialize it.  We hold the class's monitor while we do it, so this
+ * can race safely with dvmInitClass and with other callers.
+ *
+ * On failure, returns "false" with an exception raised.
+ */
+bool dvmEnsureClassVerified(ClassObject *clazz) {
+    Thread *self = dvmThreadSelf();
+    bool result = true;
+
+    dvmLockObject(self, (Object *) clazz);
+    assert(dvmIsClassLinked(clazz) || clazz->status == CLASS_ERROR);
+    if (clazz->status < CLASS_VERIFIED)
+        result = verifyClassLocked(self, clazz);
+    dvmUnlockObject(self, (Object *) clazz);
+
+    return result;
+}
+
 /*
  * If a class has not been initialized, do so by executing the code in
  * <clinit>.  The sequence is described in the VM spec v2 2.17.5.
@@ -4133,54 +4411,9 @@ bool dvmInitClass(ClassObject *clazz) {
      */
     if (clazz->status < CLASS_VERIFIED) {
         LOGD("[-] verify class\n");
-        /*
-         * If we're in an "erroneous" state, throw an exception and bail.
-         */
-        if (clazz->status == CLASS_ERROR) {
-            throwEarlierClassFailure(clazz);
+        if (!verifyClassLocked(self, clazz))
             goto bail_unlock;
-        }
-
-        assert(clazz->status == CLASS_RESOLVED);
-        assert(!IS_CLASS_FLAG_SET(clazz, CLASS_ISPREVERIFIED));
-
-        if (gDvm.classVerifyMode == VERIFY_MODE_NONE ||
-            (gDvm.classVerifyMode == VERIFY_MODE_REMOTE &&
-             clazz->classLoader == NULL)) {
-            LOGV("+++ not verifying class %s (cl=%p)\n",
-                 clazz->descriptor, clazz->classLoader);
-            goto noverify;
-        }
-
-        if (!gDvm.optimizing)
-            LOGV("+++ late verify on %s\n", clazz->descriptor);
-
-        /*
-         * We're not supposed to optimize an unverified class, but during
-         * development this mode was useful.  We can't verify an optimized
-         * class because the optimization process discards information.
-         */
-        if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOPTIMIZED)) {
-            LOGW("Class '%s' was optimized without verification; "
-                 "not verifying now\n",
-                 clazz->descriptor);
-            LOGW("  ('rm /data/dalvik-cache/*' and restart to fix this)");
-            goto verify_failed;
-        }
-
-        clazz->status = CLASS_VERIFYING;
-        if (!dvmVerifyClass(clazz, VERIFY_DEFAULT)) {
-            verify_failed:
-            dvmThrowExceptionWithClassMessage("Ljava/lang/VerifyError;",
-                                              clazz->descriptor);
-            clazz->verifyErrorClass = dvmGetException(self)->clazz;
-            clazz->status = CLASS_ERROR;
-            goto bail_unlock;
-        }
-
-        clazz->status = CLASS_VERIFIED;
     }
-    noverify:
 
     if (clazz->status == CLASS_INITIALIZED)
         goto bail_unlock;
@@ -4440,10 +4673,9 @@ static int findClassCallback(void *vclazz, void *arg) {
 ClassObject *dvmFindLoadedClass(const char *descriptor) {
     int result;
 
-    dvmHashTableLock(gDvm.loadedClasses);
-    result = dvmHashForeach(gDvm.loadedClasses, findClassCallback,
-                            (void *) descriptor);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    result = dvmForeachLoadedClass(findClassCallback, (void *) descriptor);
+    dvmUnlockLoadedClasses();
 
     return (ClassObject *) result;
 }
@@ -4606,20 +4838,16 @@ void dvmDumpClass(const ClassObject *clazz, int flags) {
  * Dump the contents of all classes.
  */
 void dvmDumpAllClasses(int flags) {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashForeach(gDvm.loadedClasses, dumpClass, (void *) flags);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    dvmForeachLoadedClass(dumpClass, (void *) flags);
+    dvmUnlockLoadedClasses();
 }
 
 /*
  * Get the number of loaded classes
  */
 int dvmGetNumLoadedClasses() {
-    int count;
-    dvmHashTableLock(gDvm.loadedClasses);
-    count = dvmHashTableNumEntries(gDvm.loadedClasses);
-    dvmHashTableUnlock(gDvm.loadedClasses);
-    return count;
+    return gDvm.loadedClasses->numClasses;
 }
 
 /*
@@ -4627,9 +4855,9 @@ int dvmGetNumLoadedClasses() {
  */
 void dvmDumpLoaderStats(const char *msg) {
     LOGV("VM stats (%s): cls=%d/%d meth=%d ifld=%d sfld=%d linear=%d\n",
-         msg, gDvm.numLoadedClasses, dvmHashTableNumEntries(gDvm.loadedClasses),
+         msg, gDvm.numLoadedClasses, dvmGetNumLoadedClasses(),
          gDvm.numDeclaredMethods, gDvm.numDeclaredInstFields,
-         gDvm.numDeclaredStaticFields, gDvm.pBootLoaderAlloc->curOffset);
+         gDvm.numDeclaredStaticFields, dvmLinearAllocBytesUsed(NULL));
 #ifdef COUNT_PRECISE_METHODS
     LOGI("GC precise methods: %d\n",
         dvmPointerSetGetCount(gDvm.preciseMethods));
@@ -4674,9 +4902,9 @@ static int dumpAccessCounts(void* vclazz, void* varg)
  */
 void dvmDumpFieldAccessCounts(void)
 {
-    dvmHashTableLock(gDvm.loadedClasses);
-    dvmHashForeach(gDvm.loadedClasses, dumpAccessCounts, NULL);
-    dvmHashTableUnlock(gDvm.loadedClasses);
+    dvmLockLoadedClasses();
+    dvmForeachLoadedClass(dumpAccessCounts, NULL);
+    dvmUnlockLoadedClasses();
 }
 #endif
 
@@ -4691,17 +4919,33 @@ static int markClassObject(void *clazz, void *arg) {
     return 0;
 }
 
+/*
+ * Mark the loader a class table belongs to.
+ */
+static int markClassLoader(void *vtable, void *arg) {
+    UNUSED_PARAMETER(arg);
+
+    dvmMarkObjectNonNull(((const LoaderClassTable *) vtable)->loader);
+    return 0;
+}
+
 /*
  * The garbage collector calls this to mark the class objects for all
  * loaded classes.
+ *
+ * The class loaders with class tables are marked too.  A defining loader
+ * is reachable from its classes anyway, but a loader that has only been
+ * an initiating loader isn't, and its table and the initiating loader
+ * lists are keyed on its address.
  */
 void dvmGcScanRootClassLoader() {
     /* dvmClassStartup() may not have been called before the first GC.
      */
     if (gDvm.loadedClasses != NULL) {
-        dvmHashTableLock(gDvm.loadedClasses);
-        dvmHashForeach(gDvm.loadedClasses, markClassObject, NULL);
-        dvmHashTableUnlock(gDvm.loadedClasses);
+        dvmLockLoadedClasses();
+        dvmForeachLoadedClass(markClassObject, NULL);
+        dvmHashForeach(gDvm.loadedClasses->loaders, markClassLoader, NULL);
+        dvmUnlockLoadedClasses();
     }
 }
 
@@ -126,6 +126,12 @@ bool dvmIsClassInitializing(const ClassObject* clazz);
  */
 bool dvmInitClass(ClassObject* clazz);
 
+/*
+ * Verify a linked class if it hasn't been verified yet, without
+ * initializing it.
+ */
+bool dvmEnsureClassVerified(ClassObject* clazz);
+
 /*
  * Retrieve the system class loader.
  */
@@ -141,6 +147,18 @@ bool dvmAddClassToHash(ClassObject* clazz);
 void dvmAddInitiatingLoader(ClassObject* clazz, Object* loader);
 bool dvmLoaderInInitiatingList(const ClassObject* clazz, const Object* loader);
 
+/*
+ * The loaded-class tables.  dvmLookupClass() doesn't need the lock, but
+ * walking the tables does, unless the world is stopped.  The callbacks
+ * return nonzero to stop the walk early.
+ */
+typedef struct ClassTables ClassTables;
+void dvmLockLoadedClasses(void);
+void dvmUnlockLoadedClasses(void);
+int dvmForeachLoadedClass(HashForeachFunc func, void* arg);
+int dvmForeachClassVisibleTo(const Object* loader, HashForeachFunc func,
+    void* arg);
+
 /*
  * Update method's "nativeFunc" and "insns" after native method resolution.
  */
@@ -402,6 +402,9 @@ struct ClassObject {
 
     /* source file name, if known */
     const char*     sourceFile;
+
+    /* number of times a biased lock on an instance was revoked (Sync.c) */
+    u4              biasRevocations;
 };
 
 /*
@@ -484,6 +487,24 @@ struct Method {
      * linear alloc area if not.
      */
     const RegisterMap* registerMap;
+
+    /*
+     * Inline caches for the method's invoke-interface instructions,
+     * created the first time one of them executes.
+     */
+    struct InlineCacheTable* inlineCaches;
+
+#if defined(WITH_JIT)
+    /*
+     * Baseline JIT: invocation + backward-branch count, and the compiled
+     * code.  "jitEntryOffsets" has one entry per code unit giving the
+     * offset of that instruction's code in the code cache, or 0 if it
+     * can't be entered there.
+     */
+    u4              jitCounter;
+    const u1*       jitCode;
+    const u4*       jitEntryOffsets;
+#endif
 };
 
 /*
@@ -668,6 +689,8 @@ INLINE void dvmSetFieldDouble(Object* obj, int offset, double val) {
 }
 INLINE void dvmSetFieldObject(Object* obj, int offset, Object* val) {
     ((JValue *) (((u1 *) (obj)) + (offset)))->l = val;
+    if (val != NULL)
+        dvmMarkCard(obj);
 }
 
 /*
@@ -731,6 +754,8 @@ INLINE void dvmSetStaticFieldDouble(StaticField* sfield, double val) {
 }
 INLINE void dvmSetStaticFieldObject(StaticField* sfield, Object* val) {
     sfield->value.l = val;
+    if (val != NULL)
+        dvmMarkCard(sfield->field.clazz);
 }
 
 /*
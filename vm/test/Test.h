@@ -20,5 +20,8 @@
 #define _DALVIK_TEST_TEST
 
 bool dvmTestHash(void);
+bool dvmTestZygoteHeap(void);
+bool dvmTestHeapBitmap(void);
+bool dvmTestLockFattening(void);
 
 #endif /*_DALVIK_TEST_TEST*/
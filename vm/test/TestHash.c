@@ -96,6 +96,9 @@ bool dvmTestHash(void)
             (HashCompareFunc) strcmp, true);
     }
 
+    /* the generations the adds outgrew can go; the entries stay */
+    dvmHashTableFreeRetired(pTab);
+
     dvmHashTableUnlock(pTab);
 
     /* make sure we can find all entries */
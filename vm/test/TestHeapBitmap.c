@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Test the heap bitmap walks, and time them against a bit-at-a-time
+ * loop over the same bitmaps.
+ *
+ * The bitmaps cover a made-up heap; nothing here touches the addresses
+ * the bits stand for.
+ */
+#include "Dalvik.h"
+#include "alloc/HeapBitmap.h"
+
+#define kTestHeapBase   ((const void*) 0x40000000)
+#define kTestHeapSize   (16 * 1024 * 1024)
+#define kNumTestSlots   (kTestHeapSize / HB_OBJECT_ALIGNMENT)
+#define kSliceWords     1000
+
+/*
+ * What a walk saw.
+ */
+typedef struct WalkResult {
+    size_t      count;
+    u8          sum;
+    const void* lastPtr;
+    const void* lastFinger;
+    bool        inOrder;
+} WalkResult;
+
+static bool walkCallback(size_t numPtrs, void** ptrs, const void* finger,
+    void* arg)
+{
+    WalkResult* result = (WalkResult*) arg;
+    size_t i;
+
+    if (finger < result->lastFinger)
+        result->inOrder = false;
+    result->lastFinger = finger;
+
+    for (i = 0; i < numPtrs; i++) {
+        if (ptrs[i] <= result->lastPtr || ptrs[i] >= finger)
+            result->inOrder = false;
+        result->lastPtr = ptrs[i];
+        result->sum += (uintptr_t) ptrs[i];
+    }
+    result->count += numPtrs;
+    return true;
+}
+
+/*
+ * Visit the slots set in "hb1" but not in "hb2" (or set in either, for
+ * "xor") one bit at a time.  This is the reference the walks are
+ * checked and timed against.
+ */
+static void slowWalk(const HeapBitmap* hb1, const HeapBitmap* hb2, bool xor,
+    WalkResult* result)
+{
+    size_t slot;
+
+    for (slot = 0; slot < kNumTestSlots; slot++) {
+        const void* obj =
+            (const char*) kTestHeapBase + slot * HB_OBJECT_ALIGNMENT;
+        bool set1 = dvmHeapBitmapIsObjectBitSet(hb1, obj) != 0;
+        bool set2 = hb2 != NULL && dvmHeapBitmapIsObjectBitSet(hb2, obj) != 0;
+
+        if (xor ? (set1 != set2) : (set1 && !set2)) {
+            result->count++;
+            result->sum += (uintptr_t) obj;
+        }
+    }
+}
+
+/*
+ * Set every "stride"th slot in "hb", starting at "first", in clusters
+ * of "run" slots.
+ */
+static void fillBitmap(HeapBitmap* hb, size_t first, size_t stride,
+    size_t run)
+{
+    size_t slot, i;
+
+    for (slot = first; slot < kNumTestSlots; slot += stride) {
+        for (i = 0; i < run && slot + i < kNumTestSlots; i++) {
+            dvmHeapBitmapSetObjectBit(hb,
+                (const char*) kTestHeapBase + (slot + i) * HB_OBJECT_ALIGNMENT);
+        }
+    }
+}
+
+/*
+ * Run one walk and the reference, compare, and log the times.
+ */
+static bool checkWalk(const char* name, const HeapBitmap* hb1,
+    const HeapBitmap* hb2, bool xor, bool sweep)
+{
+    WalkResult fast, slow;
+    u8 fastStart, fastNsec, slowStart, slowNsec;
+    bool ok;
+
+    memset(&fast, 0, sizeof(fast));
+    fast.inOrder = true;
+    memset(&slow, 0, sizeof(slow));
+
+    fastStart = dvmGetRelativeTimeNsec();
+    if (sweep)
+        ok = dvmHeapBitmapSweepWalk(hb1, hb2, walkCallback, &fast);
+    else if (hb2 != NULL)
+        ok = dvmHeapBitmapXorWalk(hb1, hb2, walkCallback, &fast);
+    else
+        ok = dvmHeapBitmapWalk(hb1, walkCallback, &fast);
+    fastNsec = dvmGetRelativeTimeNsec() - fastStart;
+
+    slowStart = dvmGetRelativeTimeNsec();
+    slowWalk(hb1, hb2, xor, &slow);
+    slowNsec = dvmGetRelativeTimeNsec() - slowStart;
+
+    if (!ok || !fast.inOrder || fast.count != slow.count ||
+        fast.sum != slow.sum)
+    {
+        LOGE("TestHeapBitmap %s failed: %zd objects (expected %zd)%s\n",
+            name, fast.count, slow.count,
+            fast.inOrder ? "" : ", out of order");
+        return false;
+    }
+
+    LOGD("TestHeapBitmap %s: %zd objects, %lld usec (bit loop %lld usec)\n",
+        name, fast.count, (long long) fastNsec / 1000,
+        (long long) slowNsec / 1000);
+    return true;
+}
+
+/*
+ * Walk the bitmaps a slice at a time, the way hprof does, and check
+ * that the slices add up to the whole.
+ */
+static bool checkSlices(const char* name, const HeapBitmap* hb1,
+    const HeapBitmap* hb2)
+{
+    WalkResult sliced, slow;
+    size_t numWords = hb1->bitsLen / sizeof(*hb1->bits);
+    size_t firstWord;
+
+    memset(&sliced, 0, sizeof(sliced));
+    sliced.inOrder = true;
+    memset(&slow, 0, sizeof(slow));
+
+    for (firstWord = 0; firstWord < numWords; firstWord += kSliceWords) {
+        HeapBitmap slice1, slice2;
+        bool ok;
+
+        /* each walk's finger starts over */
+        sliced.lastFinger = NULL;
+
+        dvmHeapBitmapSlice(&slice1, hb1, firstWord, kSliceWords);
+        if (hb2 != NULL) {
+            dvmHeapBitmapSlice(&slice2, hb2, firstWord, kSliceWords);
+            ok = dvmHeapBitmapXorWalk(&slice1, &slice2, walkCallback,
+                    &sliced);
+        } else {
+            ok = dvmHeapBitmapWalk(&slice1, walkCallback, &sliced);
+        }
+        if (!ok) {
+            LOGE("TestHeapBitmap %s: walk failed at word %zd\n",
+                name, firstWord);
+            return false;
+        }
+    }
+
+    slowWalk(hb1, hb2, true, &slow);
+    if (!sliced.inOrder || sliced.count != slow.count ||
+        sliced.sum != slow.sum)
+    {
+        LOGE("TestHeapBitmap %s failed: %zd objects (expected %zd)%s\n",
+            name, sliced.count, slow.count,
+            sliced.inOrder ? "" : ", out of order");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Walk sparse and dense bitmaps every way the collector does.
+ */
+bool dvmTestHeapBitmap(void)
+{
+    HeapBitmap sparse, dense, live, mark;
+    bool result = false;
+
+    memset(&sparse, 0, sizeof(sparse));
+    memset(&dense, 0, sizeof(dense));
+    memset(&live, 0, sizeof(live));
+    memset(&mark, 0, sizeof(mark));
+    if (!dvmHeapBitmapInit(&sparse, kTestHeapBase, kTestHeapSize, "test") ||
+        !dvmHeapBitmapInit(&dense, kTestHeapBase, kTestHeapSize, "test") ||
+        !dvmHeapBitmapInit(&live, kTestHeapBase, kTestHeapSize, "test") ||
+        !dvmHeapBitmapInit(&mark, kTestHeapBase, kTestHeapSize, "test"))
+    {
+        LOGE("TestHeapBitmap: can't create bitmaps\n");
+        goto bail;
+    }
+
+    /* a few objects in a mostly empty heap, and a packed one */
+    fillBitmap(&sparse, 5, 4099, 3);
+    fillBitmap(&dense, 0, 3, 2);
+
+    /* most of the live objects survive; whole words die in places */
+    fillBitmap(&live, 0, 1, 1);
+    fillBitmap(&mark, 1, 7, 5);
+    fillBitmap(&mark, 0, 1024, 700);
+
+    if (!checkWalk("walk sparse", &sparse, NULL, false, false) ||
+        !checkWalk("walk dense", &dense, NULL, false, false) ||
+        !checkWalk("xor sparse/dense", &sparse, &dense, true, false) ||
+        !checkWalk("xor live/mark", &live, &mark, true, false) ||
+        !checkWalk("sweep live/mark", &live, &mark, false, true) ||
+        !checkWalk("sweep dense/sparse", &dense, &sparse, false, true) ||
+        !checkSlices("slices dense", &dense, NULL) ||
+        !checkSlices("slices live/mark", &live, &mark))
+    {
+        assert(false);
+        goto bail;
+    }
+
+    result = true;
+
+bail:
+    dvmHeapBitmapDelete(&sparse);
+    dvmHeapBitmapDelete(&dense);
+    dvmHeapBitmapDelete(&live);
+    dvmHeapBitmapDelete(&mark);
+    return result;
+}
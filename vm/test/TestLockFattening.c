@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Test that deadlock prediction fattens biased and contended thin locks
+ * with the right owner and recursion count.
+ *
+ * Deadlock prediction is switched on for the duration, and lock biasing
+ * is switched on or off to get the lock words we want.
+ */
+#include "Dalvik.h"
+
+#ifdef WITH_DEADLOCK_PREDICTION
+
+/*
+ * Check that "obj" has a monitor that "self" owns, and that it takes
+ * exactly "holds" unlocks to let go of it.
+ */
+static bool checkFattened(Thread* self, Object* obj, int holds,
+    const char* what)
+{
+    int i;
+
+    if (!IS_LOCK_FAT(&obj->lock)) {
+        LOGE("TestLockFattening: %s lock not fattened\n", what);
+        return false;
+    }
+    for (i = 0; i < holds; i++) {
+        if (!dvmHoldsLock(self, obj)) {
+            LOGE("TestLockFattening: %s lock let go after %d of %d unlocks\n",
+                what, i, holds);
+            return false;
+        }
+        if (!dvmUnlockObject(self, obj)) {
+            dvmClearException(self);
+            LOGE("TestLockFattening: %s unlock %d failed\n", what, i);
+            return false;
+        }
+    }
+    if (dvmHoldsLock(self, obj)) {
+        LOGE("TestLockFattening: %s lock still held after %d unlocks\n",
+            what, holds);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Lock "parent" "holds" times without deadlock prediction, optionally
+ * mark it contended, then lock "child" with prediction on.  That
+ * fattens the child as the lockee and the parent as the most recently
+ * locked object.
+ */
+static bool lockParentThenChild(Thread* self, Object* parent, int holds,
+    bool contended, Object* child, const char* what)
+{
+    int i;
+
+    gDvm.deadlockPredictMode = kDPOff;
+    for (i = 0; i < holds; i++)
+        dvmLockObject(self, parent);
+    if (contended) {
+        /* what a thread parked on the lock word would have left */
+        assert(!LW_IS_BIASED(parent->lock.thin));
+        parent->lock.thin |= LW_CONTENDED;
+    }
+
+    gDvm.deadlockPredictMode = kDPWarn;
+    dvmLockObject(self, child);
+
+    return checkFattened(self, child, 1, what) &&
+        checkFattened(self, parent, holds, what);
+}
+
+bool dvmTestLockFattening(void)
+{
+    Thread* self = dvmThreadSelf();
+    Object* objs[5];
+    int savedMode = gDvm.deadlockPredictMode;
+    bool savedBias = gDvm.biasedLocking;
+    bool result = false;
+    int i;
+
+    memset(objs, 0, sizeof(objs));
+    for (i = 0; i < NELEM(objs); i++) {
+        objs[i] = dvmAllocObject(gDvm.classJavaLangObject, ALLOC_DEFAULT);
+        if (objs[i] == NULL) {
+            LOGE("TestLockFattening: allocation failed\n");
+            dvmClearException(self);
+            goto bail;
+        }
+    }
+
+    /* a biased lockee, fattened as soon as it's taken */
+    gDvm.biasedLocking = true;
+    gDvm.deadlockPredictMode = kDPWarn;
+    dvmLockObject(self, objs[0]);
+    if (!checkFattened(self, objs[0], 1, "biased lockee"))
+        goto bail;
+
+    /* a biased parent held three times */
+    if (!lockParentThenChild(self, objs[1], 3, false, objs[2],
+            "biased parent"))
+    {
+        goto bail;
+    }
+
+    /* an ordinary thin parent, held twice, that somebody is waiting on */
+    gDvm.biasedLocking = false;
+    if (!lockParentThenChild(self, objs[3], 2, true, objs[4],
+            "contended parent"))
+    {
+        goto bail;
+    }
+
+    result = true;
+
+bail:
+    gDvm.deadlockPredictMode = savedMode;
+    gDvm.biasedLocking = savedBias;
+    for (i = 0; i < NELEM(objs); i++) {
+        if (objs[i] != NULL)
+            dvmReleaseTrackedAlloc(objs[i], self);
+    }
+    return result;
+}
+
+#else /*WITH_DEADLOCK_PREDICTION*/
+
+bool dvmTestLockFattening(void)
+{
+    return true;
+}
+
+#endif /*WITH_DEADLOCK_PREDICTION*/
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Test that splitting off a zygote heap throws away the old generation,
+ * so the next allocation-driven collection is a full one and doesn't
+ * lay stale mark bits over the shifted heaps.
+ *
+ * The zygote runs this right after its own split, before its first
+ * fork, since the split can't be undone and only happens once.  All it
+ * adds is a few objects and collections.
+ */
+#include "Dalvik.h"
+#include "alloc/Heap.h"
+#include "alloc/HeapInternal.h"
+#include "alloc/HeapSource.h"
+
+#define kNumTestObjects 64
+
+/*
+ * Run the kind of collection a failed allocation runs.
+ */
+static void collectForMalloc(void)
+{
+    dvmLockHeap();
+    dvmWaitForConcurrentGcToComplete();
+    dvmCollectGarbageInternal(false, GC_FOR_MALLOC);
+    dvmUnlockHeap();
+}
+
+/*
+ * Check that every object in "objs" survived.
+ */
+static bool checkObjects(const char* when, Object** objs)
+{
+    int i;
+
+    for (i = 0; i < kNumTestObjects; i++) {
+        if (!dvmIsValidObject(objs[i])) {
+            LOGE("TestZygoteHeap: object %d freed %s\n", i, when);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool dvmTestZygoteHeap(void)
+{
+    GcHeap* gcHeap = gDvm.gcHeap;
+    Object* objs[kNumTestObjects];
+    bool result = false;
+    int i;
+
+    /* only a VM that can do minor collections can get this wrong */
+    if (!gDvm.generationalGc || gDvm.cardTableLength == 0 ||
+        !gDvm.newZygoteHeapAllocated)
+    {
+        return true;
+    }
+
+    memset(objs, 0, sizeof(objs));
+
+    if (gcHeap->numOldBitmaps != 0 || gcHeap->tryMinorGc) {
+        LOGE("TestZygoteHeap: old generation kept across a new heap\n");
+        goto bail;
+    }
+
+    /* allocate in the new heap, and collect the way malloc would */
+    for (i = 0; i < kNumTestObjects; i++) {
+        objs[i] = dvmAllocObject(gDvm.classJavaLangObject, ALLOC_DEFAULT);
+        if (objs[i] == NULL) {
+            LOGE("TestZygoteHeap: allocation failed\n");
+            dvmClearException(dvmThreadSelf());
+            goto bail;
+        }
+    }
+    collectForMalloc();
+    if (gcHeap->lastGcWasMinor) {
+        LOGE("TestZygoteHeap: minor GC right after adding a heap\n");
+        goto bail;
+    }
+    if (!checkObjects("by the full GC", objs))
+        goto bail;
+
+    /* now there's an old generation that matches the heaps again */
+    if (gcHeap->numOldBitmaps != dvmHeapSourceGetNumHeaps()) {
+        LOGE("TestZygoteHeap: old generation not rebuilt\n");
+        goto bail;
+    }
+    collectForMalloc();
+    if (!checkObjects("by the next GC", objs))
+        goto bail;
+
+    result = true;
+
+bail:
+    for (i = 0; i < kNumTestObjects; i++) {
+        if (objs[i] != NULL)
+            dvmReleaseTrackedAlloc(objs[i], NULL);
+    }
+    return result;
+}